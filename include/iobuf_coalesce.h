@@ -0,0 +1,61 @@
+/*
+ * SPDX-License-Identifier: ISC
+ *
+ * Copyright (c) 2020 Todd C. Miller <Todd.Miller@sudo.ws>
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifndef SUDO_IOBUF_COALESCE_H
+#define SUDO_IOBUF_COALESCE_H
+
+#ifdef HAVE_ZLIB_H
+# include <zlib.h>	/* for z_stream */
+#endif
+
+/* Largest amount of I/O log data combined into a single IoBuffer. */
+#define IOBUF_COALESCE_MAX	(64 * 1024)
+
+/*
+ * Called to send an IoBuffer of the given type.
+ * If compression is enabled, buf holds the compressed data.
+ */
+typedef bool (*iobuf_send_t)(int type, const uint8_t *buf, size_t len,
+    struct timespec *delay, void *v);
+
+/*
+ * I/O log data held by a log server client until it is sent.
+ */
+struct iobuf_coalesce {
+    iobuf_send_t send;
+    void *closure;
+    bool enabled;
+    int type;
+    struct timespec delay;
+    uint8_t *data;
+    size_t len;
+#ifdef HAVE_ZLIB_H
+    z_stream *zstream;
+    uint8_t *zbuf;
+    size_t zbuf_size;
+#endif
+};
+
+/* iobuf_coalesce.c */
+void iobuf_coalesce_init(struct iobuf_coalesce *ic, bool enabled, iobuf_send_t send, void *closure);
+void iobuf_coalesce_free(struct iobuf_coalesce *ic);
+bool iobuf_coalesce_compress(struct iobuf_coalesce *ic);
+bool iobuf_coalesce_flush(struct iobuf_coalesce *ic);
+int iobuf_coalesce_write(struct iobuf_coalesce *ic, int type, const uint8_t *buf, size_t len, struct timespec *delay);
+
+#endif /* SUDO_IOBUF_COALESCE_H */
@@ -193,10 +193,14 @@ struct  _AcceptMessage
    * true if I/O logging enabled 
    */
   protobuf_c_boolean expect_iobufs;
+  /*
+   * true if IoBuffer data is compressed 
+   */
+  protobuf_c_boolean compress_iobufs;
 };
 #define ACCEPT_MESSAGE__INIT \
  { PROTOBUF_C_MESSAGE_INIT (&accept_message__descriptor) \
-    , NULL, 0,NULL, 0 }
+    , NULL, 0,NULL, 0, 0 }
 
 
 /*
@@ -417,10 +421,14 @@ struct  _ServerHello
    * true if client auth is required with signed cert 
    */
   protobuf_c_boolean tls_reqcert;
+  /*
+   * true if server can decompress IoBuffer data 
+   */
+  protobuf_c_boolean compression;
 };
 #define SERVER_HELLO__INIT \
  { PROTOBUF_C_MESSAGE_INIT (&server_hello__descriptor) \
-    , (char *)protobuf_c_empty_string, (char *)protobuf_c_empty_string, 0,NULL, 0, 0, 0 }
+    , (char *)protobuf_c_empty_string, (char *)protobuf_c_empty_string, 0,NULL, 0, 0, 0, 0 }
 
 
 /* ClientMessage methods */
@@ -24,6 +24,8 @@
 #include "sudo_queue.h"
 
 struct timeval;		/* for deprecated APIs */
+struct epoll_event;	/* for the epoll backend */
+struct sudo_ev_epoll_fd; /* for the epoll backend */
 
 /* Event types (keep in sync with sudo_plugin.h) */
 #define SUDO_EV_TIMEOUT		0x01	/* fire after timeout */
@@ -36,7 +38,7 @@ struct timeval;		/* for deprecated APIs */
 /* Event flags (internal) */
 #define SUDO_EVQ_INSERTED	0x01	/* event is on the event queue */
 #define SUDO_EVQ_ACTIVE		0x02	/* event is on the active queue */
-#define SUDO_EVQ_TIMEOUTS	0x04	/* event is on the timeouts queue */
+#define SUDO_EVQ_TIMEOUTS	0x04	/* event is on the timeouts heap */
 
 /* Event loop flags */
 #define SUDO_EVLOOP_ONCE	0x01	/* Only run once through the loop */
@@ -68,13 +70,13 @@ struct sudo_ev_siginfo_container {
 struct sudo_event {
     TAILQ_ENTRY(sudo_event) entries;
     TAILQ_ENTRY(sudo_event) active_entries;
-    TAILQ_ENTRY(sudo_event) timeouts_entries;
     struct sudo_event_base *base; /* base this event belongs to */
     int fd;			/* fd/signal we are interested in */
     short events;		/* SUDO_EV_* flags (in) */
     short revents;		/* SUDO_EV_* flags (out) */
     short flags;		/* internal event flags */
-    short pfd_idx;		/* index into pfds array (XXX) */
+    short pfd_idx;		/* index into pfds or per-fd epoll array (XXX) */
+    int timeouts_idx;		/* index into timeouts heap */
     sudo_ev_callback_t callback;/* user-provided callback */
     struct timespec timeout;	/* for SUDO_EV_TIMEOUT */
     void *closure;		/* user-provided data pointer */
@@ -84,7 +86,9 @@ TAILQ_HEAD(sudo_event_list, sudo_event);
 struct sudo_event_base {
     struct sudo_event_list events; /* tail queue of all events */
     struct sudo_event_list active; /* tail queue of active events */
-    struct sudo_event_list timeouts; /* tail queue of timeout events */
+    struct sudo_event **timeouts; /* binary min-heap of timeout events */
+    int ntimeouts;		/* number of events in the timeouts heap */
+    int timeouts_max;		/* size of the timeouts heap array */
     struct sudo_event signal_event; /* storage for signal pipe event */
     struct sudo_event_list signals[NSIG]; /* array of signal event tail queues */
     struct sigaction *orig_handlers[NSIG]; /* original signal handlers */
@@ -93,7 +97,15 @@ struct sudo_event_base {
     sig_atomic_t signal_caught;	/* at least one signal caught */
     int num_handlers;		/* number of installed handlers */
     int signal_pipe[2];		/* so we can wake up on singal */
-#if defined(HAVE_POLL) || defined(HAVE_PPOLL)
+#if defined(HAVE_EPOLL)
+    struct sudo_ev_epoll_fd *epfds; /* per-fd event state, indexed by fd */
+    struct epoll_event *epevents; /* array of ready events from the kernel */
+    int epfd;			/* epoll instance */
+    int epfd_max;		/* size of the epfds array */
+    int epevent_max;		/* size of the epevents array */
+    int ep_always;		/* number of fds that epoll cannot watch */
+    pid_t ep_pid;		/* process that created the epoll instance */
+#elif defined(HAVE_POLL) || defined(HAVE_PPOLL)
     struct pollfd *pfds;	/* array of struct pollfd */
     int pfd_max;		/* size of the pfds array */
     int pfd_high;		/* highest slot used */
@@ -195,6 +207,10 @@ __dso_public bool sudo_ev_got_break_v1(struct sudo_event_base *base);
 /* Add an event to the base's active queue and mark it active (internal). */
 void sudo_ev_activate(struct sudo_event_base *base, struct sudo_event *ev);
 
+/* Return the event with the earliest timeout or NULL (internal). */
+#define sudo_ev_first_timeout(_b) \
+    ((_b)->ntimeouts != 0 ? (_b)->timeouts[0] : NULL)
+
 /*
  * Backend implementation.
  */
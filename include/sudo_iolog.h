@@ -26,6 +26,15 @@
 /* Default maximum session ID */
 #define SESSID_MAX	2176782336U
 
+/* Name of the session index file at the top of an I/O log directory. */
+#define IOLOG_INDEX	"index"
+
+/* First line of a session index that lists every session, see sudoreplay -I. */
+#define IOLOG_INDEX_HEADER	"#sudo session index\tcomplete\n"
+
+/* Name of the per-session index of chunk offsets used for seeking. */
+#define IOLOG_SEEK_INDEX	"timing.idx"
+
 /*
  * I/O log event types as stored as the first field in the timing file.
  * Changing existing values will result in incompatible I/O log files.
@@ -97,6 +106,19 @@ struct iolog_file {
     } fd;
 };
 
+/*
+ * Seek index entry: the offset in each I/O log file where the chunk
+ * starting at the specified elapsed time begins, along with the
+ * terminal size in effect at that point.
+ */
+struct iolog_chunk {
+    struct timespec elapsed;
+    off_t offsets[IOFD_MAX];
+    off_t next;			/* offset of the next seek index entry */
+    int lines;
+    int cols;
+};
+
 struct iolog_path_escape {
     const char *name;
     size_t (*copy_fn)(char *, size_t, void *);
@@ -110,18 +132,27 @@ bool iolog_parse_timing(const char *line, struct timing_closure *timing);
 char *iolog_parse_delay(const char *cp, struct timespec *delay, const char *decimal_point);
 int iolog_read_timing_record(struct iolog_file *iol, struct timing_closure *timing);
 struct iolog_info *iolog_parse_loginfo(FILE *fp, const char *iolog_dir);
+bool iolog_index_parse(char *line, struct iolog_info *log_info, char **host, char **session);
+size_t iolog_index_dirlen(const char *dir);
 void iolog_adjust_delay(struct timespec *delay, struct timespec *max_delay, double scale_factor);
 void iolog_free_loginfo(struct iolog_info *li);
 
 /* iolog_fileio.c */
 struct passwd;
 struct group;
+bool iolog_chunk_find(int dfd, const struct timespec *target, struct iolog_chunk *chunk);
+bool iolog_chunk_resume(int dfd, const struct iolog_chunk *chunk, struct iolog_file *iolog_files);
+bool iolog_chunk_write(int dfd, struct iolog_file *iolog_files, const struct timespec *elapsed, int lines, int cols, const char **errstr);
 bool iolog_close(struct iolog_file *iol, const char **errstr);
 bool iolog_eof(struct iolog_file *iol);
+bool iolog_flush(struct iolog_file *iol, const char **errstr);
+bool iolog_index_append(const char *dir, const char *session, const char *host, const struct iolog_info *log_info, char * const argv[]);
+bool iolog_index_write(FILE *fp, const char *session, const char *host, const struct iolog_info *log_info, char * const argv[]);
 bool iolog_mkdtemp(char *path);
 bool iolog_mkpath(char *path);
 bool iolog_nextid(char *iolog_dir, char sessid[7]);
 bool iolog_open(struct iolog_file *iol, int dfd, int iofd, const char *mode);
+bool iolog_open_offset(struct iolog_file *iol, int dfd, int iofd, const char *mode, off_t offset);
 bool iolog_rename(const char *from, const char *to);
 bool iolog_write_info_file(int dfd, const char *parent, struct iolog_info *log_info, char * const argv[]);
 char *iolog_gets(struct iolog_file *iol, char *buf, size_t nbytes, const char **errsttr);
@@ -138,5 +169,6 @@ void iolog_set_gid(gid_t gid);
 void iolog_set_maxseq(unsigned int maxval);
 void iolog_set_mode(mode_t mode);
 void iolog_set_owner(uid_t uid, uid_t gid);
+void iolog_set_seq_reserve(unsigned int newval);
 
 #endif /* SUDO_IOLOG_H */
@@ -49,10 +49,12 @@ struct json_container {
     int indent_level;
     int indent_increment;
     bool need_comma;
+    bool minimal;	/* no newlines or indentation */
 };
 
 __dso_public bool sudo_json_init_v1(struct json_container *json, FILE *fp, int indent);
-#define sudo_json_init(_a, _b, _c) sudo_json_init_v1((_a), (_b), (_c))
+__dso_public bool sudo_json_init_v2(struct json_container *json, FILE *fp, int indent, bool minimal);
+#define sudo_json_init(_a, _b, _c, _d) sudo_json_init_v2((_a), (_b), (_c), (_d))
 
 __dso_public bool sudo_json_open_object_v1(struct json_container *json, const char *name);
 #define sudo_json_open_object(_a, _b) sudo_json_open_object_v1((_a), (_b))
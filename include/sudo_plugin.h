@@ -21,7 +21,7 @@
 
 /* API version major/minor */
 #define SUDO_API_VERSION_MAJOR 1
-#define SUDO_API_VERSION_MINOR 15
+#define SUDO_API_VERSION_MINOR 16
 #define SUDO_API_MKVERSION(x, y) (((x) << 16) | (y))
 #define SUDO_API_VERSION SUDO_API_MKVERSION(SUDO_API_VERSION_MAJOR, SUDO_API_VERSION_MINOR)
 
@@ -179,6 +179,21 @@ struct policy_plugin {
     struct sudo_plugin_event * (*event_alloc)(void);
 };
 
+/* I/O log event types, see the io_plugin log_io function. */
+#define SUDO_IO_EVENT_STDIN	0
+#define SUDO_IO_EVENT_STDOUT	1
+#define SUDO_IO_EVENT_STDERR	2
+#define SUDO_IO_EVENT_TTYIN	3
+#define SUDO_IO_EVENT_TTYOUT	4
+
+/* A single chunk of I/O passed to the io_plugin log_io function. */
+struct sudo_io_record {
+    int event;				/* SUDO_IO_EVENT_* */
+    unsigned int len;			/* length of buf */
+    const char *buf;			/* data that was read */
+    const struct timespec *when;	/* monotonic time data was read */
+};
+
 /* I/O plugin type and defines. */
 struct io_plugin {
 #define SUDO_IO_PLUGIN	    2
@@ -204,6 +219,8 @@ struct io_plugin {
 	const char **errstr);
     int (*log_suspend)(int signo, const char **errstr);
     struct sudo_plugin_event * (*event_alloc)(void);
+    int (*log_io)(const struct sudo_io_record records[], unsigned int count,
+	const char **errstr);
 };
 
 /* Differ audit plugin close status types. */
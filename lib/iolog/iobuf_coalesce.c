@@ -0,0 +1,258 @@
+/*
+ * SPDX-License-Identifier: ISC
+ *
+ * Copyright (c) 2020 Todd C. Miller <Todd.Miller@sudo.ws>
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/*
+ * This is an open source non-commercial project. Dear PVS-Studio, please check it.
+ * PVS-Studio Static Code Analyzer for C, C++ and C#: http://www.viva64.com
+ */
+
+#include "config.h"
+
+#include <sys/types.h>
+#ifdef HAVE_STDBOOL_H
+# include <stdbool.h>
+#else
+# include "compat/stdbool.h"
+#endif /* HAVE_STDBOOL_H */
+#if defined(HAVE_STDINT_H)
+# include <stdint.h>
+#elif defined(HAVE_INTTYPES_H)
+# include <inttypes.h>
+#endif
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "sudo_gettext.h"	/* must be included before sudo_compat.h */
+
+#include "sudo_compat.h"
+#include "sudo_fatal.h"
+#include "sudo_debug.h"
+#include "sudo_util.h"
+#include "iobuf_coalesce.h"
+
+/*
+ * Initialize ic to send I/O log data via the send function, passing
+ * it closure.  If enabled is false, data is sent as soon as it is
+ * written, otherwise it is held until iobuf_coalesce_flush() is called.
+ */
+void
+iobuf_coalesce_init(struct iobuf_coalesce *ic, bool enabled,
+    iobuf_send_t send, void *closure)
+{
+    debug_decl(iobuf_coalesce_init, SUDO_DEBUG_UTIL);
+
+    memset(ic, 0, sizeof(*ic));
+    ic->enabled = enabled;
+    ic->send = send;
+    ic->closure = closure;
+
+    debug_return;
+}
+
+/*
+ * Free the buffers and compression state used by ic.
+ * Any data not yet flushed is discarded.
+ */
+void
+iobuf_coalesce_free(struct iobuf_coalesce *ic)
+{
+    debug_decl(iobuf_coalesce_free, SUDO_DEBUG_UTIL);
+
+    free(ic->data);
+    ic->data = NULL;
+    ic->len = 0;
+#ifdef HAVE_ZLIB_H
+    if (ic->zstream != NULL) {
+	deflateEnd(ic->zstream);
+	free(ic->zstream);
+	ic->zstream = NULL;
+    }
+    free(ic->zbuf);
+    ic->zbuf = NULL;
+    ic->zbuf_size = 0;
+#endif
+
+    debug_return;
+}
+
+/*
+ * Compress all data sent from now on as a single zlib stream.
+ * Returns true on success, false on failure or if sudo was built
+ * without zlib.
+ */
+bool
+iobuf_coalesce_compress(struct iobuf_coalesce *ic)
+{
+    debug_decl(iobuf_coalesce_compress, SUDO_DEBUG_UTIL);
+
+#ifdef HAVE_ZLIB_H
+    if (ic->zstream != NULL)
+	debug_return_bool(true);
+    ic->zstream = calloc(1, sizeof(*ic->zstream));
+    if (ic->zstream == NULL) {
+	sudo_warnx(U_("%s: %s"), __func__, U_("unable to allocate memory"));
+	debug_return_bool(false);
+    }
+    if (deflateInit(ic->zstream, Z_DEFAULT_COMPRESSION) != Z_OK) {
+	sudo_warnx(U_("%s: unable to initialize compression"), __func__);
+	free(ic->zstream);
+	ic->zstream = NULL;
+	debug_return_bool(false);
+    }
+    debug_return_bool(true);
+#else
+    debug_return_bool(false);
+#endif /* HAVE_ZLIB_H */
+}
+
+#ifdef HAVE_ZLIB_H
+/*
+ * Compress buf into ic->zbuf.  Each buffer ends with a sync flush
+ * so the server can decompress it without waiting for more data.
+ * Returns the length of the compressed data or -1 on failure.
+ */
+static ssize_t
+compress_iobuf(struct iobuf_coalesce *ic, const uint8_t *buf, size_t len)
+{
+    z_stream *strm = ic->zstream;
+    size_t needed;
+    int zerr;
+    debug_decl(compress_iobuf, SUDO_DEBUG_UTIL);
+
+    /* The sync flush marker is not included in deflateBound(). */
+    needed = deflateBound(strm, len) + 16;
+    if (needed > ic->zbuf_size) {
+	free(ic->zbuf);
+	ic->zbuf_size = sudo_pow2_roundup(needed);
+	if ((ic->zbuf = malloc(ic->zbuf_size)) == NULL) {
+	    sudo_warnx(U_("%s: %s"), __func__, U_("unable to allocate memory"));
+	    ic->zbuf_size = 0;
+	    debug_return_ssize_t(-1);
+	}
+    }
+
+    strm->next_in = (Bytef *)buf;
+    strm->avail_in = len;
+    strm->next_out = ic->zbuf;
+    strm->avail_out = ic->zbuf_size;
+    zerr = deflate(strm, Z_SYNC_FLUSH);
+    if (zerr != Z_OK || strm->avail_in != 0 || strm->avail_out == 0) {
+	sudo_warnx(U_("%s: unable to compress I/O log data: %s"), __func__,
+	    strm->msg ? strm->msg : "deflate");
+	debug_return_ssize_t(-1);
+    }
+
+    debug_return_ssize_t(ic->zbuf_size - strm->avail_out);
+}
+#endif /* HAVE_ZLIB_H */
+
+/*
+ * Send buf, compressing it first if compression is enabled.
+ */
+static bool
+send_iobuf(struct iobuf_coalesce *ic, int type, const uint8_t *buf,
+    size_t len, struct timespec *delay)
+{
+    debug_decl(send_iobuf, SUDO_DEBUG_UTIL);
+
+#ifdef HAVE_ZLIB_H
+    if (ic->zstream != NULL) {
+	ssize_t zlen = compress_iobuf(ic, buf, len);
+	if (zlen == -1)
+	    debug_return_bool(false);
+	buf = ic->zbuf;
+	len = (size_t)zlen;
+    }
+#endif
+    debug_return_bool(ic->send(type, buf, len, delay, ic->closure));
+}
+
+/*
+ * Send the coalesced I/O log data, if any, as a single IoBuffer.
+ * Returns true on success, false on failure.
+ */
+bool
+iobuf_coalesce_flush(struct iobuf_coalesce *ic)
+{
+    bool ret;
+    debug_decl(iobuf_coalesce_flush, SUDO_DEBUG_UTIL);
+
+    if (ic->len == 0)
+	debug_return_bool(true);
+
+    ret = send_iobuf(ic, ic->type, ic->data, ic->len, &ic->delay);
+    ic->len = 0;
+
+    debug_return_bool(ret);
+}
+
+/*
+ * Queue I/O log data to be sent.  If coalescing is enabled, the data
+ * is held so consecutive buffers for the same stream can be sent as
+ * one IoBuffer.  The delay of the combined buffer is the sum of the
+ * delays of its parts, which keeps the total elapsed time the same.
+ * Returns 1 if the data started a new coalesced buffer, in which case
+ * the caller should arrange for iobuf_coalesce_flush() to be called
+ * before long, 0 if it was sent or added to one and -1 on error.
+ */
+int
+iobuf_coalesce_write(struct iobuf_coalesce *ic, int type, const uint8_t *buf,
+    size_t len, struct timespec *delay)
+{
+    int ret = 0;
+    debug_decl(iobuf_coalesce_write, SUDO_DEBUG_UTIL);
+
+    if (!ic->enabled)
+	debug_return_int(send_iobuf(ic, type, buf, len, delay) ? 0 : -1);
+
+    /* Flush data for a different stream or that would grow too large. */
+    if (ic->len != 0) {
+	if (type != ic->type || len > IOBUF_COALESCE_MAX - ic->len) {
+	    if (!iobuf_coalesce_flush(ic))
+		debug_return_int(-1);
+	}
+    }
+
+    /* Nothing to gain by holding on to a full buffer. */
+    if (len >= IOBUF_COALESCE_MAX)
+	debug_return_int(send_iobuf(ic, type, buf, len, delay) ? 0 : -1);
+
+    if (ic->len == 0) {
+	if (ic->data == NULL) {
+	    if ((ic->data = malloc(IOBUF_COALESCE_MAX)) == NULL) {
+		sudo_warnx(U_("%s: %s"), __func__,
+		    U_("unable to allocate memory"));
+		debug_return_int(-1);
+	    }
+	}
+	ic->type = type;
+	ic->delay = *delay;
+	ret = 1;
+    } else {
+	sudo_timespecadd(&ic->delay, delay, &ic->delay);
+    }
+    memcpy(ic->data + ic->len, buf, len);
+    ic->len += len;
+
+    sudo_debug_printf(SUDO_DEBUG_DEBUG,
+	"%s: holding %zu bytes of type %d", __func__, ic->len, type);
+
+    debug_return_int(ret);
+}
@@ -58,13 +58,19 @@
 
 static unsigned char const gzip_magic[2] = {0x1f, 0x8b};
 static unsigned int sessid_max = SESSID_MAX;
+static unsigned int sessid_reserve = 1;
+static struct iolog_seq_cache {
+    char *iolog_dir;
+    unsigned long next;
+    unsigned long last;
+} seq_cache;
 static mode_t iolog_filemode = S_IRUSR|S_IWUSR;
 static mode_t iolog_dirmode = S_IRWXU;
 static uid_t iolog_uid = ROOT_UID;
 static gid_t iolog_gid = ROOT_GID;
 static bool iolog_gid_set;
 static bool iolog_compress;
-static bool iolog_flush;
+static bool iolog_flush_writes;
 
 /*
  * Set effective user and group-IDs to iolog_uid and iolog_gid.
@@ -290,7 +296,8 @@ iolog_set_defaults(void)
     iolog_gid = ROOT_GID;
     iolog_gid_set = false;
     iolog_compress = false;
-    iolog_flush = false;
+    iolog_flush_writes = false;
+    iolog_set_seq_reserve(1);
 }
 
 /*
@@ -306,6 +313,32 @@ iolog_set_maxseq(unsigned int newval)
 	newval = SESSID_MAX;
     sessid_max = newval;
 
+    /* Reserved IDs may now be out of range. */
+    seq_cache.next = seq_cache.last + 1;
+
+    debug_return;
+}
+
+/*
+ * Set the number of sequence numbers to reserve each time the
+ * on-disk sequence file is updated.  A value larger than 1 lets
+ * a long-running process like sudo_logsrvd hand out session IDs
+ * without locking and rewriting the sequence file each time.
+ */
+void
+iolog_set_seq_reserve(unsigned int newval)
+{
+    debug_decl(iolog_set_seq_reserve, SUDO_DEBUG_UTIL);
+
+    if (newval == 0)
+	newval = 1;
+    sessid_reserve = newval;
+
+    /* Discard any IDs that are still reserved. */
+    free(seq_cache.iolog_dir);
+    seq_cache.iolog_dir = NULL;
+    seq_cache.next = seq_cache.last = 0;
+
     debug_return;
 }
 
@@ -374,13 +407,13 @@ iolog_set_compress(bool newval)
 }
 
 /*
- * Set iolog_flush
+ * Set whether to flush after every write.
  */
 void
 iolog_set_flush(bool newval)
 {
     debug_decl(iolog_set_flush, SUDO_DEBUG_UTIL);
-    iolog_flush = newval;
+    iolog_flush_writes = newval;
     debug_return;
 }
 
@@ -418,23 +451,51 @@ iolog_openat(int dfd, const char *path, int flags)
     debug_return_int(fd);
 }
 
+/*
+ * Convert id to a six character base 36 string, followed by a newline.
+ * Note that that least significant digits go at the end of the string.
+ */
+static void
+iolog_fmtid(unsigned long id, char buf[7])
+{
+    static const char b36char[] = "0123456789ABCDEFGHIJKLMNOPQRSTUVWXYZ";
+    int i;
+
+    for (i = 5; i >= 0; i--) {
+	buf[i] = b36char[id % 36];
+	id /= 36;
+    }
+    buf[6] = '\n';
+}
+
 /*
  * Read the on-disk sequence number, set sessid to the next
  * number, and update the on-disk copy.
  * Uses file locking to avoid sequence number collisions.
+ * If iolog_set_seq_reserve() was used to reserve more than one
+ * number at a time, the remaining numbers are handed out without
+ * accessing the sequence file until they have all been used.
  */
 bool
 iolog_nextid(char *iolog_dir, char sessid[7])
 {
     char buf[32], *ep;
-    int i, len, fd = -1;
-    unsigned long id = 0;
+    int len, fd = -1;
+    unsigned long id = 0, last;
     ssize_t nread;
     bool ret = false;
     char pathbuf[PATH_MAX];
-    static const char b36char[] = "0123456789ABCDEFGHIJKLMNOPQRSTUVWXYZ";
     debug_decl(iolog_nextid, SUDO_DEBUG_UTIL);
 
+    /* Use a previously reserved ID if there is one. */
+    if (seq_cache.next <= seq_cache.last && seq_cache.iolog_dir != NULL &&
+	    strcmp(seq_cache.iolog_dir, iolog_dir) == 0) {
+	iolog_fmtid(seq_cache.next++, buf);
+	memcpy(sessid, buf, 6);
+	sessid[6] = '\0';
+	debug_return_bool(true);
+    }
+
     /*
      * Create I/O log directory if it doesn't already exist.
      */
@@ -489,19 +550,25 @@ iolog_nextid(char *iolog_dir, char sessid[7])
     id++;
 
     /*
-     * Convert id to a string and stash in sessid.
-     * Note that that least significant digits go at the end of the string.
+     * Reserve IDs through last, stopping at sessid_max so the
+     * sequence wraps around the same way as when reserving one at a time.
      */
-    for (i = 5; i >= 0; i--) {
-	buf[i] = b36char[id % 36];
-	id /= 36;
+    last = id;
+    if (sessid_reserve > 1) {
+	last = id + sessid_reserve - 1;
+	if (last > sessid_max)
+	    last = MAX(id, sessid_max);
     }
-    buf[6] = '\n';
 
     /* Stash id for logging purposes. */
+    iolog_fmtid(id, buf);
     memcpy(sessid, buf, 6);
     sessid[6] = '\0';
 
+    /* Write the last reserved ID so other processes start after it. */
+    if (last != id)
+	iolog_fmtid(last, buf);
+
     /* Rewind and overwrite old seq file, including the NUL byte. */
 #ifdef HAVE_PWRITE
     if (pwrite(fd, buf, 7, 0) != 7) {
@@ -512,6 +579,19 @@ iolog_nextid(char *iolog_dir, char sessid[7])
 	    "%s: unable to write %s", __func__, pathbuf);
 	goto done;
     }
+
+    /* Remember the remaining reserved IDs, if any. */
+    if (last != id) {
+	if (seq_cache.iolog_dir == NULL ||
+		strcmp(seq_cache.iolog_dir, iolog_dir) != 0) {
+	    free(seq_cache.iolog_dir);
+	    seq_cache.iolog_dir = strdup(iolog_dir);
+	}
+	if (seq_cache.iolog_dir != NULL) {
+	    seq_cache.next = id + 1;
+	    seq_cache.last = last;
+	}
+    }
     ret = true;
 
 done:
@@ -553,17 +633,34 @@ iolog_mkpath(char *path)
  */
 bool
 iolog_open(struct iolog_file *iol, int dfd, int iofd, const char *mode)
+{
+    return iolog_open_offset(iol, dfd, iofd, mode, 0);
+}
+
+/*
+ * Like iolog_open() but starts at the specified offset in the file,
+ * which must be the start of a chunk (see iolog_chunk_write()).
+ * In read mode, reading begins at offset.  In append mode ("a"),
+ * the file is truncated to offset and writing continues from there.
+ * The offset is ignored in write mode.
+ */
+bool
+iolog_open_offset(struct iolog_file *iol, int dfd, int iofd, const char *mode,
+    off_t offset)
 {
     int flags;
     const char *file;
     unsigned char magic[2];
-    debug_decl(iolog_open, SUDO_DEBUG_UTIL);
+    debug_decl(iolog_open_offset, SUDO_DEBUG_UTIL);
 
     if (mode[0] == 'r') {
 	flags = mode[1] == '+' ? O_RDWR : O_RDONLY;
     } else if (mode[0] == 'w') {
 	flags = O_CREAT|O_TRUNC;
 	flags |= mode[1] == '+' ? O_RDWR : O_WRONLY;
+    } else if (mode[0] == 'a' && mode[1] == '\0') {
+	/* Need to read the magic number to tell if it is compressed. */
+	flags = O_RDWR;
     } else {
 	sudo_debug_printf(SUDO_DEBUG_ERROR,
 	    "%s: invalid I/O mode %s", __func__, mode);
@@ -589,12 +686,31 @@ iolog_open(struct iolog_file *iol, int dfd, int iofd, const char *mode)
 		iol->compressed = iolog_compress;
 	    } else {
 		/* check for gzip magic number */
-		if (read(fd, magic, sizeof(magic)) == ssizeof(magic)) {
+		switch (read(fd, magic, sizeof(magic))) {
+		case ssizeof(magic):
 		    if (magic[0] == gzip_magic[0] && magic[1] == gzip_magic[1])
 			iol->compressed = true;
+		    break;
+		case 0:
+		    /* Nothing written yet, use the current setting. */
+		    if (*mode == 'a')
+			iol->compressed = iolog_compress;
+		    break;
+		}
+		/* Discard anything past the start of the chunk. */
+		if (*mode == 'a' && ftruncate(fd, offset) == -1) {
+		    sudo_debug_printf(SUDO_DEBUG_ERROR|SUDO_DEBUG_ERRNO,
+			"%s: unable to truncate %s to %lld", __func__,
+			file, (long long)offset);
+		    offset = -1;
+		}
+		if (offset == -1 || lseek(fd, offset, SEEK_SET) == -1) {
+		    close(fd);
+		    fd = -1;
 		}
-		(void)lseek(fd, 0, SEEK_SET);
 	    }
+	}
+	if (fd != -1) {
 	    (void)fcntl(fd, F_SETFD, FD_CLOEXEC);
 #ifdef HAVE_ZLIB_H
 	    if (iol->compressed)
@@ -760,8 +876,41 @@ iolog_read(struct iolog_file *iol, void *buf, size_t nbytes,
     debug_return_ssize_t(nread);
 }
 
+/*
+ * Flush buffered data in a (possibly compressed) I/O log to the
+ * underlying file.  Callers that batch writes with flushing disabled
+ * use this to make their data visible at well-defined points.
+ */
+bool
+iolog_flush(struct iolog_file *iol, const char **errstr)
+{
+    bool ret = true;
+    debug_decl(iolog_flush, SUDO_DEBUG_UTIL);
+
+#ifdef HAVE_ZLIB_H
+    if (iol->compressed) {
+	if (gzflush(iol->fd.g, Z_SYNC_FLUSH) != Z_OK) {
+	    ret = false;
+	    if (errstr != NULL)
+		*errstr = gzstrerror(iol->fd.g);
+	}
+    } else
+#endif
+    {
+	if (fflush(iol->fd.f) != 0) {
+	    ret = false;
+	    if (errstr != NULL)
+		*errstr = strerror(errno);
+	}
+    }
+
+    debug_return_bool(ret);
+}
+
 /*
  * Write to an I/O log, optionally compressing.
+ * If iolog_flush_writes is not set, consecutive writes are coalesced
+ * in the stdio or zlib buffer until iolog_flush() or iolog_close().
  */
 ssize_t
 iolog_write(struct iolog_file *iol, const void *buf, size_t len,
@@ -786,14 +935,6 @@ iolog_write(struct iolog_file *iol, const void *buf, size_t len,
 		*errstr = gzstrerror(iol->fd.g);
 	    goto done;
 	}
-	if (iolog_flush) {
-	    if (gzflush(iol->fd.g, Z_SYNC_FLUSH) != Z_OK) {
-		ret = -1;
-		if (errstr != NULL)
-		    *errstr = gzstrerror(iol->fd.g);
-		goto done;
-	    }
-	}
     } else
 #endif
     {
@@ -804,14 +945,10 @@ iolog_write(struct iolog_file *iol, const void *buf, size_t len,
 		*errstr = strerror(errno);
 	    goto done;
 	}
-	if (iolog_flush) {
-	    if (fflush(iol->fd.f) != 0) {
-		ret = -1;
-		if (errstr != NULL)
-		    *errstr = strerror(errno);
-		goto done;
-	    }
-	}
+    }
+    if (iolog_flush_writes) {
+	if (!iolog_flush(iol, errstr))
+	    ret = -1;
     }
 
 done:
@@ -921,6 +1058,400 @@ iolog_write_info_file(int dfd, const char *parent, struct iolog_info *log_info,
     debug_return_bool(!error);
 }
 
+/*
+ * Copy str to dst, escaping characters that are special in the index.
+ * If dst is NULL, just compute the length.  Returns the escaped length.
+ */
+static size_t
+iolog_index_escape(char *dst, const char *str)
+{
+    size_t len = 0;
+
+    for (; *str != '\0'; str++) {
+	char ch = *str;
+	switch (ch) {
+	case '\\':
+	case '\t':
+	case '\n':
+	    if (dst != NULL) {
+		dst[len] = '\\';
+		dst[len + 1] = ch == '\t' ? 't' : ch == '\n' ? 'n' : '\\';
+	    }
+	    len += 2;
+	    break;
+	default:
+	    if (dst != NULL)
+		dst[len] = ch;
+	    len++;
+	    break;
+	}
+    }
+    return len;
+}
+
+/*
+ * Format a session index record, returning a newly allocated string.
+ * The fields are normalized the same way as in the "log" file so that
+ * searches on the index match what iolog_parse_loginfo() would return.
+ * Fields are tab-separated and the record is terminated by a newline:
+ *  timestamp lines cols user runas_user runas_group host tty cwd session cmd
+ */
+static char *
+iolog_index_format(const char *session, const char *host,
+    const struct iolog_info *log_info, char * const argv[], size_t *lenp)
+{
+    const char *fields[9];
+    char * const *av;
+    char *line, *cp;
+    char nums[(((sizeof(long long) * 8) + 2) / 3) * 3 + 4];
+    size_t len;
+    int i, nlen;
+    debug_decl(iolog_index_format, SUDO_DEBUG_UTIL);
+
+    nlen = snprintf(nums, sizeof(nums), "%lld\t%d\t%d\t",
+	(long long)log_info->tstamp, log_info->lines, log_info->cols);
+    if (nlen < 0 || (size_t)nlen >= sizeof(nums))
+	debug_return_str(NULL);
+
+    fields[0] = log_info->user ? log_info->user : "unknown";
+    fields[1] = log_info->runas_user ? log_info->runas_user : RUNAS_DEFAULT;
+    fields[2] = log_info->runas_group ? log_info->runas_group : "";
+    fields[3] = host ? host : "";
+    fields[4] = log_info->tty ? log_info->tty : "unknown";
+    fields[5] = log_info->cwd ? log_info->cwd : "unknown";
+    fields[6] = session;
+    fields[7] = log_info->cmd ? log_info->cmd : "unknown";
+    fields[8] = NULL;
+
+    /* Compute the length: fields, separators, args and trailing newline. */
+    len = nlen;
+    for (i = 0; fields[i] != NULL; i++)
+	len += iolog_index_escape(NULL, fields[i]) + 1;
+    if (argv != NULL) {
+	for (av = argv + 1; *av != NULL; av++)
+	    len += iolog_index_escape(NULL, *av) + 1;
+    }
+
+    if ((line = malloc(len + 1)) == NULL)
+	debug_return_str(NULL);
+    memcpy(line, nums, nlen);
+    cp = line + nlen;
+    for (i = 0; fields[i] != NULL; i++) {
+	if (i != 0)
+	    *cp++ = '\t';
+	cp += iolog_index_escape(cp, fields[i]);
+    }
+    if (argv != NULL) {
+	for (av = argv + 1; *av != NULL; av++) {
+	    *cp++ = ' ';
+	    cp += iolog_index_escape(cp, *av);
+	}
+    }
+    *cp++ = '\n';
+    *cp = '\0';
+    *lenp = (size_t)(cp - line);
+
+    debug_return_str(line);
+}
+
+/*
+ * Write a session index record to fp, used when rebuilding the index.
+ * The session is the path of the I/O log relative to the index directory.
+ */
+bool
+iolog_index_write(FILE *fp, const char *session, const char *host,
+    const struct iolog_info *log_info, char * const argv[])
+{
+    char *line;
+    size_t len;
+    bool ret;
+    debug_decl(iolog_index_write, SUDO_DEBUG_UTIL);
+
+    line = iolog_index_format(session, host, log_info, argv, &len);
+    if (line == NULL)
+	debug_return_bool(false);
+    ret = fwrite(line, 1, len, fp) == len;
+    free(line);
+
+    debug_return_bool(ret);
+}
+
+/*
+ * Append a record for a new session to the index in dir.
+ * The session is the path of the I/O log relative to dir.
+ * Records are appended under a lock in a single write(2) so that
+ * concurrent writers do not interleave.  If the index was replaced
+ * by a rebuild while we waited for the lock, reopen it and try again.
+ * A new index has no IOLOG_INDEX_HEADER so it is not trusted to be
+ * complete.  If the record cannot be written, the index is removed
+ * so that it cannot hide the session.
+ */
+bool
+iolog_index_append(const char *dir, const char *session, const char *host,
+    const struct iolog_info *log_info, char * const argv[])
+{
+    char path[PATH_MAX], *line = NULL;
+    struct stat sb1, sb2;
+    bool ret = false;
+    size_t len;
+    int fd = -1;
+    debug_decl(iolog_index_append, SUDO_DEBUG_UTIL);
+
+    len = (size_t)snprintf(path, sizeof(path), "%s/%s", dir, IOLOG_INDEX);
+    if (len >= sizeof(path)) {
+	errno = ENAMETOOLONG;
+	goto done;
+    }
+    line = iolog_index_format(session, host, log_info, argv, &len);
+    if (line == NULL)
+	goto done;
+
+    for (;;) {
+	fd = iolog_openat(AT_FDCWD, path, O_CREAT|O_WRONLY|O_APPEND);
+	if (fd == -1) {
+	    sudo_debug_printf(SUDO_DEBUG_ERROR|SUDO_DEBUG_LINENO|SUDO_DEBUG_ERRNO,
+		"unable to open %s", path);
+	    goto done;
+	}
+	if (!sudo_lock_file(fd, SUDO_LOCK)) {
+	    sudo_debug_printf(SUDO_DEBUG_ERROR|SUDO_DEBUG_LINENO|SUDO_DEBUG_ERRNO,
+		"unable to lock %s", path);
+	    goto done;
+	}
+	if (fstat(fd, &sb1) == 0 && stat(path, &sb2) == 0 &&
+		sb1.st_dev == sb2.st_dev && sb1.st_ino == sb2.st_ino)
+	    break;
+	close(fd);
+    }
+    if (sb1.st_size == 0 && fchown(fd, iolog_uid, iolog_gid) != 0) {
+	sudo_debug_printf(SUDO_DEBUG_ERROR|SUDO_DEBUG_ERRNO,
+	    "%s: unable to fchown %d:%d %s", __func__,
+	    (int)iolog_uid, (int)iolog_gid, path);
+    }
+    if (write(fd, line, len) != (ssize_t)len) {
+	sudo_debug_printf(SUDO_DEBUG_ERROR|SUDO_DEBUG_LINENO|SUDO_DEBUG_ERRNO,
+	    "unable to write to %s, removing it", path);
+	if (unlink(path) == -1) {
+	    sudo_debug_printf(SUDO_DEBUG_ERROR|SUDO_DEBUG_LINENO|SUDO_DEBUG_ERRNO,
+		"unable to remove %s", path);
+	}
+	goto done;
+    }
+    ret = true;
+
+done:
+    if (fd != -1)
+	close(fd);
+    free(line);
+    debug_return_bool(ret);
+}
+
+/*
+ * End the current chunk of each writable I/O log file and append
+ * an entry to the seek index that maps the elapsed time to the
+ * offset in each file where the next chunk begins.
+ * The current terminal size is stored too, since a window size
+ * change before the chunk would otherwise be lost when seeking.
+ * A compressed file starts a new gzip member for each chunk so that
+ * reading can begin at a chunk boundary.  Readers that are unaware
+ * of the index just see a multi-member gzip file.
+ */
+bool
+iolog_chunk_write(int dfd, struct iolog_file *iolog_files,
+    const struct timespec *elapsed, int lines, int cols, const char **errstr)
+{
+    char line[(IOFD_MAX + 4) * 24];
+    off_t offsets[IOFD_MAX];
+    struct stat sb;
+    int iofd, len, fd;
+    bool ret = false;
+    debug_decl(iolog_chunk_write, SUDO_DEBUG_UTIL);
+
+    for (iofd = 0; iofd < IOFD_MAX; iofd++) {
+	struct iolog_file *iol = &iolog_files[iofd];
+
+	offsets[iofd] = 0;
+	if (!iol->enabled || !iol->writable)
+	    continue;
+#ifdef HAVE_ZLIB_H
+	if (iol->compressed) {
+	    /* Complete the gzip member, the next write starts a new one. */
+	    if (gzflush(iol->fd.g, Z_FINISH) != Z_OK) {
+		if (errstr != NULL)
+		    *errstr = gzstrerror(iol->fd.g);
+		goto done;
+	    }
+	    offsets[iofd] = gzoffset(iol->fd.g);
+	} else
+#endif
+	{
+	    if (fflush(iol->fd.f) != 0) {
+		if (errstr != NULL)
+		    *errstr = strerror(errno);
+		goto done;
+	    }
+#ifdef HAVE_FSEEKO
+	    offsets[iofd] = ftello(iol->fd.f);
+#else
+	    offsets[iofd] = ftell(iol->fd.f);
+#endif
+	}
+	if (offsets[iofd] == -1) {
+	    if (errstr != NULL)
+		*errstr = strerror(errno);
+	    goto done;
+	}
+    }
+
+    len = snprintf(line, sizeof(line),
+	"%lld.%09ld %lld %lld %lld %lld %lld %lld %d %d\n",
+	(long long)elapsed->tv_sec, elapsed->tv_nsec,
+	(long long)offsets[IOFD_STDIN], (long long)offsets[IOFD_STDOUT],
+	(long long)offsets[IOFD_STDERR], (long long)offsets[IOFD_TTYIN],
+	(long long)offsets[IOFD_TTYOUT], (long long)offsets[IOFD_TIMING],
+	lines, cols);
+    if (len < 0 || len >= ssizeof(line)) {
+	/* Not actually possible due to the size of line[]. */
+	if (errstr != NULL)
+	    *errstr = strerror(EOVERFLOW);
+	goto done;
+    }
+
+    fd = iolog_openat(dfd, IOLOG_SEEK_INDEX, O_CREAT|O_WRONLY|O_APPEND);
+    if (fd == -1) {
+	if (errstr != NULL)
+	    *errstr = strerror(errno);
+	goto done;
+    }
+    if (fstat(fd, &sb) == 0 && sb.st_size == 0) {
+	if (fchown(fd, iolog_uid, iolog_gid) != 0) {
+	    sudo_debug_printf(SUDO_DEBUG_ERROR|SUDO_DEBUG_ERRNO,
+		"%s: unable to fchown %d:%d %s", __func__,
+		(int)iolog_uid, (int)iolog_gid, IOLOG_SEEK_INDEX);
+	}
+    }
+    if (write(fd, line, len) != len) {
+	if (errstr != NULL)
+	    *errstr = strerror(errno);
+	close(fd);
+	goto done;
+    }
+    close(fd);
+    ret = true;
+
+done:
+    debug_return_bool(ret);
+}
+
+/*
+ * Find the last entry in the seek index at or before the target time.
+ * Returns true if one was found, else false.
+ */
+bool
+iolog_chunk_find(int dfd, const struct timespec *target,
+    struct iolog_chunk *chunk)
+{
+    struct timespec elapsed;
+    char *line = NULL, *cp, *ep;
+    size_t linesize = 0;
+    long long vals[IOFD_MAX + 2];	/* offsets, lines and columns */
+    bool ret = false;
+    FILE *fp = NULL;
+    int fd, i;
+    debug_decl(iolog_chunk_find, SUDO_DEBUG_UTIL);
+
+    fd = iolog_openat(dfd, IOLOG_SEEK_INDEX, O_RDONLY);
+    if (fd == -1 || (fp = fdopen(fd, "r")) == NULL) {
+	sudo_debug_printf(SUDO_DEBUG_INFO|SUDO_DEBUG_ERRNO,
+	    "unable to open %s", IOLOG_SEEK_INDEX);
+	if (fd != -1)
+	    close(fd);
+	debug_return_bool(false);
+    }
+
+    while (getdelim(&line, &linesize, '\n', fp) != -1) {
+	if ((cp = iolog_parse_delay(line, &elapsed, ".")) == NULL)
+	    break;
+	for (i = 0; i < (int)nitems(vals); i++) {
+	    errno = 0;
+	    vals[i] = strtoll(cp, &ep, 10);
+	    if (ep == cp || (*ep != ' ' && *ep != '\n') || vals[i] < 0 ||
+		    errno == ERANGE)
+		break;
+	    cp = ep;
+	}
+	if (i != (int)nitems(vals) || *cp != '\n' ||
+		vals[IOFD_MAX] > INT_MAX || vals[IOFD_MAX + 1] > INT_MAX) {
+	    /* May be a partial entry if we crashed while writing it. */
+	    sudo_debug_printf(SUDO_DEBUG_WARN|SUDO_DEBUG_LINENO,
+		"invalid %s entry: %s", IOLOG_SEEK_INDEX, line);
+	    break;
+	}
+	if (sudo_timespeccmp(&elapsed, target, >))
+	    break;
+
+	chunk->elapsed = elapsed;
+	for (i = 0; i < IOFD_MAX; i++)
+	    chunk->offsets[i] = (off_t)vals[i];
+	chunk->lines = (int)vals[IOFD_MAX];
+	chunk->cols = (int)vals[IOFD_MAX + 1];
+#ifdef HAVE_FSEEKO
+	chunk->next = ftello(fp);
+#else
+	chunk->next = ftell(fp);
+#endif
+	ret = chunk->next != -1;
+    }
+
+    free(line);
+    fclose(fp);
+    debug_return_bool(ret);
+}
+
+/*
+ * Open the I/O log files for writing at the start of the specified
+ * chunk.  Anything written after the chunk began, including later
+ * seek index entries, is discarded.
+ * Files that did not exist when the chunk began are left disabled.
+ */
+bool
+iolog_chunk_resume(int dfd, const struct iolog_chunk *chunk,
+    struct iolog_file *iolog_files)
+{
+    int fd, iofd;
+    debug_decl(iolog_chunk_resume, SUDO_DEBUG_UTIL);
+
+    fd = iolog_openat(dfd, IOLOG_SEEK_INDEX, O_WRONLY);
+    if (fd == -1 || ftruncate(fd, chunk->next) == -1) {
+	sudo_debug_printf(SUDO_DEBUG_ERROR|SUDO_DEBUG_ERRNO,
+	    "unable to truncate %s to %lld", IOLOG_SEEK_INDEX,
+	    (long long)chunk->next);
+	if (fd != -1)
+	    close(fd);
+	debug_return_bool(false);
+    }
+    close(fd);
+
+    for (iofd = 0; iofd < IOFD_MAX; iofd++) {
+	iolog_files[iofd].enabled = true;
+	if (!iolog_open_offset(&iolog_files[iofd], dfd, iofd, "a",
+		chunk->offsets[iofd])) {
+	    if (errno != ENOENT) {
+		sudo_debug_printf(SUDO_DEBUG_ERROR|SUDO_DEBUG_ERRNO,
+		    "unable to open %s at offset %lld",
+		    iolog_fd_to_name(iofd), (long long)chunk->offsets[iofd]);
+		debug_return_bool(false);
+	    }
+	}
+    }
+    if (!iolog_files[IOFD_TIMING].enabled) {
+	sudo_debug_printf(SUDO_DEBUG_ERROR|SUDO_DEBUG_ERRNO,
+	    "unable to open %s", iolog_fd_to_name(IOFD_TIMING));
+	debug_return_bool(false);
+    }
+    debug_return_bool(true);
+}
+
 /*
  * Map IOFD_* -> name.
  */
@@ -176,6 +176,108 @@ bad:
     debug_return_ptr(NULL);
 }
 
+/*
+ * Undo the escaping done when the index record was written, in place.
+ */
+static void
+iolog_index_unescape(char *str)
+{
+    char *dst = str;
+
+    for (; *str != '\0'; str++) {
+	if (*str == '\\' && str[1] != '\0') {
+	    str++;
+	    *dst++ = *str == 't' ? '\t' : *str == 'n' ? '\n' : *str;
+	} else {
+	    *dst++ = *str;
+	}
+    }
+    *dst = '\0';
+}
+
+/*
+ * Parse a session index record as written by iolog_index_append().
+ * The line is modified in place and the strings stored in log_info,
+ * host and session point into it; they must not be freed.
+ * Returns true on success, false if the record is malformed.
+ */
+bool
+iolog_index_parse(char *line, struct iolog_info *log_info, char **host,
+    char **session)
+{
+    char *fields[11], *cp, *ep;
+    const char *errstr;
+    int i;
+    debug_decl(iolog_index_parse, SUDO_DEBUG_UTIL);
+
+    line[strcspn(line, "\n")] = '\0';
+    for (i = 0, cp = line; i < 11; i++) {
+	fields[i] = cp;
+	ep = strchr(cp, '\t');
+	if (ep == NULL)
+	    break;
+	*ep = '\0';
+	cp = ep + 1;
+    }
+    if (i != 10) {
+	sudo_debug_printf(SUDO_DEBUG_WARN|SUDO_DEBUG_LINENO,
+	    "%s: expected 11 fields, got %d", __func__, i + 1);
+	debug_return_bool(false);
+    }
+
+    memset(log_info, 0, sizeof(*log_info));
+    log_info->tstamp = sudo_strtonum(fields[0], 0, TIME_T_MAX, &errstr);
+    if (errstr != NULL)
+	debug_return_bool(false);
+    log_info->lines = sudo_strtonum(fields[1], 0, INT_MAX, &errstr);
+    if (errstr != NULL)
+	debug_return_bool(false);
+    log_info->cols = sudo_strtonum(fields[2], 0, INT_MAX, &errstr);
+    if (errstr != NULL)
+	debug_return_bool(false);
+    for (i = 3; i < 11; i++)
+	iolog_index_unescape(fields[i]);
+    log_info->user = fields[3];
+    log_info->runas_user = fields[4];
+    log_info->runas_group = *fields[5] != '\0' ? fields[5] : NULL;
+    *host = fields[6];
+    log_info->tty = fields[7];
+    log_info->cwd = fields[8];
+    *session = fields[9];
+    log_info->cmd = fields[10];
+
+    debug_return_bool(true);
+}
+
+/*
+ * Returns the length of the leading part of the I/O log directory
+ * template dir that contains no escape sequences, ending on a path
+ * component boundary.  This is where the session index is stored so
+ * that there is a single index for all sessions, even when the I/O
+ * log directory includes escapes like %{user}.  Returns 0 if there
+ * is no such directory other than "/".
+ */
+size_t
+iolog_index_dirlen(const char *dir)
+{
+    const char *cp, *esc;
+    size_t len;
+    debug_decl(iolog_index_dirlen, SUDO_DEBUG_UTIL);
+
+    if ((esc = strchr(dir, '%')) == NULL) {
+	len = strlen(dir);
+    } else {
+	/* Stop at the start of the component containing the escape. */
+	for (cp = esc; cp > dir && cp[-1] != '/'; cp--)
+	    continue;
+	len = (size_t)(cp - dir);
+    }
+    while (len > 0 && dir[len - 1] == '/')
+	len--;
+
+    debug_return_size_t(len);
+}
+
 void
 iolog_adjust_delay(struct timespec *delay, struct timespec *max_delay,
      double scale_factor)
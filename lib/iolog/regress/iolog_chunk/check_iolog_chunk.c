@@ -0,0 +1,255 @@
+/*
+ * SPDX-License-Identifier: ISC
+ *
+ * Copyright (c) 2020 Todd C. Miller <Todd.Miller@sudo.ws>
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include <config.h>
+
+#include <sys/types.h>
+#include <stdio.h>
+#include <stdlib.h>
+#ifdef HAVE_STRING_H
+# include <string.h>
+#endif /* HAVE_STRING_H */
+#ifdef HAVE_STRINGS_H
+# include <strings.h>
+#endif /* HAVE_STRINGS_H */
+#include <time.h>
+#include <unistd.h>
+#include <fcntl.h>
+
+#define SUDO_ERROR_WRAP 0
+
+#include "sudo_compat.h"
+#include "sudo_util.h"
+#include "sudo_fatal.h"
+#include "sudo_iolog.h"
+
+__dso_public int main(int argc, char *argv[]);
+
+static int ntests, nerrors;
+
+/*
+ * Append data to the timing and ttyout files.
+ */
+static void
+write_logs(struct iolog_file *iolog_files, const char *timing,
+    const char *ttyout)
+{
+    const char *errstr;
+
+    if (iolog_write(&iolog_files[IOFD_TIMING], timing, strlen(timing),
+	    &errstr) == -1 ||
+	    iolog_write(&iolog_files[IOFD_TTYOUT], ttyout, strlen(ttyout),
+	    &errstr) == -1)
+	sudo_fatalx_nodebug("unable to write I/O log: %s", errstr);
+}
+
+/*
+ * Add a seek index entry at the specified number of seconds.
+ */
+static void
+write_chunk(int dfd, struct iolog_file *iolog_files, time_t secs,
+    int lines, int cols)
+{
+    struct timespec elapsed = { secs, 0 };
+    const char *errstr = NULL;
+
+    if (!iolog_chunk_write(dfd, iolog_files, &elapsed, lines, cols, &errstr)) {
+	sudo_fatalx_nodebug("unable to write %s: %s", IOLOG_SEEK_INDEX,
+	    errstr ? errstr : "unknown error");
+    }
+}
+
+static void
+close_logs(struct iolog_file *iolog_files)
+{
+    int iofd;
+
+    for (iofd = 0; iofd < IOFD_MAX; iofd++) {
+	if (iolog_files[iofd].enabled)
+	    iolog_close(&iolog_files[iofd], NULL);
+    }
+}
+
+/*
+ * Read the ttyout file starting at offset and compare to expected.
+ */
+static void
+check_ttyout(int dfd, off_t offset, const char *expected, const char *what)
+{
+    struct iolog_file iol = { true };
+    const char *errstr;
+    char buf[64];
+    ssize_t nread;
+
+    ntests++;
+    if (!iolog_open_offset(&iol, dfd, IOFD_TTYOUT, "r", offset)) {
+	sudo_warn_nodebug("%s: unable to open ttyout", what);
+	nerrors++;
+	return;
+    }
+    nread = iolog_read(&iol, buf, sizeof(buf) - 1, &errstr);
+    if (nread == -1) {
+	sudo_warnx_nodebug("%s: unable to read ttyout: %s", what, errstr);
+	nerrors++;
+    } else {
+	buf[nread] = '\0';
+	if (strcmp(buf, expected) != 0) {
+	    sudo_warnx_nodebug("%s: ttyout: expected \"%s\", got \"%s\"",
+		what, expected, buf);
+	    nerrors++;
+	}
+    }
+    iolog_close(&iol, NULL);
+}
+
+/*
+ * Look up target in the seek index and compare the entry found.
+ * An expected time of -1 means no entry should be found.
+ */
+static void
+check_find(int dfd, time_t target_secs, time_t secs, int lines, int cols,
+    struct iolog_chunk *chunk, const char *what)
+{
+    struct timespec target = { target_secs, 0 };
+    bool found;
+
+    ntests++;
+    memset(chunk, 0, sizeof(*chunk));
+    found = iolog_chunk_find(dfd, &target, chunk);
+    if (secs == -1) {
+	if (found) {
+	    sudo_warnx_nodebug("%s: target %lld: unexpected entry at %lld",
+		what, (long long)target_secs, (long long)chunk->elapsed.tv_sec);
+	    nerrors++;
+	}
+	return;
+    }
+    if (!found) {
+	sudo_warnx_nodebug("%s: target %lld: no entry found", what,
+	    (long long)target_secs);
+	nerrors++;
+    } else if (chunk->elapsed.tv_sec != secs || chunk->elapsed.tv_nsec != 0 ||
+	    chunk->lines != lines || chunk->cols != cols) {
+	sudo_warnx_nodebug("%s: target %lld: expected [%lld, %d x %d], "
+	    "got [%lld, %d x %d]", what, (long long)target_secs,
+	    (long long)secs, lines, cols, (long long)chunk->elapsed.tv_sec,
+	    chunk->lines, chunk->cols);
+	nerrors++;
+    }
+}
+
+/*
+ * Write a session with two seek index entries, look them up,
+ * then resume writing at the first one.
+ */
+static void
+test_chunks(bool compress)
+{
+    const char *what = compress ? "compressed" : "uncompressed";
+    struct iolog_file iolog_files[IOFD_MAX];
+    char dir[] = "/tmp/check_iolog_chunk.XXXXXX";
+    struct iolog_chunk chunk;
+    int dfd, fd, iofd;
+
+    if (mkdtemp(dir) == NULL)
+	sudo_fatal_nodebug("mkdtemp");
+    if ((dfd = open(dir, O_RDONLY)) == -1)
+	sudo_fatal_nodebug("%s", dir);
+    iolog_set_compress(compress);
+
+    memset(iolog_files, 0, sizeof(iolog_files));
+    iolog_files[IOFD_TIMING].enabled = true;
+    iolog_files[IOFD_TTYOUT].enabled = true;
+    for (iofd = 0; iofd < IOFD_MAX; iofd++) {
+	if (!iolog_open(&iolog_files[iofd], dfd, iofd, "w"))
+	    sudo_fatal_nodebug("%s/%s", dir, iolog_fd_to_name(iofd));
+    }
+    write_logs(iolog_files, "4 0.5 4\n", "aaaa");
+    write_chunk(dfd, iolog_files, 1, 24, 80);
+    write_logs(iolog_files, "5 0.5 30 100\n4 0.5 4\n", "bbbb");
+    write_chunk(dfd, iolog_files, 2, 30, 100);
+    write_logs(iolog_files, "4 0.5 4\n", "cccc");
+    close_logs(iolog_files);
+
+    /* Before the first entry, between entries and after the last one. */
+    check_find(dfd, 0, -1, 0, 0, &chunk, what);
+    check_find(dfd, 1, 1, 24, 80, &chunk, what);
+    check_ttyout(dfd, chunk.offsets[IOFD_TTYOUT], "bbbbcccc", what);
+    check_find(dfd, 5, 2, 30, 100, &chunk, what);
+    check_ttyout(dfd, chunk.offsets[IOFD_TTYOUT], "cccc", what);
+
+    /* A partial entry at the end of the index is ignored. */
+    fd = openat(dfd, IOLOG_SEEK_INDEX, O_WRONLY|O_APPEND);
+    if (fd == -1 || write(fd, "3.000000000 1 2 3", 17) != 17)
+	sudo_fatal_nodebug("%s/%s", dir, IOLOG_SEEK_INDEX);
+    close(fd);
+    check_find(dfd, 5, 2, 30, 100, &chunk, what);
+
+    /* Resume at the first entry, discarding everything after it. */
+    check_find(dfd, 1, 1, 24, 80, &chunk, what);
+    memset(iolog_files, 0, sizeof(iolog_files));
+    ntests++;
+    if (!iolog_chunk_resume(dfd, &chunk, iolog_files)) {
+	sudo_warnx_nodebug("%s: unable to resume at chunk", what);
+	nerrors++;
+    } else {
+	for (iofd = 0; iofd < IOFD_MAX; iofd++) {
+	    bool expected = iofd == IOFD_TIMING || iofd == IOFD_TTYOUT;
+	    if (iolog_files[iofd].enabled != expected) {
+		sudo_warnx_nodebug("%s: %s should%s be enabled", what,
+		    iolog_fd_to_name(iofd), expected ? "" : " not");
+		nerrors++;
+	    }
+	}
+	write_logs(iolog_files, "4 0.5 4\n", "dddd");
+	close_logs(iolog_files);
+	check_ttyout(dfd, 0, "aaaadddd", what);
+	check_find(dfd, 5, 1, 24, 80, &chunk, what);
+    }
+
+    for (iofd = 0; iofd < IOFD_MAX; iofd++)
+	(void)unlinkat(dfd, iolog_fd_to_name(iofd), 0);
+    (void)unlinkat(dfd, IOLOG_SEEK_INDEX, 0);
+    close(dfd);
+    if (rmdir(dir) != 0) {
+	sudo_warn_nodebug("unable to remove %s", dir);
+	nerrors++;
+    }
+}
+
+int
+main(int argc, char *argv[])
+{
+    initprogname(argc > 0 ? argv[0] : "check_iolog_chunk");
+
+    iolog_set_defaults();
+    iolog_set_owner(geteuid(), getegid());
+
+    test_chunks(false);
+#ifdef HAVE_ZLIB_H
+    test_chunks(true);
+#endif
+
+    if (ntests != 0) {
+	printf("check_iolog_chunk: %d test%s run, %d errors, %d%% success rate\n",
+	    ntests, ntests == 1 ? "" : "s", nerrors,
+	    (ntests - nerrors) * 100 / ntests);
+    }
+
+    exit(nerrors);
+}
@@ -133,6 +133,42 @@ test_adjust_delay(int *ntests, int *nerrors)
     (*ntests) += i;
 }
 
+static struct index_dirlen_test {
+    const char *dir;
+    size_t len;
+} index_dirlen_tests[] = {
+    { "/var/log/sudo-io", 16 },
+    { "/var/log/sudo-io/", 16 },
+    { "/var/log/sudo-io/%{user}", 16 },
+    { "/var/log/sudo-io/%{user}/%{seq}", 16 },
+    { "/var/log/sudo-io/io-%{user}", 16 },
+    { "/var/log/%%sudo", 8 },
+    { "%{user}", 0 },
+    { "/", 0 },
+    { "/%{user}", 0 }
+};
+
+/*
+ * Test iolog_index_dirlen()
+ */
+void
+test_index_dirlen(int *ntests, int *nerrors)
+{
+    unsigned int i;
+
+    for (i = 0; i < nitems(index_dirlen_tests); i++) {
+	struct index_dirlen_test *test = &index_dirlen_tests[i];
+	size_t len = iolog_index_dirlen(test->dir);
+
+	if (len != test->len) {
+	    sudo_warnx("%s:%u %s: want %zu, got %zu", __func__, i,
+		test->dir, test->len, len);
+	    (*nerrors)++;
+	}
+    }
+    (*ntests) += i;
+}
+
 int
 main(int argc, char *argv[])
 {
@@ -144,6 +180,8 @@ main(int argc, char *argv[])
 
     test_adjust_delay(&tests, &errors);
 
+    test_index_dirlen(&tests, &errors);
+
     if (tests != 0) {
 	printf("iolog_util: %d test%s run, %d errors, %d%% success rate\n",
 	    tests, tests == 1 ? "" : "s", errors,
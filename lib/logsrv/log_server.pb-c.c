@@ -1053,7 +1053,7 @@ const ProtobufCMessageDescriptor info_message__descriptor =
   (ProtobufCMessageInit) info_message__init,
   NULL,NULL,NULL    /* reserved[123] */
 };
-static const ProtobufCFieldDescriptor accept_message__field_descriptors[3] =
+static const ProtobufCFieldDescriptor accept_message__field_descriptors[4] =
 {
   {
     "submit_time",
@@ -1091,8 +1091,21 @@ static const ProtobufCFieldDescriptor accept_message__field_descriptors[3] =
     0,             /* flags */
     0,NULL,NULL    /* reserved1,reserved2, etc */
   },
+  {
+    "compress_iobufs",
+    4,
+    PROTOBUF_C_LABEL_NONE,
+    PROTOBUF_C_TYPE_BOOL,
+    0,   /* quantifier_offset */
+    offsetof(AcceptMessage, compress_iobufs),
+    NULL,
+    NULL,
+    0,             /* flags */
+    0,NULL,NULL    /* reserved1,reserved2, etc */
+  },
 };
 static const unsigned accept_message__field_indices_by_name[] = {
+  3,   /* field[3] = compress_iobufs */
   2,   /* field[2] = expect_iobufs */
   1,   /* field[1] = info_msgs */
   0,   /* field[0] = submit_time */
@@ -1100,7 +1113,7 @@ static const unsigned accept_message__field_indices_by_name[] = {
 static const ProtobufCIntRange accept_message__number_ranges[1 + 1] =
 {
   { 1, 0 },
-  { 0, 3 }
+  { 0, 4 }
 };
 const ProtobufCMessageDescriptor accept_message__descriptor =
 {
@@ -1110,7 +1123,7 @@ const ProtobufCMessageDescriptor accept_message__descriptor =
   "AcceptMessage",
   "",
   sizeof(AcceptMessage),
-  3,
+  4,
   accept_message__field_descriptors,
   accept_message__field_indices_by_name,
   1,  accept_message__number_ranges,
@@ -1578,7 +1591,7 @@ const ProtobufCMessageDescriptor server_message__descriptor =
   (ProtobufCMessageInit) server_message__init,
   NULL,NULL,NULL    /* reserved[123] */
 };
-static const ProtobufCFieldDescriptor server_hello__field_descriptors[6] =
+static const ProtobufCFieldDescriptor server_hello__field_descriptors[7] =
 {
   {
     "server_id",
@@ -1652,8 +1665,21 @@ static const ProtobufCFieldDescriptor server_hello__field_descriptors[6] =
     0,             /* flags */
     0,NULL,NULL    /* reserved1,reserved2, etc */
   },
+  {
+    "compression",
+    7,
+    PROTOBUF_C_LABEL_NONE,
+    PROTOBUF_C_TYPE_BOOL,
+    0,   /* quantifier_offset */
+    offsetof(ServerHello, compression),
+    NULL,
+    NULL,
+    0,             /* flags */
+    0,NULL,NULL    /* reserved1,reserved2, etc */
+  },
 };
 static const unsigned server_hello__field_indices_by_name[] = {
+  6,   /* field[6] = compression */
   1,   /* field[1] = redirect */
   0,   /* field[0] = server_id */
   2,   /* field[2] = servers */
@@ -1664,7 +1690,7 @@ static const unsigned server_hello__field_indices_by_name[] = {
 static const ProtobufCIntRange server_hello__number_ranges[1 + 1] =
 {
   { 1, 0 },
-  { 0, 6 }
+  { 0, 7 }
 };
 const ProtobufCMessageDescriptor server_hello__descriptor =
 {
@@ -1674,7 +1700,7 @@ const ProtobufCMessageDescriptor server_hello__descriptor =
   "ServerHello",
   "",
   sizeof(ServerHello),
-  6,
+  7,
   server_hello__field_descriptors,
   server_hello__field_indices_by_name,
   1,  server_hello__number_ranges,
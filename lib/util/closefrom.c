@@ -27,6 +27,9 @@
 #ifndef HAVE_CLOSEFROM
 
 #include <sys/types.h>
+#ifdef HAVE_SYS_SYSCALL_H
+# include <sys/syscall.h>
+#endif
 #include <unistd.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -99,6 +102,11 @@ sudo_closefrom(int lowfd)
     if (fcntl(lowfd, F_CLOSEM, 0) != -1)
 	return;
 #endif
+#if defined(SYS_close_range) && !defined(__APPLE__)
+    /* Linux 5.9 and higher, the C library may not have a wrapper. */
+    if (syscall(SYS_close_range, (unsigned int)lowfd, ~0U, 0U) == 0)
+	return;
+#endif
 #if defined(HAVE_PSTAT_GETPROC)
     /*
      * EOVERFLOW is not a fatal error for the fields we use.
@@ -94,6 +94,121 @@ sudo_ev_deactivate_all(struct sudo_event_base *base)
     debug_return;
 }
 
+/*
+ * Timeout events are stored in a binary min-heap ordered by expiration
+ * time.  Each event records its index in the heap so that it can be
+ * removed or re-armed in O(log n) time.
+ */
+static inline void
+sudo_ev_timeout_set(struct sudo_event_base *base, int idx,
+    struct sudo_event *ev)
+{
+    base->timeouts[idx] = ev;
+    ev->timeouts_idx = idx;
+}
+
+/*
+ * Move the event at idx up the heap until its parent expires first.
+ */
+static void
+sudo_ev_timeout_up(struct sudo_event_base *base, int idx)
+{
+    struct sudo_event *ev = base->timeouts[idx];
+
+    while (idx > 0) {
+	const int parent = (idx - 1) / 2;
+	if (!sudo_timespeccmp(&ev->timeout, &base->timeouts[parent]->timeout, <))
+	    break;
+	sudo_ev_timeout_set(base, idx, base->timeouts[parent]);
+	idx = parent;
+    }
+    sudo_ev_timeout_set(base, idx, ev);
+}
+
+/*
+ * Move the event at idx down the heap until its children expire later.
+ */
+static void
+sudo_ev_timeout_down(struct sudo_event_base *base, int idx)
+{
+    struct sudo_event *ev = base->timeouts[idx];
+
+    for (;;) {
+	int child = (idx * 2) + 1;
+	if (child >= base->ntimeouts)
+	    break;
+	if (child + 1 < base->ntimeouts &&
+	    sudo_timespeccmp(&base->timeouts[child + 1]->timeout,
+	    &base->timeouts[child]->timeout, <))
+	    child++;
+	if (!sudo_timespeccmp(&base->timeouts[child]->timeout, &ev->timeout, <))
+	    break;
+	sudo_ev_timeout_set(base, idx, base->timeouts[child]);
+	idx = child;
+    }
+    sudo_ev_timeout_set(base, idx, ev);
+}
+
+/*
+ * Make sure there is room in the timeouts heap for one more event.
+ * Returns 0 on success, -1 on allocation failure.
+ */
+static int
+sudo_ev_timeout_reserve(struct sudo_event_base *base)
+{
+    struct sudo_event **timeouts;
+    int timeouts_max;
+    debug_decl(sudo_ev_timeout_reserve, SUDO_DEBUG_EVENT);
+
+    if (base->ntimeouts < base->timeouts_max)
+	debug_return_int(0);
+
+    timeouts_max = base->timeouts_max ? base->timeouts_max * 2 : 32;
+    timeouts = reallocarray(base->timeouts, timeouts_max,
+	sizeof(struct sudo_event *));
+    if (timeouts == NULL) {
+	sudo_debug_printf(SUDO_DEBUG_ERROR|SUDO_DEBUG_LINENO,
+	    "%s: unable to allocate %d timeouts", __func__, timeouts_max);
+	debug_return_int(-1);
+    }
+    base->timeouts = timeouts;
+    base->timeouts_max = timeouts_max;
+    debug_return_int(0);
+}
+
+/*
+ * Insert an event into the timeouts heap, which must have room for it.
+ */
+static void
+sudo_ev_timeout_insert(struct sudo_event_base *base, struct sudo_event *ev)
+{
+    sudo_ev_timeout_set(base, base->ntimeouts++, ev);
+    sudo_ev_timeout_up(base, ev->timeouts_idx);
+    SET(ev->flags, SUDO_EVQ_TIMEOUTS);
+}
+
+/*
+ * Remove an event from the timeouts heap.
+ */
+static void
+sudo_ev_timeout_remove(struct sudo_event_base *base, struct sudo_event *ev)
+{
+    const int idx = ev->timeouts_idx;
+
+    CLR(ev->flags, SUDO_EVQ_TIMEOUTS);
+    ev->timeouts_idx = -1;
+    if (idx != --base->ntimeouts) {
+	/* Fill the hole with the last event and restore heap order. */
+	sudo_ev_timeout_set(base, idx, base->timeouts[base->ntimeouts]);
+	if (idx > 0 && sudo_timespeccmp(&base->timeouts[idx]->timeout,
+	    &base->timeouts[(idx - 1) / 2]->timeout, <)) {
+	    sudo_ev_timeout_up(base, idx);
+	} else {
+	    sudo_ev_timeout_down(base, idx);
+	}
+    }
+}
+
 /*
  * Activate all signal events for which the corresponding signal_pending[]
  * flag is set.
@@ -177,7 +292,6 @@ sudo_ev_base_init(struct sudo_event_base *base)
     debug_decl(sudo_ev_base_init, SUDO_DEBUG_EVENT);
 
     TAILQ_INIT(&base->events);
-    TAILQ_INIT(&base->timeouts);
     for (i = 0; i < NSIG; i++)
 	TAILQ_INIT(&base->signals[i]);
     if (sudo_ev_base_alloc_impl(base) != 0) {
@@ -249,6 +363,7 @@ sudo_ev_base_free_v1(struct sudo_event_base *base)
     sudo_ev_base_free_impl(base);
     close(base->signal_pipe[0]);
     close(base->signal_pipe[1]);
+    free(base->timeouts);
     free(base);
 
     debug_return;
@@ -278,6 +393,7 @@ sudo_ev_init(struct sudo_event *ev, int fd, short events,
     ev->fd = fd;
     ev->events = events;
     ev->pfd_idx = -1;
+    ev->timeouts_idx = -1;
     ev->callback = callback;
     ev->closure = closure;
 
@@ -486,14 +602,19 @@ sudo_ev_add_v2(struct sudo_event_base *base, struct sudo_event *ev,
 	}
     }
 
+    /* Make sure there is space in the timeouts heap before we begin. */
+    if (timo != NULL && !ISSET(ev->flags, SUDO_EVQ_TIMEOUTS)) {
+	if (sudo_ev_timeout_reserve(base) != 0)
+	    debug_return_int(-1);
+    }
+
     /* Only add new events to the events list. */
     if (ISSET(ev->flags, SUDO_EVQ_INSERTED)) {
-	/* If event no longer has a timeout, remove from timeouts queue. */
+	/* If event no longer has a timeout, remove from timeouts heap. */
 	if (timo == NULL && ISSET(ev->flags, SUDO_EVQ_TIMEOUTS)) {
 	    sudo_debug_printf(SUDO_DEBUG_INFO,
-		"%s: removing event %p from timeouts queue", __func__, ev);
-	    CLR(ev->flags, SUDO_EVQ_TIMEOUTS);
-	    TAILQ_REMOVE(&base->timeouts, ev, timeouts_entries);
+		"%s: removing event %p from timeouts heap", __func__, ev);
+	    sudo_ev_timeout_remove(base, ev);
 	}
     } else {
 	/* Special handling for signal events. */
@@ -518,24 +639,16 @@ sudo_ev_add_v2(struct sudo_event_base *base, struct sudo_event *ev,
     }
     /* Timeouts can be changed for existing events. */
     if (timo != NULL) {
-	struct sudo_event *evtmp;
-	if (ISSET(ev->flags, SUDO_EVQ_TIMEOUTS)) {
-	    /* Remove from timeouts list, then add back. */
-	    TAILQ_REMOVE(&base->timeouts, ev, timeouts_entries);
-	}
-	/* Convert to absolute time and insert in sorted order; O(n). */
+	/* Convert to absolute time and insert in the heap; O(log n). */
 	sudo_gettime_mono(&ev->timeout);
 	sudo_timespecadd(&ev->timeout, timo, &ev->timeout);
-	TAILQ_FOREACH(evtmp, &base->timeouts, timeouts_entries) {
-	    if (sudo_timespeccmp(&ev->timeout, &evtmp->timeout, <))
-		break;
-	}
-	if (evtmp != NULL) {
-	    TAILQ_INSERT_BEFORE(evtmp, ev, timeouts_entries);
+	if (ISSET(ev->flags, SUDO_EVQ_TIMEOUTS)) {
+	    /* Already in the heap, the new timeout may be earlier or later. */
+	    sudo_ev_timeout_up(base, ev->timeouts_idx);
+	    sudo_ev_timeout_down(base, ev->timeouts_idx);
 	} else {
-	    TAILQ_INSERT_TAIL(&base->timeouts, ev, timeouts_entries);
+	    sudo_ev_timeout_insert(base, ev);
 	}
-	SET(ev->flags, SUDO_EVQ_TIMEOUTS);
     }
     debug_return_int(0);
 }
@@ -606,9 +719,9 @@ sudo_ev_del_v1(struct sudo_event_base *base, struct sudo_event *ev)
 	/* Unlink from event list. */
 	TAILQ_REMOVE(&base->events, ev, entries);
 
-	/* Unlink from timeouts list. */
+	/* Remove from timeouts heap. */
 	if (ISSET(ev->flags, SUDO_EVQ_TIMEOUTS))
-	    TAILQ_REMOVE(&base->timeouts, ev, timeouts_entries);
+	    sudo_ev_timeout_remove(base, ev);
     }
 
     /* Unlink from active list. */
@@ -618,6 +731,7 @@ sudo_ev_del_v1(struct sudo_event_base *base, struct sudo_event *ev)
     /* Mark event unused. */
     ev->flags = 0;
     ev->pfd_idx = -1;
+    ev->timeouts_idx = -1;
 
     debug_return_int(0);
 }
@@ -677,12 +791,11 @@ rescan:
 	case 0:
 	    /* Timed out, activate timeout events. */
 	    sudo_gettime_mono(&now);
-	    while ((ev = TAILQ_FIRST(&base->timeouts)) != NULL) {
+	    while ((ev = sudo_ev_first_timeout(base)) != NULL) {
 		if (sudo_timespeccmp(&ev->timeout, &now, >))
 		    break;
-		/* Remove from timeouts list. */
-		CLR(ev->flags, SUDO_EVQ_TIMEOUTS);
-		TAILQ_REMOVE(&base->timeouts, ev, timeouts_entries);
+		/* Remove from timeouts heap. */
+		sudo_ev_timeout_remove(base, ev);
 		/* Make event active. */
 		ev->revents = SUDO_EV_TIMEOUT;
 		TAILQ_INSERT_TAIL(&base->active, ev, active_entries);
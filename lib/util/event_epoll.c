@@ -0,0 +1,489 @@
+/*
+ * SPDX-License-Identifier: ISC
+ *
+ * Copyright (c) 2020 Todd C. Miller <Todd.Miller@sudo.ws>
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/*
+ * This is an open source non-commercial project. Dear PVS-Studio, please check it.
+ * PVS-Studio Static Code Analyzer for C, C++ and C#: http://www.viva64.com
+ */
+
+#include <config.h>
+
+#include <sys/types.h>
+#include <sys/epoll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#ifdef HAVE_STDBOOL_H
+# include <stdbool.h>
+#else
+# include "compat/stdbool.h"
+#endif /* HAVE_STDBOOL_H */
+#ifdef HAVE_STRING_H
+# include <string.h>
+#endif /* HAVE_STRING_H */
+#ifdef HAVE_STRINGS_H
+# include <strings.h>
+#endif /* HAVE_STRINGS_H */
+#include <time.h>
+#include <unistd.h>
+#include <errno.h>
+#include <limits.h>
+
+#include "sudo_compat.h"
+#include "sudo_util.h"
+#include "sudo_fatal.h"
+#include "sudo_debug.h"
+#include "sudo_event.h"
+
+/*
+ * The kernel only allows a descriptor to be registered once per epoll
+ * instance but more than one event may refer to the same fd (e.g. a
+ * separate read and write event for a socket).  We keep a table indexed
+ * by fd of the events interested in that fd; ev->pfd_idx is the index
+ * of the event in its fd's evs[] array.  The fd is stored in the epoll
+ * data so only the events for descriptors that are ready are visited.
+ */
+struct sudo_ev_epoll_fd {
+    struct sudo_event **evs;	/* events for this fd */
+    int nevs;			/* number of entries used in evs */
+    int maxevs;			/* size of the evs array */
+    unsigned int mask;		/* EPOLLIN/EPOLLOUT currently registered */
+    bool always;		/* fd not pollable (regular file), always ready */
+};
+
+int
+sudo_ev_base_alloc_impl(struct sudo_event_base *base)
+{
+    debug_decl(sudo_ev_base_alloc_impl, SUDO_DEBUG_EVENT);
+
+    base->epfd = epoll_create1(EPOLL_CLOEXEC);
+    if (base->epfd == -1) {
+	sudo_debug_printf(SUDO_DEBUG_ERROR|SUDO_DEBUG_LINENO|SUDO_DEBUG_ERRNO,
+	    "%s: unable to create epoll instance", __func__);
+	debug_return_int(-1);
+    }
+    base->ep_pid = getpid();
+    base->epfds = NULL;
+    base->epfd_max = 0;
+    base->ep_always = 0;
+    base->epevent_max = 32;
+    base->epevents =
+	reallocarray(NULL, base->epevent_max, sizeof(struct epoll_event));
+    if (base->epevents == NULL) {
+	sudo_debug_printf(SUDO_DEBUG_ERROR|SUDO_DEBUG_LINENO,
+	    "%s: unable to allocate %d epoll events", __func__,
+	    base->epevent_max);
+	close(base->epfd);
+	base->epfd = -1;
+	base->epevent_max = 0;
+	debug_return_int(-1);
+    }
+
+    debug_return_int(0);
+}
+
+void
+sudo_ev_base_free_impl(struct sudo_event_base *base)
+{
+    int i;
+    debug_decl(sudo_ev_base_free_impl, SUDO_DEBUG_EVENT);
+
+    for (i = 0; i < base->epfd_max; i++)
+	free(base->epfds[i].evs);
+    free(base->epfds);
+    free(base->epevents);
+    if (base->epfd != -1)
+	close(base->epfd);
+    debug_return;
+}
+
+/*
+ * Replace the epoll instance with a new one and register the
+ * descriptors we still watch.  This drops any registrations the
+ * kernel kept that we no longer know about.
+ */
+static int
+sudo_ev_epoll_reopen(struct sudo_event_base *base)
+{
+    int fd, epfd;
+    debug_decl(sudo_ev_epoll_reopen, SUDO_DEBUG_EVENT);
+
+    epfd = epoll_create1(EPOLL_CLOEXEC);
+    if (epfd == -1) {
+	sudo_debug_printf(SUDO_DEBUG_ERROR|SUDO_DEBUG_LINENO|SUDO_DEBUG_ERRNO,
+	    "%s: unable to create epoll instance", __func__);
+	debug_return_int(-1);
+    }
+    sudo_debug_printf(SUDO_DEBUG_INFO,
+	"%s: replacing epoll instance %d (pid %d) with %d",
+	__func__, base->epfd, (int)base->ep_pid, epfd);
+    if (base->epfd != -1)
+	close(base->epfd);
+    base->epfd = epfd;
+    base->ep_pid = getpid();
+
+    for (fd = 0; fd < base->epfd_max; fd++) {
+	struct sudo_ev_epoll_fd *slot = &base->epfds[fd];
+	struct epoll_event epev;
+
+	if (slot->always || slot->mask == 0)
+	    continue;
+	memset(&epev, 0, sizeof(epev));
+	epev.events = slot->mask;
+	epev.data.fd = fd;
+	if (epoll_ctl(base->epfd, EPOLL_CTL_ADD, fd, &epev) == -1) {
+	    /* Most likely closed by the child, re-added on the next change. */
+	    sudo_debug_printf(SUDO_DEBUG_DEBUG|SUDO_DEBUG_LINENO|SUDO_DEBUG_ERRNO,
+		"%s: unable to add fd %d to epoll set", __func__, fd);
+	    slot->mask = 0;
+	}
+    }
+
+    debug_return_int(0);
+}
+
+/*
+ * An epoll instance is shared with any child created by fork(2), so
+ * changes made by the child would modify the parent's interest set.
+ * If we are not the process that created the instance, get our own.
+ */
+static int
+sudo_ev_epoll_check_fork(struct sudo_event_base *base)
+{
+    debug_decl(sudo_ev_epoll_check_fork, SUDO_DEBUG_EVENT);
+
+    if (base->ep_pid == getpid())
+	debug_return_int(0);
+    debug_return_int(sudo_ev_epoll_reopen(base));
+}
+
+/*
+ * Update the kernel's interest set for fd to match the events in slot.
+ * Descriptors that epoll cannot watch (regular files, some devices)
+ * are always considered ready, as they would be with poll(2).
+ */
+static int
+sudo_ev_epoll_ctl(struct sudo_event_base *base, int fd,
+    struct sudo_ev_epoll_fd *slot)
+{
+    struct epoll_event epev;
+    unsigned int mask = 0;
+    int i, op;
+    debug_decl(sudo_ev_epoll_ctl, SUDO_DEBUG_EVENT);
+
+    if (sudo_ev_epoll_check_fork(base) != 0)
+	debug_return_int(-1);
+
+    for (i = 0; i < slot->nevs; i++) {
+	if (ISSET(slot->evs[i]->events, SUDO_EV_READ))
+	    mask |= EPOLLIN;
+	if (ISSET(slot->evs[i]->events, SUDO_EV_WRITE))
+	    mask |= EPOLLOUT;
+    }
+    if (slot->always) {
+	if (slot->nevs == 0) {
+	    slot->always = false;
+	    base->ep_always--;
+	}
+	slot->mask = mask;
+	debug_return_int(0);
+    }
+    if (mask == slot->mask)
+	debug_return_int(0);
+
+    memset(&epev, 0, sizeof(epev));
+    epev.events = mask;
+    epev.data.fd = fd;
+    if (mask == 0) {
+	/*
+	 * Fails if the fd was already closed and no other descriptor
+	 * refers to the same open file description, which removes it.
+	 */
+	if (epoll_ctl(base->epfd, EPOLL_CTL_DEL, fd, &epev) == -1) {
+	    sudo_debug_printf(SUDO_DEBUG_DEBUG|SUDO_DEBUG_LINENO|SUDO_DEBUG_ERRNO,
+		"%s: unable to remove fd %d from epoll set", __func__, fd);
+	}
+	slot->mask = 0;
+	debug_return_int(0);
+    }
+
+    op = slot->mask ? EPOLL_CTL_MOD : EPOLL_CTL_ADD;
+    if (epoll_ctl(base->epfd, op, fd, &epev) == -1) {
+	switch (errno) {
+	case ENOENT:
+	    /*
+	     * The registration was dropped when the last descriptor for
+	     * the old open file was closed and the fd number reused.
+	     */
+	    op = EPOLL_CTL_ADD;
+	    if (epoll_ctl(base->epfd, op, fd, &epev) == 0)
+		break;
+	    if (errno != EPERM)
+		goto bad;
+	    /* FALLTHROUGH */
+	case EPERM:
+	    /* Not supported by epoll, treat as always ready like poll(2). */
+	    sudo_debug_printf(SUDO_DEBUG_INFO,
+		"%s: fd %d not supported by epoll, always ready", __func__, fd);
+	    slot->always = true;
+	    base->ep_always++;
+	    break;
+	case EEXIST:
+	    /*
+	     * The kernel keys a registration by fd number and open file
+	     * description; it outlives close(2) while the description is
+	     * still open elsewhere (a dup(2) or another process).  The
+	     * fd refers to that description again, update the old one.
+	     */
+	    op = EPOLL_CTL_MOD;
+	    if (epoll_ctl(base->epfd, op, fd, &epev) == 0)
+		break;
+	    goto bad;
+	default:
+	    goto bad;
+	}
+    }
+    sudo_debug_printf(SUDO_DEBUG_DEBUG, "%s: fd %d, events 0x%x",
+	__func__, fd, mask);
+    slot->mask = mask;
+    debug_return_int(0);
+bad:
+    sudo_debug_printf(SUDO_DEBUG_ERROR|SUDO_DEBUG_LINENO|SUDO_DEBUG_ERRNO,
+	"%s: epoll_ctl op %d, fd %d failed", __func__, op, fd);
+    debug_return_int(-1);
+}
+
+int
+sudo_ev_add_impl(struct sudo_event_base *base, struct sudo_event *ev)
+{
+    struct sudo_ev_epoll_fd *slot;
+    debug_decl(sudo_ev_add_impl, SUDO_DEBUG_EVENT);
+
+    if (ev->fd < 0) {
+	sudo_debug_printf(SUDO_DEBUG_ERROR|SUDO_DEBUG_LINENO,
+	    "%s: invalid fd %d", __func__, ev->fd);
+	debug_return_int(-1);
+    }
+
+    /* If out of space in the fd table, realloc. */
+    if (ev->fd >= base->epfd_max) {
+	struct sudo_ev_epoll_fd *epfds;
+	int n = base->epfd_max ? base->epfd_max : 32;
+
+	while (n <= ev->fd)
+	    n *= 2;
+	epfds = reallocarray(base->epfds, n, sizeof(*epfds));
+	if (epfds == NULL) {
+	    sudo_debug_printf(SUDO_DEBUG_ERROR|SUDO_DEBUG_LINENO,
+		"%s: unable to allocate %d epoll fds", __func__, n);
+	    debug_return_int(-1);
+	}
+	memset(epfds + base->epfd_max, 0,
+	    (n - base->epfd_max) * sizeof(*epfds));
+	base->epfds = epfds;
+	base->epfd_max = n;
+    }
+    slot = &base->epfds[ev->fd];
+
+    /* If out of space in the fd's event array, realloc. */
+    if (slot->nevs == slot->maxevs) {
+	struct sudo_event **evs;
+	int n = slot->maxevs ? slot->maxevs * 2 : 2;
+
+	evs = reallocarray(slot->evs, n, sizeof(*evs));
+	if (evs == NULL) {
+	    sudo_debug_printf(SUDO_DEBUG_ERROR|SUDO_DEBUG_LINENO,
+		"%s: unable to allocate %d events for fd %d", __func__,
+		n, ev->fd);
+	    debug_return_int(-1);
+	}
+	slot->evs = evs;
+	slot->maxevs = n;
+    }
+
+    ev->pfd_idx = slot->nevs;
+    slot->evs[slot->nevs++] = ev;
+    if (sudo_ev_epoll_ctl(base, ev->fd, slot) != 0) {
+	slot->nevs--;
+	ev->pfd_idx = -1;
+	debug_return_int(-1);
+    }
+
+    debug_return_int(0);
+}
+
+int
+sudo_ev_del_impl(struct sudo_event_base *base, struct sudo_event *ev)
+{
+    struct sudo_ev_epoll_fd *slot;
+    debug_decl(sudo_ev_del_impl, SUDO_DEBUG_EVENT);
+
+    if (ev->fd < 0 || ev->fd >= base->epfd_max || ev->pfd_idx == -1)
+	debug_return_int(0);
+    slot = &base->epfds[ev->fd];
+
+    /* Move the last event into the deleted event's slot. */
+    if (--slot->nevs != ev->pfd_idx) {
+	slot->evs[ev->pfd_idx] = slot->evs[slot->nevs];
+	slot->evs[ev->pfd_idx]->pfd_idx = ev->pfd_idx;
+    }
+    ev->pfd_idx = -1;
+
+    debug_return_int(sudo_ev_epoll_ctl(base, ev->fd, slot));
+}
+
+/*
+ * Activate the events for fd based on the epoll events that fired.
+ * Returns the number of events activated.
+ */
+static int
+sudo_ev_epoll_activate(struct sudo_event_base *base,
+    struct sudo_ev_epoll_fd *slot, unsigned int revents)
+{
+    int i, nactive = 0;
+    debug_decl(sudo_ev_epoll_activate, SUDO_DEBUG_EVENT);
+
+    for (i = 0; i < slot->nevs; i++) {
+	struct sudo_event *ev = slot->evs[i];
+	int what = 0;
+
+	if (ISSET(ev->flags, SUDO_EVQ_ACTIVE))
+	    continue;
+	if (revents & (EPOLLIN|EPOLLHUP|EPOLLERR))
+	    what |= (ev->events & SUDO_EV_READ);
+	if (revents & (EPOLLOUT|EPOLLHUP|EPOLLERR))
+	    what |= (ev->events & SUDO_EV_WRITE);
+	if (what == 0)
+	    continue;
+
+	/* Make event active, the signal pipe event goes first. */
+	sudo_debug_printf(SUDO_DEBUG_DEBUG,
+	    "%s: fd %d ready, events %d, activating %p",
+	    __func__, ev->fd, what, ev);
+	ev->revents = what;
+	if (ev == &base->signal_event) {
+	    TAILQ_INSERT_HEAD(&base->active, ev, active_entries);
+	    SET(ev->flags, SUDO_EVQ_ACTIVE);
+	} else {
+	    sudo_ev_activate(base, ev);
+	}
+	nactive++;
+    }
+    debug_return_int(nactive);
+}
+
+int
+sudo_ev_scan_impl(struct sudo_event_base *base, int flags)
+{
+    struct timespec now, ts, *timeout;
+    struct sudo_event *ev;
+    int i, nready, nstale = 0, timeout_ms;
+    debug_decl(sudo_ev_scan_impl, SUDO_DEBUG_EVENT);
+
+    if (sudo_ev_epoll_check_fork(base) != 0)
+	debug_return_int(-1);
+
+    if ((ev = sudo_ev_first_timeout(base)) != NULL) {
+	sudo_gettime_mono(&now);
+	sudo_timespecsub(&ev->timeout, &now, &ts);
+	if (ts.tv_sec < 0)
+	    sudo_timespecclear(&ts);
+	timeout = &ts;
+    } else {
+	if (ISSET(flags, SUDO_EVLOOP_NONBLOCK)) {
+	    sudo_timespecclear(&ts);
+	    timeout = &ts;
+	} else {
+	    timeout = NULL;
+	}
+    }
+    if (base->ep_always != 0) {
+	/* Don't block if there are descriptors that are always ready. */
+	sudo_timespecclear(&ts);
+	timeout = &ts;
+    }
+
+    /* Round up to the next millisecond so we don't wake up early. */
+    if (timeout != NULL) {
+	if (timeout->tv_sec > (INT_MAX / 1000) - 1) {
+	    timeout_ms = INT_MAX;
+	} else {
+	    timeout_ms = (timeout->tv_sec * 1000) +
+		((timeout->tv_nsec + 999999) / 1000000);
+	}
+    } else {
+	timeout_ms = -1;
+    }
+
+    nready = epoll_wait(base->epfd, base->epevents, base->epevent_max,
+	timeout_ms);
+    sudo_debug_printf(SUDO_DEBUG_INFO, "%s: %d fds ready", __func__, nready);
+    if (nready == -1) {
+	/* Error or interrupted by signal. */
+	debug_return_int(-1);
+    }
+
+    /* Activate only the I/O events that fired. */
+    for (i = 0; i < nready; i++) {
+	const int fd = base->epevents[i].data.fd;
+
+	if (fd < 0 || fd >= base->epfd_max) {
+	    sudo_debug_printf(SUDO_DEBUG_WARN|SUDO_DEBUG_LINENO,
+		"%s: ignoring event for unknown fd %d", __func__, fd);
+	    nstale++;
+	    continue;
+	}
+	if (base->epfds[fd].mask == 0) {
+	    /* Registration outlived close(2), see sudo_ev_epoll_ctl(). */
+	    nstale++;
+	    continue;
+	}
+	sudo_ev_epoll_activate(base, &base->epfds[fd],
+	    base->epevents[i].events);
+    }
+
+    /* We can't remove a stale registration by fd, start over. */
+    if (nstale != 0) {
+	sudo_debug_printf(SUDO_DEBUG_INFO,
+	    "%s: %d stale epoll registrations", __func__, nstale);
+	(void)sudo_ev_epoll_reopen(base);
+    }
+
+    /* If the ready array was filled, grow it for next time. */
+    if (nready == base->epevent_max) {
+	struct epoll_event *epevents;
+
+	epevents = reallocarray(base->epevents, base->epevent_max,
+	    2 * sizeof(struct epoll_event));
+	if (epevents != NULL) {
+	    base->epevents = epevents;
+	    base->epevent_max *= 2;
+	}
+    }
+
+    /* Events for fds epoll cannot watch are always active. */
+    if (base->ep_always != 0) {
+	for (i = 0; i < base->epfd_max; i++) {
+	    if (base->epfds[i].always) {
+		nready += sudo_ev_epoll_activate(base, &base->epfds[i],
+		    EPOLLIN|EPOLLOUT);
+	    }
+	}
+    }
+
+    debug_return_int(nready);
+}
@@ -58,6 +58,19 @@ print_indent(FILE *fp, int indent)
 	putc(' ', fp);
 }
 
+/*
+ * Start a new line at the current indentation level.
+ * In minimal mode everything is printed on a single line.
+ */
+static void
+print_newline(struct json_container *json)
+{
+    if (!json->minimal) {
+	putc('\n', json->fp);
+	print_indent(json->fp, json->indent_level);
+    }
+}
+
 /*
  * Print a quoted JSON string, escaping special characters.
  * Does not support unicode escapes.
@@ -101,7 +114,8 @@ json_print_string(struct json_container *json, const char *str)
 }
 
 bool
-sudo_json_init_v1(struct json_container *json, FILE *fp, int indent)
+sudo_json_init_v2(struct json_container *json, FILE *fp, int indent,
+    bool minimal)
 {
     debug_decl(sudo_json_init, SUDO_DEBUG_UTIL);
 
@@ -109,10 +123,17 @@ sudo_json_init_v1(struct json_container *json, FILE *fp, int indent)
     json->fp = fp;
     json->indent_level = indent;
     json->indent_increment = indent;
+    json->minimal = minimal;
 
     debug_return_bool(true);
 }
 
+bool
+sudo_json_init_v1(struct json_container *json, FILE *fp, int indent)
+{
+    return sudo_json_init_v2(json, fp, indent, false);
+}
+
 bool
 sudo_json_open_object_v1(struct json_container *json, const char *name)
 {
@@ -121,9 +142,7 @@ sudo_json_open_object_v1(struct json_container *json, const char *name)
     /* Add comma if we are continuing an object/array. */
     if (json->need_comma)
 	putc(',', json->fp);
-    putc('\n', json->fp);
-
-    print_indent(json->fp, json->indent_level);
+    print_newline(json);
 
     if (name != NULL) {
 	json_print_string(json, name);
@@ -144,8 +163,7 @@ sudo_json_close_object_v1(struct json_container *json)
     debug_decl(sudo_json_close_object, SUDO_DEBUG_UTIL);
 
     json->indent_level -= json->indent_increment;
-    putc('\n', json->fp);
-    print_indent(json->fp, json->indent_level);
+    print_newline(json);
     putc('}', json->fp);
 
     debug_return_bool(true);
@@ -159,9 +177,7 @@ sudo_json_open_array_v1(struct json_container *json, const char *name)
     /* Add comma if we are continuing an object/array. */
     if (json->need_comma)
 	putc(',', json->fp);
-    putc('\n', json->fp);
-
-    print_indent(json->fp, json->indent_level);
+    print_newline(json);
 
     json_print_string(json, name);
     putc(':', json->fp);
@@ -180,8 +196,7 @@ sudo_json_close_array_v1(struct json_container *json)
     debug_decl(sudo_json_close_array, SUDO_DEBUG_UTIL);
 
     json->indent_level -= json->indent_increment;
-    putc('\n', json->fp);
-    print_indent(json->fp, json->indent_level);
+    print_newline(json);
     putc(']', json->fp);
 
     debug_return_bool(true);
@@ -197,10 +212,8 @@ sudo_json_add_value_int(struct json_container *json, const char *name,
     /* Add comma if we are continuing an object/array. */
     if (json->need_comma)
 	putc(',', json->fp);
-    putc('\n', json->fp);
     json->need_comma = true;
-
-    print_indent(json->fp, json->indent_level);
+    print_newline(json);
 
     if (as_object) {
 	putc('{', json->fp);
@@ -242,19 +255,17 @@ sudo_json_add_value_int(struct json_container *json, const char *name,
 	    putc(']', json->fp);
 	} else  {
 	    putc('[', json->fp);
-	    putc('\n', json->fp);
 	    json->indent_level += json->indent_increment;
 	    for (i = 0; value->u.array[i] != NULL; i++) {
-		print_indent(json->fp, json->indent_level);
+		print_newline(json);
 		json_print_string(json, value->u.array[i]);
 		if (value->u.array[i + 1] != NULL) {
 		    putc(',', json->fp);
 		    putc(' ', json->fp);
 		}
-		putc('\n', json->fp);
 	    }
 	    json->indent_level -= json->indent_increment;
-	    print_indent(json->fp, json->indent_level);
+	    print_newline(json);
 	    putc(']', json->fp);
 	}
 	break;
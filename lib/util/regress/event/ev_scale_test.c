@@ -0,0 +1,262 @@
+/*
+ * SPDX-License-Identifier: ISC
+ *
+ * Copyright (c) 2020 Todd C. Miller <Todd.Miller@sudo.ws>
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include <config.h>
+
+#include <sys/types.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <stdio.h>
+#include <stdlib.h>
+#ifdef HAVE_STRING_H
+# include <string.h>
+#endif /* HAVE_STRING_H */
+#ifdef HAVE_STRINGS_H
+# include <strings.h>
+#endif /* HAVE_STRINGS_H */
+#ifdef HAVE_STDBOOL_H
+# include <stdbool.h>
+#else
+# include "compat/stdbool.h"
+#endif
+#include <time.h>
+#include <unistd.h>
+
+#include "sudo_compat.h"
+#include "sudo_fatal.h"
+#include "sudo_util.h"
+#include "sudo_event.h"
+
+__dso_public int main(int argc, char *argv[]);
+
+/*
+ * Drive the event loop with a large number of idle descriptors and
+ * a few busy ones.  Only the busy events should fire each iteration.
+ * With -v, the per-iteration cost is displayed; run it against builds
+ * configured with and without --disable-epoll to compare backends.
+ */
+
+#define NIDLE		10000
+#define NHOT		4
+#define NITERATIONS	1000
+
+#if defined(HAVE_EPOLL)
+# define BACKEND	"epoll"
+#elif defined(HAVE_POLL) || defined(HAVE_PPOLL)
+# define BACKEND	"poll"
+#else
+# define BACKEND	"select"
+#endif
+
+static int nidle_fired, nhot_fired;
+
+static void
+idle_cb(int fd, int what, void *v)
+{
+    nidle_fired++;
+}
+
+static void
+hot_cb(int fd, int what, void *v)
+{
+    char ch;
+
+    if (read(fd, &ch, 1) == 1)
+	nhot_fired++;
+}
+
+/*
+ * Raise the open file limit as far as we can and return the
+ * number of descriptors available for idle socket pairs.
+ */
+static int
+max_idle_fds(void)
+{
+    struct rlimit rl;
+    int nfds = NIDLE;
+
+    if (getrlimit(RLIMIT_NOFILE, &rl) == 0) {
+	if (rl.rlim_cur < rl.rlim_max) {
+	    rl.rlim_cur = rl.rlim_max;
+	    (void)setrlimit(RLIMIT_NOFILE, &rl);
+	    (void)getrlimit(RLIMIT_NOFILE, &rl);
+	}
+	/* Leave room for stdio, the hot sockets and the backend. */
+	if (rl.rlim_cur != RLIM_INFINITY && rl.rlim_cur < NIDLE + 64)
+	    nfds = (int)rl.rlim_cur - 64;
+    }
+    return nfds & ~1;
+}
+
+int
+main(int argc, char *argv[])
+{
+    struct sudo_event_base *base;
+    struct sudo_event **idle_evs, *hot_evs[NHOT];
+    struct timespec start, stop, elapsed;
+    int hot_sv[NHOT][2], *idle_fds;
+    int ch, i, nidle, errors = 0, ntests = 0;
+    bool verbose = false;
+
+    initprogname(argc > 0 ? argv[0] : "ev_scale_test");
+
+    while ((ch = getopt(argc, argv, "v")) != -1) {
+	switch (ch) {
+	case 'v':
+	    verbose = true;
+	    break;
+	default:
+	    fprintf(stderr, "usage: %s [-v]\n", getprogname());
+	    return EXIT_FAILURE;
+	}
+    }
+
+    if ((base = sudo_ev_base_alloc()) == NULL)
+	sudo_fatalx_nodebug("unable to allocate event base");
+
+    /* Idle socket pairs, both ends are watched for reading. */
+    nidle = max_idle_fds();
+    idle_fds = reallocarray(NULL, nidle, sizeof(int));
+    idle_evs = reallocarray(NULL, nidle, sizeof(struct sudo_event *));
+    if (idle_fds == NULL || idle_evs == NULL)
+	sudo_fatalx_nodebug("unable to allocate memory");
+    for (i = 0; i < nidle; i += 2) {
+	if (socketpair(AF_UNIX, SOCK_STREAM, 0, idle_fds + i) == -1)
+	    sudo_fatal_nodebug("socketpair");
+    }
+    for (i = 0; i < nidle; i++) {
+	idle_evs[i] = sudo_ev_alloc(idle_fds[i], SUDO_EV_READ|SUDO_EV_PERSIST,
+	    idle_cb, NULL);
+	if (idle_evs[i] == NULL)
+	    sudo_fatalx_nodebug("unable to allocate event");
+	if (sudo_ev_add(base, idle_evs[i], NULL, false) == -1)
+	    sudo_fatalx_nodebug("unable to add event to queue");
+    }
+
+    /* Hot socket pairs, the read end is watched. */
+    for (i = 0; i < NHOT; i++) {
+	if (socketpair(AF_UNIX, SOCK_STREAM, 0, hot_sv[i]) == -1)
+	    sudo_fatal_nodebug("socketpair");
+	hot_evs[i] = sudo_ev_alloc(hot_sv[i][0], SUDO_EV_READ|SUDO_EV_PERSIST,
+	    hot_cb, NULL);
+	if (hot_evs[i] == NULL)
+	    sudo_fatalx_nodebug("unable to allocate event");
+	if (sudo_ev_add(base, hot_evs[i], NULL, false) == -1)
+	    sudo_fatalx_nodebug("unable to add event to queue");
+    }
+
+    sudo_gettime_mono(&start);
+    for (i = 0; i < NITERATIONS; i++) {
+	int j;
+
+	for (j = 0; j < NHOT; j++) {
+	    if (write(hot_sv[j][1], "x", 1) != 1)
+		sudo_fatal_nodebug("write");
+	}
+	nhot_fired = nidle_fired = 0;
+	ntests++;
+	if (sudo_ev_loop(base, SUDO_EVLOOP_ONCE) != 0) {
+	    sudo_warnx_nodebug("iteration %d: event loop error", i);
+	    errors++;
+	    break;
+	}
+	if (nhot_fired != NHOT || nidle_fired != 0) {
+	    sudo_warnx_nodebug("iteration %d: expected %d hot and 0 idle "
+		"events, got %d hot and %d idle", i, NHOT, nhot_fired,
+		nidle_fired);
+	    errors++;
+	}
+    }
+    sudo_gettime_mono(&stop);
+
+    /* Removing the hot events must leave only idle events. */
+    for (i = 0; i < NHOT; i++) {
+	sudo_ev_free(hot_evs[i]);
+	if (write(hot_sv[i][1], "x", 1) != 1)
+	    sudo_fatal_nodebug("write");
+    }
+    nhot_fired = nidle_fired = 0;
+    ntests++;
+    if (sudo_ev_loop(base, SUDO_EVLOOP_NONBLOCK|SUDO_EVLOOP_ONCE) != 0 ||
+	    nhot_fired != 0 || nidle_fired != 0) {
+	sudo_warnx_nodebug("deleted events fired: %d hot, %d idle",
+	    nhot_fired, nidle_fired);
+	errors++;
+    }
+
+    /*
+     * Deleting an event in a child process must not affect the parent.
+     * The epoll instance is shared across fork() unless it is replaced.
+     */
+    for (i = 0; i < NHOT; i++) {
+	hot_evs[i] = sudo_ev_alloc(hot_sv[i][0], SUDO_EV_READ|SUDO_EV_PERSIST,
+	    hot_cb, NULL);
+	if (hot_evs[i] == NULL)
+	    sudo_fatalx_nodebug("unable to allocate event");
+	if (sudo_ev_add(base, hot_evs[i], NULL, false) == -1)
+	    sudo_fatalx_nodebug("unable to add event to queue");
+    }
+    switch (fork()) {
+    case -1:
+	sudo_fatal_nodebug("fork");
+    case 0:
+	for (i = 0; i < NHOT; i++)
+	    sudo_ev_del(base, hot_evs[i]);
+	_exit(0);
+    default:
+	(void)wait(NULL);
+	break;
+    }
+    nhot_fired = nidle_fired = 0;
+    ntests++;
+    if (sudo_ev_loop(base, SUDO_EVLOOP_NONBLOCK|SUDO_EVLOOP_ONCE) != 0 ||
+	    nhot_fired != NHOT || nidle_fired != 0) {
+	sudo_warnx_nodebug("after fork: expected %d hot and 0 idle "
+	    "events, got %d hot and %d idle", NHOT, nhot_fired, nidle_fired);
+	errors++;
+    }
+    for (i = 0; i < NHOT; i++)
+	sudo_ev_free(hot_evs[i]);
+
+    if (verbose) {
+	sudo_timespecsub(&stop, &start, &elapsed);
+	printf("%s: %s backend, %d idle fds, %d busy fds, %.2f usec/iteration\n",
+	    getprogname(), BACKEND, nidle, NHOT,
+	    (elapsed.tv_sec * 1000000.0 + elapsed.tv_nsec / 1000.0) /
+	    NITERATIONS);
+    }
+
+    for (i = 0; i < nidle; i++) {
+	sudo_ev_free(idle_evs[i]);
+	close(idle_fds[i]);
+    }
+    for (i = 0; i < NHOT; i++) {
+	close(hot_sv[i][0]);
+	close(hot_sv[i][1]);
+    }
+    free(idle_evs);
+    free(idle_fds);
+    sudo_ev_base_free(base);
+
+    if (ntests != 0) {
+	printf("%s: %d tests run, %d errors, %d%% success rate\n",
+	    getprogname(), ntests, errors, (ntests - errors) * 100 / ntests);
+    }
+    exit(errors);
+}
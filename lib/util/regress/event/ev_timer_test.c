@@ -0,0 +1,225 @@
+/*
+ * SPDX-License-Identifier: ISC
+ *
+ * Copyright (c) 2020 Todd C. Miller <Todd.Miller@sudo.ws>
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include <config.h>
+
+#include <sys/types.h>
+#include <stdio.h>
+#include <stdlib.h>
+#ifdef HAVE_STRING_H
+# include <string.h>
+#endif /* HAVE_STRING_H */
+#ifdef HAVE_STRINGS_H
+# include <strings.h>
+#endif /* HAVE_STRINGS_H */
+#ifdef HAVE_STDBOOL_H
+# include <stdbool.h>
+#else
+# include "compat/stdbool.h"
+#endif
+#include <time.h>
+#include <unistd.h>
+
+#include "sudo_compat.h"
+#include "sudo_fatal.h"
+#include "sudo_util.h"
+#include "sudo_event.h"
+
+__dso_public int main(int argc, char *argv[]);
+
+/*
+ * Verify that timeout events fire in expiration order, including events
+ * that are re-armed or cancelled, then arm and cancel a large number of
+ * timers.  With -v, the cost of arming and cancelling is displayed.
+ */
+
+#define NORDERED	1000
+#define NTIMERS		1000000
+
+struct timer_closure {
+    struct sudo_event *ev;
+    bool cancelled;
+};
+
+static struct timespec last_timeout;
+static int nfired, nout_of_order, ncancelled_fired;
+
+/*
+ * Timers must fire in order of their absolute expiration time.
+ */
+static void
+timer_cb(int fd, int what, void *v)
+{
+    struct timer_closure *tc = v;
+
+    if (tc->cancelled)
+	ncancelled_fired++;
+    if (sudo_timespeccmp(&tc->ev->timeout, &last_timeout, <))
+	nout_of_order++;
+    last_timeout = tc->ev->timeout;
+    nfired++;
+}
+
+static double
+elapsed_usec(struct timespec *start, struct timespec *stop)
+{
+    struct timespec elapsed;
+
+    sudo_timespecsub(stop, start, &elapsed);
+    return elapsed.tv_sec * 1000000.0 + elapsed.tv_nsec / 1000.0;
+}
+
+int
+main(int argc, char *argv[])
+{
+    struct sudo_event_base *base;
+    struct sudo_event **evs;
+    struct timer_closure *closures;
+    struct timespec timo, start, armed, stop;
+    int ch, i, ntimers = NTIMERS, errors = 0, ntests = 0;
+    bool verbose = false;
+
+    initprogname(argc > 0 ? argv[0] : "ev_timer_test");
+
+    while ((ch = getopt(argc, argv, "n:v")) != -1) {
+	switch (ch) {
+	case 'n':
+	    ntimers = atoi(optarg);
+	    if (ntimers < NORDERED) {
+		fprintf(stderr, "%s: timer count must be at least %d\n",
+		    getprogname(), NORDERED);
+		return EXIT_FAILURE;
+	    }
+	    break;
+	case 'v':
+	    verbose = true;
+	    break;
+	default:
+	    fprintf(stderr, "usage: %s [-v] [-n count]\n", getprogname());
+	    return EXIT_FAILURE;
+	}
+    }
+
+    if ((base = sudo_ev_base_alloc()) == NULL)
+	sudo_fatalx_nodebug("unable to allocate event base");
+    evs = reallocarray(NULL, ntimers, sizeof(struct sudo_event *));
+    closures = calloc(ntimers, sizeof(struct timer_closure));
+    if (evs == NULL || closures == NULL)
+	sudo_fatalx_nodebug("unable to allocate memory");
+    for (i = 0; i < ntimers; i++) {
+	evs[i] = sudo_ev_alloc(-1, SUDO_EV_TIMEOUT, timer_cb, &closures[i]);
+	if (evs[i] == NULL)
+	    sudo_fatalx_nodebug("unable to allocate event");
+	closures[i].ev = evs[i];
+    }
+
+    /*
+     * Arm timers in a scrambled order, re-arm every third one with
+     * a new timeout (which may be earlier or later) and cancel every
+     * fifth one.
+     */
+    for (i = 0; i < NORDERED; i++) {
+	const int n = (i * 7919) % NORDERED;
+
+	timo.tv_sec = 0;
+	timo.tv_nsec = n * 10000;
+	if (sudo_ev_add(base, evs[n], &timo, false) == -1)
+	    sudo_fatalx_nodebug("unable to add event to queue");
+    }
+    for (i = 0; i < NORDERED; i += 3) {
+	timo.tv_sec = 0;
+	timo.tv_nsec = (NORDERED - i) * 10000;
+	if (sudo_ev_add(base, evs[i], &timo, false) == -1)
+	    sudo_fatalx_nodebug("unable to add event to queue");
+    }
+    for (i = 0; i < NORDERED; i += 5) {
+	closures[i].cancelled = true;
+	if (sudo_ev_del(base, evs[i]) == -1)
+	    sudo_fatalx_nodebug("unable to delete event from queue");
+    }
+    ntests++;
+    if (sudo_ev_dispatch(base) != 1) {
+	sudo_warnx_nodebug("event loop error");
+	errors++;
+    }
+    ntests++;
+    if (nfired != NORDERED - (NORDERED / 5)) {
+	sudo_warnx_nodebug("expected %d timers to fire, got %d",
+	    NORDERED - (NORDERED / 5), nfired);
+	errors++;
+    }
+    ntests++;
+    if (ncancelled_fired != 0) {
+	sudo_warnx_nodebug("%d cancelled timers fired", ncancelled_fired);
+	errors++;
+    }
+    ntests++;
+    if (nout_of_order != 0) {
+	sudo_warnx_nodebug("%d timers fired out of order",
+	    nout_of_order);
+	errors++;
+    }
+
+    /*
+     * Arm all the timers with distinct timeouts far in the future,
+     * then cancel them in a different order than they were armed.
+     */
+    nfired = 0;
+    sudo_gettime_mono(&start);
+    for (i = 0; i < ntimers; i++) {
+	const int n = (int)(((long long)i * 7919) % ntimers);
+
+	timo.tv_sec = 3600 + n / 1000;
+	timo.tv_nsec = (n % 1000) * 1000;
+	if (sudo_ev_add(base, evs[i], &timo, false) == -1)
+	    sudo_fatalx_nodebug("unable to add event to queue");
+    }
+    sudo_gettime_mono(&armed);
+    for (i = 0; i < ntimers; i++) {
+	const int n = (i & 1) ? i / 2 : ntimers - 1 - i / 2;
+
+	if (sudo_ev_del(base, evs[n]) == -1)
+	    sudo_fatalx_nodebug("unable to delete event from queue");
+    }
+    sudo_gettime_mono(&stop);
+
+    /* Nothing should be left to run. */
+    ntests++;
+    if (sudo_ev_loop(base, SUDO_EVLOOP_NONBLOCK) != 1 || nfired != 0) {
+	sudo_warnx_nodebug("cancelled timers still pending");
+	errors++;
+    }
+
+    if (verbose) {
+	printf("%s: %d timers, %.3f usec/arm, %.3f usec/cancel\n",
+	    getprogname(), ntimers, elapsed_usec(&start, &armed) / ntimers,
+	    elapsed_usec(&armed, &stop) / ntimers);
+    }
+
+    for (i = 0; i < ntimers; i++)
+	sudo_ev_free(evs[i]);
+    free(closures);
+    free(evs);
+    sudo_ev_base_free(base);
+
+    if (ntests != 0) {
+	printf("%s: %d tests run, %d errors, %d%% success rate\n",
+	    getprogname(), ntests, errors, (ntests - errors) * 100 / ntests);
+    }
+    exit(errors);
+}
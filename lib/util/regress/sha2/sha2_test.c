@@ -0,0 +1,310 @@
+/*
+ * SPDX-License-Identifier: ISC
+ *
+ * Copyright (c) 2020 Todd C. Miller <Todd.Miller@sudo.ws>
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include <config.h>
+
+#include <sys/types.h>
+#include <stdio.h>
+#include <stdlib.h>
+#ifdef HAVE_STRING_H
+# include <string.h>
+#endif /* HAVE_STRING_H */
+#ifdef HAVE_STRINGS_H
+# include <strings.h>
+#endif /* HAVE_STRINGS_H */
+#if defined(HAVE_STDINT_H)
+# include <stdint.h>
+#elif defined(HAVE_INTTYPES_H)
+# include <inttypes.h>
+#endif
+#ifdef HAVE_STDBOOL_H
+# include <stdbool.h>
+#else
+# include "compat/stdbool.h"
+#endif
+#include <time.h>
+#include <unistd.h>
+
+#include "sudo_compat.h"
+#include "sudo_fatal.h"
+#include "sudo_util.h"
+#include "compat/sha2.h"
+
+__dso_public int main(int argc, char *argv[]);
+
+/*
+ * Test the bundled SHA-2 implementation.  Known answers are checked
+ * for all digest types and SHA224Update() and SHA256Update(), which
+ * may use CPU-specific code, are compared against a reference built
+ * on the portable SHA256Transform() for many lengths and chunk sizes.
+ * With -b, the throughput of each digest type is also reported.
+ */
+
+#define BENCH_SIZE	(64 * 1024 * 1024)
+
+struct sha2_vector {
+    const char *name;
+    const char *input;
+    size_t repeat;
+    const char *output;
+};
+
+static const char two_block[] =
+    "abcdefghbcdefghicdefghijdefghijkefghijklfghijklmghijklmn"
+    "hijklmnoijklmnopjklmnopqklmnopqrlmnopqrsmnopqrstnopqrstu";
+
+static struct sha2_vector test_vectors[] = {
+    { "sha224", "a", 1000000,
+	"20794655980c91d8bbb4c1ea97618a4bf03f42581948b2ee4ee7ad67" },
+    { "sha256", "a", 1000000,
+	"cdc76e5c9914fb9281a1c7e284d73e67f1809a48a497200e046d39ccc7112cd0" },
+    { "sha384", "a", 1000000,
+	"9d0e1809716474cb086e834e310a4a1ced149e9c00f248527972cec5704c2a5b"
+	"07b8b3dc38ecc4ebae97ddd87f3d8985" },
+    { "sha512", "a", 1000000,
+	"e718483d0ce769644e2e42c7bc15b4638e1f98b13b2044285632a803afa973eb"
+	"de0ff244877ea60a4cb0432ce577c31beb009c5c2c49aa2e4eadb217ad8cc09b" },
+    { "sha224", two_block, 1,
+	"c97ca9a559850ce97a04a96def6d99a9e0e0e2ab14e6b8df265fc0b3" },
+    { "sha256", two_block, 1,
+	"cf5b16a778af8380036ce59e7b0492370b249b11e8f07a51afac45037afee9d1" },
+    { "sha384", two_block, 1,
+	"09330c33f71147e83d192fc782cd1b4753111b173b3b05d22fa08086e3b0f712"
+	"fcc7c71a557e2db966c3e9fa91746039" },
+    { "sha512", two_block, 1,
+	"8e959b75dae313da8cf4f72814fc143f8f7779c6eb9f7fa17299aeadb6889018"
+	"501d289e4900f7e4331b99dec4b5433ac7d329eeb6dd26545e96e55b874be909" },
+    { NULL }
+};
+
+static struct sha2_func {
+    const char *name;
+    size_t digest_len;
+    void (*init)(SHA2_CTX *);
+    void (*update)(SHA2_CTX *, const uint8_t *, size_t);
+    void (*final)(uint8_t *, SHA2_CTX *);
+} sha2_funcs[] = {
+    { "sha224", SHA224_DIGEST_LENGTH, SHA224Init, SHA224Update, SHA224Final },
+    { "sha256", SHA256_DIGEST_LENGTH, SHA256Init, SHA256Update, SHA256Final },
+    { "sha384", SHA384_DIGEST_LENGTH, SHA384Init, SHA384Update, SHA384Final },
+    { "sha512", SHA512_DIGEST_LENGTH, SHA512Init, SHA512Update, SHA512Final },
+    { NULL }
+};
+
+static struct sha2_func *
+find_func(const char *name)
+{
+    struct sha2_func *func;
+
+    for (func = sha2_funcs; func->name != NULL; func++) {
+	if (strcmp(func->name, name) == 0)
+	    return func;
+    }
+    sudo_fatalx_nodebug("unknown digest %s", name);
+}
+
+static void
+to_hex(char *dst, const unsigned char *digest, size_t len)
+{
+    static const char hex[] = "0123456789abcdef";
+    size_t i;
+
+    for (i = 0; i < len; i++) {
+	dst[i * 2] = hex[digest[i] >> 4];
+	dst[i * 2 + 1] = hex[digest[i] & 0x0f];
+    }
+    dst[len * 2] = '\0';
+}
+
+/*
+ * Compute a SHA-224 or SHA-256 digest one block at a time using
+ * the portable SHA256Transform() and our own padding.
+ */
+static void
+reference_sha256(struct sha2_func *func, const uint8_t *data, size_t len,
+    uint8_t *digest)
+{
+    uint8_t block[SHA256_BLOCK_LENGTH * 2];
+    const uint64_t nbits = (uint64_t)len << 3;
+    size_t i, tail, padlen;
+    SHA2_CTX ctx;
+
+    func->init(&ctx);
+    for (i = 0; i + SHA256_BLOCK_LENGTH <= len; i += SHA256_BLOCK_LENGTH)
+	SHA256Transform(ctx.state.st32, data + i);
+    tail = len - i;
+    padlen = tail + 9 <= SHA256_BLOCK_LENGTH ?
+	SHA256_BLOCK_LENGTH : SHA256_BLOCK_LENGTH * 2;
+    memset(block, 0, sizeof(block));
+    memcpy(block, data + i, tail);
+    block[tail] = 0x80;
+    for (i = 0; i < 8; i++)
+	block[padlen - 1 - i] = (uint8_t)(nbits >> (i * 8));
+    for (i = 0; i < padlen; i += SHA256_BLOCK_LENGTH)
+	SHA256Transform(ctx.state.st32, block + i);
+    for (i = 0; i < func->digest_len; i++)
+	digest[i] = (uint8_t)(ctx.state.st32[i / 4] >> (24 - (i % 4) * 8));
+}
+
+static int
+check_vectors(int *ntests)
+{
+    unsigned char digest[SHA512_DIGEST_LENGTH];
+    char hex[SHA512_DIGEST_STRING_LENGTH];
+    struct sha2_vector *vec;
+    struct sha2_func *func;
+    SHA2_CTX ctx;
+    int errors = 0;
+    size_t i, len;
+
+    for (vec = test_vectors; vec->name != NULL; vec++) {
+	(*ntests)++;
+	func = find_func(vec->name);
+	func->init(&ctx);
+	len = strlen(vec->input);
+	for (i = 0; i < vec->repeat; i++)
+	    func->update(&ctx, (const uint8_t *)vec->input, len);
+	func->final(digest, &ctx);
+	to_hex(hex, digest, func->digest_len);
+	if (strcmp(hex, vec->output) != 0) {
+	    sudo_warnx_nodebug("%s: expected %s, got %s", vec->name,
+		vec->output, hex);
+	    errors++;
+	}
+    }
+    return errors;
+}
+
+/*
+ * Compare SHA224Update() and SHA256Update() with the reference for
+ * every length up to 1024 bytes, fed in chunks of various sizes.
+ */
+static int
+check_reference(int *ntests)
+{
+    static const size_t chunks[] = { 1, 7, 63, 64, 65, 200, 1024 };
+    unsigned char expected[SHA256_DIGEST_LENGTH];
+    unsigned char digest[SHA256_DIGEST_LENGTH];
+    char hex1[SHA256_DIGEST_STRING_LENGTH], hex2[SHA256_DIGEST_STRING_LENGTH];
+    const char *names[] = { "sha224", "sha256" };
+    struct sha2_func *func;
+    uint8_t data[1024];
+    size_t i, len, off, n;
+    SHA2_CTX ctx;
+    int errors = 0;
+    unsigned int j;
+
+    for (i = 0; i < sizeof(data); i++)
+	data[i] = (uint8_t)((i * 131) ^ (i >> 3));
+
+    for (j = 0; j < nitems(names); j++) {
+	func = find_func(names[j]);
+	for (len = 0; len <= sizeof(data); len++) {
+	    reference_sha256(func, data, len, expected);
+	    for (i = 0; i < nitems(chunks); i++) {
+		(*ntests)++;
+		func->init(&ctx);
+		for (off = 0; off < len; off += n) {
+		    n = MIN(chunks[i], len - off);
+		    func->update(&ctx, data + off, n);
+		}
+		func->final(digest, &ctx);
+		if (memcmp(digest, expected, func->digest_len) != 0) {
+		    to_hex(hex1, expected, func->digest_len);
+		    to_hex(hex2, digest, func->digest_len);
+		    sudo_warnx_nodebug("%s: length %zu, chunk %zu: "
+			"expected %s, got %s", func->name, len, chunks[i],
+			hex1, hex2);
+		    errors++;
+		}
+	    }
+	}
+    }
+    return errors;
+}
+
+static void
+benchmark(void)
+{
+    unsigned char digest[SHA512_DIGEST_LENGTH];
+    struct timespec start, stop;
+    struct sha2_func *func;
+    uint8_t *data;
+    SHA2_CTX ctx;
+    double secs;
+    size_t i;
+
+    if ((data = malloc(BENCH_SIZE)) == NULL)
+	sudo_fatalx_nodebug("unable to allocate memory");
+    for (i = 0; i < BENCH_SIZE; i++)
+	data[i] = (uint8_t)i;
+
+    for (func = sha2_funcs; func->name != NULL; func++) {
+	sudo_gettime_mono(&start);
+	func->init(&ctx);
+	func->update(&ctx, data, BENCH_SIZE);
+	func->final(digest, &ctx);
+	sudo_gettime_mono(&stop);
+	sudo_timespecsub(&stop, &start, &stop);
+	secs = stop.tv_sec + stop.tv_nsec / 1000000000.0;
+	printf("%s: %.1f MB/s\n", func->name,
+	    secs > 0 ? BENCH_SIZE / secs / (1024 * 1024) : 0.0);
+    }
+
+    /* The portable transform, for comparison. */
+    func = find_func("sha256");
+    sudo_gettime_mono(&start);
+    reference_sha256(func, data, BENCH_SIZE, digest);
+    sudo_gettime_mono(&stop);
+    sudo_timespecsub(&stop, &start, &stop);
+    secs = stop.tv_sec + stop.tv_nsec / 1000000000.0;
+    printf("sha256 (portable): %.1f MB/s\n",
+	secs > 0 ? BENCH_SIZE / secs / (1024 * 1024) : 0.0);
+
+    free(data);
+}
+
+int
+main(int argc, char *argv[])
+{
+    int ch, errors = 0, ntests = 0;
+    bool bench = false;
+
+    initprogname(argc > 0 ? argv[0] : "sha2_test");
+
+    while ((ch = getopt(argc, argv, "b")) != -1) {
+	switch (ch) {
+	case 'b':
+	    bench = true;
+	    break;
+	default:
+	    fprintf(stderr, "usage: %s [-b]\n", getprogname());
+	    return EXIT_FAILURE;
+	}
+    }
+
+    errors += check_vectors(&ntests);
+    errors += check_reference(&ntests);
+    if (ntests != 0) {
+	printf("%s: %d tests run, %d errors, %d%% success rate\n",
+	    getprogname(), ntests, errors, (ntests - errors) * 100 / ntests);
+    }
+    if (bench)
+	benchmark();
+    exit(errors);
+}
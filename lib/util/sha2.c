@@ -59,6 +59,19 @@
 #include "sudo_compat.h"
 #include "compat/sha2.h"
 
+/*
+ * On x86 we can use the SHA extensions (SHA-NI) for SHA-224 and SHA-256
+ * when the CPU supports them.  The compiler must support the "target"
+ * function attribute so the rest of the file is built for the baseline.
+ */
+#if (defined(__x86_64__) || defined(__i386__)) && \
+    ((defined(__GNUC__) && __GNUC__ >= 5) || \
+    (defined(__clang__) && __clang_major__ >= 4))
+# define SHA2_X86_SHANI
+# include <cpuid.h>
+# include <immintrin.h>
+#endif
+
 /*
  * SHA-2 operates on 32-bit and 64-bit words in big endian byte order.
  * The following macros convert between character arrays and big endian words.
@@ -256,18 +269,130 @@ SHA256Transform(uint32_t state[8], const uint8_t data[SHA256_BLOCK_LENGTH])
 #undef s1
 #undef R
 
+#ifdef SHA2_X86_SHANI
+/*
+ * Returns 1 if the CPU supports the SHA extensions as well as
+ * the SSSE3 and SSE4.1 instructions used to load and store the state.
+ * The result is cached after the first call.
+ */
+static int
+sha256_have_shani(void)
+{
+	static int have_shani = -1;
+	unsigned int eax, ebx, ecx, edx;
+
+	if (have_shani == -1) {
+		have_shani = 0;
+		if (__get_cpuid(1, &eax, &ebx, &ecx, &edx) &&
+		    (ecx & bit_SSSE3) && (ecx & bit_SSE4_1) &&
+		    __get_cpuid_max(0, NULL) >= 7) {
+			__cpuid_count(7, 0, eax, ebx, ecx, edx);
+			if (ebx & (1U << 29))
+				have_shani = 1;
+		}
+	}
+	return have_shani;
+}
+
+/*
+ * Process nblocks 64-byte blocks using the SHA extensions.
+ * The state is kept in the ABEF/CDGH order used by sha256rnds2
+ * for the whole run and converted back at the end.
+ */
+__attribute__((target("sha,sse4.1,ssse3")))
+static void
+SHA256Blocks_shani(uint32_t state[8], const uint8_t *data, size_t nblocks)
+{
+	const __m128i mask =
+	    _mm_set_epi64x(0x0c0d0e0f08090a0bULL, 0x0405060700010203ULL);
+	__m128i state0, state1, msg, tmp, abef, cdgh;
+	__m128i W[4];
+	unsigned int j;
+
+	/* Load state and convert from ABCD/EFGH to ABEF/CDGH. */
+	tmp = _mm_loadu_si128((const __m128i *)&state[0]);
+	state1 = _mm_loadu_si128((const __m128i *)&state[4]);
+	tmp = _mm_shuffle_epi32(tmp, 0xB1);
+	state1 = _mm_shuffle_epi32(state1, 0x1B);
+	state0 = _mm_alignr_epi8(tmp, state1, 8);
+	state1 = _mm_blend_epi16(state1, tmp, 0xF0);
+
+	while (nblocks--) {
+		abef = state0;
+		cdgh = state1;
+
+		/* 64 rounds, four at a time. */
+		for (j = 0; j < 16; j++) {
+			if (j < 4) {
+				/* Copy data to W in big endian format. */
+				W[j] = _mm_shuffle_epi8(_mm_loadu_si128(
+				    (const __m128i *)(data + (j * 16))), mask);
+			} else {
+				/* Expand the message schedule. */
+				tmp = _mm_alignr_epi8(W[(j - 1) & 3],
+				    W[(j - 2) & 3], 4);
+				msg = _mm_add_epi32(_mm_sha256msg1_epu32(W[j & 3],
+				    W[(j - 3) & 3]), tmp);
+				W[j & 3] = _mm_sha256msg2_epu32(msg,
+				    W[(j - 1) & 3]);
+			}
+			msg = _mm_add_epi32(W[j & 3],
+			    _mm_loadu_si128((const __m128i *)&SHA256_K[j * 4]));
+			state1 = _mm_sha256rnds2_epu32(state1, state0, msg);
+			msg = _mm_shuffle_epi32(msg, 0x0E);
+			state0 = _mm_sha256rnds2_epu32(state0, state1, msg);
+		}
+
+		/* Add the working vars back into the state. */
+		state0 = _mm_add_epi32(state0, abef);
+		state1 = _mm_add_epi32(state1, cdgh);
+		data += SHA256_BLOCK_LENGTH;
+	}
+
+	/* Convert from ABEF/CDGH back to ABCD/EFGH and store. */
+	tmp = _mm_shuffle_epi32(state0, 0x1B);
+	state1 = _mm_shuffle_epi32(state1, 0xB1);
+	state0 = _mm_blend_epi16(tmp, state1, 0xF0);
+	state1 = _mm_alignr_epi8(state1, tmp, 8);
+	_mm_storeu_si128((__m128i *)&state[0], state0);
+	_mm_storeu_si128((__m128i *)&state[4], state1);
+}
+#endif /* SHA2_X86_SHANI */
+
+/*
+ * Process nblocks 64-byte blocks, using the fastest
+ * implementation supported by the CPU.
+ */
+static void
+SHA256Blocks(uint32_t state[8], const uint8_t *data, size_t nblocks)
+{
+#ifdef SHA2_X86_SHANI
+	if (sha256_have_shani()) {
+		SHA256Blocks_shani(state, data, nblocks);
+		return;
+	}
+#endif
+	while (nblocks--) {
+		SHA256Transform(state, data);
+		data += SHA256_BLOCK_LENGTH;
+	}
+}
+
 void
 SHA256Update(SHA2_CTX *ctx, const uint8_t *data, size_t len)
 {
-	size_t i = 0, j;
+	size_t i = 0, j, nblocks;
 
 	j = (size_t)((ctx->count[0] >> 3) & (SHA256_BLOCK_LENGTH - 1));
 	ctx->count[0] += ((uint64_t)len << 3);
 	if ((j + len) > SHA256_BLOCK_LENGTH - 1) {
 		memcpy(&ctx->buffer[j], data, (i = SHA256_BLOCK_LENGTH - j));
-		SHA256Transform(ctx->state.st32, ctx->buffer);
-		for ( ; i + SHA256_BLOCK_LENGTH - 1 < len; i += SHA256_BLOCK_LENGTH)
-			SHA256Transform(ctx->state.st32, (uint8_t *)&data[i]);
+		SHA256Blocks(ctx->state.st32, ctx->buffer, 1);
+		nblocks = (len - i) / SHA256_BLOCK_LENGTH;
+		if (nblocks != 0) {
+			SHA256Blocks(ctx->state.st32, &data[i], nblocks);
+			i += nblocks * SHA256_BLOCK_LENGTH;
+		}
 		j = 0;
 	}
 	memcpy(&ctx->buffer[j], &data[i], len - i);
@@ -499,7 +624,7 @@ SHA512Pad(SHA2_CTX *ctx)
 	SHA512Update(ctx, (uint8_t *)"\200", 1);
 
 	/* Pad message such that the resulting length modulo 1024 is 896. */
-	while ((ctx->count[0] & 1008) != 896)
+	while ((ctx->count[0] & 1016) != 896)
 		SHA512Update(ctx, (uint8_t *)"\0", 1);
 
 	/* Append length of message in bits and do final SHA512Transform(). */
@@ -0,0 +1,454 @@
+/*
+ * SPDX-License-Identifier: ISC
+ *
+ * Copyright (c) 2020 Todd C. Miller <Todd.Miller@sudo.ws>
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include "config.h"
+
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#ifdef HAVE_STDBOOL_H
+# include <stdbool.h>
+#else
+# include "compat/stdbool.h"
+#endif /* HAVE_STDBOOL_H */
+#if defined(HAVE_STDINT_H)
+# include <stdint.h>
+#elif defined(HAVE_INTTYPES_H)
+# include <inttypes.h>
+#endif
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "log_server.pb-c.h"
+#include "sudo_gettext.h"	/* must be included before sudo_compat.h */
+#include "sudo_compat.h"
+#include "sudo_debug.h"
+#include "sudo_util.h"
+#include "sudo_iolog.h"
+#include "logsrvd.h"
+
+/*
+ * Fast paths for decoding a ClientMessage.
+ *
+ * Nearly all the messages a client sends are IoBuffers.  Rather than
+ * have protobuf-c allocate a message tree and copy the I/O data into
+ * it, these are decoded in place and the IoBuffer data points into
+ * the connection's read buffer.  Other messages are unpacked by
+ * protobuf-c using a per-connection arena that is reset after each
+ * message instead of being freed piece by piece.
+ *
+ * IoBuffer data from a client that enabled compression is inflated
+ * into a per-connection buffer before it is written to the I/O log.
+ */
+
+/* Protobuf wire types. */
+#define WIRETYPE_VARINT		0
+#define WIRETYPE_64BIT		1
+#define WIRETYPE_LENGTH		2
+#define WIRETYPE_32BIT		5
+
+/* Arena allocations are aligned to this boundary. */
+#define ARENA_ALIGN		16
+
+/* Don't keep an arena larger than this between messages. */
+#define ARENA_SIZE_MAX		(2 * MESSAGE_SIZE_MAX)
+
+/*
+ * Decode a varint, advancing *cpp past it.
+ * Returns true on success, false if the varint is truncated or too long.
+ */
+static bool
+read_varint(const uint8_t **cpp, const uint8_t *end, uint64_t *valp)
+{
+    const uint8_t *cp = *cpp;
+    uint64_t val = 0;
+    unsigned int shift;
+
+    for (shift = 0; shift < 64 && cp < end; shift += 7) {
+	val |= (uint64_t)(*cp & 0x7f) << shift;
+	if ((*cp++ & 0x80) == 0) {
+	    *cpp = cp;
+	    *valp = val;
+	    return true;
+	}
+    }
+    return false;
+}
+
+/*
+ * Read a length-delimited field, advancing *cpp past it.
+ * Stores the start of the field's contents in datap and its length in lenp.
+ */
+static bool
+read_length_delimited(const uint8_t **cpp, const uint8_t *end,
+    const uint8_t **datap, size_t *lenp)
+{
+    uint64_t len;
+
+    if (!read_varint(cpp, end, &len) || len > (uint64_t)(end - *cpp))
+	return false;
+    *datap = *cpp;
+    *lenp = (size_t)len;
+    *cpp += len;
+    return true;
+}
+
+/*
+ * Skip over the contents of a field of the specified wire type.
+ */
+static bool
+skip_field(const uint8_t **cpp, const uint8_t *end, unsigned int wiretype)
+{
+    const uint8_t *data;
+    uint64_t val;
+    size_t len;
+
+    switch (wiretype) {
+    case WIRETYPE_VARINT:
+	return read_varint(cpp, end, &val);
+    case WIRETYPE_64BIT:
+	len = 8;
+	break;
+    case WIRETYPE_32BIT:
+	len = 4;
+	break;
+    case WIRETYPE_LENGTH:
+	return read_length_delimited(cpp, end, &data, &len);
+    default:
+	/* Groups are not used by proto3. */
+	return false;
+    }
+    if (len > (size_t)(end - *cpp))
+	return false;
+    *cpp += len;
+    return true;
+}
+
+/*
+ * Decode a TimeSpec from buf.
+ */
+static bool
+unpack_timespec(const uint8_t *buf, size_t len, TimeSpec *ts)
+{
+    const uint8_t *cp = buf, *end = buf + len;
+    uint64_t key, val;
+
+    time_spec__init(ts);
+    while (cp < end) {
+	if (!read_varint(&cp, end, &key))
+	    return false;
+	switch (key) {
+	case (1 << 3) | WIRETYPE_VARINT:
+	    if (!read_varint(&cp, end, &val))
+		return false;
+	    ts->tv_sec = (int64_t)val;
+	    break;
+	case (2 << 3) | WIRETYPE_VARINT:
+	    if (!read_varint(&cp, end, &val))
+		return false;
+	    ts->tv_nsec = (int32_t)val;
+	    break;
+	default:
+	    if (!skip_field(&cp, end, key & 0x07))
+		return false;
+	    break;
+	}
+    }
+    return true;
+}
+
+/*
+ * Decode an IoBuffer from buf without copying its data.
+ * Returns false for anything the fast path doesn't handle, such as
+ * a repeated delay field, which must be merged.
+ */
+static bool
+unpack_iobuf(const uint8_t *buf, size_t len, IoBuffer *iobuf, TimeSpec *delay)
+{
+    const uint8_t *cp = buf, *end = buf + len, *data;
+    size_t datalen;
+    uint64_t key;
+
+    io_buffer__init(iobuf);
+    while (cp < end) {
+	if (!read_varint(&cp, end, &key))
+	    return false;
+	switch (key) {
+	case (1 << 3) | WIRETYPE_LENGTH:
+	    if (iobuf->delay != NULL)
+		return false;
+	    if (!read_length_delimited(&cp, end, &data, &datalen))
+		return false;
+	    if (!unpack_timespec(data, datalen, delay))
+		return false;
+	    iobuf->delay = delay;
+	    break;
+	case (2 << 3) | WIRETYPE_LENGTH:
+	    if (!read_length_delimited(&cp, end, &data, &datalen))
+		return false;
+	    iobuf->data.data = (uint8_t *)data;
+	    iobuf->data.len = datalen;
+	    break;
+	default:
+	    if (!skip_field(&cp, end, key & 0x07))
+		return false;
+	    break;
+	}
+    }
+    return true;
+}
+
+/*
+ * Decode a ClientMessage containing an IoBuffer in place.
+ * On success, msg, iobuf and delay are filled in and the IoBuffer
+ * data points into buf, so it is only valid as long as buf is.
+ * Returns false if buf does not hold a simple IoBuffer message;
+ * the caller should use client_message__unpack() in that case.
+ */
+bool
+client_message_unpack_iobuf(const uint8_t *buf, size_t len,
+    ClientMessage *msg, IoBuffer *iobuf, TimeSpec *delay)
+{
+    const uint8_t *cp = buf, *end = buf + len, *data;
+    size_t datalen;
+    uint64_t key;
+    debug_decl(client_message_unpack_iobuf, SUDO_DEBUG_UTIL);
+
+    /* Only a single IoBuffer field, anything else is decoded normally. */
+    if (!read_varint(&cp, end, &key))
+	debug_return_bool(false);
+    if ((key & 0x07) != WIRETYPE_LENGTH)
+	debug_return_bool(false);
+    switch (key >> 3) {
+    case CLIENT_MESSAGE__TYPE_TTYIN_BUF:
+    case CLIENT_MESSAGE__TYPE_TTYOUT_BUF:
+    case CLIENT_MESSAGE__TYPE_STDIN_BUF:
+    case CLIENT_MESSAGE__TYPE_STDOUT_BUF:
+    case CLIENT_MESSAGE__TYPE_STDERR_BUF:
+	break;
+    default:
+	debug_return_bool(false);
+    }
+    if (!read_length_delimited(&cp, end, &data, &datalen) || cp != end)
+	debug_return_bool(false);
+    if (!unpack_iobuf(data, datalen, iobuf, delay))
+	debug_return_bool(false);
+
+    /* All the IoBuffer members of the oneof share the same storage. */
+    client_message__init(msg);
+    msg->type_case = (ClientMessage__TypeCase)(key >> 3);
+    msg->ttyout_buf = iobuf;
+
+    debug_return_bool(true);
+}
+
+/*
+ * Prepare to decompress IoBuffer data from a client that enabled
+ * compression in its AcceptMessage.
+ */
+bool
+iobuf_inflate_init(struct connection_closure *closure)
+{
+    debug_decl(iobuf_inflate_init, SUDO_DEBUG_UTIL);
+
+#ifdef HAVE_ZLIB_H
+    closure->zstream = calloc(1, sizeof(*closure->zstream));
+    if (closure->zstream == NULL) {
+	closure->errstr = _("unable to allocate memory");
+	debug_return_bool(false);
+    }
+    if (inflateInit(closure->zstream) != Z_OK) {
+	free(closure->zstream);
+	closure->zstream = NULL;
+	closure->errstr = _("unable to initialize decompression");
+	debug_return_bool(false);
+    }
+    debug_return_bool(true);
+#else
+    closure->errstr = _("compressed I/O buffers are not supported");
+    debug_return_bool(false);
+#endif /* HAVE_ZLIB_H */
+}
+
+#ifdef HAVE_ZLIB_H
+/*
+ * Decompress the data in msg, storing the result in out.
+ * The client ends each buffer with a sync flush so all of the
+ * data for this buffer is available without waiting for the next.
+ */
+bool
+iobuf_inflate(IoBuffer *msg, IoBuffer *out, struct connection_closure *closure)
+{
+    z_stream *strm = closure->zstream;
+    struct connection_buffer *zbuf = &closure->zbuf;
+    unsigned int newsize;
+    void *newdata;
+    int zerr;
+    debug_decl(iobuf_inflate, SUDO_DEBUG_UTIL);
+
+    strm->next_in = msg->data.data;
+    strm->avail_in = msg->data.len;
+    zbuf->len = 0;
+    for (;;) {
+	if (zbuf->len == zbuf->size) {
+	    /* Don't let a small message expand without bound. */
+	    if (zbuf->size >= MESSAGE_SIZE_MAX) {
+		closure->errstr = _("IoBuffer too large");
+		debug_return_bool(false);
+	    }
+	    newsize = zbuf->size ? zbuf->size * 2 : 64 * 1024;
+	    if ((newdata = realloc(zbuf->data, newsize)) == NULL) {
+		closure->errstr = _("unable to allocate memory");
+		debug_return_bool(false);
+	    }
+	    zbuf->data = newdata;
+	    zbuf->size = newsize;
+	}
+	strm->next_out = zbuf->data + zbuf->len;
+	strm->avail_out = zbuf->size - zbuf->len;
+	zerr = inflate(strm, Z_SYNC_FLUSH);
+	zbuf->len = zbuf->size - strm->avail_out;
+	if (zerr != Z_OK && zerr != Z_BUF_ERROR) {
+	    sudo_debug_printf(SUDO_DEBUG_ERROR|SUDO_DEBUG_LINENO,
+		"inflate returned %d: %s", zerr, strm->msg ? strm->msg : "");
+	    closure->errstr = _("invalid compressed IoBuffer");
+	    debug_return_bool(false);
+	}
+	/* Output space left over means all the input was consumed. */
+	if (strm->avail_out != 0)
+	    break;
+    }
+    if (strm->avail_in != 0) {
+	closure->errstr = _("invalid compressed IoBuffer");
+	debug_return_bool(false);
+    }
+
+    *out = *msg;
+    out->data.data = zbuf->data;
+    out->data.len = zbuf->len;
+    debug_return_bool(true);
+}
+#endif /* HAVE_ZLIB_H */
+
+/*
+ * Allocate memory from the arena (protobuf-c allocator callback).
+ * Requests that do not fit in the current block are satisfied by
+ * malloc(3) and the block is grown when the arena is next reset.
+ */
+static void *
+msg_arena_alloc(void *v, size_t size)
+{
+    struct msg_arena *arena = v;
+    uint8_t *ptr;
+
+    size = (size + ARENA_ALIGN - 1) & ~((size_t)ARENA_ALIGN - 1);
+    if (size <= arena->size - arena->used) {
+	ptr = arena->data + arena->used;
+	arena->used += size;
+	return ptr;
+    }
+
+    /* Chain extra allocations together so they can be freed on reset. */
+    if ((ptr = malloc(ARENA_ALIGN + size)) == NULL)
+	return NULL;
+    *(void **)ptr = arena->overflow;
+    arena->overflow = ptr;
+    arena->overflow_size += size;
+    return ptr + ARENA_ALIGN;
+}
+
+/*
+ * Memory is not freed individually, only when the arena is reset.
+ */
+static void
+msg_arena_release(void *v, void *ptr)
+{
+    return;
+}
+
+/*
+ * Initialize an empty arena, the first message sizes it.
+ */
+void
+msg_arena_init(struct msg_arena *arena)
+{
+    debug_decl(msg_arena_init, SUDO_DEBUG_UTIL);
+
+    memset(arena, 0, sizeof(*arena));
+    arena->allocator.alloc = msg_arena_alloc;
+    arena->allocator.free = msg_arena_release;
+    arena->allocator.allocator_data = arena;
+
+    debug_return;
+}
+
+/*
+ * Free everything allocated from the arena since the last reset.
+ * If the arena overflowed, grow it so the next message of the same
+ * size can be unpacked without calling malloc(3).
+ */
+void
+msg_arena_reset(struct msg_arena *arena)
+{
+    size_t needed;
+    void *next;
+    debug_decl(msg_arena_reset, SUDO_DEBUG_UTIL);
+
+    while (arena->overflow != NULL) {
+	next = *(void **)arena->overflow;
+	free(arena->overflow);
+	arena->overflow = next;
+    }
+    if (arena->overflow_size != 0) {
+	needed = arena->used + arena->overflow_size;
+	if (needed <= ARENA_SIZE_MAX) {
+	    needed = sudo_pow2_roundup(needed);
+	    sudo_debug_printf(SUDO_DEBUG_INFO|SUDO_DEBUG_LINENO,
+		"growing message arena from %zu to %zu", arena->size, needed);
+	    free(arena->data);
+	    if ((arena->data = malloc(needed)) != NULL) {
+		arena->size = needed;
+	    } else {
+		arena->size = 0;
+	    }
+	}
+	arena->overflow_size = 0;
+    }
+    arena->used = 0;
+
+    debug_return;
+}
+
+/*
+ * Free the arena and its contents.
+ */
+void
+msg_arena_free(struct msg_arena *arena)
+{
+    debug_decl(msg_arena_free, SUDO_DEBUG_UTIL);
+
+    arena->overflow_size = 0;
+    msg_arena_reset(arena);
+    free(arena->data);
+    arena->data = NULL;
+    arena->size = 0;
+
+    debug_return;
+}
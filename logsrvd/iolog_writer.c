@@ -583,6 +583,10 @@ iolog_details_write(struct iolog_details *details,
      struct connection_closure *closure)
 {
     struct iolog_info log_info;
+    const char *iolog_dir = logsrvd_conf_iolog_dir();
+    char index_dir[PATH_MAX];
+    size_t dirlen;
+    int len;
     debug_decl(iolog_details_write, SUDO_DEBUG_UTIL);
 
     /* Convert to iolog_info */
@@ -597,8 +601,32 @@ iolog_details_write(struct iolog_details *details,
     log_info.lines = details->lines;
     log_info.cols = details->columns;
 
-    debug_return_bool(iolog_write_info_file(closure->iolog_dir_fd,
-	 details->iolog_path, &log_info, details->argv));
+    if (!iolog_write_info_file(closure->iolog_dir_fd, details->iolog_path,
+	    &log_info, details->argv))
+	debug_return_bool(false);
+
+    /*
+     * Add the session to the index at the top of the I/O log dir,
+     * the part of iolog_dir before the first escape sequence.
+     */
+    dirlen = iolog_index_dirlen(iolog_dir);
+    if (dirlen == 0 ||
+	    dirlen >= (size_t)(details->iolog_file - details->iolog_path) ||
+	    strncmp(details->iolog_path, iolog_dir, dirlen) != 0) {
+	sudo_debug_printf(SUDO_DEBUG_INFO,
+	    "no session index for I/O log dir %s", iolog_dir);
+	debug_return_bool(true);
+    }
+    len = snprintf(index_dir, sizeof(index_dir), "%.*s", (int)dirlen,
+	details->iolog_path);
+    if (len < 0 || len >= ssizeof(index_dir) ||
+	    !iolog_index_append(index_dir, details->iolog_path + dirlen + 1,
+	    details->submithost, &log_info, details->argv)) {
+	sudo_debug_printf(SUDO_DEBUG_WARN|SUDO_DEBUG_ERRNO,
+	    "unable to add %s to the session index", details->iolog_path);
+    }
+
+    debug_return_bool(true);
 }
 
 static bool
@@ -638,6 +666,56 @@ iolog_close_all(struct connection_closure *closure)
     debug_return;
 }
 
+/*
+ * Flush buffered data for all open I/O log files if iolog_flush is set.
+ * Called before sending a commit point so the client is only
+ * told about data that has been written out.
+ * If there is new data, a new chunk is started and the commit point
+ * is recorded in the seek index so a restart can resume there
+ * without reading the timing file.  No index is written when the
+ * terminal size is not known, e.g. after restarting without one,
+ * or when iolog_flush is not set, since starting a chunk would
+ * write out the buffered data.
+ */
+bool
+iolog_flush_all(struct connection_closure *closure)
+{
+    const char *errstr;
+    bool ret = true;
+    int i;
+    debug_decl(iolog_flush_all, SUDO_DEBUG_UTIL);
+
+    if (!logsrvd_conf_iolog_flush())
+	debug_return_bool(true);
+
+    if (closure->lines != 0 &&
+	    sudo_timespeccmp(&closure->elapsed_time, &closure->chunk_time, !=)) {
+	if (!iolog_chunk_write(closure->iolog_dir_fd, closure->iolog_files,
+		&closure->elapsed_time, closure->lines, closure->cols,
+		&errstr)) {
+	    sudo_debug_printf(SUDO_DEBUG_ERROR|SUDO_DEBUG_LINENO,
+		"unable to update %s/%s: %s", closure->details.iolog_path,
+		IOLOG_SEEK_INDEX, errstr);
+	    debug_return_bool(false);
+	}
+	closure->chunk_time = closure->elapsed_time;
+	debug_return_bool(true);
+    }
+
+    for (i = 0; i < IOFD_MAX; i++) {
+	if (!closure->iolog_files[i].enabled)
+	    continue;
+	if (!iolog_flush(&closure->iolog_files[i], &errstr)) {
+	    sudo_debug_printf(SUDO_DEBUG_ERROR|SUDO_DEBUG_LINENO,
+		"unable to flush %s/%s: %s", closure->details.iolog_path,
+		iolog_fd_to_name(i), errstr);
+	    ret = false;
+	}
+    }
+
+    debug_return_bool(ret);
+}
+
 bool
 iolog_init(AcceptMessage *msg, struct connection_closure *closure)
 {
@@ -650,6 +728,8 @@ iolog_init(AcceptMessage *msg, struct connection_closure *closure)
     /* Write sudo I/O log info file */
     if (!iolog_details_write(&closure->details, closure))
 	debug_return_bool(false);
+    closure->lines = closure->details.lines;
+    closure->cols = closure->details.columns;
 
     /*
      * Create timing, stdout, stderr and ttyout files for sudoreplay.
@@ -851,6 +931,7 @@ done:
 bool
 iolog_restart(RestartMessage *msg, struct connection_closure *closure)
 {
+    struct iolog_chunk chunk;
     struct timespec target;
     struct stat sb;
     int iofd;
@@ -887,6 +968,25 @@ iolog_restart(RestartMessage *msg, struct connection_closure *closure)
 	goto bad;
     }
 
+    /* Resume directly at the commit point if it is in the seek index. */
+    if (iolog_chunk_find(closure->iolog_dir_fd, &target, &chunk) &&
+	    sudo_timespeccmp(&chunk.elapsed, &target, ==)) {
+	sudo_debug_printf(SUDO_DEBUG_INFO|SUDO_DEBUG_LINENO,
+	    "resuming %s at [%lld, %ld] using %s", closure->details.iolog_path,
+	    (long long)target.tv_sec, target.tv_nsec, IOLOG_SEEK_INDEX);
+	if (!iolog_chunk_resume(closure->iolog_dir_fd, &chunk,
+		closure->iolog_files))
+	    goto bad;
+	closure->elapsed_time = target;
+	closure->chunk_time = target;
+	closure->lines = chunk.lines;
+	closure->cols = chunk.cols;
+	debug_return_bool(true);
+    }
+
+    /* The seek index does not match the log once it is rewritten. */
+    (void)unlinkat(closure->iolog_dir_fd, IOLOG_SEEK_INDEX, 0);
+
     /* Open existing I/O log files. */
     if (!iolog_open_all(closure->iolog_dir_fd, closure->details.iolog_path,
 	    closure->iolog_files, "r+"))
@@ -1047,6 +1147,8 @@ store_winsize(ChangeWindowSize *msg, struct connection_closure *closure)
     }
 
     update_elapsed_time(msg->delay, &closure->elapsed_time);
+    closure->lines = msg->rows;
+    closure->cols = msg->cols;
 
     debug_return_int(0);
 }
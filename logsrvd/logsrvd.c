@@ -19,6 +19,7 @@
 #include <sys/stat.h>
 #include <sys/types.h>
 #include <sys/socket.h>
+#include <sys/wait.h>
 #include <netinet/in.h>
 #include <netinet/tcp.h>
 #include <arpa/inet.h>
@@ -26,6 +27,7 @@
 #include <errno.h>
 #include <fcntl.h>
 #include <limits.h>
+#include <signal.h>
 #ifdef HAVE_STDBOOL_H
 # include <stdbool.h>
 #else
@@ -84,6 +86,23 @@ static const char server_id[] = "Sudo Audit Server 0.1";
 static const char *conf_file = _PATH_SUDO_LOGSRVD_CONF;
 static double random_drop;
 
+/* Worker processes, only used when worker_processes > 1. */
+static struct logsrvd_worker {
+    pid_t pid;
+    time_t started;
+    time_t restart_at;		/* when to restart a failed worker */
+    unsigned int backoff;	/* current restart delay in seconds */
+} *workers;
+static unsigned int nworkers;		/* number of workers to run */
+static unsigned int nworker_slots;	/* size of the workers array */
+static int *inherited_listeners;
+static int num_inherited_listeners;
+static volatile sig_atomic_t supervisor_signals[NSIG];
+
+/* Delay in seconds before restarting a worker that fails at startup. */
+#define WORKER_BACKOFF_MIN	1
+#define WORKER_BACKOFF_MAX	60
+
 /* Server callback may redirect to client callback for TLS. */
 static void client_msg_cb(int fd, int what, void *v);
 
@@ -113,6 +132,14 @@ connection_closure_free(struct connection_closure *closure)
 	iolog_details_free(&closure->details);
 	free(closure->read_buf.data);
 	free(closure->write_buf.data);
+	msg_arena_free(&closure->arena);
+#ifdef HAVE_ZLIB_H
+	if (closure->zstream != NULL) {
+	    inflateEnd(closure->zstream);
+	    free(closure->zstream);
+	}
+	free(closure->zbuf.data);
+#endif
 	free(closure);
 
 	if (shutting_down && TAILQ_EMPTY(&connections))
@@ -184,6 +211,9 @@ fmt_hello_message(struct connection_buffer *buf)
     hello.tls = false;
     hello.tls_server_auth = false;
     hello.tls_reqcert = false;
+#endif
+#ifdef HAVE_ZLIB_H
+    hello.compression = true;
 #endif
     msg.hello = &hello;
     msg.type_case = SERVER_MESSAGE__TYPE_HELLO;
@@ -252,6 +282,10 @@ handle_accept(AcceptMessage *msg, struct connection_closure *closure)
 
     /* Create I/O log info file and parent directories. */
     if (msg->expect_iobufs) {
+	if (msg->compress_iobufs) {
+	    if (!iobuf_inflate_init(closure))
+		debug_return_bool(false);
+	}
 	if (!iolog_init(msg, closure)) {
 	    closure->errstr = _("error creating I/O log");
 	    debug_return_bool(false);
@@ -427,6 +461,9 @@ handle_alert(AlertMessage *msg, struct connection_closure *closure)
 static bool
 handle_iobuf(int iofd, IoBuffer *msg, struct connection_closure *closure)
 {
+#ifdef HAVE_ZLIB_H
+    IoBuffer iobuf;
+#endif
     debug_decl(handle_iobuf, SUDO_DEBUG_UTIL);
 
     if (closure->state != RUNNING) {
@@ -438,6 +475,23 @@ handle_iobuf(int iofd, IoBuffer *msg, struct connection_closure *closure)
 
     sudo_debug_printf(SUDO_DEBUG_INFO, "%s: received IoBuffer", __func__);
 
+    /* Sanity check message. */
+    if (msg->delay == NULL) {
+	sudo_debug_printf(SUDO_DEBUG_ERROR|SUDO_DEBUG_LINENO,
+	    "invalid IoBuffer, missing delay");
+	closure->errstr = _("invalid IoBuffer");
+	debug_return_bool(false);
+    }
+
+#ifdef HAVE_ZLIB_H
+    /* Decompress IoBuffer data if the client enabled compression. */
+    if (closure->zstream != NULL) {
+	if (!iobuf_inflate(msg, &iobuf, closure))
+	    debug_return_bool(false);
+	msg = &iobuf;
+    }
+#endif
+
     /* Store IoBuffer in log. */
     if (store_iobuf(iofd, msg, closure) == -1) {
 	sudo_debug_printf(SUDO_DEBUG_ERROR|SUDO_DEBUG_LINENO,
@@ -525,15 +579,26 @@ static bool
 handle_client_message(uint8_t *buf, size_t len,
     struct connection_closure *closure)
 {
-    ClientMessage *msg;
+    ClientMessage *msg, iobuf_msg;
+    IoBuffer iobuf;
+    TimeSpec delay;
     bool ret = false;
     debug_decl(handle_client_message, SUDO_DEBUG_UTIL);
 
-    msg = client_message__unpack(NULL, len, buf);
-    if (msg == NULL) {
-	sudo_debug_printf(SUDO_DEBUG_ERROR|SUDO_DEBUG_LINENO,
-	    "unable to unpack ClientMessage size %zu", len);
-	debug_return_bool(false);
+    /*
+     * IoBuffers are decoded in place, everything else is unpacked
+     * using the connection's arena, which is reset when we are done.
+     */
+    if (client_message_unpack_iobuf(buf, len, &iobuf_msg, &iobuf, &delay)) {
+	msg = &iobuf_msg;
+    } else {
+	msg = client_message__unpack(&closure->arena.allocator, len, buf);
+	if (msg == NULL) {
+	    sudo_debug_printf(SUDO_DEBUG_ERROR|SUDO_DEBUG_LINENO,
+		"unable to unpack ClientMessage size %zu", len);
+	    msg_arena_reset(&closure->arena);
+	    debug_return_bool(false);
+	}
     }
 
     switch (msg->type_case) {
@@ -579,7 +644,7 @@ handle_client_message(uint8_t *buf, size_t len,
 	closure->errstr = _("unrecognized ClientMessage type");
 	break;
     }
-    client_message__free_unpacked(msg, NULL);
+    msg_arena_reset(&closure->arena);
 
     debug_return_bool(ret);
 }
@@ -881,6 +946,10 @@ server_commit_cb(int unused, int what, void *v)
 
     debug_decl(server_commit_cb, SUDO_DEBUG_UTIL);
 
+    /* I/O log writes are batched, flush them before acknowledging. */
+    if (!iolog_flush_all(closure))
+	goto bad;
+
     /* Send the client an acknowledgement of what has been committed to disk. */
     commit_point.tv_sec = closure->elapsed_time.tv_sec;
     commit_point.tv_nsec = closure->elapsed_time.tv_nsec;
@@ -1344,6 +1413,7 @@ connection_closure_alloc(int sock)
 
     closure->iolog_dir_fd = -1;
     closure->sock = sock;
+    msg_arena_init(&closure->arena);
 
     TAILQ_INSERT_TAIL(&connections, closure, entries);
 
@@ -1472,8 +1542,13 @@ bad:
     debug_return_bool(false);
 }
 
+/*
+ * Create a listening socket for the specified address.
+ * If reuseport is set, multiple workers may each bind their own
+ * socket to the same address and the kernel balances between them.
+ */
 static int
-create_listener(struct listen_address *addr)
+create_listener(struct listen_address *addr, bool reuseport)
 {
     int flags, i, sock;
     debug_decl(create_listener, SUDO_DEBUG_UTIL);
@@ -1485,6 +1560,14 @@ create_listener(struct listen_address *addr)
     i = 1;
     if (setsockopt(sock, SOL_SOCKET, SO_REUSEADDR, &i, sizeof(i)) == -1)
 	sudo_warn("SO_REUSEADDR");
+#ifdef SO_REUSEPORT
+    if (reuseport) {
+	if (setsockopt(sock, SOL_SOCKET, SO_REUSEPORT, &i, sizeof(i)) == -1) {
+	    sudo_warn("SO_REUSEPORT");
+	    goto bad;
+	}
+    }
+#endif
     if (bind(sock, &addr->sa_un.sa, addr->sa_len) == -1) {
 	sudo_warn("bind");
 	goto bad;
@@ -1543,20 +1626,45 @@ listener_cb(int fd, int what, void *v)
 }
 
 static void
-register_listener(struct listen_address *addr, struct sudo_event_base *base)
+register_listener(int sock, struct sudo_event_base *base)
 {
     struct sudo_event *ev;
-    int sock;
     debug_decl(register_listener, SUDO_DEBUG_UTIL);
 
-    sock = create_listener(addr);
+    ev = sudo_ev_alloc(sock, SUDO_EV_READ|SUDO_EV_PERSIST, listener_cb, base);
+    if (ev == NULL)
+	sudo_fatal(NULL);
+    if (sudo_ev_add(base, ev, NULL, false) == -1)
+	sudo_fatal(U_("unable to add event to queue"));
 
-    if (sock != -1) {
-        ev = sudo_ev_alloc(sock, SUDO_EV_READ|SUDO_EV_PERSIST, listener_cb, base);
-        if (ev == NULL)
-            sudo_fatal(NULL);
-        if (sudo_ev_add(base, ev, NULL, false) == -1)
-            sudo_fatal(U_("unable to add event to queue"));
+    debug_return;
+}
+
+/*
+ * Register listeners for each configured address.
+ * Workers use the sockets created by the supervisor if it could not
+ * use SO_REUSEPORT.  Otherwise, a worker that cannot bind its own
+ * listener exits so the supervisor notices and restarts it.
+ */
+static void
+register_listeners(struct sudo_event_base *base)
+{
+    struct listen_address *addr;
+    int i, sock;
+    debug_decl(register_listeners, SUDO_DEBUG_UTIL);
+
+    if (inherited_listeners != NULL) {
+	for (i = 0; i < num_inherited_listeners; i++)
+	    register_listener(inherited_listeners[i], base);
+	debug_return;
+    }
+
+    TAILQ_FOREACH(addr, logsrvd_conf_listen_address(), entries) {
+	sock = create_listener(addr, nworkers > 1);
+	if (sock != -1)
+	    register_listener(sock, base);
+	else if (nworkers > 1)
+	    sudo_fatalx(U_("unable to create listening socket"));
     }
 
     debug_return;
@@ -1621,6 +1729,330 @@ daemonize(bool nofork)
     debug_return;
 }
 
+/*
+ * Returns true if listening sockets may be created with SO_REUSEPORT.
+ * The option may be defined but unsupported by the running kernel.
+ */
+static bool
+reuseport_supported(void)
+{
+    bool ret = false;
+#ifdef SO_REUSEPORT
+    struct listen_address *addr;
+    int i = 1, sock;
+    debug_decl(reuseport_supported, SUDO_DEBUG_UTIL);
+
+    addr = TAILQ_FIRST(logsrvd_conf_listen_address());
+    if (addr == NULL)
+	debug_return_bool(false);
+    sock = socket(addr->sa_un.sa.sa_family, SOCK_STREAM, 0);
+    if (sock != -1) {
+	if (setsockopt(sock, SOL_SOCKET, SO_REUSEPORT, &i, sizeof(i)) == 0)
+	    ret = true;
+	else
+	    sudo_warn("SO_REUSEPORT");
+	close(sock);
+    }
+    debug_return_bool(ret);
+#else
+    return ret;
+#endif /* SO_REUSEPORT */
+}
+
+/*
+ * Without SO_REUSEPORT, workers share listening sockets created
+ * by the supervisor and compete to accept new connections.
+ */
+static void
+create_inherited_listeners(void)
+{
+    struct listen_address *addr;
+    int sock;
+    debug_decl(create_inherited_listeners, SUDO_DEBUG_UTIL);
+
+    TAILQ_FOREACH(addr, logsrvd_conf_listen_address(), entries) {
+	sock = create_listener(addr, false);
+	if (sock == -1)
+	    continue;
+	inherited_listeners = reallocarray(inherited_listeners,
+	    num_inherited_listeners + 1, sizeof(int));
+	if (inherited_listeners == NULL)
+	    sudo_fatal(NULL);
+	inherited_listeners[num_inherited_listeners++] = sock;
+    }
+    if (num_inherited_listeners == 0)
+	sudo_fatalx(U_("unable to create listening socket"));
+
+    debug_return;
+}
+
+static void
+supervisor_handler(int signo)
+{
+    supervisor_signals[signo] = 1;
+}
+
+/*
+ * Start a worker in the specified slot.
+ * Returns true in the worker and false in the supervisor.
+ */
+static bool
+start_worker(unsigned int slot, sigset_t *omask)
+{
+    struct sigaction sa;
+    pid_t pid;
+    debug_decl(start_worker, SUDO_DEBUG_UTIL);
+
+    switch (pid = fork()) {
+    case -1:
+	sudo_warn("fork");
+	workers[slot].pid = -1;
+	debug_return_bool(false);
+    case 0:
+	/* Worker, restore default signal handling. */
+	memset(&sa, 0, sizeof(sa));
+	sigemptyset(&sa.sa_mask);
+	sa.sa_handler = SIG_DFL;
+	(void)sigaction(SIGHUP, &sa, NULL);
+	(void)sigaction(SIGINT, &sa, NULL);
+	(void)sigaction(SIGTERM, &sa, NULL);
+	(void)sigaction(SIGCHLD, &sa, NULL);
+	(void)sigaction(SIGALRM, &sa, NULL);
+	/* Keep SIGHUP blocked until main() has registered its handler. */
+	sigaddset(omask, SIGHUP);
+	(void)sigprocmask(SIG_SETMASK, omask, NULL);
+	free(workers);
+	workers = NULL;
+	debug_return_bool(true);
+    default:
+	sudo_debug_printf(SUDO_DEBUG_INFO, "started worker %u, pid %d",
+	    slot, (int)pid);
+	workers[slot].pid = pid;
+	workers[slot].restart_at = 0;
+	time(&workers[slot].started);
+	debug_return_bool(false);
+    }
+}
+
+/*
+ * Send a signal to all running workers.
+ */
+static void
+signal_workers(int signo)
+{
+    unsigned int i;
+    debug_decl(signal_workers, SUDO_DEBUG_UTIL);
+
+    for (i = 0; i < nworkers; i++) {
+	if (workers[i].pid > 0)
+	    (void)kill(workers[i].pid, signo);
+    }
+
+    debug_return;
+}
+
+/*
+ * Resize the worker table to match the worker_processes setting.
+ * New slots are started by the supervisor loop, workers in slots
+ * beyond the new count are shut down and not restarted.
+ */
+static void
+resize_workers(unsigned int count)
+{
+    unsigned int i;
+    debug_decl(resize_workers, SUDO_DEBUG_UTIL);
+
+    if (count > nworker_slots) {
+	struct logsrvd_worker *tmp;
+
+	tmp = reallocarray(workers, count, sizeof(*workers));
+	if (tmp == NULL) {
+	    sudo_warn(NULL);
+	    debug_return;
+	}
+	workers = tmp;
+	memset(workers + nworker_slots, 0,
+	    (count - nworker_slots) * sizeof(*workers));
+	for (i = nworker_slots; i < count; i++)
+	    workers[i].pid = -1;
+	nworker_slots = count;
+    }
+    for (i = count; i < nworkers; i++) {
+	if (workers[i].pid > 0)
+	    (void)kill(workers[i].pid, SIGTERM);
+    }
+    for (i = nworkers; i < count; i++) {
+	workers[i].restart_at = 0;
+	workers[i].backoff = 0;
+    }
+    sudo_debug_printf(SUDO_DEBUG_INFO, "worker processes %u -> %u",
+	nworkers, count);
+    nworkers = count;
+
+    debug_return;
+}
+
+/*
+ * Start workers that are not running and whose restart time has come.
+ * Returns true in the worker and false in the supervisor.
+ */
+static bool
+start_pending_workers(sigset_t *omask)
+{
+    time_t now = time(NULL);
+    unsigned int i;
+    debug_decl(start_pending_workers, SUDO_DEBUG_UTIL);
+
+    for (i = 0; i < nworkers; i++) {
+	if (workers[i].pid > 0 || workers[i].restart_at > now)
+	    continue;
+	if (start_worker(i, omask))
+	    debug_return_bool(true);
+	if (workers[i].pid == -1) {
+	    /* fork(2) failed, try again later. */
+	    workers[i].backoff = WORKER_BACKOFF_MIN;
+	    workers[i].restart_at = now + workers[i].backoff;
+	}
+    }
+
+    debug_return_bool(false);
+}
+
+/*
+ * Start nworkers worker processes, each of which runs its own event
+ * loop with its own listeners and connections.  The supervisor stays
+ * behind to restart workers that die and to relay SIGHUP, SIGINT and
+ * SIGTERM.  A worker that dies shortly after starting is restarted
+ * after a delay that doubles each time, up to WORKER_BACKOFF_MAX.
+ * On SIGHUP, the number of workers is adjusted to the new setting;
+ * listener changes require a restart.  Only returns in the workers.
+ */
+static void
+run_supervisor(void)
+{
+    struct sigaction sa;
+    sigset_t mask, omask;
+    unsigned int i, nrunning;
+    bool shutting_down = false;
+    time_t now, next;
+    int status;
+    pid_t pid;
+    debug_decl(run_supervisor, SUDO_DEBUG_UTIL);
+
+    if ((workers = calloc(nworkers, sizeof(*workers))) == NULL)
+	sudo_fatal(NULL);
+    nworker_slots = nworkers;
+    for (i = 0; i < nworkers; i++)
+	workers[i].pid = -1;
+    if (!reuseport_supported())
+	create_inherited_listeners();
+
+    /* Signals are only delivered while waiting in sigsuspend(). */
+    sigemptyset(&mask);
+    sigaddset(&mask, SIGHUP);
+    sigaddset(&mask, SIGINT);
+    sigaddset(&mask, SIGTERM);
+    sigaddset(&mask, SIGCHLD);
+    sigaddset(&mask, SIGALRM);
+    if (sigprocmask(SIG_BLOCK, &mask, &omask) == -1)
+	sudo_fatal("sigprocmask");
+    memset(&sa, 0, sizeof(sa));
+    sigemptyset(&sa.sa_mask);
+    sa.sa_handler = supervisor_handler;
+    (void)sigaction(SIGHUP, &sa, NULL);
+    (void)sigaction(SIGINT, &sa, NULL);
+    (void)sigaction(SIGTERM, &sa, NULL);
+    (void)sigaction(SIGCHLD, &sa, NULL);
+    (void)sigaction(SIGALRM, &sa, NULL);
+
+    for (;;) {
+	/* Reap workers, scheduling a restart unless we are shutting down. */
+	while ((pid = waitpid(-1, &status, WNOHANG)) > 0) {
+	    for (i = 0; i < nworker_slots; i++) {
+		if (workers[i].pid == pid)
+		    break;
+	    }
+	    if (i == nworker_slots)
+		continue;
+	    workers[i].pid = -1;
+	    if (shutting_down || i >= nworkers)
+		continue;
+	    if (WIFSIGNALED(status)) {
+		sudo_warnx(U_("worker %d killed by signal %d"), (int)pid,
+		    WTERMSIG(status));
+	    } else {
+		sudo_warnx(U_("worker %d exited with status %d"), (int)pid,
+		    WEXITSTATUS(status));
+	    }
+	    /* Back off if the worker died right after starting. */
+	    now = time(NULL);
+	    if (now - workers[i].started < WORKER_BACKOFF_MIN) {
+		if (workers[i].backoff == 0)
+		    workers[i].backoff = WORKER_BACKOFF_MIN;
+		else if (workers[i].backoff < WORKER_BACKOFF_MAX / 2)
+		    workers[i].backoff *= 2;
+		else
+		    workers[i].backoff = WORKER_BACKOFF_MAX;
+		sudo_debug_printf(SUDO_DEBUG_INFO,
+		    "restarting worker %u in %u seconds", i,
+		    workers[i].backoff);
+	    } else {
+		workers[i].backoff = 0;
+	    }
+	    workers[i].restart_at = now + workers[i].backoff;
+	}
+
+	if (supervisor_signals[SIGHUP]) {
+	    supervisor_signals[SIGHUP] = 0;
+	    sudo_debug_printf(SUDO_DEBUG_INFO, "received SIGHUP");
+	    if (logsrvd_conf_read(conf_file)) {
+		const unsigned int count = logsrvd_conf_worker_processes();
+		if (count != nworkers && !shutting_down)
+		    resize_workers(count);
+	    }
+	    signal_workers(SIGHUP);
+	}
+	if (supervisor_signals[SIGINT] || supervisor_signals[SIGTERM]) {
+	    /* Workers shut down their own connections via server_shutdown(). */
+	    supervisor_signals[SIGINT] = supervisor_signals[SIGTERM] = 0;
+	    shutting_down = true;
+	    signal_workers(SIGTERM);
+	}
+	supervisor_signals[SIGCHLD] = 0;
+	supervisor_signals[SIGALRM] = 0;
+
+	if (!shutting_down) {
+	    if (start_pending_workers(&omask))
+		debug_return;
+	}
+
+	/* Wake up for the next scheduled restart, if any. */
+	nrunning = 0;
+	next = 0;
+	for (i = 0; i < nworker_slots; i++) {
+	    if (workers[i].pid > 0) {
+		nrunning++;
+	    } else if (i < nworkers && !shutting_down) {
+		nrunning++;
+		if (next == 0 || workers[i].restart_at < next)
+		    next = workers[i].restart_at;
+	    }
+	}
+	if (nrunning == 0)
+	    break;
+	if (next != 0) {
+	    now = time(NULL);
+	    alarm(next > now ? (unsigned int)(next - now) : 1);
+	} else {
+	    alarm(0);
+	}
+
+	sigsuspend(&omask);
+    }
+
+    exit(shutting_down ? EXIT_SUCCESS : EXIT_FAILURE);
+}
+
 static void
 usage(bool fatal)
 {
@@ -1660,7 +2092,6 @@ __dso_public int main(int argc, char *argv[]);
 int
 main(int argc, char *argv[])
 {
-    struct listen_address *addr;
     struct sudo_event_base *evbase;
     bool nofork = false;
     char *ep;
@@ -1726,12 +2157,16 @@ main(int argc, char *argv[])
     signal(SIGPIPE, SIG_IGN);
     daemonize(nofork);
 
+    /* Each worker has its own event loop, listeners and connections. */
+    nworkers = logsrvd_conf_worker_processes();
+    if (nworkers > 1)
+	run_supervisor();
+
     if ((evbase = sudo_ev_base_alloc()) == NULL)
 	sudo_fatal(NULL);
     sudo_ev_base_setdef(evbase);
 
-    TAILQ_FOREACH(addr, logsrvd_conf_listen_address(), entries)
-	register_listener(addr, evbase);
+    register_listeners(evbase);
 
 #if defined(HAVE_OPENSSL)
     if (logsrvd_conf_get_tls_opt() == true) {
@@ -1744,6 +2179,14 @@ main(int argc, char *argv[])
     register_signal(SIGHUP, evbase);
     register_signal(SIGINT, evbase);
     register_signal(SIGTERM, evbase);
+    if (nworkers > 1) {
+	sigset_t mask;
+
+	/* A SIGHUP received since the fork is delivered now. */
+	sigemptyset(&mask);
+	sigaddset(&mask, SIGHUP);
+	(void)sigprocmask(SIG_UNBLOCK, &mask, NULL);
+    }
 
     sudo_ev_dispatch(evbase);
 
@@ -26,6 +26,9 @@
 #if defined(HAVE_OPENSSL)
 # include <openssl/ssl.h>
 #endif
+#ifdef HAVE_ZLIB_H
+# include <zlib.h>
+#endif
 
 #include "logsrv_util.h"
 
@@ -41,6 +44,9 @@
 /* Shutdown timeout (in seconds) in case client connections time out. */
 #define SHUTDOWN_TIMEO	10
 
+/* Upper bound on the worker_processes setting. */
+#define MAX_WORKER_PROCESSES	1024
+
 /*
  * I/O log details from the AcceptMessage + iolog path and sessid.
  */
@@ -64,6 +70,18 @@ struct iolog_details {
     char sessid[7];
 };
 
+/*
+ * Arena used to unpack client messages, reset after each message.
+ */
+struct msg_arena {
+    ProtobufCAllocator allocator;
+    uint8_t *data;
+    size_t size;
+    size_t used;
+    size_t overflow_size;
+    void *overflow;
+};
+
 /*
  * Connection status.
  * In the RUNNING state we expect I/O log buffers.
@@ -85,14 +103,20 @@ struct connection_closure {
     struct iolog_details details;
     struct timespec submit_time;
     struct timespec elapsed_time;
+    struct timespec chunk_time;
     struct connection_buffer read_buf;
     struct connection_buffer write_buf;
+    struct msg_arena arena;
     struct sudo_event *commit_ev;
     struct sudo_event *read_ev;
     struct sudo_event *write_ev;
 #if defined(HAVE_OPENSSL)
     struct sudo_event *ssl_accept_ev;
     SSL *ssl;
+#endif
+#ifdef HAVE_ZLIB_H
+    z_stream *zstream;
+    struct connection_buffer zbuf;
 #endif
     const char *errstr;
     struct iolog_file iolog_files[IOFD_MAX];
@@ -100,6 +124,8 @@ struct connection_closure {
     bool write_instead_of_read;
     bool temporary_write_event;
     int iolog_dir_fd;
+    int lines;			/* current terminal size, 0 if unknown */
+    int cols;
     int sock;
 #ifdef HAVE_STRUCT_IN6_ADDR
     char ipaddr[INET6_ADDRSTRLEN];
@@ -157,6 +183,16 @@ enum logsrvd_eventlog_format {
     EVLOG_SUDO
 };
 
+/* client_message.c */
+bool client_message_unpack_iobuf(const uint8_t *buf, size_t len, ClientMessage *msg, IoBuffer *iobuf, TimeSpec *delay);
+bool iobuf_inflate_init(struct connection_closure *closure);
+#ifdef HAVE_ZLIB_H
+bool iobuf_inflate(IoBuffer *msg, IoBuffer *out, struct connection_closure *closure);
+#endif
+void msg_arena_init(struct msg_arena *arena);
+void msg_arena_reset(struct msg_arena *arena);
+void msg_arena_free(struct msg_arena *arena);
+
 /* eventlog.c */
 bool log_accept(const struct iolog_details *details);
 bool log_reject(const struct iolog_details *details, const char *reason);
@@ -170,14 +206,17 @@ int store_iobuf(int iofd, IoBuffer *msg, struct connection_closure *closure);
 int store_suspend(CommandSuspend *msg, struct connection_closure *closure);
 int store_winsize(ChangeWindowSize *msg, struct connection_closure *closure);
 void iolog_close_all(struct connection_closure *closure);
+bool iolog_flush_all(struct connection_closure *closure);
 void iolog_details_free(struct iolog_details *details);
 
 /* logsrvd_conf.c */
 bool logsrvd_conf_read(const char *path);
+bool logsrvd_conf_iolog_flush(void);
 const char *logsrvd_conf_iolog_dir(void);
 const char *logsrvd_conf_iolog_file(void);
 struct listen_address_list *logsrvd_conf_listen_address(void);
 bool logsrvd_conf_tcp_keepalive(void);
+unsigned int logsrvd_conf_worker_processes(void);
 struct timespec *logsrvd_conf_get_sock_timeout(void);
 #if defined(HAVE_OPENSSL)
 bool logsrvd_conf_get_tls_opt(void);
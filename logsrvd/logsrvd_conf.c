@@ -75,6 +75,7 @@ static struct logsrvd_config {
         struct listen_address_list addresses;
         struct timespec timeout;
         bool tcp_keepalive;
+        unsigned int worker_processes;
 #if defined(HAVE_OPENSSL)
         bool tls;
         struct logsrvd_tls_config tls_config;
@@ -89,6 +90,7 @@ static struct logsrvd_config {
 	gid_t gid;
 	mode_t mode;
 	unsigned int maxseq;
+	unsigned int seq_reserve;
 	char *iolog_dir;
 	char *iolog_file;
     } iolog;
@@ -116,6 +118,12 @@ logsrvd_conf_iolog_mode(void)
     return logsrvd_config->iolog.mode;
 }
 
+bool
+logsrvd_conf_iolog_flush(void)
+{
+    return logsrvd_config->iolog.flush;
+}
+
 const char *
 logsrvd_conf_iolog_dir(void)
 {
@@ -140,6 +148,12 @@ logsrvd_conf_tcp_keepalive(void)
 {
     return logsrvd_config->server.tcp_keepalive;
 }
+unsigned int
+logsrvd_conf_worker_processes(void)
+{
+    return logsrvd_config->server.worker_processes;
+}
+
 struct timespec *
 logsrvd_conf_get_sock_timeout(void)
 {
@@ -353,6 +367,23 @@ cb_iolog_maxseq(struct logsrvd_config *config, const char *str)
     debug_return_bool(true);
 }
 
+static bool
+cb_iolog_seq_reserve(struct logsrvd_config *config, const char *str)
+{
+    const char *errstr;
+    unsigned int value;
+    debug_decl(cb_iolog_seq_reserve, SUDO_DEBUG_UTIL);
+
+    value = sudo_strtonum(str, 1, SESSID_MAX, &errstr);
+    if (errstr != NULL) {
+	sudo_debug_printf(SUDO_DEBUG_ERROR|SUDO_DEBUG_LINENO,
+	    "bad seq_reserve: %s: %s", str, errstr);
+	debug_return_bool(false);
+    }
+    config->iolog.seq_reserve = value;
+    debug_return_bool(true);
+}
+
 /* Server callbacks */
 /* TODO: unit test */
 static bool
@@ -434,6 +465,21 @@ cb_keepalive(struct logsrvd_config *config, const char *str)
     debug_return_bool(true);
 }
 
+static bool
+cb_worker_processes(struct logsrvd_config *config, const char *str)
+{
+    unsigned int nworkers;
+    const char *errstr;
+    debug_decl(cb_worker_processes, SUDO_DEBUG_UTIL);
+
+    nworkers = sudo_strtonum(str, 1, MAX_WORKER_PROCESSES, &errstr);
+    if (errstr != NULL)
+	debug_return_bool(false);
+
+    config->server.worker_processes = nworkers;
+    debug_return_bool(true);
+}
+
 #if defined(HAVE_OPENSSL)
 static bool
 cb_tls_opt(struct logsrvd_config *config, const char *str)
@@ -710,6 +756,7 @@ static struct logsrvd_config_entry server_conf_entries[] = {
     { "listen_address", cb_listen_address },
     { "timeout", cb_timeout },
     { "tcp_keepalive", cb_keepalive },
+    { "worker_processes", cb_worker_processes },
 #if defined(HAVE_OPENSSL)
     { "tls", cb_tls_opt },
     { "tls_key", cb_tls_key },
@@ -733,6 +780,7 @@ static struct logsrvd_config_entry iolog_conf_entries[] = {
     { "iolog_group", cb_iolog_group },
     { "iolog_mode", cb_iolog_mode },
     { "maxseq", cb_iolog_maxseq },
+    { "seq_reserve", cb_iolog_seq_reserve },
     { NULL }
 };
 
@@ -892,6 +940,7 @@ logsrvd_conf_alloc(void)
     TAILQ_INIT(&config->server.addresses);
     config->server.timeout.tv_sec = DEFAULT_SOCKET_TIMEOUT_SEC;
     config->server.tcp_keepalive = true;
+    config->server.worker_processes = 1;
 
 #if defined(HAVE_OPENSSL)
     config->server.tls_config.cacert_path = strdup(DEFAULT_CA_CERT_PATH);
@@ -905,6 +954,7 @@ logsrvd_conf_alloc(void)
     config->iolog.flush = true;
     config->iolog.mode = S_IRUSR|S_IWUSR;
     config->iolog.maxseq = SESSID_MAX;
+    config->iolog.seq_reserve = 1;
     if (!cb_iolog_dir(config, _PATH_SUDO_IO_LOGDIR))
 	goto bad;
     if (!cb_iolog_file(config, "%{seq}"))
@@ -962,10 +1012,12 @@ logsrvd_conf_apply(struct logsrvd_config *config)
     /* Set I/O log library settings */
     iolog_set_defaults();
     iolog_set_compress(config->iolog.compress);
-    iolog_set_flush(config->iolog.flush);
+    /* logsrvd batches I/O log writes and flushes at commit points. */
+    iolog_set_flush(false);
     iolog_set_owner(config->iolog.uid, config->iolog.gid);
     iolog_set_mode(config->iolog.mode);
     iolog_set_maxseq(config->iolog.maxseq);
+    iolog_set_seq_reserve(config->iolog.seq_reserve);
 
     logsrvd_conf_free(logsrvd_config);
     logsrvd_config = config;
@@ -0,0 +1,585 @@
+/*
+ * SPDX-License-Identifier: ISC
+ *
+ * Copyright (c) 2020 Todd C. Miller <Todd.Miller@sudo.ws>
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include "config.h"
+
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#ifdef HAVE_STDBOOL_H
+# include <stdbool.h>
+#else
+# include "compat/stdbool.h"
+#endif /* HAVE_STDBOOL_H */
+#if defined(HAVE_STDINT_H)
+# include <stdint.h>
+#elif defined(HAVE_INTTYPES_H)
+# include <inttypes.h>
+#endif
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define SUDO_ERROR_WRAP 0
+
+#include "log_server.pb-c.h"
+#include "sudo_gettext.h"	/* must be included before sudo_compat.h */
+#include "sudo_compat.h"
+#include "sudo_queue.h"
+#include "sudo_fatal.h"
+#include "sudo_util.h"
+#include "sudo_iolog.h"
+#include "logsrvd.h"
+
+__dso_public int main(int argc, char *argv[]);
+
+static int ntests, nerrors;
+
+static ClientMessage__TypeCase iobuf_types[] = {
+    CLIENT_MESSAGE__TYPE_TTYIN_BUF,
+    CLIENT_MESSAGE__TYPE_TTYOUT_BUF,
+    CLIENT_MESSAGE__TYPE_STDIN_BUF,
+    CLIENT_MESSAGE__TYPE_STDOUT_BUF,
+    CLIENT_MESSAGE__TYPE_STDERR_BUF
+};
+
+/*
+ * Hand-built protobuf messages, used to produce encodings that
+ * client_message__pack() never will.
+ */
+struct wirebuf {
+    uint8_t data[1024];
+    size_t len;
+};
+
+static void
+put_bytes(struct wirebuf *wb, const void *data, size_t len)
+{
+    if (len > sizeof(wb->data) - wb->len)
+	sudo_fatalx_nodebug("%s: buffer overflow", __func__);
+    memcpy(wb->data + wb->len, data, len);
+    wb->len += len;
+}
+
+static void
+put_varint(struct wirebuf *wb, uint64_t val)
+{
+    uint8_t byte;
+
+    do {
+	byte = val & 0x7f;
+	val >>= 7;
+	if (val != 0)
+	    byte |= 0x80;
+	put_bytes(wb, &byte, 1);
+    } while (val != 0);
+}
+
+static void
+put_key(struct wirebuf *wb, unsigned int field, unsigned int wiretype)
+{
+    put_varint(wb, (field << 3) | wiretype);
+}
+
+static void
+put_field(struct wirebuf *wb, unsigned int field, const struct wirebuf *sub)
+{
+    put_key(wb, field, 2);
+    put_varint(wb, sub->len);
+    put_bytes(wb, sub->data, sub->len);
+}
+
+/*
+ * Pack msg into a newly-allocated buffer.
+ */
+static uint8_t *
+pack_message(ClientMessage *msg, size_t *lenp)
+{
+    uint8_t *buf;
+    size_t len;
+
+    len = client_message__get_packed_size(msg);
+    if ((buf = malloc(len ? len : 1)) == NULL)
+	sudo_fatalx_nodebug("unable to allocate memory");
+    if (client_message__pack(msg, buf) != len)
+	sudo_fatalx_nodebug("%s: packed size mismatch", __func__);
+    *lenp = len;
+    return buf;
+}
+
+static IoBuffer *
+msg_iobuf(ClientMessage *msg)
+{
+    switch (msg->type_case) {
+    case CLIENT_MESSAGE__TYPE_TTYIN_BUF:
+	return msg->ttyin_buf;
+    case CLIENT_MESSAGE__TYPE_TTYOUT_BUF:
+	return msg->ttyout_buf;
+    case CLIENT_MESSAGE__TYPE_STDIN_BUF:
+	return msg->stdin_buf;
+    case CLIENT_MESSAGE__TYPE_STDOUT_BUF:
+	return msg->stdout_buf;
+    case CLIENT_MESSAGE__TYPE_STDERR_BUF:
+	return msg->stderr_buf;
+    default:
+	return NULL;
+    }
+}
+
+/*
+ * Compare two decoded IoBuffers, a missing delay is the same as zero.
+ */
+static bool
+iobuf_equal(IoBuffer *a, IoBuffer *b)
+{
+    int64_t a_sec = 0, b_sec = 0;
+    int32_t a_nsec = 0, b_nsec = 0;
+
+    if (a->delay != NULL) {
+	a_sec = a->delay->tv_sec;
+	a_nsec = a->delay->tv_nsec;
+    }
+    if (b->delay != NULL) {
+	b_sec = b->delay->tv_sec;
+	b_nsec = b->delay->tv_nsec;
+    }
+    if (a_sec != b_sec || a_nsec != b_nsec)
+	return false;
+    if (a->data.len != b->data.len)
+	return false;
+    return a->data.len == 0 ||
+	memcmp(a->data.data, b->data.data, a->data.len) == 0;
+}
+
+/*
+ * Decode buf with the fast path and check that it matches what
+ * client_message__unpack() produces.
+ */
+static void
+check_fast_path(const char *what, const uint8_t *buf, size_t len)
+{
+    ClientMessage msg, *umsg;
+    IoBuffer iobuf, *uiobuf;
+    TimeSpec delay;
+
+    ntests++;
+    if (!client_message_unpack_iobuf(buf, len, &msg, &iobuf, &delay)) {
+	sudo_warnx_nodebug("%s: fast path rejected a valid IoBuffer", what);
+	nerrors++;
+	return;
+    }
+    umsg = client_message__unpack(NULL, len, buf);
+    if (umsg == NULL) {
+	sudo_warnx_nodebug("%s: unable to unpack ClientMessage", what);
+	nerrors++;
+	return;
+    }
+    uiobuf = msg_iobuf(umsg);
+    if (msg.type_case != umsg->type_case || uiobuf == NULL ||
+	    msg_iobuf(&msg) != &iobuf || !iobuf_equal(&iobuf, uiobuf)) {
+	sudo_warnx_nodebug("%s: fast path result differs from protobuf-c",
+	    what);
+	nerrors++;
+    } else if (iobuf.data.len != 0 &&
+	    (iobuf.data.data < buf || iobuf.data.data + iobuf.data.len > buf + len)) {
+	sudo_warnx_nodebug("%s: IoBuffer data not decoded in place", what);
+	nerrors++;
+    }
+    client_message__free_unpacked(umsg, NULL);
+}
+
+/*
+ * The fast path must reject buf, leaving it to client_message__unpack().
+ */
+static void
+check_rejected(const char *what, const uint8_t *buf, size_t len)
+{
+    ClientMessage msg;
+    IoBuffer iobuf;
+    TimeSpec delay;
+
+    ntests++;
+    if (client_message_unpack_iobuf(buf, len, &msg, &iobuf, &delay)) {
+	sudo_warnx_nodebug("%s: fast path accepted an invalid message", what);
+	nerrors++;
+    }
+}
+
+/*
+ * Messages packed by protobuf-c, including every IoBuffer field,
+ * decode the same with the fast path.
+ */
+static void
+test_roundtrip(void)
+{
+    static const struct {
+	bool has_delay;
+	int64_t tv_sec;
+	int32_t tv_nsec;
+	size_t datalen;
+    } cases[] = {
+	{ true, 0, 0, 0 },
+	{ true, 1, 500000000, 1 },
+	{ true, 0, 999999999, 127 },
+	{ true, 300, 0, 128 },
+	{ true, INT64_MAX, INT32_MAX, 70000 },
+	{ true, -1, -1, 16 },
+	{ false, 0, 0, 42 },
+	{ false, 0, 0, 0 }
+    };
+    uint8_t *data, *buf;
+    unsigned int i, j;
+    char what[64];
+    size_t len;
+
+    if ((data = malloc(70000)) == NULL)
+	sudo_fatalx_nodebug("unable to allocate memory");
+    for (i = 0; i < 70000; i++)
+	data[i] = (uint8_t)(i * 7);
+
+    for (i = 0; i < nitems(iobuf_types); i++) {
+	for (j = 0; j < nitems(cases); j++) {
+	    ClientMessage msg = CLIENT_MESSAGE__INIT;
+	    IoBuffer iobuf = IO_BUFFER__INIT;
+	    TimeSpec delay = TIME_SPEC__INIT;
+
+	    if (cases[j].has_delay) {
+		delay.tv_sec = cases[j].tv_sec;
+		delay.tv_nsec = cases[j].tv_nsec;
+		iobuf.delay = &delay;
+	    }
+	    iobuf.data.data = data;
+	    iobuf.data.len = cases[j].datalen;
+	    msg.type_case = iobuf_types[i];
+	    msg.ttyout_buf = &iobuf;	/* the oneof members share storage */
+
+	    buf = pack_message(&msg, &len);
+	    (void)snprintf(what, sizeof(what), "roundtrip %d/%u",
+		(int)iobuf_types[i], j);
+	    check_fast_path(what, buf, len);
+	    free(buf);
+	}
+    }
+    free(data);
+}
+
+/*
+ * Every truncation of a valid message is rejected.
+ */
+static void
+test_truncated(void)
+{
+    ClientMessage msg = CLIENT_MESSAGE__INIT;
+    IoBuffer iobuf = IO_BUFFER__INIT;
+    TimeSpec delay = TIME_SPEC__INIT;
+    uint8_t data[200], *buf;
+    char what[64];
+    size_t i, len;
+
+    memset(data, 'x', sizeof(data));
+    delay.tv_sec = 1234567;
+    delay.tv_nsec = 89;
+    iobuf.delay = &delay;
+    iobuf.data.data = data;
+    iobuf.data.len = sizeof(data);
+    msg.type_case = CLIENT_MESSAGE__TYPE_STDOUT_BUF;
+    msg.stdout_buf = &iobuf;
+
+    buf = pack_message(&msg, &len);
+    for (i = 0; i < len; i++) {
+	(void)snprintf(what, sizeof(what), "truncated at %zu of %zu", i, len);
+	check_rejected(what, buf, i);
+    }
+    free(buf);
+}
+
+/*
+ * Varints that are too long or lengths that are too big are rejected,
+ * wherever they appear.
+ */
+static void
+test_varints(void)
+{
+    struct wirebuf wb, iob, ts;
+    unsigned int i;
+
+    /* Key that never terminates. */
+    wb.len = 0;
+    for (i = 0; i < 11; i++)
+	put_bytes(&wb, "\xff", 1);
+    check_rejected("overlong key", wb.data, wb.len);
+
+    /* Message length that never terminates. */
+    wb.len = 0;
+    put_key(&wb, CLIENT_MESSAGE__TYPE_TTYOUT_BUF, 2);
+    for (i = 0; i < 11; i++)
+	put_bytes(&wb, "\x80", 1);
+    put_bytes(&wb, "\x01", 1);
+    check_rejected("overlong message length", wb.data, wb.len);
+
+    /* Message length larger than the address space. */
+    wb.len = 0;
+    put_key(&wb, CLIENT_MESSAGE__TYPE_TTYOUT_BUF, 2);
+    put_varint(&wb, UINT64_MAX);
+    put_bytes(&wb, "\x12\x00", 2);
+    check_rejected("oversized message length", wb.data, wb.len);
+
+    /* Message length one more than is present. */
+    iob.len = 0;
+    put_key(&iob, 2, 2);
+    put_varint(&iob, 3);
+    put_bytes(&iob, "abc", 3);
+    wb.len = 0;
+    put_key(&wb, CLIENT_MESSAGE__TYPE_TTYOUT_BUF, 2);
+    put_varint(&wb, iob.len + 1);
+    put_bytes(&wb, iob.data, iob.len);
+    check_rejected("message length exceeds buffer", wb.data, wb.len);
+
+    /* Message length shorter than what is present. */
+    wb.len = 0;
+    put_key(&wb, CLIENT_MESSAGE__TYPE_TTYOUT_BUF, 2);
+    put_varint(&wb, iob.len - 1);
+    put_bytes(&wb, iob.data, iob.len);
+    check_rejected("trailing data", wb.data, wb.len);
+
+    /* Data length that exceeds the IoBuffer. */
+    iob.len = 0;
+    put_key(&iob, 2, 2);
+    put_varint(&iob, 4);
+    put_bytes(&iob, "abc", 3);
+    wb.len = 0;
+    put_field(&wb, CLIENT_MESSAGE__TYPE_TTYOUT_BUF, &iob);
+    check_rejected("data length exceeds IoBuffer", wb.data, wb.len);
+
+    /* Data length larger than the address space. */
+    iob.len = 0;
+    put_key(&iob, 2, 2);
+    put_varint(&iob, UINT64_MAX);
+    put_bytes(&iob, "abc", 3);
+    wb.len = 0;
+    put_field(&wb, CLIENT_MESSAGE__TYPE_TTYOUT_BUF, &iob);
+    check_rejected("oversized data length", wb.data, wb.len);
+
+    /* Delay seconds that never terminate. */
+    ts.len = 0;
+    put_key(&ts, 1, 0);
+    for (i = 0; i < 11; i++)
+	put_bytes(&ts, "\x80", 1);
+    put_bytes(&ts, "\x01", 1);
+    iob.len = 0;
+    put_field(&iob, 1, &ts);
+    wb.len = 0;
+    put_field(&wb, CLIENT_MESSAGE__TYPE_TTYOUT_BUF, &iob);
+    check_rejected("overlong tv_sec", wb.data, wb.len);
+
+    /* Delay length that exceeds the IoBuffer. */
+    iob.len = 0;
+    put_key(&iob, 1, 2);
+    put_varint(&iob, 10);
+    put_bytes(&iob, "\x08\x01", 2);
+    wb.len = 0;
+    put_field(&wb, CLIENT_MESSAGE__TYPE_TTYOUT_BUF, &iob);
+    check_rejected("delay length exceeds IoBuffer", wb.data, wb.len);
+
+    /* A ten byte varint is the longest allowed. */
+    ts.len = 0;
+    put_key(&ts, 1, 0);
+    put_varint(&ts, UINT64_MAX);
+    iob.len = 0;
+    put_field(&iob, 1, &ts);
+    wb.len = 0;
+    put_field(&wb, CLIENT_MESSAGE__TYPE_TTYOUT_BUF, &iob);
+    check_fast_path("ten byte varint", wb.data, wb.len);
+}
+
+/*
+ * Unknown fields in an IoBuffer or TimeSpec are skipped.
+ */
+static void
+test_unknown(void)
+{
+    struct wirebuf wb, iob, ts, sub;
+
+    sub.len = 0;
+    put_bytes(&sub, "unknown", 7);
+
+    ts.len = 0;
+    put_key(&ts, 1, 0);
+    put_varint(&ts, 42);
+    put_key(&ts, 3, 0);			/* unknown varint */
+    put_varint(&ts, 300);
+    put_key(&ts, 4, 5);			/* unknown 32-bit */
+    put_bytes(&ts, "\x01\x02\x03\x04", 4);
+    put_key(&ts, 2, 0);
+    put_varint(&ts, 7);
+
+    iob.len = 0;
+    put_key(&iob, 15, 1);		/* unknown 64-bit */
+    put_bytes(&iob, "\x01\x02\x03\x04\x05\x06\x07\x08", 8);
+    put_field(&iob, 1, &ts);
+    put_field(&iob, 2000, &sub);	/* unknown length-delimited */
+    put_key(&iob, 2, 2);
+    put_varint(&iob, 5);
+    put_bytes(&iob, "hello", 5);
+    put_key(&iob, 3, 0);		/* unknown varint */
+    put_varint(&iob, UINT32_MAX);
+
+    wb.len = 0;
+    put_field(&wb, CLIENT_MESSAGE__TYPE_STDERR_BUF, &iob);
+    check_fast_path("unknown fields", wb.data, wb.len);
+
+    /* Groups are not valid in proto3. */
+    iob.len = 0;
+    put_key(&iob, 2, 2);
+    put_varint(&iob, 5);
+    put_bytes(&iob, "hello", 5);
+    put_key(&iob, 9, 3);
+    put_key(&iob, 9, 4);
+    wb.len = 0;
+    put_field(&wb, CLIENT_MESSAGE__TYPE_STDERR_BUF, &iob);
+    check_rejected("group field", wb.data, wb.len);
+
+    /* Unknown 64-bit field that is cut short. */
+    iob.len = 0;
+    put_key(&iob, 15, 1);
+    put_bytes(&iob, "\x01\x02\x03", 3);
+    wb.len = 0;
+    put_field(&wb, CLIENT_MESSAGE__TYPE_STDERR_BUF, &iob);
+    check_rejected("short 64-bit field", wb.data, wb.len);
+}
+
+/*
+ * Anything other than a single IoBuffer is left to protobuf-c,
+ * which unpacks it using the message arena.
+ */
+static void
+test_fallback(void)
+{
+    ClientMessage msg = CLIENT_MESSAGE__INIT, *umsg;
+    CommandSuspend suspend = COMMAND_SUSPEND__INIT;
+    ChangeWindowSize winsize = CHANGE_WINDOW_SIZE__INIT;
+    TimeSpec delay = TIME_SPEC__INIT;
+    struct wirebuf wb, iob, ts;
+    struct msg_arena arena;
+    uint8_t *buf;
+    size_t len;
+    int i;
+
+    msg_arena_init(&arena);
+
+    /* Messages that are not IoBuffers. */
+    delay.tv_sec = 5;
+    suspend.delay = &delay;
+    suspend.signal = "STOP";
+    msg.type_case = CLIENT_MESSAGE__TYPE_SUSPEND_EVENT;
+    msg.suspend_event = &suspend;
+    buf = pack_message(&msg, &len);
+    check_rejected("CommandSuspend", buf, len);
+    ntests++;
+    umsg = client_message__unpack(&arena.allocator, len, buf);
+    if (umsg == NULL || umsg->type_case != CLIENT_MESSAGE__TYPE_SUSPEND_EVENT ||
+	    strcmp(umsg->suspend_event->signal, "STOP") != 0 ||
+	    umsg->suspend_event->delay->tv_sec != 5) {
+	sudo_warnx_nodebug("CommandSuspend: unable to unpack using arena");
+	nerrors++;
+    }
+    msg_arena_reset(&arena);
+    free(buf);
+
+    winsize.rows = 24;
+    winsize.cols = 80;
+    winsize.delay = &delay;
+    msg.type_case = CLIENT_MESSAGE__TYPE_WINSIZE_EVENT;
+    msg.winsize_event = &winsize;
+    buf = pack_message(&msg, &len);
+    check_rejected("ChangeWindowSize", buf, len);
+    free(buf);
+
+    /* The delay field repeated, which protobuf-c must merge. */
+    iob.len = 0;
+    for (i = 0; i < 2; i++) {
+	ts.len = 0;
+	put_key(&ts, i + 1, 0);
+	put_varint(&ts, 10 + i);
+	put_field(&iob, 1, &ts);
+    }
+    put_key(&iob, 2, 2);
+    put_varint(&iob, 2);
+    put_bytes(&iob, "hi", 2);
+    wb.len = 0;
+    put_field(&wb, CLIENT_MESSAGE__TYPE_TTYIN_BUF, &iob);
+    check_rejected("repeated delay", wb.data, wb.len);
+    ntests++;
+    umsg = client_message__unpack(&arena.allocator, wb.len, wb.data);
+    if (umsg == NULL || umsg->type_case != CLIENT_MESSAGE__TYPE_TTYIN_BUF ||
+	    umsg->ttyin_buf->delay == NULL ||
+	    umsg->ttyin_buf->delay->tv_nsec != 11) {
+	sudo_warnx_nodebug("repeated delay: unable to unpack using arena");
+	nerrors++;
+    }
+    msg_arena_reset(&arena);
+
+    /* The IoBuffer repeated, protobuf-c keeps the last one. */
+    iob.len = 0;
+    put_key(&iob, 2, 2);
+    put_varint(&iob, 2);
+    put_bytes(&iob, "hi", 2);
+    wb.len = 0;
+    put_field(&wb, CLIENT_MESSAGE__TYPE_TTYIN_BUF, &iob);
+    put_field(&wb, CLIENT_MESSAGE__TYPE_TTYOUT_BUF, &iob);
+    check_rejected("two IoBuffers", wb.data, wb.len);
+    ntests++;
+    umsg = client_message__unpack(&arena.allocator, wb.len, wb.data);
+    if (umsg == NULL || umsg->type_case != CLIENT_MESSAGE__TYPE_TTYOUT_BUF) {
+	sudo_warnx_nodebug("two IoBuffers: unable to unpack using arena");
+	nerrors++;
+    }
+    msg_arena_reset(&arena);
+
+    /* An IoBuffer sent with the wrong wire type. */
+    wb.len = 0;
+    put_key(&wb, CLIENT_MESSAGE__TYPE_TTYIN_BUF, 0);
+    put_varint(&wb, 1);
+    check_rejected("IoBuffer wire type", wb.data, wb.len);
+
+    /* An empty message. */
+    check_rejected("empty message", wb.data, 0);
+
+    msg_arena_free(&arena);
+}
+
+int
+main(int argc, char *argv[])
+{
+    initprogname(argc > 0 ? argv[0] : "check_client_message");
+
+    test_roundtrip();
+    test_truncated();
+    test_varints();
+    test_unknown();
+    test_fallback();
+
+    if (ntests != 0) {
+	printf("check_client_message: %d test%s run, %d errors, %d%% success rate\n",
+	    ntests, ntests == 1 ? "" : "s", nerrors,
+	    (ntests - nerrors) * 100 / ntests);
+    }
+
+    exit(nerrors);
+}
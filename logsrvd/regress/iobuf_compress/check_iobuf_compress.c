@@ -0,0 +1,688 @@
+/*
+ * SPDX-License-Identifier: ISC
+ *
+ * Copyright (c) 2020 Todd C. Miller <Todd.Miller@sudo.ws>
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include "config.h"
+
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <netinet/in.h>
+#ifdef HAVE_STDBOOL_H
+# include <stdbool.h>
+#else
+# include "compat/stdbool.h"
+#endif /* HAVE_STDBOOL_H */
+#if defined(HAVE_STDINT_H)
+# include <stdint.h>
+#elif defined(HAVE_INTTYPES_H)
+# include <inttypes.h>
+#endif
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <fcntl.h>
+
+#define SUDO_ERROR_WRAP 0
+
+#include "log_server.pb-c.h"
+#include "sudo_gettext.h"	/* must be included before sudo_compat.h */
+#include "sudo_compat.h"
+#include "sudo_queue.h"
+#include "sudo_fatal.h"
+#include "sudo_util.h"
+#include "sudo_iolog.h"
+#include "iobuf_coalesce.h"
+#include "logsrvd.h"
+
+/*
+ * Check that I/O log data coalesced and compressed by the sudoers
+ * log server client is written to the I/O log by sudo_logsrvd exactly
+ * as if it had been sent unchanged.  The client side is the same
+ * iobuf_coalesce code the sudoers plugin uses, the server side is the
+ * real decode, inflate and store path.
+ */
+
+#define NWRITES			2000
+
+__dso_public int main(int argc, char *argv[]);
+
+static int ntests, nerrors;
+
+/* Streams written to, in the order they are checked. */
+static int iofds[] = { IOFD_STDIN, IOFD_STDOUT, IOFD_STDERR, IOFD_TTYIN,
+    IOFD_TTYOUT };
+
+struct io_write {
+    int iofd;
+    struct timespec delay;
+    size_t len;
+    uint8_t *data;
+};
+
+/*
+ * A simple generator so every run writes the same data.
+ */
+static unsigned int
+next_rand(unsigned int *state)
+{
+    *state = *state * 1103515245 + 12345;
+    return (*state >> 16) & 0x7fff;
+}
+
+/*
+ * Build a sequence of writes that switches streams every few writes.
+ * Most writes are small, as in an interactive session, a few are
+ * larger than the client's coalesce buffer.
+ */
+static struct io_write *
+make_writes(size_t nwrites)
+{
+    struct io_write *writes;
+    unsigned int state = 1;
+    size_t i, j;
+    int iofd = IOFD_TTYOUT;
+
+    writes = calloc(nwrites, sizeof(*writes));
+    if (writes == NULL)
+	sudo_fatalx_nodebug("unable to allocate memory");
+    for (i = 0; i < nwrites; i++) {
+	struct io_write *w = &writes[i];
+
+	if (next_rand(&state) % 8 == 0)
+	    iofd = iofds[next_rand(&state) % nitems(iofds)];
+	w->iofd = iofd;
+	w->delay.tv_sec = next_rand(&state) % 16 == 0 ? 1 : 0;
+	w->delay.tv_nsec = (long)(next_rand(&state) % 1000) * 999999;
+	switch (next_rand(&state) % 64) {
+	case 0:
+	    w->len = IOBUF_COALESCE_MAX + next_rand(&state);
+	    break;
+	case 1:
+	    w->len = IOBUF_COALESCE_MAX - 1;
+	    break;
+	default:
+	    w->len = 1 + next_rand(&state) % 512;
+	    break;
+	}
+	if ((w->data = malloc(w->len)) == NULL)
+	    sudo_fatalx_nodebug("unable to allocate memory");
+	/* Mostly text, with some binary data thrown in. */
+	for (j = 0; j < w->len; j++) {
+	    if (i % 7 == 0)
+		w->data[j] = (uint8_t)next_rand(&state);
+	    else
+		w->data[j] = (uint8_t)("abcdefgh \r\n"[next_rand(&state) % 11]);
+	}
+    }
+    return writes;
+}
+
+static void
+free_writes(struct io_write *writes, size_t nwrites)
+{
+    size_t i;
+
+    for (i = 0; i < nwrites; i++)
+	free(writes[i].data);
+    free(writes);
+}
+
+static ClientMessage__TypeCase
+iofd_to_type(int iofd)
+{
+    switch (iofd) {
+    case IOFD_STDIN:
+	return CLIENT_MESSAGE__TYPE_STDIN_BUF;
+    case IOFD_STDOUT:
+	return CLIENT_MESSAGE__TYPE_STDOUT_BUF;
+    case IOFD_STDERR:
+	return CLIENT_MESSAGE__TYPE_STDERR_BUF;
+    case IOFD_TTYIN:
+	return CLIENT_MESSAGE__TYPE_TTYIN_BUF;
+    case IOFD_TTYOUT:
+	return CLIENT_MESSAGE__TYPE_TTYOUT_BUF;
+    default:
+	sudo_fatalx_nodebug("%s: unexpected iofd %d", __func__, iofd);
+    }
+}
+
+static int
+type_to_iofd(ClientMessage__TypeCase type)
+{
+    switch (type) {
+    case CLIENT_MESSAGE__TYPE_STDIN_BUF:
+	return IOFD_STDIN;
+    case CLIENT_MESSAGE__TYPE_STDOUT_BUF:
+	return IOFD_STDOUT;
+    case CLIENT_MESSAGE__TYPE_STDERR_BUF:
+	return IOFD_STDERR;
+    case CLIENT_MESSAGE__TYPE_TTYIN_BUF:
+	return IOFD_TTYIN;
+    case CLIENT_MESSAGE__TYPE_TTYOUT_BUF:
+	return IOFD_TTYOUT;
+    default:
+	return -1;
+    }
+}
+
+/*
+ * Set up the server's side of the connection, writing the I/O log
+ * to a new directory under tmpdir.
+ */
+static void
+server_open(struct connection_closure *closure, const char *tmpdir,
+    const char *name, bool compress)
+{
+    char path[PATH_MAX];
+
+    memset(closure, 0, sizeof(*closure));
+    (void)snprintf(path, sizeof(path), "%s/%s", tmpdir, name);
+    if (mkdir(path, S_IRWXU) != 0)
+	sudo_fatal_nodebug("mkdir %s", path);
+    closure->iolog_dir_fd = open(path, O_RDONLY);
+    if (closure->iolog_dir_fd == -1)
+	sudo_fatal_nodebug("open %s", path);
+    closure->iolog_files[IOFD_TIMING].enabled = true;
+    if (!iolog_open(&closure->iolog_files[IOFD_TIMING],
+	    closure->iolog_dir_fd, IOFD_TIMING, "w"))
+	sudo_fatal_nodebug("unable to open %s/timing", path);
+    closure->state = RUNNING;
+    if (compress && !iobuf_inflate_init(closure))
+	sudo_fatalx_nodebug("%s", closure->errstr);
+}
+
+static void
+server_close(struct connection_closure *closure)
+{
+    iolog_close_all(closure);
+#ifdef HAVE_ZLIB_H
+    if (closure->zstream != NULL) {
+	inflateEnd(closure->zstream);
+	free(closure->zstream);
+    }
+    free(closure->zbuf.data);
+#endif
+}
+
+/*
+ * Decode a ClientMessage the way handle_client_message() and
+ * handle_iobuf() do and store it in the I/O log.
+ */
+static bool
+server_recv(struct connection_closure *closure, const uint8_t *buf,
+    size_t len)
+{
+    ClientMessage msg;
+    IoBuffer iobuf, *iobufp = &iobuf;
+    TimeSpec delay;
+    int iofd;
+#ifdef HAVE_ZLIB_H
+    IoBuffer inflated;
+#endif
+
+    if (!client_message_unpack_iobuf(buf, len, &msg, &iobuf, &delay)) {
+	closure->errstr = "unable to unpack IoBuffer";
+	return false;
+    }
+    iofd = type_to_iofd(msg.type_case);
+    if (iofd == -1 || iobuf.delay == NULL) {
+	closure->errstr = "invalid IoBuffer";
+	return false;
+    }
+#ifdef HAVE_ZLIB_H
+    if (closure->zstream != NULL) {
+	if (!iobuf_inflate(&iobuf, &inflated, closure))
+	    return false;
+	iobufp = &inflated;
+    }
+#endif
+    if (store_iobuf(iofd, iobufp, closure) == -1) {
+	closure->errstr = "unable to store IoBuffer";
+	return false;
+    }
+    return true;
+}
+
+/*
+ * Send an IoBuffer the way fmt_iobuf_message() does (iobuf_send_t).
+ * The data has already been compressed by iobuf_coalesce if enabled.
+ */
+static bool
+client_send(int type, const uint8_t *data, size_t len,
+    struct timespec *delay, void *v)
+{
+    struct connection_closure *server = v;
+    ClientMessage msg = CLIENT_MESSAGE__INIT;
+    IoBuffer iobuf = IO_BUFFER__INIT;
+    TimeSpec ts = TIME_SPEC__INIT;
+    uint8_t *buf;
+    size_t msglen;
+
+    ts.tv_sec = delay->tv_sec;
+    ts.tv_nsec = delay->tv_nsec;
+    iobuf.delay = &ts;
+    iobuf.data.data = (uint8_t *)data;
+    iobuf.data.len = len;
+    msg.type_case = type;
+    msg.ttyout_buf = &iobuf;
+
+    msglen = client_message__get_packed_size(&msg);
+    if ((buf = malloc(msglen)) == NULL)
+	sudo_fatalx_nodebug("unable to allocate memory");
+    client_message__pack(&msg, buf);
+    if (!server_recv(server, buf, msglen)) {
+	sudo_fatalx_nodebug("%s: server rejected IoBuffer: %s", __func__,
+	    server->errstr);
+    }
+    free(buf);
+    return true;
+}
+
+/*
+ * Send all the writes to a new server session in tmpdir/name.
+ * Stores the total elapsed time the server recorded in elapsed.
+ */
+static void
+run_session(const char *tmpdir, const char *name, struct io_write *writes,
+    size_t nwrites, bool coalesce, bool compress, struct timespec *elapsed)
+{
+    struct connection_closure server;
+    struct iobuf_coalesce client;
+    size_t i;
+
+    server_open(&server, tmpdir, name, compress);
+    iobuf_coalesce_init(&client, coalesce, client_send, &server);
+    if (compress && !iobuf_coalesce_compress(&client))
+	sudo_fatalx_nodebug("unable to initialize compression");
+
+    for (i = 0; i < nwrites; i++) {
+	struct io_write *w = &writes[i];
+
+	if (iobuf_coalesce_write(&client, iofd_to_type(w->iofd), w->data,
+		w->len, &w->delay) == -1)
+	    sudo_fatalx_nodebug("%s: unable to send I/O log data", name);
+    }
+    if (!iobuf_coalesce_flush(&client))
+	sudo_fatalx_nodebug("%s: unable to flush I/O log data", name);
+
+    *elapsed = server.elapsed_time;
+    iobuf_coalesce_free(&client);
+    server_close(&server);
+}
+
+/*
+ * Read the contents of tmpdir/name/file into a newly-allocated buffer.
+ * A missing file is treated as empty.
+ */
+static uint8_t *
+read_file(const char *tmpdir, const char *name, const char *file,
+    size_t *lenp)
+{
+    char path[PATH_MAX];
+    uint8_t *buf = NULL;
+    struct stat sb;
+    int fd;
+
+    *lenp = 0;
+    (void)snprintf(path, sizeof(path), "%s/%s/%s", tmpdir, name, file);
+    if ((fd = open(path, O_RDONLY)) == -1)
+	return NULL;
+    if (fstat(fd, &sb) == -1)
+	sudo_fatal_nodebug("fstat %s", path);
+    if ((buf = malloc(sb.st_size + 1)) == NULL)
+	sudo_fatalx_nodebug("unable to allocate memory");
+    if (read(fd, buf, sb.st_size) != sb.st_size)
+	sudo_fatal_nodebug("read %s", path);
+    buf[sb.st_size] = '\0';
+    close(fd);
+    *lenp = sb.st_size;
+    return buf;
+}
+
+static unsigned int
+count_lines(const uint8_t *buf, size_t len)
+{
+    unsigned int lines = 0;
+    size_t i;
+
+    for (i = 0; i < len; i++) {
+	if (buf[i] == '\n')
+	    lines++;
+    }
+    return lines;
+}
+
+/*
+ * Check that each stream of session name holds the original data.
+ */
+static void
+check_streams(const char *tmpdir, const char *name, struct io_write *writes,
+    size_t nwrites)
+{
+    uint8_t *expected, *buf;
+    size_t i, j, len, explen = 0;
+
+    for (j = 0; j < nwrites; j++)
+	explen += writes[j].len;
+    if ((expected = malloc(explen)) == NULL)
+	sudo_fatalx_nodebug("unable to allocate memory");
+    for (i = 0; i < nitems(iofds); i++) {
+	explen = 0;
+	for (j = 0; j < nwrites; j++) {
+	    if (writes[j].iofd == iofds[i]) {
+		memcpy(expected + explen, writes[j].data, writes[j].len);
+		explen += writes[j].len;
+	    }
+	}
+	buf = read_file(tmpdir, name, iolog_fd_to_name(iofds[i]), &len);
+	ntests++;
+	if (len != explen || (len != 0 && memcmp(buf, expected, len) != 0)) {
+	    sudo_warnx_nodebug("%s: %s: data does not match what was sent",
+		name, iolog_fd_to_name(iofds[i]));
+	    nerrors++;
+	}
+	free(buf);
+    }
+    free(expected);
+}
+
+/*
+ * Check that two sessions have identical timing files.
+ */
+static void
+check_timing(const char *tmpdir, const char *name1, const char *name2)
+{
+    uint8_t *timing1, *timing2;
+    size_t len1, len2;
+
+    timing1 = read_file(tmpdir, name1, "timing", &len1);
+    timing2 = read_file(tmpdir, name2, "timing", &len2);
+    ntests++;
+    if (len1 == 0 || len1 != len2 || memcmp(timing1, timing2, len1) != 0) {
+	sudo_warnx_nodebug("%s: timing records differ from %s", name2, name1);
+	nerrors++;
+    }
+    free(timing1);
+    free(timing2);
+}
+
+static void
+check_elapsed(const char *name, const struct timespec *elapsed,
+    const struct timespec *expected)
+{
+    ntests++;
+    if (sudo_timespeccmp(elapsed, expected, !=)) {
+	sudo_warnx_nodebug("%s: elapsed time %lld.%09ld, expected %lld.%09ld",
+	    name, (long long)elapsed->tv_sec, elapsed->tv_nsec,
+	    (long long)expected->tv_sec, expected->tv_nsec);
+	nerrors++;
+    }
+}
+
+/*
+ * Coalesced and compressed I/O decodes to the original streams,
+ * compression doesn't change the timing records and coalescing
+ * doesn't change the total elapsed time.
+ */
+static void
+test_sessions(const char *tmpdir)
+{
+    struct timespec expected, elapsed;
+    struct io_write *writes;
+    uint8_t *timing1, *timing2;
+    size_t i, len1, len2;
+
+    writes = make_writes(NWRITES);
+    sudo_timespecclear(&expected);
+    for (i = 0; i < NWRITES; i++)
+	sudo_timespecadd(&expected, &writes[i].delay, &expected);
+
+    run_session(tmpdir, "plain", writes, NWRITES, false, false, &elapsed);
+    check_streams(tmpdir, "plain", writes, NWRITES);
+    check_elapsed("plain", &elapsed, &expected);
+
+    run_session(tmpdir, "coalesced", writes, NWRITES, true, false, &elapsed);
+    check_streams(tmpdir, "coalesced", writes, NWRITES);
+    check_elapsed("coalesced", &elapsed, &expected);
+
+    /* Coalescing must have reduced the number of records. */
+    timing1 = read_file(tmpdir, "plain", "timing", &len1);
+    timing2 = read_file(tmpdir, "coalesced", "timing", &len2);
+    ntests++;
+    if (count_lines(timing1, len1) != NWRITES ||
+	    count_lines(timing2, len2) >= NWRITES / 2) {
+	sudo_warnx_nodebug("coalesced: %u records, plain %u",
+	    count_lines(timing2, len2), count_lines(timing1, len1));
+	nerrors++;
+    }
+    free(timing1);
+    free(timing2);
+
+#ifdef HAVE_ZLIB_H
+    run_session(tmpdir, "compressed", writes, NWRITES, false, true, &elapsed);
+    check_streams(tmpdir, "compressed", writes, NWRITES);
+    check_elapsed("compressed", &elapsed, &expected);
+    check_timing(tmpdir, "plain", "compressed");
+
+    run_session(tmpdir, "coalesced_compressed", writes, NWRITES, true, true,
+	&elapsed);
+    check_streams(tmpdir, "coalesced_compressed", writes, NWRITES);
+    check_elapsed("coalesced_compressed", &elapsed, &expected);
+    check_timing(tmpdir, "coalesced", "coalesced_compressed");
+#endif
+
+    free_writes(writes, NWRITES);
+}
+
+#ifdef HAVE_ZLIB_H
+/*
+ * Compress len bytes of data as a packed IoBuffer message using strm.
+ */
+static uint8_t *
+pack_compressed(z_stream *strm, const uint8_t *data, size_t len,
+    size_t *msglenp)
+{
+    ClientMessage msg = CLIENT_MESSAGE__INIT;
+    IoBuffer iobuf = IO_BUFFER__INIT;
+    TimeSpec ts = TIME_SPEC__INIT;
+    size_t zsize = deflateBound(strm, len) + 16;
+    uint8_t *zbuf, *buf;
+
+    if ((zbuf = malloc(zsize)) == NULL)
+	sudo_fatalx_nodebug("unable to allocate memory");
+    strm->next_in = (Bytef *)data;
+    strm->avail_in = len;
+    strm->next_out = zbuf;
+    strm->avail_out = zsize;
+    if (deflate(strm, Z_SYNC_FLUSH) != Z_OK)
+	sudo_fatalx_nodebug("%s: unable to compress", __func__);
+
+    iobuf.delay = &ts;
+    iobuf.data.data = zbuf;
+    iobuf.data.len = zsize - strm->avail_out;
+    msg.type_case = CLIENT_MESSAGE__TYPE_TTYOUT_BUF;
+    msg.ttyout_buf = &iobuf;
+    *msglenp = client_message__get_packed_size(&msg);
+    if ((buf = malloc(*msglenp)) == NULL)
+	sudo_fatalx_nodebug("unable to allocate memory");
+    client_message__pack(&msg, buf);
+    free(zbuf);
+    return buf;
+}
+
+/*
+ * Check that the server rejects a compressed payload.
+ * The first message is valid and must be accepted.
+ */
+static void
+check_reject(const char *tmpdir, const char *name, const uint8_t *data,
+    size_t len, const uint8_t *bad, size_t badlen, bool badraw)
+{
+    struct connection_closure server;
+    z_stream strm;
+    uint8_t *buf;
+    size_t msglen;
+
+    memset(&strm, 0, sizeof(strm));
+    if (deflateInit(&strm, Z_DEFAULT_COMPRESSION) != Z_OK)
+	sudo_fatalx_nodebug("unable to initialize compression");
+    server_open(&server, tmpdir, name, true);
+
+    buf = pack_compressed(&strm, data, len, &msglen);
+    ntests++;
+    if (!server_recv(&server, buf, msglen)) {
+	sudo_warnx_nodebug("%s: valid IoBuffer rejected: %s", name,
+	    server.errstr);
+	nerrors++;
+    }
+    free(buf);
+
+    if (badraw) {
+	/* Send bad as the compressed data itself. */
+	ClientMessage msg = CLIENT_MESSAGE__INIT;
+	IoBuffer iobuf = IO_BUFFER__INIT;
+	TimeSpec ts = TIME_SPEC__INIT;
+
+	iobuf.delay = &ts;
+	iobuf.data.data = (uint8_t *)bad;
+	iobuf.data.len = badlen;
+	msg.type_case = CLIENT_MESSAGE__TYPE_TTYOUT_BUF;
+	msg.ttyout_buf = &iobuf;
+	msglen = client_message__get_packed_size(&msg);
+	if ((buf = malloc(msglen)) == NULL)
+	    sudo_fatalx_nodebug("unable to allocate memory");
+	client_message__pack(&msg, buf);
+    } else {
+	/* Send bad compressed as the client would. */
+	buf = pack_compressed(&strm, bad, badlen, &msglen);
+    }
+    ntests++;
+    server.errstr = NULL;
+    if (server_recv(&server, buf, msglen)) {
+	sudo_warnx_nodebug("%s: invalid IoBuffer accepted", name);
+	nerrors++;
+    } else if (server.errstr == NULL) {
+	sudo_warnx_nodebug("%s: IoBuffer rejected without an error", name);
+	nerrors++;
+    }
+    free(buf);
+
+    server_close(&server);
+    deflateEnd(&strm);
+}
+
+/*
+ * Corrupt or oversized compressed payloads are rejected.
+ */
+static void
+test_reject(const char *tmpdir)
+{
+    static const uint8_t garbage[] = {
+	0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff
+    };
+    const char text[] = "some terminal output\r\n";
+    uint8_t *big, stream_end[64];
+    size_t bigsize = 2 * MESSAGE_SIZE_MAX;
+    z_stream strm;
+
+    /* Not a deflate block at all. */
+    check_reject(tmpdir, "reject_garbage", (const uint8_t *)text,
+	sizeof(text) - 1, garbage, sizeof(garbage), true);
+
+    /* Expands to more than the largest message allowed. */
+    if ((big = calloc(1, bigsize)) == NULL)
+	sudo_fatalx_nodebug("unable to allocate memory");
+    check_reject(tmpdir, "reject_oversized", (const uint8_t *)text,
+	sizeof(text) - 1, big, bigsize, false);
+    free(big);
+
+    /* A new zlib stream header in the middle of the stream. */
+    memset(&strm, 0, sizeof(strm));
+    if (deflateInit(&strm, Z_DEFAULT_COMPRESSION) != Z_OK)
+	sudo_fatalx_nodebug("unable to initialize compression");
+    strm.next_in = (Bytef *)text;
+    strm.avail_in = sizeof(text) - 1;
+    strm.next_out = stream_end;
+    strm.avail_out = sizeof(stream_end);
+    if (deflate(&strm, Z_SYNC_FLUSH) != Z_OK)
+	sudo_fatalx_nodebug("unable to compress");
+    check_reject(tmpdir, "reject_new_stream", (const uint8_t *)text,
+	sizeof(text) - 1, stream_end, sizeof(stream_end) - strm.avail_out,
+	true);
+    deflateEnd(&strm);
+
+}
+#endif /* HAVE_ZLIB_H */
+
+/*
+ * Remove the session directories and their files.
+ */
+static void
+cleanup(const char *tmpdir)
+{
+    static const char *sessions[] = {
+	"plain", "coalesced", "compressed", "coalesced_compressed",
+	"reject_garbage", "reject_oversized", "reject_new_stream"
+    };
+    char path[PATH_MAX];
+    size_t i;
+    int iofd;
+
+    for (i = 0; i < nitems(sessions); i++) {
+	for (iofd = 0; iofd < IOFD_MAX; iofd++) {
+	    (void)snprintf(path, sizeof(path), "%s/%s/%s", tmpdir,
+		sessions[i], iolog_fd_to_name(iofd));
+	    (void)unlink(path);
+	}
+	(void)snprintf(path, sizeof(path), "%s/%s", tmpdir, sessions[i]);
+	(void)rmdir(path);
+    }
+    if (rmdir(tmpdir) != 0) {
+	sudo_warn_nodebug("unable to remove %s", tmpdir);
+	nerrors++;
+    }
+}
+
+int
+main(int argc, char *argv[])
+{
+    char tmpdir[] = "/tmp/check_iobuf_compress.XXXXXX";
+
+    initprogname(argc > 0 ? argv[0] : "check_iobuf_compress");
+
+    if (mkdtemp(tmpdir) == NULL)
+	sudo_fatal_nodebug("mkdtemp");
+    iolog_set_owner(geteuid(), getegid());
+    iolog_set_compress(false);
+
+    test_sessions(tmpdir);
+#ifdef HAVE_ZLIB_H
+    test_reject(tmpdir);
+#endif
+    cleanup(tmpdir);
+
+    if (ntests != 0) {
+	printf("check_iobuf_compress: %d test%s run, %d errors, %d%% success rate\n",
+	    ntests, ntests == 1 ? "" : "s", nerrors,
+	    (ntests - nerrors) * 100 / ntests);
+    }
+
+    exit(nerrors);
+}
@@ -0,0 +1,244 @@
+/*
+ * SPDX-License-Identifier: ISC
+ *
+ * Copyright (c) 2020 Todd C. Miller <Todd.Miller@sudo.ws>
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include "config.h"
+
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <netinet/in.h>
+#ifdef HAVE_STDBOOL_H
+# include <stdbool.h>
+#else
+# include "compat/stdbool.h"
+#endif /* HAVE_STDBOOL_H */
+#if defined(HAVE_STDINT_H)
+# include <stdint.h>
+#elif defined(HAVE_INTTYPES_H)
+# include <inttypes.h>
+#endif
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <fcntl.h>
+
+#define SUDO_ERROR_WRAP 0
+
+#include "log_server.pb-c.h"
+#include "sudo_gettext.h"	/* must be included before sudo_compat.h */
+#include "sudo_compat.h"
+#include "sudo_queue.h"
+#include "sudo_fatal.h"
+#include "sudo_util.h"
+#include "sudo_iolog.h"
+#include "logsrvd.h"
+
+/*
+ * Check that sudo_logsrvd records each commit point in the seek index
+ * when iolog_flush is set and writes no index when it is not.
+ */
+
+#define NCOMMITS	4
+
+__dso_public int main(int argc, char *argv[]);
+
+static int ntests, nerrors;
+
+/*
+ * Install a configuration with iolog_flush set to flush.
+ */
+static void
+set_flush(const char *tmpdir, bool flush)
+{
+    char path[PATH_MAX];
+    FILE *fp;
+
+    (void)snprintf(path, sizeof(path), "%s/logsrvd.conf", tmpdir);
+    if ((fp = fopen(path, "w")) == NULL)
+	sudo_fatal_nodebug("%s", path);
+    fprintf(fp, "[iolog]\niolog_flush = %s\n", flush ? "true" : "false");
+    fclose(fp);
+    if (!logsrvd_conf_read(path))
+	sudo_fatalx_nodebug("unable to read %s", path);
+    (void)unlink(path);
+
+    /* Don't try to give the files to root. */
+    iolog_set_owner(geteuid(), getegid());
+}
+
+static off_t
+file_size(int dfd, const char *name)
+{
+    struct stat sb;
+
+    if (fstatat(dfd, name, &sb, 0) == -1)
+	return -1;
+    return sb.st_size;
+}
+
+/*
+ * Store I/O in a new session in tmpdir/name, flushing at each
+ * commit point the way server_commit_cb() does, and check the
+ * seek index afterwards.
+ */
+static void
+run_session(const char *tmpdir, const char *name, bool flush)
+{
+    struct timespec commits[NCOMMITS];
+    off_t sizes[NCOMMITS][2], ttyout_len = 0, stdout_len = 0;
+    struct connection_closure closure;
+    struct iolog_chunk chunk;
+    char path[PATH_MAX];
+    char data[128];
+    int i, j, dfd;
+
+    set_flush(tmpdir, flush);
+
+    memset(&closure, 0, sizeof(closure));
+    (void)snprintf(path, sizeof(path), "%s/%s", tmpdir, name);
+    if (mkdir(path, S_IRWXU) != 0)
+	sudo_fatal_nodebug("mkdir %s", path);
+    closure.details.iolog_path = path;
+    closure.iolog_dir_fd = open(path, O_RDONLY);
+    if (closure.iolog_dir_fd == -1)
+	sudo_fatal_nodebug("open %s", path);
+    closure.iolog_files[IOFD_TIMING].enabled = true;
+    if (!iolog_open(&closure.iolog_files[IOFD_TIMING],
+	    closure.iolog_dir_fd, IOFD_TIMING, "w"))
+	sudo_fatal_nodebug("unable to open %s/timing", path);
+    closure.state = RUNNING;
+    closure.lines = 24;
+    closure.cols = 80;
+
+    for (i = 0; i < NCOMMITS; i++) {
+	for (j = 0; j <= i; j++) {
+	    IoBuffer iobuf = IO_BUFFER__INIT;
+	    TimeSpec delay = TIME_SPEC__INIT;
+
+	    memset(data, 'a' + j, sizeof(data));
+	    delay.tv_nsec = 250000000;
+	    iobuf.delay = &delay;
+	    iobuf.data.data = (uint8_t *)data;
+	    iobuf.data.len = sizeof(data) - i;
+	    if (store_iobuf(j % 2 ? IOFD_STDOUT : IOFD_TTYOUT, &iobuf,
+		    &closure) == -1)
+		sudo_fatalx_nodebug("%s: unable to store IoBuffer", name);
+	    if (j % 2)
+		stdout_len += iobuf.data.len;
+	    else
+		ttyout_len += iobuf.data.len;
+	}
+	if (!iolog_flush_all(&closure))
+	    sudo_fatalx_nodebug("%s: unable to flush I/O log", name);
+	commits[i] = closure.elapsed_time;
+	sizes[i][0] = file_size(closure.iolog_dir_fd, "ttyout");
+	sizes[i][1] = file_size(closure.iolog_dir_fd, "stdout");
+	if (sizes[i][1] == -1) {
+	    /* Not created until the first write. */
+	    sizes[i][1] = 0;
+	}
+    }
+
+    /* iolog_close_all() closes the directory too. */
+    dfd = dup(closure.iolog_dir_fd);
+    iolog_close_all(&closure);
+
+    for (i = 0; i < NCOMMITS; i++) {
+	bool found;
+
+	memset(&chunk, 0, sizeof(chunk));
+	found = iolog_chunk_find(dfd, &commits[i], &chunk) &&
+	    sudo_timespeccmp(&chunk.elapsed, &commits[i], ==);
+	ntests++;
+	if (found != flush) {
+	    sudo_warnx_nodebug("%s: commit point %d %s in the seek index",
+		name, i, found ? "found" : "not found");
+	    nerrors++;
+	    continue;
+	}
+	if (!found)
+	    continue;
+
+	/* With iolog_flush set the data is on disk at each commit. */
+	ntests++;
+	if (chunk.offsets[IOFD_TTYOUT] != sizes[i][0] ||
+		chunk.offsets[IOFD_STDOUT] != sizes[i][1] ||
+		chunk.lines != 24 || chunk.cols != 80) {
+	    sudo_warnx_nodebug("%s: commit point %d: offsets %lld %lld, "
+		"expected %lld %lld", name, i,
+		(long long)chunk.offsets[IOFD_TTYOUT],
+		(long long)chunk.offsets[IOFD_STDOUT],
+		(long long)sizes[i][0], (long long)sizes[i][1]);
+	    nerrors++;
+	}
+    }
+
+    /* Without an index, the index file must not exist at all. */
+    ntests++;
+    if ((file_size(dfd, IOLOG_SEEK_INDEX) != -1) != flush) {
+	sudo_warnx_nodebug("%s: %s %s", name, IOLOG_SEEK_INDEX,
+	    flush ? "missing" : "unexpectedly written");
+	nerrors++;
+    }
+
+    /* Either way, all the data is written by the time the log is closed. */
+    ntests++;
+    if (file_size(dfd, "ttyout") != ttyout_len ||
+	    file_size(dfd, "stdout") != stdout_len) {
+	sudo_warnx_nodebug("%s: wrong I/O log file sizes", name);
+	nerrors++;
+    }
+
+    for (i = 0; i < IOFD_MAX; i++)
+	(void)unlinkat(dfd, iolog_fd_to_name(i), 0);
+    (void)unlinkat(dfd, IOLOG_SEEK_INDEX, 0);
+    close(dfd);
+    if (rmdir(path) != 0) {
+	sudo_warn_nodebug("unable to remove %s", path);
+	nerrors++;
+    }
+}
+
+int
+main(int argc, char *argv[])
+{
+    char tmpdir[] = "/tmp/check_seek_index.XXXXXX";
+
+    initprogname(argc > 0 ? argv[0] : "check_seek_index");
+
+    if (mkdtemp(tmpdir) == NULL)
+	sudo_fatal_nodebug("mkdtemp");
+
+    run_session(tmpdir, "flush", true);
+    run_session(tmpdir, "noflush", false);
+
+    if (rmdir(tmpdir) != 0) {
+	sudo_warn_nodebug("unable to remove %s", tmpdir);
+	nerrors++;
+    }
+
+    if (ntests != 0) {
+	printf("check_seek_index: %d test%s run, %d errors, %d%% success rate\n",
+	    ntests, ntests == 1 ? "" : "s", nerrors,
+	    (ntests - nerrors) * 100 / ntests);
+    }
+
+    exit(nerrors);
+}
@@ -129,6 +129,8 @@ if test -z "$rundir"; then
 fi
 AC_MSG_RESULT([$rundir])
 SUDO_DEFINE_UNQUOTED(_PATH_SUDO_TIMEDIR, "$rundir/ts")
+SUDO_DEFINE_UNQUOTED(_PATH_SUDO_PWCACHE_DIR, "$rundir/pwcache")
+SUDO_DEFINE_UNQUOTED(_PATH_SUDO_DIGEST_DIR, "$rundir/digests")
 ])dnl
 
 dnl
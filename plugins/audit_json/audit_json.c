@@ -24,7 +24,9 @@
 #include <config.h>
 
 #include <sys/types.h>
+#include <sys/socket.h>
 #include <sys/stat.h>
+#include <sys/un.h>
 #include <sys/wait.h>
 
 #include <stdio.h>
@@ -62,8 +64,22 @@
 
 #ifndef HAVE_FSEEKO
 # define fseeko(f, o, w)	fseek((f), (o), (w))
+# define ftello(f)		ftell(f)
 #endif
 
+/*
+ * Plugin options:
+ *
+ * logfile=path		Path to the audit log (default sudo_audit.json)
+ * logformat=json	The log is a single JSON object (the default)
+ * logformat=jsonl	JSON Lines, one record per line, append-only
+ * rotate_size=size	Rotate the log when it reaches size bytes (or K, M, G)
+ * rotate_interval=secs	Rotate the log when an interval of secs seconds
+ *			(counted from the epoch) has passed since the last write
+ * socket=path		Send JSON Lines records to a local datagram socket
+ *			instead of writing them to the log file
+ */
+
 static int audit_debug_instance = SUDO_DEBUG_INSTANCE_INITIALIZER;
 static sudo_conv_t audit_conv;
 static sudo_printf_t audit_printf;
@@ -72,8 +88,16 @@ static struct audit_state {
     int submit_optind;
     char uuid_str[37];
     bool accepted;
+    bool json_lines;
+    int sock;
     FILE *log_fp;
+    FILE *record_fp;
+    char *record_buf;
+    size_t record_len;
     char *logfile;
+    char *socket_path;
+    off_t rotate_size;
+    time_t rotate_interval;
     char * const * settings;
     char * const * user_info;
     char * const * submit_argv;
@@ -130,6 +154,115 @@ oom:
     return false;
 }
 
+/*
+ * Parse a size in bytes with an optional K, M or G suffix.
+ */
+static bool
+parse_size(const char *str, off_t *sizep)
+{
+    unsigned long long size, multiplier = 1;
+    char *ep;
+    debug_decl(parse_size, SUDO_DEBUG_PLUGIN);
+
+    errno = 0;
+    size = strtoull(str, &ep, 10);
+    if (ep == str || *str == '-' || errno != 0)
+	debug_return_bool(false);
+    switch (*ep) {
+    case 'g': case 'G':
+	multiplier *= 1024;
+	/* FALLTHROUGH */
+    case 'm': case 'M':
+	multiplier *= 1024;
+	/* FALLTHROUGH */
+    case 'k': case 'K':
+	multiplier *= 1024;
+	ep++;
+	break;
+    }
+    if (*ep != '\0' || size > LLONG_MAX / multiplier)
+	debug_return_bool(false);
+    *sizep = (off_t)(size * multiplier);
+    debug_return_bool(true);
+}
+
+/*
+ * Open (or reopen) the log file.
+ * In JSON Lines mode the file is opened for append only.
+ */
+static bool
+audit_open_log(void)
+{
+    mode_t oldmask;
+    int fd, flags;
+    debug_decl(audit_open_log, SUDO_DEBUG_PLUGIN);
+
+    if (state.log_fp != NULL) {
+	fclose(state.log_fp);
+	state.log_fp = NULL;
+    }
+
+    flags = O_CREAT | (state.json_lines ? O_WRONLY|O_APPEND : O_RDWR);
+    oldmask = umask(S_IRWXG|S_IRWXO);
+    fd = open(state.logfile, flags, S_IRUSR|S_IWUSR);
+    (void)umask(oldmask);
+    if (fd == -1 ||
+	    (state.log_fp = fdopen(fd, state.json_lines ? "a" : "w")) == NULL) {
+	sudo_debug_printf(SUDO_DEBUG_ERROR|SUDO_DEBUG_ERRNO|SUDO_DEBUG_LINENO,
+	    "unable to open %s", state.logfile);
+	if (fd != -1)
+	    close(fd);
+	debug_return_bool(false);
+    }
+    debug_return_bool(true);
+}
+
+/*
+ * Connect to the collector's datagram socket.
+ * The socket is non-blocking so a slow or stuck collector cannot
+ * hold up sudo; records it has no room for are dropped.
+ */
+static bool
+audit_open_socket(void)
+{
+    struct sockaddr_un sun;
+    int flags;
+    debug_decl(audit_open_socket, SUDO_DEBUG_PLUGIN);
+
+    if (state.sock != -1)
+	close(state.sock);
+
+    memset(&sun, 0, sizeof(sun));
+    sun.sun_family = AF_UNIX;
+    if (strlcpy(sun.sun_path, state.socket_path, sizeof(sun.sun_path)) >=
+	    sizeof(sun.sun_path)) {
+	sudo_debug_printf(SUDO_DEBUG_ERROR|SUDO_DEBUG_LINENO,
+	    "socket path too long: %s", state.socket_path);
+	state.sock = -1;
+	debug_return_bool(false);
+    }
+    state.sock = socket(AF_UNIX, SOCK_DGRAM, 0);
+    if (state.sock == -1 ||
+	    connect(state.sock, (struct sockaddr *)&sun, sizeof(sun)) == -1) {
+	sudo_debug_printf(SUDO_DEBUG_ERROR|SUDO_DEBUG_ERRNO|SUDO_DEBUG_LINENO,
+	    "unable to connect to %s", state.socket_path);
+	if (state.sock != -1) {
+	    close(state.sock);
+	    state.sock = -1;
+	}
+	debug_return_bool(false);
+    }
+    flags = fcntl(state.sock, F_GETFL, 0);
+    if (flags == -1 || fcntl(state.sock, F_SETFL, flags | O_NONBLOCK) == -1) {
+	sudo_debug_printf(SUDO_DEBUG_ERROR|SUDO_DEBUG_ERRNO|SUDO_DEBUG_LINENO,
+	    "unable to make socket for %s non-blocking", state.socket_path);
+	close(state.sock);
+	state.sock = -1;
+	debug_return_bool(false);
+    }
+    debug_return_bool(true);
+}
+
 static int
 audit_open(unsigned int version, sudo_conv_t conversation,
     sudo_printf_t plugin_printf, char * const settings[],
@@ -143,8 +276,7 @@ audit_open(unsigned int version, sudo_conv_t conversation,
     const char *cp, *plugin_path = NULL;
     unsigned char uuid[16];
     char * const *cur;
-    mode_t oldmask;
-    int fd, ret = -1;
+    int ret = -1;
     debug_decl(audit_open, SUDO_DEBUG_PLUGIN);
 
     audit_conv = conversation;
@@ -158,6 +290,7 @@ audit_open(unsigned int version, sudo_conv_t conversation,
     state.user_info = user_info;
     state.submit_argv = submit_argv;
     state.submit_envp = submit_envp;
+    state.sock = -1;
 
     /* Initialize the debug subsystem.  */
     for (cur = settings; (cp = *cur) != NULL; cur++) {
@@ -189,31 +322,60 @@ audit_open(unsigned int version, sudo_conv_t conversation,
 	goto bad;
     }
 
-    /* Parse plugin_options to check for logfile option. */
+    /* Parse plugin_options. */
     if (plugin_options != NULL) {
 	for (cur = plugin_options; (cp = *cur) != NULL; cur++) {
 	    if (strncmp(cp, "logfile=", sizeof("logfile=") - 1) == 0) {
 		state.logfile = strdup(cp + sizeof("logfile=") - 1);
 		if (state.logfile == NULL)
 		    goto oom;
+	    } else if (strncmp(cp, "logformat=", sizeof("logformat=") - 1) == 0) {
+		cp += sizeof("logformat=") - 1;
+		if (strcmp(cp, "jsonl") == 0) {
+		    state.json_lines = true;
+		} else if (strcmp(cp, "json") == 0) {
+		    state.json_lines = false;
+		} else {
+		    sudo_warnx(U_("invalid %s value: %s"), "logformat", cp);
+		}
+	    } else if (strncmp(cp, "rotate_size=", sizeof("rotate_size=") - 1) == 0) {
+		cp += sizeof("rotate_size=") - 1;
+		if (!parse_size(cp, &state.rotate_size)) {
+		    sudo_warnx(U_("invalid %s value: %s"), "rotate_size", cp);
+		    state.rotate_size = 0;
+		}
+	    } else if (strncmp(cp, "rotate_interval=", sizeof("rotate_interval=") - 1) == 0) {
+		const char *errstr2;
+		cp += sizeof("rotate_interval=") - 1;
+		state.rotate_interval = sudo_strtonum(cp, 0, INT_MAX, &errstr2);
+		if (errstr2 != NULL) {
+		    sudo_warnx(U_("invalid %s value: %s"), "rotate_interval", cp);
+		    state.rotate_interval = 0;
+		}
+	    } else if (strncmp(cp, "socket=", sizeof("socket=") - 1) == 0) {
+		state.socket_path = strdup(cp + sizeof("socket=") - 1);
+		if (state.socket_path == NULL)
+		    goto oom;
 	    }
 	}
     }
-    if (state.logfile == NULL) {
-	if (asprintf(&state.logfile, "%s/sudo_audit.json", _PATH_SUDO_LOGDIR) == -1)
-	    goto oom;
-    }
 
-    /* open log file */
-    /* TODO: suport pipe */
-    oldmask = umask(S_IRWXG|S_IRWXO);
-    fd = open(state.logfile, O_RDWR|O_CREAT, S_IRUSR|S_IWUSR);
-    (void)umask(oldmask);
-    if (fd == -1 || (state.log_fp = fdopen(fd, "w")) == NULL) {
-	*errstr = U_("unable to open audit system");
-	if (fd != -1)
-	    close(fd);
-	goto bad;
+    if (state.socket_path != NULL) {
+	/* Records are sent to a collector one per datagram. */
+	state.json_lines = true;
+	if (!audit_open_socket()) {
+	    *errstr = U_("unable to open audit system");
+	    goto bad;
+	}
+    } else {
+	if (state.logfile == NULL) {
+	    if (asprintf(&state.logfile, "%s/sudo_audit.json", _PATH_SUDO_LOGDIR) == -1)
+		goto oom;
+	}
+	if (!audit_open_log()) {
+	    *errstr = U_("unable to open audit system");
+	    goto bad;
+	}
     }
 
     ret = 1;
@@ -228,6 +390,10 @@ bad:
 	fclose(state.log_fp);
 	state.log_fp = NULL;
     }
+    if (state.sock != -1) {
+	close(state.sock);
+	state.sock = -1;
+    }
 
 done:
     while ((debug_file = TAILQ_FIRST(&debug_files))) {
@@ -399,32 +565,267 @@ print_timestamp(struct json_container *json, struct timespec *ts)
     debug_return_bool(true);
 }
 
-static int
-audit_write_exit_record(int exit_status, int error)
+/*
+ * Rotate the log file if it has grown too large or a new rotation
+ * interval has started since it was last written to.
+ * The old log is renamed with the current time as a suffix.
+ */
+static bool
+audit_rotate_log(void)
 {
-    struct json_container json;
-    struct json_value json_value;
-    struct timespec now;
-    struct stat sb;
-    int ret = -1;
-    debug_decl(audit_write_exit_record, SUDO_DEBUG_PLUGIN);
+    struct stat sb, psb;
+    char newpath[PATH_MAX], timebuf[32];
+    unsigned int n;
+    time_t now;
+    struct tm *tm;
+    int len;
+    debug_decl(audit_rotate_log, SUDO_DEBUG_PLUGIN);
 
-    if (sudo_gettime_real(&now) == -1) {
-	sudo_warn(U_("unable to read the clock"));
-	goto done;
+    if (state.rotate_size == 0 && state.rotate_interval == 0)
+	debug_return_bool(true);
+
+    if (fstat(fileno(state.log_fp), &sb) == -1) {
+	sudo_debug_printf(SUDO_DEBUG_ERROR|SUDO_DEBUG_ERRNO|SUDO_DEBUG_LINENO,
+	    "unable to stat %s", state.logfile);
+	debug_return_bool(false);
+    }
+
+    /* Another sudo process may have already rotated the log. */
+    if (stat(state.logfile, &psb) == -1 || psb.st_dev != sb.st_dev ||
+	    psb.st_ino != sb.st_ino)
+	debug_return_bool(audit_open_log());
+
+    time(&now);
+    if (sb.st_size == 0)
+	debug_return_bool(true);
+    if (state.rotate_size == 0 || sb.st_size < state.rotate_size) {
+	if (state.rotate_interval == 0 ||
+		sb.st_mtime / state.rotate_interval == now / state.rotate_interval)
+	    debug_return_bool(true);
     }
 
     if (!sudo_lock_file(fileno(state.log_fp), SUDO_LOCK)) {
 	sudo_debug_printf(SUDO_DEBUG_ERROR|SUDO_DEBUG_ERRNO|SUDO_DEBUG_LINENO,
 	    "unable to lock %s", state.logfile);
+	debug_return_bool(false);
+    }
+
+    /* Check again now that we hold the lock. */
+    if (stat(state.logfile, &psb) == 0 && psb.st_dev == sb.st_dev &&
+	    psb.st_ino == sb.st_ino) {
+	if ((tm = localtime(&now)) == NULL ||
+		strftime(timebuf, sizeof(timebuf), "%Y%m%d%H%M%S", tm) == 0)
+	    (void)snprintf(timebuf, sizeof(timebuf), "%lld", (long long)now);
+
+	/* Don't overwrite a log rotated earlier in the same second. */
+	for (n = 0; n < 100; n++) {
+	    if (n == 0) {
+		len = snprintf(newpath, sizeof(newpath), "%s.%s",
+		    state.logfile, timebuf);
+	    } else {
+		len = snprintf(newpath, sizeof(newpath), "%s.%s.%u",
+		    state.logfile, timebuf, n);
+	    }
+	    if (len < 0 || len >= ssizeof(newpath)) {
+		errno = ENAMETOOLONG;
+		break;
+	    }
+	    if (lstat(newpath, &psb) == -1 && errno == ENOENT)
+		break;
+	}
+	if (n == 100 || len < 0 || len >= ssizeof(newpath) ||
+		rename(state.logfile, newpath) == -1) {
+	    sudo_debug_printf(SUDO_DEBUG_ERROR|SUDO_DEBUG_ERRNO|SUDO_DEBUG_LINENO,
+		"unable to rotate %s", state.logfile);
+	} else {
+	    sudo_debug_printf(SUDO_DEBUG_INFO|SUDO_DEBUG_LINENO,
+		"rotated %s to %s", state.logfile, newpath);
+	}
+    }
+    (void)sudo_lock_file(fileno(state.log_fp), SUDO_UNLOCK);
+
+    debug_return_bool(audit_open_log());
+}
+
+/*
+ * Open a stream to format a JSON Lines record in memory so it
+ * can be written to the log with a single write(2).
+ */
+static FILE *
+record_stream_open(void)
+{
+    debug_decl(record_stream_open, SUDO_DEBUG_PLUGIN);
+
+#ifdef HAVE_OPEN_MEMSTREAM
+    state.record_fp = open_memstream(&state.record_buf, &state.record_len);
+#else
+    state.record_fp = tmpfile();
+#endif
+    if (state.record_fp == NULL) {
+	sudo_debug_printf(SUDO_DEBUG_ERROR|SUDO_DEBUG_ERRNO|SUDO_DEBUG_LINENO,
+	    "unable to open record stream");
+    }
+    debug_return_ptr(state.record_fp);
+}
+
+/*
+ * Close the record stream, leaving the record in state.record_buf.
+ */
+static bool
+record_stream_close(void)
+{
+    FILE *fp = state.record_fp;
+    bool ret = false;
+#ifndef HAVE_OPEN_MEMSTREAM
+    off_t len;
+#endif
+    debug_decl(record_stream_close, SUDO_DEBUG_PLUGIN);
+
+    state.record_fp = NULL;
+#ifdef HAVE_OPEN_MEMSTREAM
+    if (fclose(fp) == 0)
+	ret = true;
+#else
+    if (fflush(fp) == 0 && (len = ftello(fp)) != -1) {
+	rewind(fp);
+	state.record_len = (size_t)len;
+	state.record_buf = malloc(state.record_len);
+	if (state.record_buf != NULL &&
+		fread(state.record_buf, 1, state.record_len, fp) == state.record_len)
+	    ret = true;
+    }
+    fclose(fp);
+#endif
+    if (!ret) {
+	sudo_debug_printf(SUDO_DEBUG_ERROR|SUDO_DEBUG_ERRNO|SUDO_DEBUG_LINENO,
+	    "unable to format record");
+	free(state.record_buf);
+	state.record_buf = NULL;
+    }
+    debug_return_bool(ret);
+}
+
+/*
+ * Send the formatted record to the collector's socket.
+ * If the collector is not keeping up, the record is dropped
+ * rather than waiting for it.
+ */
+static bool
+audit_send_record(void)
+{
+    debug_decl(audit_send_record, SUDO_DEBUG_PLUGIN);
+
+    if (send(state.sock, state.record_buf, state.record_len, 0) == -1) {
+	if (errno == EAGAIN || errno == EWOULDBLOCK)
+	    goto dropped;
+	/* The collector may have been restarted, try to reconnect. */
+	if (errno != ECONNREFUSED && errno != ENOTCONN)
+	    goto bad;
+	if (!audit_open_socket())
+	    goto bad;
+	if (send(state.sock, state.record_buf, state.record_len, 0) == -1) {
+	    if (errno == EAGAIN || errno == EWOULDBLOCK)
+		goto dropped;
+	    goto bad;
+	}
+    }
+    debug_return_bool(true);
+dropped:
+    sudo_debug_printf(SUDO_DEBUG_WARN|SUDO_DEBUG_LINENO,
+	"%s not ready, dropping %zu byte record", state.socket_path,
+	state.record_len);
+    debug_return_bool(true);
+bad:
+    sudo_debug_printf(SUDO_DEBUG_ERROR|SUDO_DEBUG_ERRNO|SUDO_DEBUG_LINENO,
+	"unable to send record to %s", state.socket_path);
+    debug_return_bool(false);
+}
+
+/*
+ * Append the formatted record to the log file.
+ * The log is opened with O_APPEND so a record written with a single
+ * write(2) cannot be interleaved with another; larger records are
+ * written with the log locked in case they need more than one write.
+ */
+static bool
+audit_append_record(void)
+{
+    const char *cp = state.record_buf;
+    size_t len = state.record_len;
+    bool locked = false;
+    bool ret = false;
+    ssize_t nwritten;
+    int fd;
+    debug_decl(audit_append_record, SUDO_DEBUG_PLUGIN);
+
+    if (!audit_rotate_log())
 	goto done;
+    fd = fileno(state.log_fp);
+
+    if (len > PIPE_BUF) {
+	if (!sudo_lock_file(fd, SUDO_LOCK)) {
+	    sudo_debug_printf(SUDO_DEBUG_ERROR|SUDO_DEBUG_ERRNO|SUDO_DEBUG_LINENO,
+		"unable to lock %s", state.logfile);
+	    goto done;
+	}
+	locked = true;
+    }
+    while (len > 0) {
+	nwritten = write(fd, cp, len);
+	if (nwritten == -1) {
+	    if (errno == EINTR)
+		continue;
+	    sudo_debug_printf(SUDO_DEBUG_ERROR|SUDO_DEBUG_ERRNO|SUDO_DEBUG_LINENO,
+		"unable to write to %s", state.logfile);
+	    goto done;
+	}
+	cp += nwritten;
+	len -= (size_t)nwritten;
+    }
+    ret = true;
+
+done:
+    if (locked)
+	(void)sudo_lock_file(fd, SUDO_UNLOCK);
+    debug_return_bool(ret);
+}
+
+/*
+ * Start a new audit record named audit_str.
+ * JSON Lines records are formatted in memory and written all at once
+ * by audit_end_record().  Otherwise, the log is locked and the record
+ * is added to the JSON object it contains.
+ */
+static bool
+audit_begin_record(struct json_container *json, const char *audit_str)
+{
+    struct stat sb;
+    FILE *fp;
+    debug_decl(audit_begin_record, SUDO_DEBUG_PLUGIN);
+
+    if (state.json_lines) {
+	if ((fp = record_stream_open()) == NULL)
+	    debug_return_bool(false);
+	sudo_json_init(json, fp, 0, true);
+	sudo_json_open_object(json, NULL);
+	sudo_json_open_object(json, audit_str);
+	debug_return_bool(true);
+    }
+
+    if (!audit_rotate_log())
+	debug_return_bool(false);
+
+    if (!sudo_lock_file(fileno(state.log_fp), SUDO_LOCK)) {
+	sudo_debug_printf(SUDO_DEBUG_ERROR|SUDO_DEBUG_ERRNO|SUDO_DEBUG_LINENO,
+	    "unable to lock %s", state.logfile);
+	debug_return_bool(false);
     }
 
     /* Note: assumes file ends in "\n}\n" */
     if (fstat(fileno(state.log_fp), &sb) == -1) {
 	sudo_debug_printf(SUDO_DEBUG_ERROR|SUDO_DEBUG_ERRNO|SUDO_DEBUG_LINENO,
 	    "unable to stat %s", state.logfile);
-	goto done;
+	goto bad;
     }
     if (sb.st_size == 0) {
 	/* New file */
@@ -435,11 +836,67 @@ audit_write_exit_record(int exit_status, int error)
     } else {
 	sudo_debug_printf(SUDO_DEBUG_ERROR|SUDO_DEBUG_ERRNO|SUDO_DEBUG_LINENO,
 	    "unable to seek %s", state.logfile);
+	goto bad;
+    }
+
+    sudo_json_init(json, state.log_fp, 4, false);
+    sudo_json_open_object(json, audit_str);
+    debug_return_bool(true);
+
+bad:
+    (void)sudo_lock_file(fileno(state.log_fp), SUDO_UNLOCK);
+    debug_return_bool(false);
+}
+
+/*
+ * Finish the current audit record and write it out.
+ */
+static bool
+audit_end_record(struct json_container *json)
+{
+    bool ret;
+    debug_decl(audit_end_record, SUDO_DEBUG_PLUGIN);
+
+    sudo_json_close_object(json);	/* close record */
+
+    if (state.json_lines) {
+	sudo_json_close_object(json);	/* close line */
+	putc('\n', json->fp);
+	if (!record_stream_close())
+	    debug_return_bool(false);
+	if (state.sock != -1)
+	    ret = audit_send_record();
+	else
+	    ret = audit_append_record();
+	free(state.record_buf);
+	state.record_buf = NULL;
+	debug_return_bool(ret);
+    }
+
+    fputs("\n}\n", state.log_fp);	/* close JSON */
+    fflush(state.log_fp);
+
+    (void)sudo_lock_file(fileno(state.log_fp), SUDO_UNLOCK);
+
+    debug_return_bool(true);
+}
+
+static int
+audit_write_exit_record(int exit_status, int error)
+{
+    struct json_container json;
+    struct json_value json_value;
+    struct timespec now;
+    int ret = -1;
+    debug_decl(audit_write_exit_record, SUDO_DEBUG_PLUGIN);
+
+    if (sudo_gettime_real(&now) == -1) {
+	sudo_warn(U_("unable to read the clock"));
 	goto done;
     }
 
-    sudo_json_init(&json, state.log_fp, 4);
-    sudo_json_open_object(&json, "exit");
+    if (!audit_begin_record(&json, "exit"))
+	goto done;
 
     /* Write UUID */
     json_value.type = JSON_STRING;
@@ -485,11 +942,8 @@ audit_write_exit_record(int exit_status, int error)
         }
     }
 
-    sudo_json_close_object(&json);	/* close record */
-    fputs("\n}\n", state.log_fp);	/* close JSON */
-    fflush(state.log_fp);
-
-    (void)sudo_lock_file(fileno(state.log_fp), SUDO_UNLOCK);
+    if (!audit_end_record(&json))
+	goto done;
 
     ret = true;
 done:
@@ -504,7 +958,6 @@ audit_write_record(const char *audit_str, const char *plugin_name,
     struct json_container json;
     struct json_value json_value;
     struct timespec now;
-    struct stat sb;
     int ret = -1;
     debug_decl(audit_write_record, SUDO_DEBUG_PLUGIN);
 
@@ -513,32 +966,8 @@ audit_write_record(const char *audit_str, const char *plugin_name,
 	goto done;
     }
 
-    if (!sudo_lock_file(fileno(state.log_fp), SUDO_LOCK)) {
-	sudo_debug_printf(SUDO_DEBUG_ERROR|SUDO_DEBUG_ERRNO|SUDO_DEBUG_LINENO,
-	    "unable to lock %s", state.logfile);
-	goto done;
-    }
-
-    /* Note: assumes file ends in "\n}\n" */
-    if (fstat(fileno(state.log_fp), &sb) == -1) {
-	sudo_debug_printf(SUDO_DEBUG_ERROR|SUDO_DEBUG_ERRNO|SUDO_DEBUG_LINENO,
-	    "unable to stat %s", state.logfile);
-	goto done;
-    }
-    if (sb.st_size == 0) {
-	/* New file */
-	putc('{', state.log_fp);
-    } else if (fseeko(state.log_fp, -3, SEEK_END) == 0) {
-	/* Continue file, overwrite the final "\n}\n" */
-	putc(',', state.log_fp);
-    } else {
-	sudo_debug_printf(SUDO_DEBUG_ERROR|SUDO_DEBUG_ERRNO|SUDO_DEBUG_LINENO,
-	    "unable to seek %s", state.logfile);
+    if (!audit_begin_record(&json, audit_str))
 	goto done;
-    }
-
-    sudo_json_init(&json, state.log_fp, 4);
-    sudo_json_open_object(&json, audit_str);
 
     json_value.type = JSON_STRING;
     json_value.u.string = plugin_name;
@@ -599,11 +1028,8 @@ audit_write_record(const char *audit_str, const char *plugin_name,
     if (run_envp != NULL)
 	print_array(&json, "run_envp", run_envp);
 
-    sudo_json_close_object(&json);	/* close audit_str */
-    fputs("\n}\n", state.log_fp);	/* close JSON */
-    fflush(state.log_fp);
-
-    (void)sudo_lock_file(fileno(state.log_fp), SUDO_UNLOCK);
+    if (!audit_end_record(&json))
+	goto done;
 
     ret = true;
 done:
@@ -677,8 +1103,11 @@ audit_close(int status_type, int status)
     }
 
     free(state.logfile);
+    free(state.socket_path);
     if (state.log_fp != NULL)
 	fclose(state.log_fp);
+    if (state.sock != -1)
+	close(state.sock);
 
     debug_return;
 }
@@ -0,0 +1,474 @@
+/*
+ * SPDX-License-Identifier: ISC
+ *
+ * Copyright (c) 2020 Todd C. Miller <Todd.Miller@sudo.ws>
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include <config.h>
+
+#include <sys/types.h>
+#include <sys/time.h>
+#include <stdio.h>
+#include <stdlib.h>
+#ifdef HAVE_STRING_H
+# include <string.h>
+#endif /* HAVE_STRING_H */
+#ifdef HAVE_STRINGS_H
+# include <strings.h>
+#endif /* HAVE_STRINGS_H */
+#include <unistd.h>
+#include <dirent.h>
+#include <signal.h>
+
+#define SUDO_ERROR_WRAP 0
+
+#include "audit_json.c"
+
+/*
+ * Check the JSON Lines output of the audit_json plugin, log rotation
+ * by size and by interval and sending records to a local socket.
+ */
+
+__dso_public int main(int argc, char *argv[]);
+
+static int ntests, nerrors;
+
+static char *settings[] = { "progname=sudo", NULL };
+static char *user_info[] = { "user=nobody", "uid=65534", NULL };
+static char *submit_argv[] = { "sudo", "true", NULL };
+static char *submit_envp[] = { "PATH=/usr/bin:/bin", NULL };
+static char *command_info[] = { "command=/bin/true", NULL };
+static char *run_argv[] = { "true", NULL };
+static char *run_envp[] = { "PATH=/usr/bin:/bin", NULL };
+
+/*
+ * Open the plugin with a fresh state and the specified options.
+ */
+static bool
+open_plugin(char *options[])
+{
+    const char *errstr = NULL;
+
+    memset(&state, 0, sizeof(state));
+    state.sock = -1;
+    if (audit_json.open(SUDO_API_VERSION, NULL, NULL, settings, user_info,
+	    1, submit_argv, submit_envp, options, &errstr) != 1) {
+	sudo_warnx_nodebug("unable to open plugin: %s",
+	    errstr ? errstr : "unknown error");
+	nerrors++;
+	return false;
+    }
+    return true;
+}
+
+static bool
+accept_cmnd(void)
+{
+    const char *errstr = NULL;
+
+    return audit_json.accept("sudoers", SUDO_POLICY_PLUGIN, command_info,
+	run_argv, run_envp, &errstr) == 1;
+}
+
+/*
+ * Read a file into a NUL-terminated buffer.
+ */
+static char *
+read_file(const char *path)
+{
+    struct stat sb;
+    char *buf;
+    int fd;
+
+    if ((fd = open(path, O_RDONLY)) == -1)
+	return NULL;
+    if (fstat(fd, &sb) == -1 || (buf = malloc(sb.st_size + 1)) == NULL)
+	sudo_fatal_nodebug("%s", path);
+    if (read(fd, buf, sb.st_size) != sb.st_size)
+	sudo_fatal_nodebug("%s", path);
+    buf[sb.st_size] = '\0';
+    close(fd);
+    return buf;
+}
+
+/*
+ * Check that line holds a single JSON object named name on one line.
+ * Returns the length of the line including the newline, or 0 on error.
+ */
+static size_t
+check_record(const char *what, const char *line, const char *name)
+{
+    char prefix[64];
+    bool quoted = false;
+    int depth = 0;
+    size_t len;
+
+    ntests++;
+    (void)snprintf(prefix, sizeof(prefix), "{\"%s\": {", name);
+    if (strncmp(line, prefix, strlen(prefix)) != 0) {
+	sudo_warnx_nodebug("%s: expected the %s record, got \"%.40s\"", what,
+	    name, line);
+	nerrors++;
+	return 0;
+    }
+    for (len = 0; line[len] != '\0' && line[len] != '\n'; len++) {
+	if (quoted) {
+	    if (line[len] == '\\' && line[len + 1] != '\0')
+		len++;
+	    else if (line[len] == '"')
+		quoted = false;
+	    continue;
+	}
+	switch (line[len]) {
+	case '"':
+	    quoted = true;
+	    break;
+	case '{':
+	    depth++;
+	    break;
+	case '}':
+	    depth--;
+	    break;
+	}
+    }
+    if (line[len] != '\n' || depth != 0 || line[len - 1] != '}') {
+	sudo_warnx_nodebug("%s: %s record is not a complete line", what, name);
+	nerrors++;
+	return 0;
+    }
+    ntests++;
+    if (strstr(line, state.uuid_str) == NULL ||
+	    (size_t)(strstr(line, state.uuid_str) - line) > len) {
+	sudo_warnx_nodebug("%s: %s record is missing the uuid", what, name);
+	nerrors++;
+    }
+    return len + 1;
+}
+
+static int
+count_lines(const char *buf)
+{
+    int lines = 0;
+
+    if (buf != NULL) {
+	for (; *buf != '\0'; buf++) {
+	    if (*buf == '\n')
+		lines++;
+	}
+    }
+    return lines;
+}
+
+/*
+ * Count the rotated logs for base in dir and the records they hold.
+ */
+static int
+count_rotated(const char *dir, const char *base, int *records)
+{
+    char path[PATH_MAX];
+    size_t baselen = strlen(base);
+    struct dirent *dp;
+    int nfiles = 0;
+    char *buf;
+    DIR *d;
+
+    *records = 0;
+    if ((d = opendir(dir)) == NULL)
+	sudo_fatal_nodebug("%s", dir);
+    while ((dp = readdir(d)) != NULL) {
+	if (strncmp(dp->d_name, base, baselen) != 0 ||
+		dp->d_name[baselen] != '.')
+	    continue;
+	(void)snprintf(path, sizeof(path), "%s/%s", dir, dp->d_name);
+	buf = read_file(path);
+	*records += count_lines(buf);
+	free(buf);
+	nfiles++;
+    }
+    closedir(d);
+    return nfiles;
+}
+
+/*
+ * Each record is a single line holding one JSON object.
+ */
+static void
+test_jsonl(const char *dir)
+{
+    char logopt[PATH_MAX + 8], path[PATH_MAX];
+    char *options[] = { logopt, "logformat=jsonl", NULL };
+    const char *errstr = NULL;
+    char uuid[sizeof(state.uuid_str)];
+    char *buf, *cp;
+    size_t len;
+
+    (void)snprintf(path, sizeof(path), "%s/jsonl.log", dir);
+    (void)snprintf(logopt, sizeof(logopt), "logfile=%s", path);
+    if (!open_plugin(options))
+	return;
+    ntests++;
+    if (!accept_cmnd() || audit_json.reject("sudoers", SUDO_POLICY_PLUGIN,
+	    "not allowed", command_info, &errstr) != 1) {
+	sudo_warnx_nodebug("%s: unable to write records", __func__);
+	nerrors++;
+    }
+    memcpy(uuid, state.uuid_str, sizeof(uuid));
+    audit_json.close(SUDO_PLUGIN_WAIT_STATUS, 0);
+
+    if ((buf = read_file(path)) == NULL) {
+	sudo_warn_nodebug("%s", path);
+	ntests++;
+	nerrors++;
+	return;
+    }
+    ntests++;
+    if (count_lines(buf) != 3) {
+	sudo_warnx_nodebug("%s: expected 3 records, got %d", __func__,
+	    count_lines(buf));
+	nerrors++;
+    }
+    memcpy(state.uuid_str, uuid, sizeof(uuid));
+    cp = buf;
+    if ((len = check_record(__func__, cp, "accept")) != 0) {
+	cp += len;
+	if ((len = check_record(__func__, cp, "reject")) != 0) {
+	    cp += len;
+	    (void)check_record(__func__, cp, "exit");
+	}
+    }
+    free(buf);
+    (void)unlink(path);
+}
+
+/*
+ * A log that has reached rotate_size is renamed before the next write.
+ */
+static void
+test_rotate_size(const char *dir)
+{
+    char logopt[PATH_MAX + 8], path[PATH_MAX];
+    char *options[] = { logopt, "logformat=jsonl", "rotate_size=1", NULL };
+    int i, nfiles, records;
+    char *buf;
+
+    (void)snprintf(path, sizeof(path), "%s/size.log", dir);
+    (void)snprintf(logopt, sizeof(logopt), "logfile=%s", path);
+    if (!open_plugin(options))
+	return;
+    for (i = 0; i < 3; i++) {
+	ntests++;
+	if (!accept_cmnd()) {
+	    sudo_warnx_nodebug("%s: unable to write record %d", __func__, i);
+	    nerrors++;
+	}
+    }
+    audit_json.close(SUDO_PLUGIN_NO_STATUS, 0);
+
+    buf = read_file(path);
+    ntests++;
+    if (count_lines(buf) != 1) {
+	sudo_warnx_nodebug("%s: %d records in the current log, expected 1",
+	    __func__, count_lines(buf));
+	nerrors++;
+    }
+    free(buf);
+
+    nfiles = count_rotated(dir, "size.log", &records);
+    ntests++;
+    if (nfiles != 2 || records != 2) {
+	sudo_warnx_nodebug("%s: %d rotated logs with %d records, expected 2",
+	    __func__, nfiles, records);
+	nerrors++;
+    }
+}
+
+/*
+ * A log last written in an earlier rotate_interval is renamed before
+ * the next write, one written in the current interval is not.
+ */
+static void
+test_rotate_interval(const char *dir)
+{
+    char logopt[PATH_MAX + 8], path[PATH_MAX];
+    char *options[] = {
+	logopt, "logformat=jsonl", "rotate_interval=1000000", NULL
+    };
+    struct timeval times[2];
+    int nfiles, records;
+    char *buf;
+
+    (void)snprintf(path, sizeof(path), "%s/interval.log", dir);
+    (void)snprintf(logopt, sizeof(logopt), "logfile=%s", path);
+    if (!open_plugin(options))
+	return;
+
+    ntests++;
+    if (!accept_cmnd()) {
+	sudo_warnx_nodebug("%s: unable to write record", __func__);
+	nerrors++;
+    }
+
+    /* Pretend the log was last written two intervals ago. */
+    memset(times, 0, sizeof(times));
+    times[0].tv_sec = times[1].tv_sec = time(NULL) - 2 * 1000000;
+    if (utimes(path, times) == -1)
+	sudo_fatal_nodebug("%s", path);
+
+    ntests++;
+    if (!accept_cmnd() || !accept_cmnd()) {
+	sudo_warnx_nodebug("%s: unable to write record", __func__);
+	nerrors++;
+    }
+    audit_json.close(SUDO_PLUGIN_NO_STATUS, 0);
+
+    buf = read_file(path);
+    ntests++;
+    if (count_lines(buf) != 2) {
+	sudo_warnx_nodebug("%s: %d records in the current log, expected 2",
+	    __func__, count_lines(buf));
+	nerrors++;
+    }
+    free(buf);
+
+    nfiles = count_rotated(dir, "interval.log", &records);
+    ntests++;
+    if (nfiles != 1 || records != 1) {
+	sudo_warnx_nodebug("%s: %d rotated logs with %d records, expected 1",
+	    __func__, nfiles, records);
+	nerrors++;
+    }
+}
+
+/*
+ * Records sent to a socket are one datagram each.  A collector that
+ * does not read them must not block sudo, the records are dropped.
+ */
+static void
+test_socket(const char *dir)
+{
+    char sockopt[PATH_MAX + 8], buf[64 * 1024];
+    char *options[] = { sockopt, NULL };
+    struct sockaddr_un sun;
+    int i, sock, bufsize = 4096;
+    int failed = 0, received = 0;
+    const int nrecords = 1000;
+    ssize_t nread;
+
+    memset(&sun, 0, sizeof(sun));
+    sun.sun_family = AF_UNIX;
+    (void)snprintf(sun.sun_path, sizeof(sun.sun_path), "%s/sock", dir);
+    (void)snprintf(sockopt, sizeof(sockopt), "socket=%s", sun.sun_path);
+    sock = socket(AF_UNIX, SOCK_DGRAM, 0);
+    if (sock == -1 || bind(sock, (struct sockaddr *)&sun, sizeof(sun)) == -1)
+	sudo_fatal_nodebug("%s", sun.sun_path);
+    (void)setsockopt(sock, SOL_SOCKET, SO_RCVBUF, &bufsize, sizeof(bufsize));
+
+    if (!open_plugin(options)) {
+	close(sock);
+	(void)unlink(sun.sun_path);
+	return;
+    }
+
+    ntests++;
+    if (!accept_cmnd()) {
+	sudo_warnx_nodebug("%s: unable to send record", __func__);
+	nerrors++;
+    }
+    nread = recv(sock, buf, sizeof(buf) - 1, 0);
+    if (nread > 0) {
+	buf[nread] = '\0';
+	if (check_record(__func__, buf, "accept") != (size_t)nread) {
+	    sudo_warnx_nodebug("%s: datagram does not hold one record",
+		__func__);
+	    nerrors++;
+	}
+    } else {
+	sudo_warn_nodebug("%s: recv", __func__);
+	ntests++;
+	nerrors++;
+    }
+
+    /* The test is killed if sending blocks. */
+    alarm(60);
+    for (i = 0; i < nrecords; i++) {
+	if (!accept_cmnd())
+	    failed++;
+    }
+    alarm(0);
+    audit_json.close(SUDO_PLUGIN_NO_STATUS, 0);
+
+    while (recv(sock, buf, sizeof(buf), MSG_DONTWAIT) > 0)
+	received++;
+    ntests++;
+    if (failed != 0 || received == 0 || received >= nrecords) {
+	sudo_warnx_nodebug("%s: %d records sent, %d failed, %d received",
+	    __func__, nrecords, failed, received);
+	nerrors++;
+    }
+
+    close(sock);
+    (void)unlink(sun.sun_path);
+}
+
+/*
+ * Remove everything in dir, then dir itself.
+ */
+static bool
+remove_dir(const char *dir)
+{
+    char path[PATH_MAX];
+    struct dirent *dp;
+    DIR *d;
+
+    if ((d = opendir(dir)) == NULL)
+	return false;
+    while ((dp = readdir(d)) != NULL) {
+	if (strcmp(dp->d_name, ".") == 0 || strcmp(dp->d_name, "..") == 0)
+	    continue;
+	(void)snprintf(path, sizeof(path), "%s/%s", dir, dp->d_name);
+	(void)unlink(path);
+    }
+    closedir(d);
+    return rmdir(dir) == 0;
+}
+
+int
+main(int argc, char *argv[])
+{
+    char dir[] = "/tmp/check_jsonl.XXXXXX";
+
+    initprogname(argc > 0 ? argv[0] : "check_jsonl");
+
+    if (mkdtemp(dir) == NULL)
+	sudo_fatal_nodebug("mkdtemp");
+
+    test_jsonl(dir);
+    test_rotate_size(dir);
+    test_rotate_interval(dir);
+    test_socket(dir);
+
+    if (!remove_dir(dir)) {
+	sudo_warn_nodebug("unable to remove %s", dir);
+	nerrors++;
+    }
+
+    if (ntests != 0) {
+	printf("check_jsonl: %d test%s run, %d errors, %d%% success rate\n",
+	    ntests, ntests == 1 ? "" : "s", nerrors,
+	    (ntests - nerrors) * 100 / ntests);
+    }
+
+    exit(nerrors);
+}
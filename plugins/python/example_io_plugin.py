@@ -103,6 +103,31 @@ class SudoIOPlugin(sudo.Plugin):
     def log_stderr(self, buf: str) -> int:
         return self._log("STD ERR", buf.strip())
 
+    def log_io(self, records: Tuple[Tuple[int, float, memoryview], ...]) -> int:
+        """Receives a batch of I/O, used instead of the log_* functions.
+
+        Each record is a tuple of (event, time, buf), where event is one of
+        the sudo.IO_EVENT constants and time is the time in seconds (from an
+        arbitrary starting point) when the data was read.  Only the streams
+        that have a log_* function are passed, or all of them if the plugin
+        only implements log_io().
+
+        The buf is a read-only memoryview of the data, which is not decoded.
+        It remains valid after log_io() returns.
+        """
+        log_funcs = {
+            sudo.IO_EVENT.TTYIN: self.log_ttyin,
+            sudo.IO_EVENT.TTYOUT: self.log_ttyout,
+            sudo.IO_EVENT.STDIN: self.log_stdin,
+            sudo.IO_EVENT.STDOUT: self.log_stdout,
+            sudo.IO_EVENT.STDERR: self.log_stderr
+        }
+        for event, time, buf in records:
+            rc = log_funcs[event](str(buf, "utf-8", "replace"))
+            if rc != sudo.RC.ACCEPT:
+                return rc
+        return sudo.RC.ACCEPT
+
     def change_winsize(self, line: int, cols: int) -> int:
         self._log("WINSIZE", "{}x{}".format(line, cols))
 
@@ -23,6 +23,8 @@
 
 #include "python_plugin_common.h"
 
+#include "sudo_util.h"
+
 struct IOPluginContext
 {
     struct PluginContext base_ctx;
@@ -118,11 +120,16 @@ python_plugin_io_open(struct IOPluginContext *io_ctx,
 
     // skip plugin callbacks which are not mandatory
     MARK_CALLBACK_OPTIONAL(show_version);
-    MARK_CALLBACK_OPTIONAL(log_ttyin);
-    MARK_CALLBACK_OPTIONAL(log_ttyout);
-    MARK_CALLBACK_OPTIONAL(log_stdin);
-    MARK_CALLBACK_OPTIONAL(log_stdout);
-    MARK_CALLBACK_OPTIONAL(log_stderr);
+    MARK_CALLBACK_OPTIONAL(log_io);
+    if (CALLBACK_PLUGINFUNC(log_io) == NULL) {
+        // sudo only passes the streams with a log function to log_io,
+        // so if it is implemented all of them are logged.
+        MARK_CALLBACK_OPTIONAL(log_ttyin);
+        MARK_CALLBACK_OPTIONAL(log_ttyout);
+        MARK_CALLBACK_OPTIONAL(log_stdin);
+        MARK_CALLBACK_OPTIONAL(log_stdout);
+        MARK_CALLBACK_OPTIONAL(log_stderr);
+    }
     MARK_CALLBACK_OPTIONAL(change_winsize);
     MARK_CALLBACK_OPTIONAL(log_suspend);
     // open and close are mandatory
@@ -159,13 +166,100 @@ python_plugin_io_show_version(struct IOPluginContext *io_ctx, int verbose)
     debug_return_int(python_plugin_show_version(BASE_CTX(io_ctx), CALLBACK_PYNAME(show_version), verbose));
 }
 
+// The data of each record is passed as a read-only memoryview so it is
+// not decoded.  The front end reuses its buffers once log_io() returns and
+// a memoryview (or a slice of one) cannot be revoked once the plugin has it,
+// so the batch is copied once into a bytes object that the views refer to.
+static PyObject *
+_py_io_records(const struct sudo_io_record records[], unsigned int count)
+{
+    debug_decl(_py_io_records, PYTHON_DEBUG_INTERNAL);
+
+    PyObject *py_records = NULL, *py_data = NULL, *py_view = NULL;
+    Py_ssize_t size = 0, offset = 0;
+
+    for (unsigned int i = 0; i < count; ++i)
+        size += (Py_ssize_t)records[i].len;
+
+    py_data = PyBytes_FromStringAndSize(NULL, size);
+    if (py_data == NULL)
+        goto cleanup;
+    py_view = PyMemoryView_FromObject(py_data);
+    if (py_view == NULL)
+        goto cleanup;
+    py_records = PyTuple_New(count);
+    if (py_records == NULL)
+        goto cleanup;
+
+    for (unsigned int i = 0; i < count; ++i) {
+        double when = records[i].when->tv_sec + records[i].when->tv_nsec / 1000000000.0;
+        Py_ssize_t len = (Py_ssize_t)records[i].len;
+
+        memcpy(PyBytes_AS_STRING(py_data) + offset, records[i].buf, (size_t)len);
+        PyObject *py_buf = PySequence_GetSlice(py_view, offset, offset + len);
+        offset += len;
+
+        PyObject *py_record = Py_BuildValue("(idN)", records[i].event, when, py_buf);
+        if (py_record == NULL) {
+            Py_CLEAR(py_records);
+            break;
+        }
+        PyTuple_SET_ITEM(py_records, i, py_record);  // steals the reference
+    }
+
+cleanup:
+    Py_XDECREF(py_view);
+    Py_XDECREF(py_data);
+    debug_return_ptr(py_records);
+}
+
+static int
+_call_plugin_log_io(struct IOPluginContext *io_ctx, const struct sudo_io_record records[], unsigned int count)
+{
+    debug_decl(_call_plugin_log_io, PYTHON_DEBUG_CALLBACKS);
+    PyObject *py_records = _py_io_records(records, count);
+    int rc = python_plugin_api_rc_call(BASE_CTX(io_ctx), CALLBACK_PYNAME(log_io),
+                                       Py_BuildValue("(N)", py_records));
+    debug_return_int(rc);
+}
+
+// Data that is not valid UTF-8 is replaced rather than failing the call.
+static PyObject *
+_py_io_buf_args(const char *buf, unsigned int len)
+{
+    PyObject *py_str = PyUnicode_DecodeUTF8(buf, (Py_ssize_t)len, "replace");
+    return Py_BuildValue("(N)", py_str);
+}
+
+// Calls the python log function of a stream, or log_io() if only that one is implemented.
+static int
+_call_plugin_log_stream(struct IOPluginContext *io_ctx, const char *func_name, int event,
+                        const char *buf, unsigned int len)
+{
+    debug_decl(_call_plugin_log_stream, PYTHON_DEBUG_CALLBACKS);
+    struct PluginContext *plugin_ctx = BASE_CTX(io_ctx);
+
+    if (!PyObject_HasAttrString(plugin_ctx->py_instance, func_name)) {
+        struct timespec now;
+        struct sudo_io_record record = { event, len, buf, &now };
+        if (sudo_gettime_awake(&now) == -1) {
+            now.tv_sec = 0;
+            now.tv_nsec = 0;
+        }
+        debug_return_int(_call_plugin_log_io(io_ctx, &record, 1));
+    }
+
+    debug_return_int(python_plugin_api_rc_call(plugin_ctx, func_name,
+                                               _py_io_buf_args(buf, len)));
+}
+
 int
 python_plugin_io_log_ttyin(struct IOPluginContext *io_ctx, const char *buf, unsigned int len, const char **errstr)
 {
     debug_decl(python_plugin_io_log_ttyin, PYTHON_DEBUG_CALLBACKS);
     PyThreadState_Swap(BASE_CTX(io_ctx)->py_interpreter);
-    int rc = python_plugin_api_rc_call(BASE_CTX(io_ctx), CALLBACK_PYNAME(log_ttyin),
-                                       Py_BuildValue("(s#)", buf, len));
+    int rc = _call_plugin_log_stream(io_ctx, CALLBACK_PYNAME(log_ttyin),
+                                     SUDO_IO_EVENT_TTYIN, buf, len);
     IO_CB_SET_ERROR(errstr);
     debug_return_int(rc);
 }
@@ -175,8 +269,8 @@ python_plugin_io_log_ttyout(struct IOPluginContext *io_ctx, const char *buf, uns
 {
     debug_decl(python_plugin_io_log_ttyout, PYTHON_DEBUG_CALLBACKS);
     PyThreadState_Swap(BASE_CTX(io_ctx)->py_interpreter);
-    int rc = python_plugin_api_rc_call(BASE_CTX(io_ctx), CALLBACK_PYNAME(log_ttyout),
-                                       Py_BuildValue("(s#)", buf, len));
+    int rc = _call_plugin_log_stream(io_ctx, CALLBACK_PYNAME(log_ttyout),
+                                     SUDO_IO_EVENT_TTYOUT, buf, len);
     IO_CB_SET_ERROR(errstr);
     debug_return_int(rc);
 }
@@ -186,8 +280,8 @@ python_plugin_io_log_stdin(struct IOPluginContext *io_ctx, const char *buf, unsi
 {
     debug_decl(python_plugin_io_log_stdin, PYTHON_DEBUG_CALLBACKS);
     PyThreadState_Swap(BASE_CTX(io_ctx)->py_interpreter);
-    int rc = python_plugin_api_rc_call(BASE_CTX(io_ctx), CALLBACK_PYNAME(log_stdin),
-                                               Py_BuildValue("(s#)", buf, len));
+    int rc = _call_plugin_log_stream(io_ctx, CALLBACK_PYNAME(log_stdin),
+                                     SUDO_IO_EVENT_STDIN, buf, len);
     IO_CB_SET_ERROR(errstr);
     debug_return_int(rc);
 }
@@ -197,8 +291,8 @@ python_plugin_io_log_stdout(struct IOPluginContext *io_ctx, const char *buf, uns
 {
     debug_decl(python_plugin_io_log_stdout, PYTHON_DEBUG_CALLBACKS);
     PyThreadState_Swap(BASE_CTX(io_ctx)->py_interpreter);
-    int rc = python_plugin_api_rc_call(BASE_CTX(io_ctx), CALLBACK_PYNAME(log_stdout),
-                                               Py_BuildValue("(s#)", buf, len));
+    int rc = _call_plugin_log_stream(io_ctx, CALLBACK_PYNAME(log_stdout),
+                                     SUDO_IO_EVENT_STDOUT, buf, len);
     IO_CB_SET_ERROR(errstr);
     debug_return_int(rc);
 }
@@ -208,8 +302,19 @@ python_plugin_io_log_stderr(struct IOPluginContext *io_ctx, const char *buf, uns
 {
     debug_decl(python_plugin_io_log_stderr, PYTHON_DEBUG_CALLBACKS);
     PyThreadState_Swap(BASE_CTX(io_ctx)->py_interpreter);
-    int rc = python_plugin_api_rc_call(BASE_CTX(io_ctx), CALLBACK_PYNAME(log_stderr),
-                                               Py_BuildValue("(s#)", buf, len));
+    int rc = _call_plugin_log_stream(io_ctx, CALLBACK_PYNAME(log_stderr),
+                                     SUDO_IO_EVENT_STDERR, buf, len);
+    IO_CB_SET_ERROR(errstr);
+    debug_return_int(rc);
+}
+
+int
+python_plugin_io_log_io(struct IOPluginContext *io_ctx, const struct sudo_io_record records[],
+                        unsigned int count, const char **errstr)
+{
+    debug_decl(python_plugin_io_log_io, PYTHON_DEBUG_CALLBACKS);
+    PyThreadState_Swap(BASE_CTX(io_ctx)->py_interpreter);
+    int rc = _call_plugin_log_io(io_ctx, records, count);
     IO_CB_SET_ERROR(errstr);
     debug_return_int(rc);
 }
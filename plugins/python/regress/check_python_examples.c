@@ -23,7 +23,10 @@
 
 #include "testhelpers.h"
 
+#include <unistd.h>
+
 #include "sudo_dso.h"
+#include "sudo_util.h"
 
 static const char *python_plugin_so_path = NULL;
 static void *python_plugin_handle = NULL;
@@ -243,6 +246,146 @@ check_example_io_plugin_command_log(void)
     return true;
 }
 
+int
+check_example_io_plugin_log_io(void)
+{
+    const char *errstr = NULL;
+    struct timespec now = { 1, 500000000 };
+    struct sudo_io_record records[] = {
+        { SUDO_IO_EVENT_STDIN, 19, "some standard input", &now },
+        { SUDO_IO_EVENT_STDOUT, 20, "some standard output", &now },
+        { SUDO_IO_EVENT_TTYOUT, 15, "some tty output", &now },
+        { SUDO_IO_EVENT_STDERR, 19, "some standard error", &now }
+    };
+    create_io_plugin_options(data.tmp_dir);
+
+    str_array_free(&data.plugin_argv);
+    data.plugin_argc = 2;
+    data.plugin_argv = create_str_array(3, "id", "--help", NULL);
+
+    str_array_free(&data.command_info);
+    data.command_info = create_str_array(3, "command=/bin/id", "runas_uid=0", NULL);
+
+    VERIFY_INT(python_io->open(SUDO_API_VERSION, fake_conversation, fake_printf, data.settings,
+                              data.user_info, data.command_info, data.plugin_argc, data.plugin_argv,
+                              data.user_env, data.plugin_options, &errstr), SUDO_RC_OK);
+    VERIFY_PTR_NE(python_io->log_io, NULL);
+    VERIFY_INT(python_io->log_io(records, 4, &errstr), SUDO_RC_OK);
+    VERIFY_INT(python_io->log_io(records, 0, &errstr), SUDO_RC_OK);
+
+    python_io->close(0, 0);
+
+    VERIFY_FILE("sudo.log", expected_path("check_example_io_plugin_log_io.stored"));
+
+    return true;
+}
+
+int
+check_io_plugin_log_io_records(void)
+{
+    const char *errstr = NULL;
+    char buf[256];
+    struct timespec now = { 0, 0 };
+    struct sudo_io_record records[2];
+    unsigned int i;
+
+    // every byte value, so the data is not valid UTF-8
+    for (i = 0; i < sizeof(buf); ++i)
+        buf[i] = (char)i;
+    for (i = 0; i < 2; ++i) {
+        records[i].event = i ? SUDO_IO_EVENT_TTYOUT : SUDO_IO_EVENT_STDOUT;
+        records[i].len = sizeof(buf) / (i + 1);
+        records[i].buf = buf;
+        records[i].when = &now;
+    }
+
+    str_array_free(&data.plugin_options);
+    data.plugin_options = create_str_array(
+        3,
+        "ModulePath=" SRC_DIR "/regress/plugin_io_records.py",
+        "ClassName=IORecordsPlugin",
+        NULL
+    );
+
+    str_array_free(&data.plugin_argv);
+    data.plugin_argc = 2;
+    data.plugin_argv = create_str_array(3, "id", "--help", NULL);
+
+    VERIFY_INT(python_io->open(SUDO_API_VERSION, fake_conversation, fake_printf, data.settings,
+                              data.user_info, data.command_info, data.plugin_argc, data.plugin_argv,
+                              data.user_env, data.plugin_options, &errstr), SUDO_RC_OK);
+
+    VERIFY_INT(python_io->log_io(records, 2, &errstr), SUDO_RC_OK);
+
+    // sudo reuses the buffer, the data kept by the plugin must not change
+    memset(buf, 0, sizeof(buf));
+
+    python_io->close(0, 0);
+
+    VERIFY_STR(data.stdout_str, "2 records, 384 bytes, 1 binary\n"
+               "kept: 00010203 fcfdfeff 00010203 7c7d7e7f\n");
+
+    return true;
+}
+
+// Benchmark, only run with -b.  The time taken depends on the machine.
+int
+check_io_plugin_log_io_throughput(void)
+{
+    const char *errstr = NULL;
+    static char buf[4096];
+    struct timespec now = { 0, 0 }, start, end;
+    struct sudo_io_record records[64];
+    const unsigned int loops = 1000;
+    unsigned long long msecs;
+    unsigned int i;
+
+    // every byte value, so the data is not valid UTF-8
+    for (i = 0; i < sizeof(buf); ++i)
+        buf[i] = (char)(i & 0xff);
+    for (i = 0; i < 64; ++i) {
+        records[i].event = (i % 2) ? SUDO_IO_EVENT_TTYOUT : SUDO_IO_EVENT_STDOUT;
+        records[i].len = sizeof(buf);
+        records[i].buf = buf;
+        records[i].when = &now;
+    }
+
+    str_array_free(&data.plugin_options);
+    data.plugin_options = create_str_array(
+        3,
+        "ModulePath=" SRC_DIR "/regress/plugin_io_throughput.py",
+        "ClassName=IOThroughputPlugin",
+        NULL
+    );
+
+    str_array_free(&data.plugin_argv);
+    data.plugin_argc = 2;
+    data.plugin_argv = create_str_array(3, "id", "--help", NULL);
+
+    VERIFY_INT(python_io->open(SUDO_API_VERSION, fake_conversation, fake_printf, data.settings,
+                              data.user_info, data.command_info, data.plugin_argc, data.plugin_argv,
+                              data.user_env, data.plugin_options, &errstr), SUDO_RC_OK);
+
+    VERIFY_INT(sudo_gettime_mono(&start), 0);
+    for (i = 0; i < loops; ++i) {
+        VERIFY_INT(python_io->log_io(records, 64, &errstr), SUDO_RC_OK);
+    }
+    VERIFY_INT(sudo_gettime_mono(&end), 0);
+    sudo_timespecsub(&end, &start, &end);
+
+    python_io->close(0, 0);
+
+    VERIFY_STR(data.stdout_str, "64000 records, 262144000 bytes, 64000 binary\n");
+
+    msecs = (unsigned long long)end.tv_sec * 1000 + (unsigned long long)end.tv_nsec / 1000000;
+    printf("    %u MiB in %llu.%03llu seconds (%llu MiB/s)\n",
+           loops * (unsigned int)sizeof(buf) * 64 / (1024 * 1024),
+           msecs / 1000, msecs % 1000,
+           msecs ? (unsigned long long)loops * sizeof(buf) * 64 * 1000 / (1024 * 1024) / msecs : 0);
+
+    return true;
+}
+
 typedef struct io_plugin * (io_clone_func)(void);
 
 int
@@ -964,6 +1107,7 @@ check_io_plugin_callbacks_are_optional(void)
     VERIFY_PTR(python_io->log_ttyout, NULL);
     VERIFY_PTR(python_io->show_version, NULL);
     VERIFY_PTR(python_io->change_winsize, NULL);
+    VERIFY_PTR(python_io->log_io, NULL);
 
     python_io->close(0, 0);
     return true;
@@ -1320,20 +1464,38 @@ _unload_symbols(void)
 int
 main(int argc, char *argv[])
 {
-    if (argc != 2) {
+    bool bench = false;
+    int ch;
+
+    while ((ch = getopt(argc, argv, "b")) != -1) {
+        switch (ch) {
+        case 'b':
+            bench = true;
+            break;
+        default:
+            printf("usage: %s [-b] python_plugin.so\n", argv[0]);
+            return EXIT_FAILURE;
+        }
+    }
+    argc -= optind;
+    argv += optind;
+
+    if (argc != 1) {
         printf("Please specify the python_plugin.so as argument!\n");
         return EXIT_FAILURE;
     }
-    python_plugin_so_path = argv[1];
+    python_plugin_so_path = argv[0];
 
     RUN_TEST(check_example_io_plugin_version_display(true));
     RUN_TEST(check_example_io_plugin_version_display(false));
     RUN_TEST(check_example_io_plugin_command_log());
+    RUN_TEST(check_example_io_plugin_log_io());
     RUN_TEST(check_example_io_plugin_command_log_multiple());
     RUN_TEST(check_example_io_plugin_failed_to_start_command());
     RUN_TEST(check_example_io_plugin_fails_with_python_backtrace());
     RUN_TEST(check_io_plugin_callbacks_are_optional());
     RUN_TEST(check_io_plugin_reports_error());
+    RUN_TEST(check_io_plugin_log_io_records());
 
     RUN_TEST(check_example_group_plugin());
     RUN_TEST(check_example_group_plugin_is_able_to_debug());
@@ -1378,5 +1540,8 @@ main(int argc, char *argv[])
     RUN_TEST(check_example_debugging("py_calls@info"));
     RUN_TEST(check_example_debugging("plugin@err"));
 
+    if (bench)
+        RUN_TEST(check_io_plugin_log_io_throughput());
+
     return EXIT_SUCCESS;
 }
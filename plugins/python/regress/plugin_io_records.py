@@ -0,0 +1,32 @@
+import sudo
+
+
+# Checks the I/O records it receives through log_io().  Used to check that
+# binary data can be passed and that data kept by the plugin stays valid
+# after sudo has reused its buffer.
+class IORecordsPlugin(sudo.Plugin):
+    def __init__(self, **kwargs):
+        self._records = 0
+        self._bytes = 0
+        self._binary = 0
+        self._kept = []
+
+    def open(self, argv, command_info):
+        return sudo.RC.ACCEPT
+
+    def log_io(self, records):
+        for event, time, buf in records:
+            self._records += 1
+            self._bytes += len(buf)
+            if buf[-1] == 0xff:
+                self._binary += 1
+            # keep a slice and a new view without copying the data
+            self._kept.append(buf[:4])
+            self._kept.append(memoryview(buf)[-4:])
+        return sudo.RC.ACCEPT
+
+    def close(self, exit_status, error):
+        sudo.log_info("{} records, {} bytes, {} binary".format(
+            self._records, self._bytes, self._binary))
+        sudo.log_info("kept: {}".format(
+            " ".join(bytes(buf).hex() for buf in self._kept)))
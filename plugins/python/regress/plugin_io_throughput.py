@@ -0,0 +1,25 @@
+import sudo
+
+
+# Counts the I/O it receives through log_io().  Used to measure the cost
+# of passing large amounts of I/O to python in batches.
+class IOThroughputPlugin(sudo.Plugin):
+    def __init__(self, **kwargs):
+        self._records = 0
+        self._bytes = 0
+        self._binary = 0
+
+    def open(self, argv, command_info):
+        return sudo.RC.ACCEPT
+
+    def log_io(self, records):
+        for event, time, buf in records:
+            self._records += 1
+            self._bytes += len(buf)
+            if buf[-1] == 0xff:
+                self._binary += 1
+        return sudo.RC.ACCEPT
+
+    def close(self, exit_status, error):
+        sudo.log_info("{} records, {} bytes, {} binary".format(
+            self._records, self._bytes, self._binary))
@@ -617,6 +617,15 @@ sudo_module_init(void)
     };
     MODULE_REGISTER_ENUM("PLUGIN_TYPE", constants_plugin_types);
 
+    struct key_value_str_int constants_io_event[] = {
+        {"STDIN", SUDO_IO_EVENT_STDIN},
+        {"STDOUT", SUDO_IO_EVENT_STDOUT},
+        {"STDERR", SUDO_IO_EVENT_STDERR},
+        {"TTYIN", SUDO_IO_EVENT_TTYIN},
+        {"TTYOUT", SUDO_IO_EVENT_TTYOUT}
+    };
+    MODULE_REGISTER_ENUM("IO_EVENT", constants_io_event);
+
     // classes
     if (sudo_module_register_conv_message(py_module) != SUDO_RC_OK)
         goto cleanup;
@@ -463,6 +463,30 @@ io_log_output(const char *buf, unsigned int len)
     return ret;
 }
 
+/*
+ * Log a batch of I/O, tty and pipe input go to the input file.
+ */
+static int
+io_log_records(const struct sudo_io_record records[], unsigned int count,
+    const char **errstr)
+{
+    unsigned int i;
+
+    for (i = 0; i < count; i++) {
+	switch (records[i].event) {
+	case SUDO_IO_EVENT_TTYIN:
+	case SUDO_IO_EVENT_STDIN:
+	    io_log_input(records[i].buf, records[i].len);
+	    break;
+	default:
+	    if (!io_log_output(records[i].buf, records[i].len))
+		return false;
+	    break;
+	}
+    }
+    return true;
+}
+
 __dso_public struct policy_plugin sample_policy = {
     SUDO_POLICY_PLUGIN,
     SUDO_API_VERSION,
@@ -492,5 +516,11 @@ __dso_public struct io_plugin sample_io = {
     io_log_output,	/* tty output */
     io_log_input,	/* command stdin if not tty */
     io_log_output,	/* command stdout if not tty */
-    io_log_output	/* command stderr if not tty */
+    io_log_output,	/* command stderr if not tty */
+    NULL, /* register_hooks */
+    NULL, /* deregister_hooks */
+    NULL, /* change_winsize */
+    NULL, /* log_suspend */
+    NULL, /* event_alloc() filled in by sudo */
+    io_log_records	/* batched I/O, used instead of the above */
 };
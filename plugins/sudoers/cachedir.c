@@ -0,0 +1,162 @@
+/*
+ * SPDX-License-Identifier: ISC
+ *
+ * Copyright (c) 2020 Todd C. Miller <Todd.Miller@sudo.ws>
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/*
+ * This is an open source non-commercial project. Dear PVS-Studio, please check it.
+ * PVS-Studio Static Code Analyzer for C, C++ and C#: http://www.viva64.com
+ */
+
+#include <config.h>
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <stdio.h>
+#include <stdlib.h>
+#ifdef HAVE_STRING_H
+# include <string.h>
+#endif /* HAVE_STRING_H */
+#ifdef HAVE_STRINGS_H
+# include <strings.h>
+#endif /* HAVE_STRINGS_H */
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+
+#include "sudoers.h"
+
+/*
+ * Helpers for the on-disk caches stored in a directory of small files,
+ * such as the shared passwd and group cache and the command digest cache.
+ * The directory and the files in it must be owned by the specified user
+ * (root, except in the regression tests) and not writable by anyone else.
+ */
+
+#ifndef O_NOFOLLOW
+# define O_NOFOLLOW 0
+#endif
+
+/*
+ * Check that the cache directory dir is secure, creating it (and its
+ * parents) owned by uid and gid if it does not already exist.
+ * Returns true if the directory may be used, else false.
+ */
+bool
+sudo_cachedir_open(const char *dir, uid_t uid, gid_t gid)
+{
+    struct stat sb;
+    char *copy;
+    bool ret = false;
+    debug_decl(sudo_cachedir_open, SUDOERS_DEBUG_UTIL);
+
+    if (dir == NULL || *dir != '/')
+	debug_return_bool(false);
+
+    switch (sudo_secure_dir(dir, uid, -1, &sb)) {
+    case SUDO_PATH_SECURE:
+	ret = true;
+	break;
+    case SUDO_PATH_MISSING:
+	if ((copy = strdup(dir)) == NULL)
+	    break;
+	if (sudo_mkdir_parents(copy, uid, gid, S_IRWXU|S_IXGRP|S_IXOTH, true)) {
+	    if (mkdir(dir, S_IRWXU) == 0 || errno == EEXIST)
+		ret = sudo_secure_dir(dir, uid, -1, &sb) == SUDO_PATH_SECURE;
+	}
+	free(copy);
+	break;
+    default:
+	sudo_debug_printf(SUDO_DEBUG_WARN|SUDO_DEBUG_LINENO,
+	    "%s: insecure cache directory", dir);
+	break;
+    }
+
+    debug_return_bool(ret);
+}
+
+/*
+ * Open a cache file for reading and make sure it is a regular file
+ * owned by uid that nobody else can write to.  The file's status
+ * is stored in sb.  Returns the file descriptor or -1 on error.
+ */
+int
+sudo_cachedir_open_file(const char *path, uid_t uid, struct stat *sb)
+{
+    int fd;
+    debug_decl(sudo_cachedir_open_file, SUDOERS_DEBUG_UTIL);
+
+    fd = open(path, O_RDONLY|O_NOFOLLOW);
+    if (fd == -1)
+	debug_return_int(-1);
+    if (fstat(fd, sb) == -1 || !S_ISREG(sb->st_mode) ||
+	    sb->st_uid != uid || (sb->st_mode & (S_IWGRP|S_IWOTH))) {
+	sudo_debug_printf(SUDO_DEBUG_WARN|SUDO_DEBUG_LINENO,
+	    "ignoring insecure cache file %s", path);
+	close(fd);
+	debug_return_int(-1);
+    }
+    (void)fcntl(fd, F_SETFD, FD_CLOEXEC);
+    debug_return_int(fd);
+}
+
+/*
+ * Atomically replace path with the contents of buf.
+ * The data is written to a temporary file in the cache directory dir,
+ * readable only by its owner, which is then renamed to path.
+ * Returns true on success, else false.
+ */
+bool
+sudo_cachedir_write_file(const char *dir, const char *path, const void *buf,
+    size_t len)
+{
+    char tmpl[PATH_MAX];
+    mode_t omask;
+    int fd, n;
+    debug_decl(sudo_cachedir_write_file, SUDOERS_DEBUG_UTIL);
+
+    n = snprintf(tmpl, sizeof(tmpl), "%s/.tmpXXXXXX", dir);
+    if (n < 0 || (size_t)n >= sizeof(tmpl))
+	debug_return_bool(false);
+    omask = umask(S_IRWXG|S_IRWXO);
+    fd = mkstemp(tmpl);
+    umask(omask);
+    if (fd == -1) {
+	sudo_debug_printf(SUDO_DEBUG_WARN|SUDO_DEBUG_ERRNO|SUDO_DEBUG_LINENO,
+	    "unable to create temporary file in %s", dir);
+	debug_return_bool(false);
+    }
+    if (write(fd, buf, len) != (ssize_t)len) {
+	sudo_debug_printf(SUDO_DEBUG_WARN|SUDO_DEBUG_ERRNO|SUDO_DEBUG_LINENO,
+	    "unable to write %s", tmpl);
+	close(fd);
+	unlink(tmpl);
+	debug_return_bool(false);
+    }
+    if (close(fd) != 0) {
+	sudo_debug_printf(SUDO_DEBUG_WARN|SUDO_DEBUG_ERRNO|SUDO_DEBUG_LINENO,
+	    "unable to close %s", tmpl);
+	unlink(tmpl);
+	debug_return_bool(false);
+    }
+    if (rename(tmpl, path) != 0) {
+	sudo_debug_printf(SUDO_DEBUG_WARN|SUDO_DEBUG_ERRNO|SUDO_DEBUG_LINENO,
+	    "unable to rename %s to %s", tmpl, path);
+	unlink(tmpl);
+	debug_return_bool(false);
+    }
+    debug_return_bool(true);
+}
@@ -865,7 +865,7 @@ convert_sudoers_json(struct sudoers_parse_tree *parse_tree,
     }
 
     /* Open JSON output. */
-    sudo_json_init(&json, output_fp, 4);
+    sudo_json_init(&json, output_fp, 4, false);
     putc('{', output_fp);
 
     /* Dump Defaults in JSON format. */
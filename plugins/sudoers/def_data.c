@@ -529,6 +529,14 @@ struct sudo_defs_types sudo_defs_table[] = {
 	"log_server_peer_key", T_STR|T_BOOL|T_PATH,
 	N_("Path to the sudoers private key file: %s"),
 	NULL,
+    }, {
+	"log_server_coalesce", T_UINT|T_BOOL,
+	N_("Time in milliseconds to combine I/O log data sent to the log server: %u"),
+	NULL,
+    }, {
+	"log_server_compress", T_FLAG,
+	N_("Compress I/O log data sent to the log server"),
+	NULL,
     }, {
 	"runas_allow_unknown_id", T_FLAG,
 	N_("Allow the use of unknown runas user and/or group ID"),
@@ -537,6 +545,26 @@ struct sudo_defs_types sudo_defs_table[] = {
 	"runas_check_shell", T_FLAG,
 	N_("Only permit running commands as a user with a valid shell"),
 	NULL,
+    }, {
+	"pwcache_timeout", T_TIMESPEC|T_BOOL,
+	N_("Shared passwd and group cache timeout: %.1f minutes"),
+	NULL,
+    }, {
+	"pwcache_dir", T_STR|T_PATH,
+	N_("Path to the shared passwd and group cache dir: %s"),
+	NULL,
+    }, {
+	"digest_cache", T_FLAG,
+	N_("Cache command digests between invocations"),
+	NULL,
+    }, {
+	"digest_cache_dir", T_STR|T_PATH,
+	N_("Path to the command digest cache dir: %s"),
+	NULL,
+    }, {
+	"log_async", T_FLAG,
+	N_("Mail and log messages in the background"),
+	NULL,
     }, {
 	NULL, 0, NULL
     }
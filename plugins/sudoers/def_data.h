@@ -244,10 +244,24 @@
 #define def_log_server_peer_cert (sudo_defs_table[I_LOG_SERVER_PEER_CERT].sd_un.str)
 #define I_LOG_SERVER_PEER_KEY   122
 #define def_log_server_peer_key (sudo_defs_table[I_LOG_SERVER_PEER_KEY].sd_un.str)
-#define I_RUNAS_ALLOW_UNKNOWN_ID 123
+#define I_LOG_SERVER_COALESCE   123
+#define def_log_server_coalesce (sudo_defs_table[I_LOG_SERVER_COALESCE].sd_un.uival)
+#define I_LOG_SERVER_COMPRESS   124
+#define def_log_server_compress (sudo_defs_table[I_LOG_SERVER_COMPRESS].sd_un.flag)
+#define I_RUNAS_ALLOW_UNKNOWN_ID 125
 #define def_runas_allow_unknown_id (sudo_defs_table[I_RUNAS_ALLOW_UNKNOWN_ID].sd_un.flag)
-#define I_RUNAS_CHECK_SHELL     124
+#define I_RUNAS_CHECK_SHELL     126
 #define def_runas_check_shell   (sudo_defs_table[I_RUNAS_CHECK_SHELL].sd_un.flag)
+#define I_PWCACHE_TIMEOUT       127
+#define def_pwcache_timeout     (sudo_defs_table[I_PWCACHE_TIMEOUT].sd_un.tspec)
+#define I_PWCACHE_DIR           128
+#define def_pwcache_dir         (sudo_defs_table[I_PWCACHE_DIR].sd_un.str)
+#define I_DIGEST_CACHE          129
+#define def_digest_cache        (sudo_defs_table[I_DIGEST_CACHE].sd_un.flag)
+#define I_DIGEST_CACHE_DIR      130
+#define def_digest_cache_dir    (sudo_defs_table[I_DIGEST_CACHE_DIR].sd_un.str)
+#define I_LOG_ASYNC             131
+#define def_log_async           (sudo_defs_table[I_LOG_ASYNC].sd_un.flag)
 
 enum def_tuple {
 	never,
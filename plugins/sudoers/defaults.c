@@ -580,6 +580,10 @@ init_defaults(void)
 	goto oom;
     if ((def_timestampdir = strdup(_PATH_SUDO_TIMEDIR)) == NULL)
 	goto oom;
+    if ((def_pwcache_dir = strdup(_PATH_SUDO_PWCACHE_DIR)) == NULL)
+	goto oom;
+    if ((def_digest_cache_dir = strdup(_PATH_SUDO_DIGEST_DIR)) == NULL)
+	goto oom;
     if ((def_passprompt = strdup(_(PASSPROMPT))) == NULL)
 	goto oom;
     if ((def_runas_default = strdup(RUNAS_DEFAULT)) == NULL)
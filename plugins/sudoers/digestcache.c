@@ -0,0 +1,257 @@
+/*
+ * SPDX-License-Identifier: ISC
+ *
+ * Copyright (c) 2020 Todd C. Miller <Todd.Miller@sudo.ws>
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/*
+ * This is an open source non-commercial project. Dear PVS-Studio, please check it.
+ * PVS-Studio Static Code Analyzer for C, C++ and C#: http://www.viva64.com
+ */
+
+#include <config.h>
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#if defined(HAVE_STDINT_H)
+# include <stdint.h>
+#elif defined(HAVE_INTTYPES_H)
+# include <inttypes.h>
+#endif
+#ifdef HAVE_STRING_H
+# include <string.h>
+#endif /* HAVE_STRING_H */
+#ifdef HAVE_STRINGS_H
+# include <strings.h>
+#endif /* HAVE_STRINGS_H */
+#include <unistd.h>
+
+#include "sudoers.h"
+#include "sudo_digest.h"
+
+/*
+ * Command digest cache.
+ *
+ * Hashing a large command on every invocation is expensive, so the
+ * result is stored in a directory of small files, one per command,
+ * named after the device and inode number of the command and the
+ * digest type.  Each file holds the command's size, modification
+ * time and change time at the time it was hashed.  An entry is only
+ * used if all of these still match the open command, so any change
+ * to the file (which always updates the change time) invalidates it.
+ *
+ * Entry files must be owned by root and not writable by anyone else.
+ * To avoid caching the digest of a file that is modified in the same
+ * clock tick it was hashed in, files changed in the last two seconds
+ * are not cached.
+ */
+
+#define DIGESTCACHE_MAGIC	0x53444743	/* "SDGC" in host order */
+#define DIGESTCACHE_VERSION	1
+#define DIGESTCACHE_MAX_LEN	64		/* SHA-512 */
+#define DIGESTCACHE_RACY_SECS	2
+
+struct digestcache_entry {
+    uint32_t magic;
+    uint16_t version;
+    uint16_t digest_type;
+    uint64_t dev;
+    uint64_t ino;
+    int64_t size;
+    int64_t mtime_sec;
+    int64_t mtime_nsec;
+    int64_t ctime_sec;
+    uint32_t digest_len;
+    unsigned char digest[DIGESTCACHE_MAX_LEN];
+};
+
+static char *digestcache_dir;
+
+/*
+ * Fill in the cache key for the file described by sb.
+ */
+static void
+digestcache_fill(struct digestcache_entry *entry, const struct stat *sb,
+    int digest_type)
+{
+    struct timespec ts;
+
+    memset(entry, 0, sizeof(*entry));
+    entry->magic = DIGESTCACHE_MAGIC;
+    entry->version = DIGESTCACHE_VERSION;
+    entry->digest_type = (uint16_t)digest_type;
+    entry->dev = (uint64_t)sb->st_dev;
+    entry->ino = (uint64_t)sb->st_ino;
+    entry->size = (int64_t)sb->st_size;
+    mtim_get(sb, ts);
+    entry->mtime_sec = (int64_t)ts.tv_sec;
+    entry->mtime_nsec = (int64_t)ts.tv_nsec;
+    entry->ctime_sec = (int64_t)sb->st_ctime;
+}
+
+/*
+ * Store the cache file name for the file described by sb in path.
+ * Returns false if the name is too long.
+ */
+static bool
+digestcache_path(char *path, size_t psize, const struct stat *sb,
+    int digest_type)
+{
+    int len;
+
+    len = snprintf(path, psize, "%s/%llx.%llx.%d", digestcache_dir,
+	(unsigned long long)sb->st_dev, (unsigned long long)sb->st_ino,
+	digest_type);
+    return len >= 0 && (size_t)len < psize;
+}
+
+/*
+ * Look up the digest of the open file described by sb.
+ * Returns a newly-allocated copy of the digest and stores its length
+ * in digest_len on a hit, else NULL.
+ */
+unsigned char *
+sudo_digestcache_get(const struct stat *sb, int digest_type,
+    size_t *digest_len)
+{
+    struct digestcache_entry entry, key;
+    unsigned char *digest = NULL;
+    char path[PATH_MAX];
+    struct stat esb;
+    int expected_len, fd;
+    debug_decl(sudo_digestcache_get, SUDOERS_DEBUG_MATCH);
+
+    if (digestcache_dir == NULL ||
+	    !digestcache_path(path, sizeof(path), sb, digest_type))
+	debug_return_ptr(NULL);
+
+    fd = sudo_cachedir_open_file(path, ROOT_UID, &esb);
+    if (fd == -1)
+	debug_return_ptr(NULL);
+    if (esb.st_size != sizeof(entry)) {
+	sudo_debug_printf(SUDO_DEBUG_WARN|SUDO_DEBUG_LINENO,
+	    "ignoring invalid cache file %s", path);
+	goto done;
+    }
+    if (read(fd, &entry, sizeof(entry)) != sizeof(entry))
+	goto done;
+
+    /* Every field except the digest itself must match. */
+    digestcache_fill(&key, sb, digest_type);
+    if (memcmp(&entry, &key,
+	    offsetof(struct digestcache_entry, digest_len)) != 0) {
+	sudo_debug_printf(SUDO_DEBUG_DEBUG|SUDO_DEBUG_LINENO,
+	    "%s: stale cache entry", path);
+	goto done;
+    }
+    expected_len = sudo_digest_getlen(digest_type);
+    if (expected_len <= 0 || entry.digest_len > DIGESTCACHE_MAX_LEN ||
+	    entry.digest_len != (uint32_t)expected_len)
+	goto done;
+    if ((digest = malloc(entry.digest_len)) == NULL) {
+	sudo_warnx(U_("%s: %s"), __func__, U_("unable to allocate memory"));
+	goto done;
+    }
+    memcpy(digest, entry.digest, entry.digest_len);
+    *digest_len = entry.digest_len;
+    sudo_debug_printf(SUDO_DEBUG_DEBUG|SUDO_DEBUG_LINENO,
+	"%s: digest cache hit", path);
+
+done:
+    close(fd);
+    debug_return_ptr(digest);
+}
+
+/*
+ * Store the digest of the open file described by sb.
+ * Errors are not fatal, the digest is simply not cached.
+ */
+void
+sudo_digestcache_put(const struct stat *sb, int digest_type,
+    const unsigned char *digest, size_t digest_len)
+{
+    struct digestcache_entry entry;
+    char path[PATH_MAX];
+    struct timespec now;
+    debug_decl(sudo_digestcache_put, SUDOERS_DEBUG_MATCH);
+
+    if (digestcache_dir == NULL || digest_len > DIGESTCACHE_MAX_LEN ||
+	    !digestcache_path(path, sizeof(path), sb, digest_type))
+	debug_return;
+
+    /* Don't cache a file that may still be changing in this clock tick. */
+    if (sudo_gettime_real(&now) == -1 ||
+	    sb->st_ctime > now.tv_sec - DIGESTCACHE_RACY_SECS) {
+	sudo_debug_printf(SUDO_DEBUG_DEBUG|SUDO_DEBUG_LINENO,
+	    "%s: recently changed, not caching", path);
+	debug_return;
+    }
+
+    digestcache_fill(&entry, sb, digest_type);
+    entry.digest_len = (uint32_t)digest_len;
+    memcpy(entry.digest, digest, digest_len);
+
+    if (!sudo_cachedir_write_file(digestcache_dir, path, &entry, sizeof(entry)))
+	debug_return;
+    sudo_debug_printf(SUDO_DEBUG_DEBUG|SUDO_DEBUG_LINENO,
+	"%s: stored in digest cache", path);
+
+    debug_return;
+}
+
+/*
+ * Enable the command digest cache stored in dir.
+ * The directory is created if it does not already exist.
+ * Must be called as root.
+ * Returns true on success, false if the cache cannot be used.
+ */
+bool
+sudo_digestcache_open(const char *dir)
+{
+    debug_decl(sudo_digestcache_open, SUDOERS_DEBUG_MATCH);
+
+    sudo_digestcache_close();
+    if (!sudo_cachedir_open(dir, ROOT_UID, ROOT_GID)) {
+	sudo_debug_printf(SUDO_DEBUG_INFO|SUDO_DEBUG_LINENO,
+	    "command digest cache disabled");
+	debug_return_bool(false);
+    }
+
+    if ((digestcache_dir = strdup(dir)) == NULL) {
+	sudo_warnx(U_("%s: %s"), __func__, U_("unable to allocate memory"));
+	debug_return_bool(false);
+    }
+    sudo_debug_printf(SUDO_DEBUG_INFO|SUDO_DEBUG_LINENO,
+	"using command digest cache %s", digestcache_dir);
+
+    debug_return_bool(true);
+}
+
+/*
+ * Disable the command digest cache.
+ */
+void
+sudo_digestcache_close(void)
+{
+    debug_decl(sudo_digestcache_close, SUDOERS_DEBUG_MATCH);
+
+    free(digestcache_dir);
+    digestcache_dir = NULL;
+
+    debug_return;
+}
@@ -131,6 +131,10 @@ struct environment {
     char **old_envp;		/* pointer the old environment we allocated */
     size_t env_size;		/* size of new_environ in char **'s */
     size_t env_len;		/* number of slots used, not counting NULL */
+    size_t *index;		/* hash of variable names to envp offset + 1 */
+    size_t index_size;		/* number of index slots, a power of two */
+    bool index_valid;		/* index is in sync with envp */
+    bool index_dups;		/* envp may contain duplicate names */
 };
 
 /*
@@ -138,6 +142,14 @@ struct environment {
  */
 static struct environment env;
 
+/*
+ * Compiled versions of env_check, env_delete and env_keep.
+ * These are built on first use and freed when the lists change.
+ */
+static struct env_filter *env_check_filter;
+static struct env_filter *env_delete_filter;
+static struct env_filter *env_keep_filter;
+
 /*
  * Default table of "bad" variables to remove from the environment.
  * XXX - how to omit TERMCAP if it starts with '/'?
@@ -244,6 +256,7 @@ env_init(char * const envp[])
     size_t len;
     debug_decl(env_init, SUDOERS_DEBUG_ENV);
 
+    env.index_valid = false;
     if (envp == NULL) {
 	/* Free the old envp we allocated, if any. */
 	free(env.old_envp);
@@ -304,6 +317,92 @@ env_swap_old(void)
     old_envp = env.old_envp;
     env.old_envp = env.envp;
     env.envp = old_envp;
+    env.index_valid = false;
+    return true;
+}
+
+/*
+ * Hash a variable name up to and including the '=' separator.
+ */
+static size_t
+env_index_hash(const char *str, size_t *lenp)
+{
+    size_t h = 5381, len = 0;
+
+    while (str[len] != '\0') {
+	h = (h * 33) ^ (unsigned char)str[len];
+	if (str[len++] == '=')
+	    break;
+    }
+    *lenp = len;
+    return h & (env.index_size - 1);
+}
+
+/*
+ * Look up str (in name=value form) in the index.
+ * Returns a pointer to its first instance in envp or NULL if not found.
+ */
+static char **
+env_index_lookup(const char *str)
+{
+    size_t h, len, pos;
+
+    for (h = env_index_hash(str, &len); (pos = env.index[h]) != 0;
+	    h = (h + 1) & (env.index_size - 1)) {
+	if (strncmp(str, env.envp[pos - 1], len) == 0)
+	    return env.envp + pos - 1;
+    }
+    return NULL;
+}
+
+/*
+ * Add the variable at offset pos in envp to the index.
+ * If the name is already present, the earlier instance is kept.
+ */
+static void
+env_index_insert(size_t pos)
+{
+    const char *str = env.envp[pos];
+    size_t h, len, cur;
+
+    for (h = env_index_hash(str, &len); (cur = env.index[h]) != 0;
+	    h = (h + 1) & (env.index_size - 1)) {
+	if (strncmp(str, env.envp[cur - 1], len) == 0) {
+	    env.index_dups = true;
+	    return;
+	}
+    }
+    env.index[h] = pos + 1;
+}
+
+/*
+ * (Re)build the index of variable names in envp.
+ * The index is sized for env_size entries so it stays at most
+ * half full until envp itself needs to grow.
+ * Does not include warnings or debugging to avoid recursive calls.
+ */
+static bool
+env_index_build(void)
+{
+    size_t pos, nsize = 16;
+
+    while (nsize < env.env_size * 2) {
+	if (nsize > SIZE_MAX / 2 / sizeof(size_t))
+	    return false;
+	nsize *= 2;
+    }
+    if (nsize > env.index_size) {
+	size_t *nindex = reallocarray(env.index, nsize, sizeof(size_t));
+	if (nindex == NULL)
+	    return false;
+	env.index = nindex;
+	env.index_size = nsize;
+    }
+    memset(env.index, 0, env.index_size * sizeof(size_t));
+    env.index_dups = false;
+    for (pos = 0; pos < env.env_len; pos++)
+	env_index_insert(pos);
+    env.index_valid = true;
     return true;
 }
 
@@ -344,6 +443,7 @@ sudo_putenv_nodebug(char *str, bool dupcheck, bool overwrite)
 	    return -1;
 	env.envp = nenvp;
 	env.env_size = nsize;
+	env.index_valid = false;
 #ifdef ENV_DEBUG
 	memset(env.envp + env.env_len, 0,
 	    (env.env_size - env.env_len) * sizeof(char *));
@@ -357,18 +457,32 @@ sudo_putenv_nodebug(char *str, bool dupcheck, bool overwrite)
     }
 #endif
 
+    /* Use the name index if possible, else fall back to a linear search. */
+    if (!env.index_valid)
+	(void)env_index_build();
+
     if (dupcheck) {
 	len = (strchr(str, '=') - str) + 1;
-	for (ep = env.envp; *ep != NULL; ep++) {
-	    if (strncmp(str, *ep, len) == 0) {
-		if (overwrite)
-		    *ep = str;
-		found = true;
-		break;
+	if (env.index_valid) {
+	    ep = env_index_lookup(str);
+	} else {
+	    for (ep = env.envp; *ep != NULL; ep++) {
+		if (strncmp(str, *ep, len) == 0)
+		    break;
 	    }
+	    if (*ep == NULL)
+		ep = NULL;
 	}
-	/* Prune out extra instances of the variable we just overwrote. */
-	if (found && overwrite) {
+	if (ep != NULL) {
+	    if (overwrite)
+		*ep = str;
+	    found = true;
+	}
+	/*
+	 * Prune out extra instances of the variable we just overwrote.
+	 * The index tells us whether there can be any.
+	 */
+	if (found && overwrite && (!env.index_valid || env.index_dups)) {
 	    while (*++ep != NULL) {
 		if (strncmp(str, *ep, len) == 0) {
 		    char **cur = ep;
@@ -378,6 +492,7 @@ sudo_putenv_nodebug(char *str, bool dupcheck, bool overwrite)
 		}
 	    }
 	    env.env_len = ep - env.envp;
+	    env.index_valid = false;
 	}
     }
 
@@ -386,6 +501,8 @@ sudo_putenv_nodebug(char *str, bool dupcheck, bool overwrite)
 	env.env_len++;
 	*ep++ = str;
 	*ep = NULL;
+	if (env.index_valid)
+	    env_index_insert(env.env_len - 1);
     }
     return 0;
 }
@@ -532,6 +649,7 @@ sudo_unsetenv_nodebug(const char *var)
 	    while ((*cur = *(cur + 1)) != NULL)
 		cur++;
 	    env.env_len--;
+	    env.index_valid = false;
 	    /* Keep going, could be multiple instances of the var. */
 	} else {
 	    ep++;
@@ -596,17 +714,55 @@ sudo_getenv(const char *name)
     debug_return_str(val);
 }
 
+/*
+ * Free the compiled environment lists.
+ */
+static void
+env_filters_free(void)
+{
+    debug_decl(env_filters_free, SUDOERS_DEBUG_ENV);
+
+    env_filter_free(env_check_filter);
+    env_check_filter = NULL;
+    env_filter_free(env_delete_filter);
+    env_delete_filter = NULL;
+    env_filter_free(env_keep_filter);
+    env_keep_filter = NULL;
+
+    debug_return;
+}
+
+/*
+ * Callback for env_check, env_delete and env_keep sudoers settings.
+ * The compiled lists are rebuilt the next time they are used.
+ */
+bool
+cb_env_list(const union sudo_defs_val *sd_un)
+{
+    debug_decl(cb_env_list, SUDOERS_DEBUG_ENV);
+
+    env_filters_free();
+
+    debug_return_bool(true);
+}
+
 /*
  * Check for var against patterns in the specified environment list.
+ * The list is compiled into *filterp on first use; if that fails
+ * the patterns are checked one at a time.
  * Returns true if the variable was found, else false.
  */
 static bool
-matches_env_list(const char *var, struct list_members *list, bool *full_match)
+matches_env_list(const char *var, struct list_members *list,
+    struct env_filter **filterp, bool *full_match)
 {
     struct list_member *cur;
     bool is_logname = false;
     debug_decl(matches_env_list, SUDOERS_DEBUG_ENV);
 
+    if (*filterp == NULL)
+	*filterp = env_filter_compile(list);
+
     switch (*var) {
     case 'L':
 	if (strncmp(var, "LOGNAME=", 8) == 0)
@@ -627,6 +783,13 @@ matches_env_list(const char *var, struct list_members *list, bool *full_match)
 	 * We treat LOGIN, LOGNAME and USER specially.
 	 * If one is preserved/deleted we want to preserve/delete them all.
 	 */
+	if (*filterp != NULL) {
+	    debug_return_bool(env_filter_match(*filterp, "LOGNAME", full_match) ||
+#ifdef _AIX
+		env_filter_match(*filterp, "LOGIN", full_match) ||
+#endif
+		env_filter_match(*filterp, "USER", full_match));
+	}
 	SLIST_FOREACH(cur, list, entries) {
 	    if (matches_env_pattern(cur->value, "LOGNAME", full_match) ||
 #ifdef _AIX
@@ -636,6 +799,8 @@ matches_env_list(const char *var, struct list_members *list, bool *full_match)
 		debug_return_bool(true);
 	}
     } else {
+	if (*filterp != NULL)
+	    debug_return_bool(env_filter_match(*filterp, var, full_match));
 	SLIST_FOREACH(cur, list, entries) {
 	    if (matches_env_pattern(cur->value, var, full_match))
 		debug_return_bool(true);
@@ -655,7 +820,8 @@ matches_env_delete(const char *var)
     debug_decl(matches_env_delete, SUDOERS_DEBUG_ENV);
 
     /* Skip anything listed in env_delete. */
-    debug_return_bool(matches_env_list(var, &def_env_delete, &full_match));
+    debug_return_bool(matches_env_list(var, &def_env_delete,
+	&env_delete_filter, &full_match));
 }
 
 /*
@@ -718,7 +884,7 @@ matches_env_check(const char *var, bool *full_match)
     debug_decl(matches_env_check, SUDOERS_DEBUG_ENV);
 
     /* Skip anything listed in env_check that includes '/' or '%'. */
-    if (matches_env_list(var, &def_env_check, full_match)) {
+    if (matches_env_list(var, &def_env_check, &env_check_filter, full_match)) {
 	if (strncmp(var, "TZ=", 3) == 0) {
 	    /* Special case for TZ */
 	    keepit = tz_is_sane(var + 3);
@@ -744,7 +910,8 @@ matches_env_keep(const char *var, bool *full_match)
     /* Preserve SHELL variable for "sudo -s". */
     if (ISSET(sudo_mode, MODE_SHELL) && strncmp(var, "SHELL=", 6) == 0) {
 	keepit = true;
-    } else if (matches_env_list(var, &def_env_keep, full_match)) {
+    } else if (matches_env_list(var, &def_env_keep, &env_keep_filter,
+	full_match)) {
 	keepit = true;
     }
     debug_return_bool(keepit);
@@ -896,6 +1063,7 @@ rebuild_env(void)
     didvar = 0;
     env.env_len = 0;
     env.env_size = 128;
+    env.index_valid = false;
     free(env.old_envp);
     env.old_envp = env.envp;
     env.envp = reallocarray(NULL, env.env_size, sizeof(char *));
@@ -1395,6 +1563,9 @@ init_envtables(void)
     const char **p;
     debug_decl(init_envtables, SUDOERS_DEBUG_ENV);
 
+    /* The lists are being reset, discard the compiled versions. */
+    env_filters_free();
+
     /* Fill in the "env_delete" list. */
     for (p = initial_badenv_table; *p; p++) {
 	cur = calloc(1, sizeof(struct list_member));
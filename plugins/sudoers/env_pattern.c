@@ -35,6 +35,35 @@
 
 #include "sudoers.h"
 
+/*
+ * An environment list (env_keep, env_check or env_delete) compiled
+ * for fast matching.  Most patterns are either a plain variable name,
+ * which is stored in a hash table, or a name prefix followed by a '*',
+ * which is stored in a trie.  The remaining patterns, those that match
+ * the value or have a '*' in the middle, are checked in list order with
+ * matches_env_pattern().  Patterns are numbered in list order so the
+ * first matching pattern determines the value of full_match, just as
+ * it would with a linear search.
+ */
+struct env_trie_node {
+    unsigned int child;		/* first child, 0 if none */
+    unsigned int sibling;	/* next sibling, 0 if none */
+    unsigned int match;		/* pattern number + 1, 0 if none */
+    unsigned char ch;
+};
+
+struct env_filter {
+    const char **patterns;	/* in list order, owned by the list */
+    unsigned int npatterns;
+    unsigned int nbuckets;	/* power of two */
+    unsigned int *name_offsets;	/* nbuckets + 1 offsets into names */
+    unsigned int *names;
+    struct env_trie_node *trie;	/* node 0 is the root */
+    unsigned int ntrie;
+    unsigned int *other;
+    unsigned int nother;
+};
+
 /* extern for regress tests */
 bool
 matches_env_pattern(const char *pattern, const char *var, bool *full_match)
@@ -97,3 +126,254 @@ matches_env_pattern(const char *pattern, const char *var, bool *full_match)
 	*full_match = len > sep_pos + 1;
     debug_return_bool(match);
 }
+
+/*
+ * Hash the first len bytes of a variable name.
+ */
+static unsigned int
+env_filter_hash(const char *name, size_t len, unsigned int nbuckets)
+{
+    unsigned int h = 5381;
+
+    while (len--)
+	h = (h * 33) ^ (unsigned char)*name++;
+    return h & (nbuckets - 1);
+}
+
+/*
+ * Classify an environment pattern.
+ * Returns 'n' for a plain name, 'p' for a name prefix followed
+ * by one or more '*' characters and 'o' for anything else.
+ * The length of the name or prefix is stored in lenp.
+ */
+static int
+env_filter_classify(const char *pattern, size_t *lenp)
+{
+    const char *cp;
+
+    for (cp = pattern; *cp != '\0' && *cp != '*'; cp++) {
+	if (*cp == '=')
+	    return 'o';
+    }
+    *lenp = (size_t)(cp - pattern);
+    if (*cp == '\0')
+	return 'n';
+    while (*cp == '*')
+	cp++;
+    return *cp == '\0' ? 'p' : 'o';
+}
+
+/*
+ * Add a prefix pattern to the trie, growing it as needed.
+ */
+static bool
+env_filter_add_prefix(struct env_filter *filter, unsigned int *trie_size,
+    const char *prefix, size_t len, unsigned int num)
+{
+    struct env_trie_node *node;
+    unsigned int cur = 0, next;
+    debug_decl(env_filter_add_prefix, SUDOERS_DEBUG_ENV);
+
+    while (len--) {
+	const unsigned char ch = (unsigned char)*prefix++;
+
+	for (next = filter->trie[cur].child; next != 0;
+		next = filter->trie[next].sibling) {
+	    if (filter->trie[next].ch == ch)
+		break;
+	}
+	if (next == 0) {
+	    if (filter->ntrie == *trie_size) {
+		node = reallocarray(filter->trie, *trie_size * 2,
+		    sizeof(*node));
+		if (node == NULL)
+		    debug_return_bool(false);
+		filter->trie = node;
+		*trie_size *= 2;
+	    }
+	    next = filter->ntrie++;
+	    node = &filter->trie[next];
+	    node->ch = ch;
+	    node->match = 0;
+	    node->child = 0;
+	    node->sibling = filter->trie[cur].child;
+	    filter->trie[cur].child = next;
+	}
+	cur = next;
+    }
+
+    /* Only the first of any duplicate patterns can match. */
+    if (filter->trie[cur].match == 0)
+	filter->trie[cur].match = num + 1;
+    debug_return_bool(true);
+}
+
+/*
+ * Free a compiled environment list.
+ */
+void
+env_filter_free(struct env_filter *filter)
+{
+    debug_decl(env_filter_free, SUDOERS_DEBUG_ENV);
+
+    if (filter != NULL) {
+	free(filter->patterns);
+	free(filter->name_offsets);
+	free(filter->names);
+	free(filter->trie);
+	free(filter->other);
+	free(filter);
+    }
+
+    debug_return;
+}
+
+/*
+ * Compile an environment list for use with env_filter_match().
+ * The filter refers to the list's patterns so it must be freed
+ * if the list is modified.
+ * Returns the filter on success or NULL on failure.
+ */
+struct env_filter *
+env_filter_compile(struct list_members *list)
+{
+    struct env_filter *filter;
+    struct list_member *cur;
+    unsigned int i, h, nnames = 0, trie_size = 64;
+    size_t len;
+    debug_decl(env_filter_compile, SUDOERS_DEBUG_ENV);
+
+    if ((filter = calloc(1, sizeof(*filter))) == NULL)
+	goto oom;
+
+    SLIST_FOREACH(cur, list, entries) {
+	if (filter->npatterns == UINT_MAX - 1)
+	    goto oom;
+	filter->npatterns++;
+    }
+    filter->patterns = reallocarray(NULL, filter->npatterns + 1,
+	sizeof(char *));
+    filter->other = reallocarray(NULL, filter->npatterns + 1,
+	sizeof(unsigned int));
+    filter->trie = reallocarray(NULL, trie_size, sizeof(*filter->trie));
+    if (filter->patterns == NULL || filter->other == NULL ||
+	    filter->trie == NULL)
+	goto oom;
+    filter->ntrie = 1;
+    memset(&filter->trie[0], 0, sizeof(filter->trie[0]));
+
+    /* Sort the patterns into the trie and other list, count the names. */
+    i = 0;
+    SLIST_FOREACH(cur, list, entries) {
+	filter->patterns[i] = cur->value;
+	switch (env_filter_classify(cur->value, &len)) {
+	case 'n':
+	    nnames++;
+	    break;
+	case 'p':
+	    if (!env_filter_add_prefix(filter, &trie_size, cur->value, len, i))
+		goto oom;
+	    break;
+	default:
+	    filter->other[filter->nother++] = i;
+	    break;
+	}
+	i++;
+    }
+
+    /* Hash the names, each bucket lists its patterns in order. */
+    filter->nbuckets = nnames ? sudo_pow2_roundup(nnames * 2) : 1;
+    filter->name_offsets = calloc(filter->nbuckets + 1, sizeof(unsigned int));
+    filter->names = reallocarray(NULL, nnames + 1, sizeof(unsigned int));
+    if (filter->name_offsets == NULL || filter->names == NULL)
+	goto oom;
+    for (i = 0; i < filter->npatterns; i++) {
+	if (env_filter_classify(filter->patterns[i], &len) == 'n') {
+	    h = env_filter_hash(filter->patterns[i], len, filter->nbuckets);
+	    filter->name_offsets[h + 1]++;
+	}
+    }
+    for (h = 0; h < filter->nbuckets; h++)
+	filter->name_offsets[h + 1] += filter->name_offsets[h];
+    for (i = 0; i < filter->npatterns; i++) {
+	if (env_filter_classify(filter->patterns[i], &len) == 'n') {
+	    h = env_filter_hash(filter->patterns[i], len, filter->nbuckets);
+	    filter->names[filter->name_offsets[h]++] = i;
+	}
+    }
+    /* Filling in the buckets advanced each offset to the next bucket. */
+    for (h = filter->nbuckets; h > 0; h--)
+	filter->name_offsets[h] = filter->name_offsets[h - 1];
+    filter->name_offsets[0] = 0;
+
+    sudo_debug_printf(SUDO_DEBUG_INFO|SUDO_DEBUG_LINENO,
+	"%u patterns: %u names, %u trie nodes, %u other", filter->npatterns,
+	nnames, filter->ntrie - 1, filter->nother);
+
+    debug_return_ptr(filter);
+oom:
+    sudo_debug_printf(SUDO_DEBUG_ERROR|SUDO_DEBUG_LINENO,
+	"unable to allocate memory");
+    env_filter_free(filter);
+    debug_return_ptr(NULL);
+}
+
+/*
+ * Check var (in name=value form) against a compiled environment list.
+ * Returns true if a pattern matched, else false.
+ * On match, full_match is set as by matches_env_pattern() for the
+ * first matching pattern in the list.
+ */
+bool
+env_filter_match(const struct env_filter *filter, const char *var,
+    bool *full_match)
+{
+    const size_t namelen = strcspn(var, "=");
+    const struct env_trie_node *node;
+    unsigned int i, h, num, best = UINT_MAX;
+    bool other_full_match = false;
+    const char *cp;
+    debug_decl(env_filter_match, SUDOERS_DEBUG_ENV);
+
+    /* Plain names, the first one to match has the lowest number. */
+    h = env_filter_hash(var, namelen, filter->nbuckets);
+    for (i = filter->name_offsets[h]; i < filter->name_offsets[h + 1]; i++) {
+	const char *pattern = filter->patterns[filter->names[i]];
+	if (strncmp(pattern, var, namelen) == 0 && pattern[namelen] == '\0') {
+	    best = filter->names[i];
+	    break;
+	}
+    }
+
+    /* Prefixes, every node along the path of the name is a match. */
+    node = &filter->trie[0];
+    for (cp = var; ; cp++) {
+	if (node->match != 0 && node->match - 1 < best)
+	    best = node->match - 1;
+	if (cp == var + namelen)
+	    break;
+	for (num = node->child; num != 0; num = filter->trie[num].sibling) {
+	    if (filter->trie[num].ch == (unsigned char)*cp)
+		break;
+	}
+	if (num == 0)
+	    break;
+	node = &filter->trie[num];
+    }
+
+    /* Other patterns only need to be checked if they come first. */
+    for (i = 0; i < filter->nother && filter->other[i] < best; i++) {
+	if (matches_env_pattern(filter->patterns[filter->other[i]], var,
+		&other_full_match)) {
+	    best = filter->other[i];
+	    break;
+	}
+    }
+
+    if (best == UINT_MAX)
+	debug_return_bool(false);
+
+    /* Names and prefixes never match the value. */
+    *full_match = other_full_match;
+    debug_return_bool(true);
+}
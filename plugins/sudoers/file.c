@@ -103,6 +103,8 @@ sudo_file_parse(struct sudo_nss *nss)
 {
     debug_decl(sudo_file_close, SUDOERS_DEBUG_NSS);
     struct sudo_file_handle *handle = nss->handle;
+    char *cache_path;
+    bool cached;
 
     if (handle == NULL || handle->fp == NULL) {
 	sudo_debug_printf(SUDO_DEBUG_ERROR, "%s: called with NULL %s",
@@ -110,6 +112,16 @@ sudo_file_parse(struct sudo_nss *nss)
 	debug_return_ptr(NULL);
     }
 
+    /* Use the policy precompiled by visudo if it is up to date. */
+    if (asprintf(&cache_path, "%s%s", sudoers_file, SUDOERS_CACHE_SUFFIX) == -1) {
+	sudo_warnx(U_("%s: %s"), __func__, U_("unable to allocate memory"));
+	debug_return_ptr(NULL);
+    }
+    cached = sudoers_cache_read(cache_path, &handle->parse_tree, true);
+    free(cache_path);
+    if (cached)
+	goto done;
+
     sudoersin = handle->fp;
     if (sudoersparse() != 0 || parse_error) {
 	if (errorlineno != -1) {
@@ -124,6 +136,10 @@ sudo_file_parse(struct sudo_nss *nss)
     /* Move parsed sudoers policy to nss handle. */
     reparent_parse_tree(&handle->parse_tree);
 
+done:
+    /* Index the userspecs by user and group; lookups work without it. */
+    handle->parse_tree.usidx = userspec_index_build(&handle->parse_tree);
+
     debug_return_ptr(&handle->parse_tree);
 }
 
@@ -1030,6 +1030,7 @@ init_parse_tree(struct sudoers_parse_tree *parse_tree, const char *lhost,
     parse_tree->aliases = NULL;
     parse_tree->shost = shost;
     parse_tree->lhost = lhost;
+    parse_tree->usidx = NULL;
 }
 
 /*
@@ -1054,6 +1055,8 @@ free_parse_tree(struct sudoers_parse_tree *parse_tree)
     free_defaults(&parse_tree->defaults);
     free_aliases(parse_tree->aliases);
     parse_tree->aliases = NULL;
+    userspec_index_free(parse_tree->usidx);
+    parse_tree->usidx = NULL;
 }
 
 /*
@@ -1107,7 +1110,7 @@ init_options(struct command_options *opts)
     opts->limitprivs = NULL;
 #endif
 }
-#line 1053 "gram.c"
+#line 1056 "gram.c"
 /* allocate initial stack or double stack size, up to YYMAXDEPTH */
 #if defined(__cplusplus) || defined(__STDC__)
 static int yygrowstack(void)
@@ -2238,7 +2241,7 @@ case 116:
 			    }
 			}
 break;
-#line 2184 "gram.c"
+#line 2187 "gram.c"
     }
     yyssp -= yym;
     yystate = *yyssp;
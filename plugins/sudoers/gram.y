@@ -1259,6 +1259,7 @@ init_parse_tree(struct sudoers_parse_tree *parse_tree, const char *lhost,
     parse_tree->aliases = NULL;
     parse_tree->shost = shost;
     parse_tree->lhost = lhost;
+    parse_tree->usidx = NULL;
 }
 
 /*
@@ -1283,6 +1284,8 @@ free_parse_tree(struct sudoers_parse_tree *parse_tree)
     free_defaults(&parse_tree->defaults);
     free_aliases(parse_tree->aliases);
     parse_tree->aliases = NULL;
+    userspec_index_free(parse_tree->usidx);
+    parse_tree->usidx = NULL;
 }
 
 /*
@@ -268,6 +268,10 @@ iolog_deserialize_info(struct iolog_details *details, char * const user_info[],
 		    details->ignore_iolog_errors = true;
 		continue;
 	    }
+	    if (strncmp(*cur, "iolog_dir=", sizeof("iolog_dir=") - 1) == 0) {
+		details->iolog_dir = *cur + sizeof("iolog_dir=") - 1;
+		continue;
+	    }
 	    if (strncmp(*cur, "iolog_path=", sizeof("iolog_path=") - 1) == 0) {
 		details->iolog_path = *cur + sizeof("iolog_path=") - 1;
 		continue;
@@ -366,6 +370,19 @@ iolog_deserialize_info(struct iolog_details *details, char * const user_info[],
 		    TIME_T_MAX, NULL);
 		continue;
 	    }
+	    if (strncmp(*cur, "log_server_coalesce=", sizeof("log_server_coalesce=") - 1) == 0) {
+		unsigned int msec = sudo_strtonum(*cur +
+		    sizeof("log_server_coalesce=") - 1, 0, 60000, NULL);
+		details->coalesce_time.tv_sec = msec / 1000;
+		details->coalesce_time.tv_nsec = (msec % 1000) * 1000000;
+		continue;
+	    }
+	    if (strncmp(*cur, "log_server_compress=", sizeof("log_server_compress=") - 1) == 0) {
+		int val = sudo_strtobool(*cur + sizeof("log_server_compress=") - 1);
+		if (val != -1)
+		    details->compress_iobufs = val;
+		continue;
+	    }
         if (strncmp(*cur, "log_server_keepalive=", sizeof("log_server_keepalive=") - 1) == 0) {
             int val = sudo_strtobool(*cur + sizeof("log_server_keepalive=") - 1);
             if (val != -1) {
@@ -469,9 +486,12 @@ oom:
 /*
  * Write the "log" file that contains the user and command info.
  * This file is not compressed.
+ * If index_dir is not NULL, the session is also added to the index
+ * stored there; session is the I/O log path relative to index_dir.
  */
 static bool
-write_info_log(int dfd, char *iolog_dir, struct iolog_details *details)
+write_info_log(int dfd, char *iolog_dir, struct iolog_details *details,
+    const char *index_dir, const char *session)
 {
     struct iolog_info iolog_info;
     debug_decl(write_info_log, SUDOERS_DEBUG_UTIL);
@@ -494,6 +514,14 @@ write_info_log(int dfd, char *iolog_dir, struct iolog_details *details)
 	warned = true;
 	debug_return_bool(false);
     }
+    if (index_dir != NULL) {
+	if (!iolog_index_append(index_dir, session, details->host,
+		&iolog_info, details->argv)) {
+	    sudo_debug_printf(SUDO_DEBUG_WARN|SUDO_DEBUG_ERRNO,
+		"unable to add %s to the session index in %s",
+		session, index_dir);
+	}
+    }
     debug_return_bool(true);
 }
 
@@ -525,6 +553,7 @@ static int
 sudoers_io_open_local(void)
 {
     char iolog_path[PATH_MAX], sessid[7];
+    const char *index_dir = NULL, *session = NULL;
     size_t len;
     int iolog_dir_fd = -1;
     int i, ret = -1;
@@ -572,8 +601,22 @@ sudoers_io_open_local(void)
 	goto done;
     }
 
+    /* The session index lives at the top of the I/O log dir. */
+    if (iolog_details.iolog_path == NULL) {
+	index_dir = _PATH_SUDO_IO_LOGDIR;
+	session = iolog_path + sizeof(_PATH_SUDO_IO_LOGDIR);
+    } else if (iolog_details.iolog_dir != NULL) {
+	len = strlen(iolog_details.iolog_dir);
+	if (strncmp(iolog_path, iolog_details.iolog_dir, len) == 0 &&
+		iolog_path[len] == '/') {
+	    index_dir = iolog_details.iolog_dir;
+	    session = iolog_path + len + 1;
+	}
+    }
+
     /* Write log file with user and command details. */
-    if (!write_info_log(iolog_dir_fd, iolog_path, &iolog_details))
+    if (!write_info_log(iolog_dir_fd, iolog_path, &iolog_details,
+	    index_dir, session))
 	goto done;
 
     /* Create the timing and I/O log files. */
@@ -863,10 +906,14 @@ sudoers_io_log_remote(int event, const char *buf, unsigned int len,
 	goto done;
     }
     if (fmt_io_buf(&client_closure, type, buf, len, delay)) {
-	ret = client_closure.write_ev->add(client_closure.write_ev,
-	    &iolog_details.server_timeout);
-	if (ret == -1)
-	    sudo_warn(U_("unable to add event to queue"));
+	/* Coalesced data is not queued until it is flushed. */
+	ret = 1;
+	if (!TAILQ_EMPTY(&client_closure.write_bufs)) {
+	    ret = client_closure.write_ev->add(client_closure.write_ev,
+		&iolog_details.server_timeout);
+	    if (ret == -1)
+		sudo_warn(U_("unable to add event to queue"));
+	}
     }
 
 done:
@@ -874,34 +921,39 @@ done:
 }
 
 /*
- * Generic I/O logging function.  Called by the I/O logging entry points.
+ * Log a chunk of I/O that was read at the specified time.
  * Returns 1 on success and -1 on error.
  */
 static int
-sudoers_io_log(const char *buf, unsigned int len, int event, const char **errstr)
+sudoers_io_log_chunk(int event, const char *buf, unsigned int len,
+    const struct timespec *now, const char **ioerror)
 {
-    struct timespec now, delay;
-    const char *ioerror = NULL;
-    int ret = -1;
-    debug_decl(sudoers_io_log, SUDOERS_DEBUG_PLUGIN);
+    struct timespec delay;
+    int ret;
+    debug_decl(sudoers_io_log_chunk, SUDOERS_DEBUG_PLUGIN);
 
-    if (sudo_gettime_awake(&now) == -1) {
-	sudo_debug_printf(SUDO_DEBUG_ERROR|SUDO_DEBUG_ERRNO,
-	    "%s: unable to get time of day", __func__);
-	ioerror = N_("unable to read the clock");
-	goto bad;
-    }
-    sudo_timespecsub(&now, &last_time, &delay);
+    sudo_timespecsub(now, &last_time, &delay);
 
     if (iolog_remote)
-	ret = sudoers_io_log_remote(event, buf, len, &delay, &ioerror);
+	ret = sudoers_io_log_remote(event, buf, len, &delay, ioerror);
     else
-	ret = sudoers_io_log_local(event, buf, len, &delay, &ioerror);
+	ret = sudoers_io_log_local(event, buf, len, &delay, ioerror);
 
-    last_time.tv_sec = now.tv_sec;
-    last_time.tv_nsec = now.tv_nsec;
+    last_time.tv_sec = now->tv_sec;
+    last_time.tv_nsec = now->tv_nsec;
+
+    debug_return_int(ret);
+}
+
+/*
+ * Handle the result of logging I/O, warning about errors.
+ * Returns 1 on success or if errors are ignored, else -1.
+ */
+static int
+sudoers_io_log_result(int ret, const char *ioerror, const char **errstr)
+{
+    debug_decl(sudoers_io_log_result, SUDOERS_DEBUG_PLUGIN);
 
-bad:
     if (ret == -1) {
 	if (ioerror != NULL) {
 	    char *cp;
@@ -926,6 +978,58 @@ bad:
     debug_return_int(ret);
 }
 
+/*
+ * Generic I/O logging function.  Called by the I/O logging entry points.
+ * Returns 1 on success and -1 on error.
+ */
+static int
+sudoers_io_log(const char *buf, unsigned int len, int event, const char **errstr)
+{
+    struct timespec now;
+    const char *ioerror = NULL;
+    int ret = -1;
+    debug_decl(sudoers_io_log, SUDOERS_DEBUG_PLUGIN);
+
+    if (sudo_gettime_awake(&now) == -1) {
+	sudo_debug_printf(SUDO_DEBUG_ERROR|SUDO_DEBUG_ERRNO,
+	    "%s: unable to get time of day", __func__);
+	ioerror = N_("unable to read the clock");
+    } else {
+	ret = sudoers_io_log_chunk(event, buf, len, &now, &ioerror);
+    }
+
+    debug_return_int(sudoers_io_log_result(ret, ioerror, errstr));
+}
+
+#if SUDO_IO_EVENT_STDIN != IO_EVENT_STDIN || SUDO_IO_EVENT_STDOUT != IO_EVENT_STDOUT || \
+    SUDO_IO_EVENT_STDERR != IO_EVENT_STDERR || SUDO_IO_EVENT_TTYIN != IO_EVENT_TTYIN || \
+    SUDO_IO_EVENT_TTYOUT != IO_EVENT_TTYOUT
+# error "SUDO_IO_EVENT_* must match IO_EVENT_*"
+#endif
+
+/*
+ * Log a batch of I/O records, using the time stamps from the front end.
+ * Returns 1 on success and -1 on error.
+ */
+static int
+sudoers_io_log_io(const struct sudo_io_record records[], unsigned int count,
+    const char **errstr)
+{
+    const char *ioerror = NULL;
+    unsigned int i;
+    int ret = 1;
+    debug_decl(sudoers_io_log_io, SUDOERS_DEBUG_PLUGIN);
+
+    for (i = 0; i < count; i++) {
+	ret = sudoers_io_log_chunk(records[i].event, records[i].buf,
+	    records[i].len, records[i].when, &ioerror);
+	if (ret == -1)
+	    break;
+    }
+
+    debug_return_int(sudoers_io_log_result(ret, ioerror, errstr));
+}
+
 static int
 sudoers_io_log_stdin(const char *buf, unsigned int len, const char **errstr)
 {
@@ -1177,5 +1281,6 @@ __dso_public struct io_plugin sudoers_io = {
     NULL, /* deregister_hooks */
     sudoers_io_change_winsize,
     sudoers_io_suspend,
-    NULL /* event_alloc() filled in by sudo */
+    NULL, /* event_alloc() filled in by sudo */
+    sudoers_io_log_io
 };
@@ -66,6 +66,7 @@
 /* Server callback may redirect to client callback for TLS. */
 static void client_msg_cb(int fd, int what, void *v);
 static void server_msg_cb(int fd, int what, void *v);
+static void iobuf_flush_cb(int fd, int what, void *v);
 
 static void
 connect_cb(int sock, int what, void *v)
@@ -536,8 +537,13 @@ client_closure_free(struct client_closure *closure)
 	closure->write_ev->free(closure->write_ev);
 	closure->write_ev = NULL;
     }
+    if (closure->iobuf_ev != NULL) {
+	closure->iobuf_ev->free(closure->iobuf_ev);
+	closure->iobuf_ev = NULL;
+    }
     free(closure->read_buf.data);
     memset(&closure->read_buf, 0, sizeof(closure->read_buf));
+    iobuf_coalesce_free(&closure->iobuf);
     memset(&closure->start_time, 0, sizeof(closure->start_time));
     memset(&closure->elapsed, 0, sizeof(closure->elapsed));
     memset(&closure->committed, 0, sizeof(closure->committed));
@@ -660,6 +666,9 @@ fmt_accept_message(struct client_closure *closure)
 
     /* Client will send IoBuffer messages. */
     accept_msg.expect_iobufs = true;
+#ifdef HAVE_ZLIB_H
+    accept_msg.compress_iobufs = closure->iobuf.zstream != NULL;
+#endif
 
     /* Convert NULL-terminated vectors to StringList. */
     runargv.strings = (char **)details->argv;
@@ -838,6 +847,10 @@ fmt_exit_message(struct client_closure *closure, int exit_status, int error)
     struct timespec run_time;
     debug_decl(fmt_exit_message, SUDOERS_DEBUG_UTIL);
 
+    /* Send any coalesced I/O log data first. */
+    if (!client_flush_iobuf(closure))
+	goto done;
+
     if (sudo_gettime_awake(&run_time) == -1) {
 	sudo_warn("%s", U_("unable to get time of day"));
 	goto done;
@@ -893,18 +906,21 @@ done:
 
 /*
  * Build and format an IoBuffer wrapped in a ClientMessage.
+ * Called by iobuf_coalesce_write() and iobuf_coalesce_flush() with
+ * data that has already been compressed if the server agreed to it.
  * Appends the wire format message to the closure's write queue.
  * Returns true on success, false on failure.
  */
-bool
-fmt_io_buf(struct client_closure *closure, int type, const char *buf,
-    unsigned int len, struct timespec *delay)
+static bool
+fmt_iobuf_message(int type, const uint8_t *buf, size_t len,
+    struct timespec *delay, void *v)
 {
+    struct client_closure *closure = v;
     ClientMessage client_msg = CLIENT_MESSAGE__INIT;
     IoBuffer iobuf_msg = IO_BUFFER__INIT;
     TimeSpec ts = TIME_SPEC__INIT;
     bool ret = false;
-    debug_decl(fmt_io_buf, SUDOERS_DEBUG_UTIL);
+    debug_decl(fmt_iobuf_message, SUDOERS_DEBUG_UTIL);
 
     /* Fill in IoBuffer. */
     ts.tv_sec = delay->tv_sec;
@@ -929,6 +945,53 @@ done:
     debug_return_bool(ret);
 }
 
+/*
+ * Format the coalesced I/O log data, if any, as an IoBuffer.
+ * Appends the wire format message to the closure's write queue.
+ * Returns true on success, false on failure.
+ */
+bool
+client_flush_iobuf(struct client_closure *closure)
+{
+    debug_decl(client_flush_iobuf, SUDOERS_DEBUG_UTIL);
+
+    if (closure->iobuf.len == 0)
+	debug_return_bool(true);
+
+    if (closure->iobuf_ev != NULL)
+	closure->iobuf_ev->del(closure->iobuf_ev);
+    debug_return_bool(iobuf_coalesce_flush(&closure->iobuf));
+}
+
+/*
+ * Queue I/O log data to be sent to the server.
+ * If a coalesce time is set, the data is held for up to that long so
+ * consecutive buffers for the same stream can be sent as one IoBuffer.
+ * Returns true on success, false on failure.
+ */
+bool
+fmt_io_buf(struct client_closure *closure, int type, const char *buf,
+    unsigned int len, struct timespec *delay)
+{
+    debug_decl(fmt_io_buf, SUDOERS_DEBUG_UTIL);
+
+    switch (iobuf_coalesce_write(&closure->iobuf, type, (const uint8_t *)buf,
+	    len, delay)) {
+    case -1:
+	debug_return_bool(false);
+    case 1:
+	/* The data is sent when the timer fires if not flushed before. */
+	if (closure->iobuf_ev->add(closure->iobuf_ev,
+		&closure->log_details->coalesce_time) == -1) {
+	    sudo_warn(U_("unable to add event to queue"));
+	    debug_return_bool(false);
+	}
+	break;
+    }
+
+    debug_return_bool(true);
+}
+
 /*
  * Build and format a ChangeWindowSize message wrapped in a ClientMessage.
  * Appends the wire format message to the closure's write queue.
@@ -944,6 +1007,10 @@ fmt_winsize(struct client_closure *closure, unsigned int lines,
     bool ret = false;
     debug_decl(fmt_winsize, SUDOERS_DEBUG_UTIL);
 
+    /* Send any coalesced I/O log data first. */
+    if (!client_flush_iobuf(closure))
+	goto done;
+
     /* Fill in ChangeWindowSize message. */
     ts.tv_sec = delay->tv_sec;
     ts.tv_nsec = delay->tv_nsec;
@@ -980,6 +1047,10 @@ fmt_suspend(struct client_closure *closure, const char *signame, struct timespec
     bool ret = false;
     debug_decl(fmt_suspend, SUDOERS_DEBUG_UTIL);
 
+    /* Send any coalesced I/O log data first. */
+    if (!client_flush_iobuf(closure))
+	goto done;
+
     /* Fill in CommandSuspend message. */
     ts.tv_sec = delay->tv_sec;
     ts.tv_nsec = delay->tv_nsec;
@@ -1110,6 +1181,16 @@ handle_server_hello(ServerHello *msg, struct client_closure *closure)
     }
 #endif /* HAVE_OPENSSL */
 
+#ifdef HAVE_ZLIB_H
+    /* Compress I/O log data if enabled and the server supports it. */
+    if (msg->compression && closure->log_details->compress_iobufs) {
+	if (!iobuf_coalesce_compress(&closure->iobuf))
+	    debug_return_bool(false);
+	sudo_debug_printf(SUDO_DEBUG_INFO, "%s: compressing I/O log data",
+	    __func__);
+    }
+#endif /* HAVE_ZLIB_H */
+
     sudo_debug_printf(SUDO_DEBUG_INFO, "%s: server ID: %s",
 	__func__, msg->server_id);
     /* TODO: handle redirect */
@@ -1531,6 +1612,42 @@ bad:
     debug_return;
 }
 
+/*
+ * Send coalesced I/O log data when the coalesce time has elapsed
+ * (timer callback).
+ */
+static void
+iobuf_flush_cb(int unused, int what, void *v)
+{
+    struct client_closure *closure = v;
+    debug_decl(iobuf_flush_cb, SUDOERS_DEBUG_UTIL);
+
+    if (closure->disabled)
+	debug_return;
+
+    if (!client_flush_iobuf(closure))
+	goto bad;
+    if (!TAILQ_EMPTY(&closure->write_bufs)) {
+	if (closure->write_ev->add(closure->write_ev,
+		&closure->log_details->server_timeout) == -1) {
+	    sudo_warn(U_("unable to add event to queue"));
+	    goto bad;
+	}
+    }
+    debug_return;
+
+bad:
+    if (closure->log_details->ignore_iolog_errors) {
+	/* Disable plugin, the command continues. */
+	closure->disabled = true;
+	closure->write_ev->del(closure->write_ev);
+    } else {
+	/* Break out of sudo event loop and kill the command. */
+	closure->iobuf_ev->loopbreak(closure->iobuf_ev);
+    }
+    debug_return;
+}
+
 /*
  * Allocate and initialize a new client closure
  */
@@ -1566,6 +1683,9 @@ client_closure_fill(struct client_closure *closure, int sock,
     if ((closure->write_ev = sudoers_io->event_alloc()) == NULL)
 	goto oom;
 
+    if ((closure->iobuf_ev = sudoers_io->event_alloc()) == NULL)
+	goto oom;
+
     if (closure->read_ev->set(closure->read_ev, sock,
 	    SUDO_PLUGIN_EV_READ|SUDO_PLUGIN_EV_PERSIST,
 	    server_msg_cb, closure) == -1)
@@ -1576,7 +1696,13 @@ client_closure_fill(struct client_closure *closure, int sock,
 	    client_msg_cb, closure) == -1)
 	goto oom;
 
+    if (closure->iobuf_ev->set(closure->iobuf_ev, -1,
+	    SUDO_PLUGIN_EV_TIMEOUT, iobuf_flush_cb, closure) == -1)
+	goto oom;
+
     closure->log_details = details;
+    iobuf_coalesce_init(&closure->iobuf,
+	sudo_timespecisset(&details->coalesce_time), fmt_iobuf_message, closure);
 
     /* Save the name and IP of the server we are successfully connected to. */
     closure->server_name = host;
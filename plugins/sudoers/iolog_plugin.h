@@ -22,6 +22,7 @@
 #endif /* HAVE_OPENSSL */
 
 #include "log_server.pb-c.h"
+#include "iobuf_coalesce.h"
 #include "strlist.h"
 
 #if PROTOBUF_C_VERSION_NUMBER < 1003000
@@ -55,13 +56,16 @@ struct iolog_details {
     const char *user;
     const char *command;
     const char *iolog_path;
+    const char *iolog_dir;
     struct passwd *runas_pw;
     struct group *runas_gr;
     char * const *argv;
     char **user_env;
     struct sudoers_str_list *log_servers;
     struct timespec server_timeout;
+    struct timespec coalesce_time;
     bool tcp_keepalive;
+    bool compress_iobufs;
 #if defined(HAVE_OPENSSL)
     char *ca_bundle;
     char *cert_file;
@@ -113,6 +117,8 @@ struct client_closure {
     struct timespec elapsed;
     struct timespec committed;
     char *iolog_id;
+    struct iobuf_coalesce iobuf;
+    struct sudo_plugin_event *iobuf_ev;
 };
 
 #if defined(HAVE_OPENSSL)
@@ -149,6 +155,7 @@ struct client_closure {
 #endif /* HAVE_OPENSSL */
 
 /* iolog_client.c */
+bool client_flush_iobuf(struct client_closure *closure);
 bool client_closure_fill(struct client_closure *closure, int sock, const struct sudoers_string *host, struct iolog_details *details, struct io_plugin *sudoers_io);
 bool client_close(struct client_closure *closure, int exit_status, int error);
 bool fmt_accept_message(struct client_closure *closure);
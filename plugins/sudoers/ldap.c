@@ -84,16 +84,6 @@
 #define ldap_unbind_ext_s(a, b, c)	ldap_unbind_s(a)
 #endif
 
-#ifndef HAVE_LDAP_SEARCH_EXT_S
-# ifdef HAVE_LDAP_SEARCH_ST
-#  define ldap_search_ext_s(a, b, c, d, e, f, g, h, i, j, k)		\
-	ldap_search_st(a, b, c, d, e, f, i, k)
-# else
-#  define ldap_search_ext_s(a, b, c, d, e, f, g, h, i, j, k)		\
-	ldap_search_s(a, b, c, d, e, f, k)
-# endif
-#endif
-
 #define LDAP_FOREACH(var, ld, res)					\
     for ((var) = ldap_first_entry((ld), (res));				\
 	(var) != NULL;							\
@@ -740,11 +730,14 @@ sudo_netgroup_lookup(LDAP *ld, struct passwd *pw,
 {
     struct ldap_config_str *base;
     struct ldap_netgroup *ng, *old_tail;
+    struct ldap_pending_search *pending = NULL;
     struct timeval tv, *tvp = NULL;
+    struct timespec deadline;
     LDAPMessage *entry, *result = NULL;
     const char *domain;
     char *escaped_domain = NULL, *escaped_user = NULL;
     char *escaped_host = NULL, *escaped_shost = NULL, *filt = NULL;
+    size_t i, nbases = 0;
     int filt_len, rc;
     bool ret = false;
     debug_decl(sudo_netgroup_lookup, SUDOERS_DEBUG_LDAP);
@@ -829,14 +822,24 @@ sudo_netgroup_lookup(LDAP *ld, struct passwd *pw,
 	goto oom;
     DPRINTF1("ldap netgroup search filter: '%s'", filt);
 
+    /* Search all the netgroup bases concurrently. */
+    STAILQ_FOREACH(base, &ldap_conf.netgroup_base, entries)
+	nbases++;
+    pending = reallocarray(NULL, nbases, sizeof(*pending));
+    if (pending == NULL)
+	goto oom;
+    sudo_ldap_search_deadline(&deadline);
+    i = 0;
     STAILQ_FOREACH(base, &ldap_conf.netgroup_base, entries) {
 	DPRINTF1("searching from netgroup_base '%s'", base->val);
-	rc = ldap_search_ext_s(ld, base->val, LDAP_SCOPE_SUBTREE, filt,
-	    NULL, 0, NULL, NULL, tvp, 0, &result);
+	sudo_ldap_search_start(ld, base->val, filt, &pending[i++]);
+    }
+
+    i = 0;
+    STAILQ_FOREACH(base, &ldap_conf.netgroup_base, entries) {
+	rc = sudo_ldap_search_finish(ld, &pending[i++], &deadline, &result);
 	if (rc != LDAP_SUCCESS) {
 	    DPRINTF1("ldap netgroup search failed: %s", ldap_err2string(rc));
-	    ldap_msgfree(result);
-	    result = NULL;
 	    continue;
 	}
 
@@ -893,6 +896,11 @@ done:
 	free(escaped_shost);
     free(filt);
     ldap_msgfree(result);
+    if (pending != NULL) {
+	for (i = 0; i < nbases; i++)
+	    sudo_ldap_search_abandon(ld, &pending[i]);
+	free(pending);
+    }
     debug_return_bool(ret);
 }
 
@@ -1682,10 +1690,12 @@ static int
 sudo_ldap_getdefs(struct sudo_nss *nss)
 {
     struct sudo_ldap_handle *handle = nss->handle;
-    struct timeval tv, *tvp = NULL;
+    struct ldap_pending_search *pending = NULL;
     struct ldap_config_str *base;
+    struct timespec deadline;
     LDAPMessage *entry, *result = NULL;
     char *filt = NULL;
+    size_t i, nbases = 0;
     int rc, ret = -1;
     static bool cached;
     debug_decl(sudo_ldap_getdefs, SUDOERS_DEBUG_LDAP);
@@ -1707,18 +1717,27 @@ sudo_ldap_getdefs(struct sudo_nss *nss)
     }
     DPRINTF1("Looking for cn=defaults: %s", filt);
 
+    /* Search all the bases concurrently. */
+    STAILQ_FOREACH(base, &ldap_conf.base, entries)
+	nbases++;
+    if (nbases != 0) {
+	pending = reallocarray(NULL, nbases, sizeof(*pending));
+	if (pending == NULL) {
+	    sudo_warnx(U_("%s: %s"), __func__, U_("unable to allocate memory"));
+	    goto done;
+	}
+    }
+    sudo_ldap_search_deadline(&deadline);
+    i = 0;
+    STAILQ_FOREACH(base, &ldap_conf.base, entries)
+	sudo_ldap_search_start(handle->ld, base->val, filt, &pending[i++]);
+
+    i = 0;
     STAILQ_FOREACH(base, &ldap_conf.base, entries) {
 	LDAP *ld = handle->ld;
 
-	if (ldap_conf.timeout > 0) {
-	    tv.tv_sec = ldap_conf.timeout;
-	    tv.tv_usec = 0;
-	    tvp = &tv;
-	}
 	ldap_msgfree(result);
-	result = NULL;
-	rc = ldap_search_ext_s(ld, base->val, LDAP_SCOPE_SUBTREE,
-	    filt, NULL, 0, NULL, NULL, tvp, 0, &result);
+	rc = sudo_ldap_search_finish(ld, &pending[i++], &deadline, &result);
 	if (rc == LDAP_SUCCESS && (entry = ldap_first_entry(ld, result))) {
 	    DPRINTF1("found:%s", ldap_get_dn(ld, entry));
 	    if (!sudo_ldap_parse_options(ld, entry, &handle->parse_tree.defaults))
@@ -1732,6 +1751,11 @@ sudo_ldap_getdefs(struct sudo_nss *nss)
 
 done:
     ldap_msgfree(result);
+    if (pending != NULL) {
+	for (i = 0; i < nbases; i++)
+	    sudo_ldap_search_abandon(handle->ld, &pending[i]);
+	free(pending);
+    }
     free(filt);
 
     debug_return_int(ret);
@@ -1829,12 +1853,14 @@ static struct ldap_result *
 sudo_ldap_result_get(struct sudo_nss *nss, struct passwd *pw)
 {
     struct sudo_ldap_handle *handle = nss->handle;
+    struct ldap_pending_search *pending = NULL;
     struct ldap_config_str *base;
     struct ldap_result *lres;
-    struct timeval tv, *tvp = NULL;
+    struct timespec deadline;
     LDAPMessage *entry, *result;
     LDAP *ld = handle->ld;
-    char *filt = NULL;
+    char *filts[2] = { NULL, NULL };
+    size_t i, nbases = 0;
     int pass, rc;
     debug_decl(sudo_ldap_result_get, SUDOERS_DEBUG_LDAP);
 
@@ -1855,59 +1881,88 @@ sudo_ldap_result_get(struct sudo_nss *nss, struct passwd *pw)
      * Since we have to sort the possible entries before we make a
      * decision, we perform the queries and store all of the results in
      * an ldap_result object.  The results are then sorted by sudoOrder.
+     *
+     * The searches for both passes are sent to all the search bases
+     * before any results are read so the server can process them
+     * concurrently.  The second pass does not depend on the first so
+     * it is sent first, before any netgroup lookups for the first pass.
+     * The results are then read in the same order as before, subject
+     * to a single timeout for all of them.
      */
     lres = sudo_ldap_result_alloc();
     if (lres == NULL)
 	goto oom;
+    STAILQ_FOREACH(base, &ldap_conf.base, entries)
+	nbases++;
+    if (nbases == 0)
+	debug_return_ptr(lres);
+    pending = reallocarray(NULL, nbases, 2 * sizeof(*pending));
+    if (pending == NULL)
+	goto oom;
+    for (i = 0; i < 2 * nbases; i++) {
+	pending[i].msgid = -1;
+	pending[i].result = NULL;
+    }
+    sudo_ldap_search_deadline(&deadline);
+    for (pass = 1; pass >= 0; pass--) {
+	filts[pass] = pass ? sudo_ldap_build_pass2() :
+	    sudo_ldap_build_pass1(ld, pw);
+	if (filts[pass] == NULL) {
+	    if (errno != ENOENT) {
+		/* Out of memory? */
+		goto oom;
+	    }
+	    continue;
+	}
+	DPRINTF1("ldap search '%s'", filts[pass]);
+	i = pass * nbases;
+	STAILQ_FOREACH(base, &ldap_conf.base, entries) {
+	    DPRINTF1("searching from base '%s'",
+		base->val);
+	    sudo_ldap_search_start(ld, base->val, filts[pass], &pending[i++]);
+	}
+    }
+
     for (pass = 0; pass < 2; pass++) {
-	filt = pass ? sudo_ldap_build_pass2() : sudo_ldap_build_pass1(ld, pw);
-	if (filt != NULL) {
-	    DPRINTF1("ldap search '%s'", filt);
-	    STAILQ_FOREACH(base, &ldap_conf.base, entries) {
-		DPRINTF1("searching from base '%s'",
-		    base->val);
-		if (ldap_conf.timeout > 0) {
-		    tv.tv_sec = ldap_conf.timeout;
-		    tv.tv_usec = 0;
-		    tvp = &tv;
-		}
-		result = NULL;
-		rc = ldap_search_ext_s(ld, base->val, LDAP_SCOPE_SUBTREE, filt,
-		    NULL, 0, NULL, NULL, tvp, 0, &result);
-		if (rc != LDAP_SUCCESS) {
-		    DPRINTF1("ldap search pass %d failed: %s", pass + 1,
-			ldap_err2string(rc));
-		    continue;
-		}
+	if (filts[pass] == NULL)
+	    continue;
+	i = pass * nbases;
+	STAILQ_FOREACH(base, &ldap_conf.base, entries) {
+	    rc = sudo_ldap_search_finish(ld, &pending[i++], &deadline,
+		&result);
+	    if (rc != LDAP_SUCCESS) {
+		DPRINTF1("ldap search pass %d failed: %s", pass + 1,
+		    ldap_err2string(rc));
+		continue;
+	    }
 
-		/* Add the search result to list of search results. */
-		DPRINTF1("adding search result");
-		if (sudo_ldap_result_add_search(lres, ld, result) == NULL)
-		    goto oom;
-		LDAP_FOREACH(entry, ld, result) {
-		    if (pass != 0) {
-			/* Check non-unix group in 2nd pass. */
-			switch (sudo_ldap_check_non_unix_group(ld, entry, pw)) {
-			case -1:
-			    goto oom;
-			case false:
-			    continue;
-			default:
-			    break;
-			}
-		    }
-		    if (sudo_ldap_result_add_entry(lres, entry) == NULL)
+	    /* Add the search result to list of search results. */
+	    DPRINTF1("adding search result");
+	    if (sudo_ldap_result_add_search(lres, ld, result) == NULL) {
+		ldap_msgfree(result);
+		goto oom;
+	    }
+	    LDAP_FOREACH(entry, ld, result) {
+		if (pass != 0) {
+		    /* Check non-unix group in 2nd pass. */
+		    switch (sudo_ldap_check_non_unix_group(ld, entry, pw)) {
+		    case -1:
 			goto oom;
+		    case false:
+			continue;
+		    default:
+			break;
+		    }
 		}
-		DPRINTF1("result now has %d entries", lres->nentries);
+		if (sudo_ldap_result_add_entry(lres, entry) == NULL)
+		    goto oom;
 	    }
-	    free(filt);
-	    filt = NULL;
-	} else if (errno != ENOENT) {
-	    /* Out of memory? */
-	    goto oom;
+	    DPRINTF1("result now has %d entries", lres->nentries);
 	}
     }
+    free(filts[0]);
+    free(filts[1]);
+    free(pending);
 
     /* Sort the entries by the sudoOrder attribute. */
     if (lres->nentries != 0) {
@@ -1919,7 +1974,13 @@ sudo_ldap_result_get(struct sudo_nss *nss, struct passwd *pw)
     debug_return_ptr(lres);
 oom:
     sudo_warnx(U_("%s: %s"), __func__, U_("unable to allocate memory"));
-    free(filt);
+    if (pending != NULL) {
+	for (i = 0; i < 2 * nbases; i++)
+	    sudo_ldap_search_abandon(ld, &pending[i]);
+	free(pending);
+    }
+    free(filts[0]);
+    free(filts[1]);
     sudo_ldap_result_free(lres);
     debug_return_ptr(NULL);
 }
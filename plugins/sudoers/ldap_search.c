@@ -0,0 +1,190 @@
+/*
+ * SPDX-License-Identifier: ISC
+ *
+ * Copyright (c) 2020 Todd C. Miller <Todd.Miller@sudo.ws>
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/*
+ * This is an open source non-commercial project. Dear PVS-Studio, please check it.
+ * PVS-Studio Static Code Analyzer for C, C++ and C#: http://www.viva64.com
+ */
+
+#include <config.h>
+
+#include <sys/types.h>
+#include <sys/time.h>
+#include <stdio.h>
+#include <stdlib.h>
+#ifdef HAVE_STRING_H
+# include <string.h>
+#endif /* HAVE_STRING_H */
+#ifdef HAVE_STRINGS_H
+# include <strings.h>
+#endif /* HAVE_STRINGS_H */
+#include <time.h>
+#ifdef HAVE_LBER_H
+# include <lber.h>
+#endif
+#include <ldap.h>
+
+#include "sudoers.h"
+#include "sudo_ldap.h"
+#include "sudo_ldap_conf.h"
+
+#ifndef LDAP_OPT_RESULT_CODE
+# define LDAP_OPT_RESULT_CODE LDAP_OPT_ERROR_NUMBER
+#endif
+
+/*
+ * Compute the deadline for a set of concurrent searches based on
+ * the configured timeout.  If there is no timeout, the deadline is
+ * cleared and searches will wait for as long as it takes.
+ */
+void
+sudo_ldap_search_deadline(struct timespec *deadline)
+{
+    debug_decl(sudo_ldap_search_deadline, SUDOERS_DEBUG_LDAP);
+
+    sudo_timespecclear(deadline);
+    if (ldap_conf.timeout > 0) {
+	if (sudo_gettime_mono(deadline) == -1) {
+	    sudo_debug_printf(SUDO_DEBUG_ERROR|SUDO_DEBUG_ERRNO,
+		"unable to read the clock");
+	    sudo_timespecclear(deadline);
+	} else {
+	    deadline->tv_sec += ldap_conf.timeout;
+	}
+    }
+
+    debug_return;
+}
+
+/*
+ * Send a subtree search to the LDAP server without waiting for the result.
+ * The result is read by sudo_ldap_search_finish().
+ */
+void
+sudo_ldap_search_start(LDAP *ld, const char *base, const char *filt,
+    struct ldap_pending_search *ps)
+{
+    struct timeval tv, *tvp = NULL;
+    debug_decl(sudo_ldap_search_start, SUDOERS_DEBUG_LDAP);
+
+    if (ldap_conf.timeout > 0) {
+	tv.tv_sec = ldap_conf.timeout;
+	tv.tv_usec = 0;
+	tvp = &tv;
+    }
+    ps->result = NULL;
+#ifdef HAVE_LDAP_SEARCH_EXT_S
+    ps->rc = ldap_search_ext(ld, base, LDAP_SCOPE_SUBTREE, filt,
+	NULL, 0, NULL, NULL, tvp, 0, &ps->msgid);
+    if (ps->rc != LDAP_SUCCESS)
+	ps->msgid = -1;
+#else
+    /* No asynchronous search extension, search synchronously. */
+    ps->msgid = -1;
+    ps->rc = ldap_search_ext_s(ld, base, LDAP_SCOPE_SUBTREE, filt,
+	NULL, 0, NULL, NULL, tvp, 0, &ps->result);
+#endif /* HAVE_LDAP_SEARCH_EXT_S */
+
+    debug_return;
+}
+
+/*
+ * Wait for the result of a search started by sudo_ldap_search_start(),
+ * up to the specified deadline (if set).  On success, the result is
+ * stored in resultp and must be freed by the caller.
+ * Returns the LDAP result code of the search.
+ */
+int
+sudo_ldap_search_finish(LDAP *ld, struct ldap_pending_search *ps,
+    const struct timespec *deadline, LDAPMessage **resultp)
+{
+    LDAPMessage *result = NULL;
+    int rc;
+    debug_decl(sudo_ldap_search_finish, SUDOERS_DEBUG_LDAP);
+
+#ifdef HAVE_LDAP_SEARCH_EXT_S
+    if (ps->msgid != -1) {
+	struct timeval tv, *tvp = NULL;
+
+	if (sudo_timespecisset(deadline)) {
+	    struct timespec now;
+
+	    sudo_timespecclear(&now);
+	    if (sudo_gettime_mono(&now) == -1 ||
+		    sudo_timespeccmp(&now, deadline, >=)) {
+		/* Out of time, just check for a result already received. */
+		sudo_timespecclear(&now);
+	    } else {
+		sudo_timespecsub(deadline, &now, &now);
+	    }
+	    TIMESPEC_TO_TIMEVAL(&tv, &now);
+	    tvp = &tv;
+	}
+	switch (ldap_result(ld, ps->msgid, LDAP_MSG_ALL, tvp, &result)) {
+	case -1:
+	    rc = LDAP_OTHER;
+	    (void)ldap_get_option(ld, LDAP_OPT_RESULT_CODE, &rc);
+	    break;
+	case 0:
+	    rc = LDAP_TIMEOUT;
+	    (void)ldap_abandon_ext(ld, ps->msgid, NULL, NULL);
+	    break;
+	default:
+	    if (ldap_parse_result(ld, result, &rc, NULL, NULL, NULL, NULL, 0)
+		    != LDAP_SUCCESS) {
+		rc = LDAP_OTHER;
+		(void)ldap_get_option(ld, LDAP_OPT_RESULT_CODE, &rc);
+	    }
+	    break;
+	}
+	ps->msgid = -1;
+    } else
+#endif /* HAVE_LDAP_SEARCH_EXT_S */
+    {
+	result = ps->result;
+	rc = ps->rc;
+	ps->result = NULL;
+    }
+    if (rc != LDAP_SUCCESS) {
+	ldap_msgfree(result);
+	result = NULL;
+    }
+    *resultp = result;
+
+    debug_return_int(rc);
+}
+
+/*
+ * Abandon a search started by sudo_ldap_search_start() whose
+ * result is no longer needed.
+ */
+void
+sudo_ldap_search_abandon(LDAP *ld, struct ldap_pending_search *ps)
+{
+    debug_decl(sudo_ldap_search_abandon, SUDOERS_DEBUG_LDAP);
+
+#ifdef HAVE_LDAP_SEARCH_EXT_S
+    if (ps->msgid != -1)
+	(void)ldap_abandon_ext(ld, ps->msgid, NULL, NULL);
+#endif
+    ps->msgid = -1;
+    ldap_msgfree(ps->result);
+    ps->result = NULL;
+
+    debug_return;
+}
@@ -67,8 +67,9 @@
 #define INCORRECT_PASSWORD_ATTEMPT	((char *)0x01)
 
 static void do_syslog(int, char *);
-static bool do_logfile(const char *);
-static bool send_mail(const char *fmt, ...);
+static bool do_logfile(const char *, time_t);
+static bool log_message(char *, int, bool, bool);
+static bool send_mail(const char *, time_t, bool);
 static bool should_mail(int);
 static void mysyslog(int, const char *, ...);
 static char *new_logline(const char *, const char *);
@@ -153,7 +154,7 @@ do_syslog(int pri, char *msg)
 }
 
 static bool
-do_logfile(const char *msg)
+do_logfile(const char *msg, time_t now)
 {
     static bool warned = false;
     const char *timestr;
@@ -186,7 +187,7 @@ do_logfile(const char *msg)
 	goto done;
     }
 
-    timestr = get_timestr(time(NULL), def_log_year);
+    timestr = get_timestr(now, def_log_year);
     if (timestr == NULL)
 	timestr = "invalid date";
     if (def_log_host) {
@@ -266,16 +267,9 @@ log_denial(int status, bool inform_user)
 	/* Become root if we are not already. */
 	uid_changed = set_perms(PERM_ROOT);
 
-	if (mailit)
-	    send_mail("%s", logline);	/* XXX - return value */
-
-	/* Log via syslog and/or a file. */
-	if (def_log_denied) {
-	    if (def_syslog)
-		do_syslog(def_syslog_badpri, logline);
-	    if (def_logfile && !do_logfile(logline))
-		ret = false;
-	}
+	/* Mail and log via syslog and/or a file. */
+	if (!log_message(logline, def_syslog_badpri, mailit, def_log_denied))
+	    ret = false;
 
 	if (uid_changed) {
 	    if (!restore_perms())
@@ -415,18 +409,11 @@ log_allowed(int status)
 	/* Become root if we are not already. */
 	uid_changed = set_perms(PERM_ROOT);
 
-	if (mailit)
-	    send_mail("%s", logline);	/* XXX - return value */
-
 	/*
-	 * Log via syslog and/or a file.
+	 * Mail and log via syslog and/or a file.
 	 */
-	if (def_log_allowed) {
-	    if (def_syslog)
-		do_syslog(def_syslog_goodpri, logline);
-	    if (def_logfile && !do_logfile(logline))
-		ret = false;
-	}
+	if (!log_message(logline, def_syslog_goodpri, mailit, def_log_allowed))
+	    ret = false;
 
 	if (uid_changed) {
 	    if (!restore_perms())
@@ -559,21 +546,11 @@ vlog_warning(int flags, int errnum, const char *fmt, va_list ap)
     uid_changed = set_perms(PERM_ROOT);
 
     /*
-     * Send a copy of the error via mail.
-     * XXX - return value
-     */
-    if (ISSET(flags, SLOG_SEND_MAIL))
-	send_mail("%s", logline);
-
-    /*
-     * Log to syslog and/or a file.
+     * Send a copy of the error via mail and log to syslog and/or a file.
      */
-    if (!ISSET(flags, SLOG_NO_LOG)) {
-	if (def_syslog)
-	    do_syslog(def_syslog_badpri, logline);
-	if (def_logfile && !do_logfile(logline))
-	    ret = false;
-    }
+    if (!log_message(logline, def_syslog_badpri,
+	    ISSET(flags, SLOG_SEND_MAIL), !ISSET(flags, SLOG_NO_LOG)))
+	ret = false;
 
     if (uid_changed) {
 	if (!restore_perms())
@@ -763,34 +740,24 @@ exec_mailer(int pipein)
 }
 
 /*
- * Send a message to MAILTO user
+ * Fork a child process that is disassociated from the session and tty
+ * so that it may outlive sudo.  The intermediate child exits right away
+ * so the detached process is reparented to init and is reaped by it.
+ * Returns 0 in the detached process, 1 in the parent and -1 on error.
  */
-static bool
-send_mail(const char *fmt, ...)
+static int
+fork_detached(void)
 {
-    FILE *mail;
-    char *p;
-    const char *timestr;
-    int fd, pfd[2], status;
+    int fd, status;
     pid_t pid, rv;
-    struct stat sb;
-    va_list ap;
-    debug_decl(send_mail, SUDOERS_DEBUG_LOGGING);
-
-    /* If mailer is disabled just return. */
-    if (!def_mailerpath || !def_mailto)
-	debug_return_bool(true);
-
-    /* Make sure the mailer exists and is a regular file. */
-    if (stat(def_mailerpath, &sb) != 0 || !S_ISREG(sb.st_mode))
-	debug_return_bool(false);
+    debug_decl(fork_detached, SUDOERS_DEBUG_LOGGING);
 
     /* Fork and return, child will daemonize. */
     switch (pid = sudo_debug_fork()) {
 	case -1:
 	    /* Error. */
 	    sudo_warn(U_("unable to fork"));
-	    debug_return_bool(false);
+	    debug_return_int(-1);
 	    break;
 	case 0:
 	    /* Child. */
@@ -804,7 +771,6 @@ send_mail(const char *fmt, ...)
 		    _exit(EXIT_FAILURE);
 		case 0:
 		    /* Grandchild continues below. */
-		    sudo_debug_enter(__func__, __FILE__, __LINE__, sudo_debug_subsys);
 		    break;
 		default:
 		    /* Parent will wait for us. */
@@ -822,7 +788,7 @@ send_mail(const char *fmt, ...)
 	    }
 	    sudo_debug_printf(SUDO_DEBUG_INFO|SUDO_DEBUG_LINENO,
 		"child (%d) exit value %d", (int)rv, status);
-	    debug_return_bool(true);
+	    debug_return_int(1);
     }
 
     /* Daemonize - disassociate from session/tty. */
@@ -842,12 +808,106 @@ send_mail(const char *fmt, ...)
     /* Close non-debug fds so we don't leak anything. */
     closefrom_nodebug(STDERR_FILENO + 1);
 
+    debug_return_int(0);
+}
+
+/*
+ * Mail the message and/or log it via syslog and the log file.
+ * If the log_async flag is set, delivery is done by a detached
+ * process so a slow mailer, syslog daemon or contended log file
+ * lock does not delay sudo.  The detached process finishes
+ * delivering the message even if sudo exits first.
+ * Log file errors cannot be reported in this case.
+ */
+static bool
+log_message(char *logline, int pri, bool mailit, bool logit)
+{
+    const time_t now = time(NULL);
+    bool detached = false;
+    bool ret = true;
+    debug_decl(log_message, SUDOERS_DEBUG_LOGGING);
+
+    if (!def_syslog && !def_logfile)
+	logit = false;
+    if (!def_mailerpath || !def_mailto)
+	mailit = false;
+    if (!logit && !mailit)
+	debug_return_bool(true);
+
+    if (def_log_async) {
+	switch (fork_detached()) {
+	case -1:
+	    /* Unable to fork, deliver the message ourselves. */
+	    break;
+	case 0:
+	    /* Detached process, deliver the message below. */
+	    detached = true;
+	    break;
+	default:
+	    /* Parent, the detached process will deliver the message. */
+	    debug_return_bool(true);
+	}
+    }
+
+    if (logit) {
+	if (def_syslog)
+	    do_syslog(pri, logline);
+	if (def_logfile && !do_logfile(logline, now))
+	    ret = false;
+    }
+    if (mailit)
+	send_mail(logline, now, detached);	/* XXX - return value */
+
+    if (detached) {
+	sudo_debug_exit_bool(__func__, __FILE__, __LINE__, sudo_debug_subsys,
+	    ret);
+	_exit(ret ? EXIT_SUCCESS : EXIT_FAILURE);
+    }
+    debug_return_bool(ret);
+}
+
+/*
+ * Send a message to MAILTO user.
+ * The mail is sent by a detached process unless we are already
+ * running in one, in which case we wait for the mailer to finish.
+ */
+static bool
+send_mail(const char *message, time_t now, bool detached)
+{
+    FILE *mail;
+    char *p;
+    const char *timestr;
+    int pfd[2], status;
+    bool ret = false;
+    pid_t pid, rv;
+    struct stat sb;
+    debug_decl(send_mail, SUDOERS_DEBUG_LOGGING);
+
+    /* If mailer is disabled just return. */
+    if (!def_mailerpath || !def_mailto)
+	debug_return_bool(true);
+
+    /* Make sure the mailer exists and is a regular file. */
+    if (stat(def_mailerpath, &sb) != 0 || !S_ISREG(sb.st_mode))
+	debug_return_bool(false);
+
+    if (!detached) {
+	switch (fork_detached()) {
+	case -1:
+	    debug_return_bool(false);
+	case 0:
+	    /* Detached process continues below. */
+	    break;
+	default:
+	    debug_return_bool(true);
+	}
+    }
+
     if (pipe2(pfd, O_CLOEXEC) == -1) {
 	mysyslog(LOG_ERR, _("unable to open pipe: %m"));
 	sudo_debug_printf(SUDO_DEBUG_ERROR, "unable to open pipe: %s",
 	    strerror(errno));
-	sudo_debug_exit(__func__, __FILE__, __LINE__, sudo_debug_subsys);
-	_exit(EXIT_FAILURE);
+	goto done;
     }
 
     switch (pid = sudo_debug_fork()) {
@@ -856,9 +916,9 @@ send_mail(const char *fmt, ...)
 	    mysyslog(LOG_ERR, _("unable to fork: %m"));
 	    sudo_debug_printf(SUDO_DEBUG_ERROR, "unable to fork: %s",
 		strerror(errno));
-	    sudo_debug_exit(__func__, __FILE__, __LINE__, sudo_debug_subsys);
-	    _exit(EXIT_FAILURE);
-	    break;
+	    (void) close(pfd[0]);
+	    (void) close(pfd[1]);
+	    goto done;
 	case 0:
 	    /* Child. */
 	    exec_mailer(pfd[0]);
@@ -894,13 +954,10 @@ send_mail(const char *fmt, ...)
 	(void) fprintf(mail, "\nContent-Type: text/plain; charset=\"%s\"\nContent-Transfer-Encoding: 8bit", nl_langinfo(CODESET));
 #endif /* HAVE_NL_LANGINFO && CODESET */
 
-    if ((timestr = get_timestr(time(NULL), def_log_year)) == NULL)
+    if ((timestr = get_timestr(now, def_log_year)) == NULL)
 	timestr = "invalid date";
-    (void) fprintf(mail, "\n\n%s : %s : %s : ", user_host, timestr, user_name);
-    va_start(ap, fmt);
-    (void) vfprintf(mail, fmt, ap);
-    va_end(ap);
-    fputs("\n\n", mail);
+    (void) fprintf(mail, "\n\n%s : %s : %s : %s\n\n", user_host, timestr,
+	user_name, message);
 
     fclose(mail);
     for (;;) {
@@ -912,8 +969,13 @@ send_mail(const char *fmt, ...)
     }
     sudo_debug_printf(SUDO_DEBUG_INFO|SUDO_DEBUG_LINENO,
 	"child (%d) exit value %d", (int)rv, status);
+    ret = true;
+
+done:
+    if (detached)
+	debug_return_bool(ret);
     sudo_debug_exit(__func__, __FILE__, __LINE__, sudo_debug_subsys);
-    _exit(EXIT_SUCCESS);
+    _exit(ret ? EXIT_SUCCESS : EXIT_FAILURE);
 }
 
 /*
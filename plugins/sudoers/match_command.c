@@ -44,7 +44,6 @@
 #else
 # include "compat/glob.h"
 #endif /* HAVE_GLOB */
-#include <dirent.h>
 #include <fcntl.h>
 #include <errno.h>
 
@@ -192,75 +191,65 @@ set_cmnd_fd(int fd)
     debug_return;
 }
 
+/*
+ * Return true if path names the same inode as user_cmnd and, if
+ * specified, its digest matches.  Sets safe_cmnd and the command fd
+ * on success.  The basename of path must already match user_base.
+ */
+static bool
+command_matches_path(const char *path, const struct command_digest *digest)
+{
+    struct stat sudoers_stat;
+    int fd = -1;
+    debug_decl(command_matches_path, SUDOERS_DEBUG_MATCH);
+
+    /* Open the file for fdexec or for digest matching. */
+    if (!open_cmnd(path, digest, &fd))
+	goto bad;
+    if (!do_stat(fd, path, &sudoers_stat))
+	goto bad;
+    if (user_stat != NULL &&
+	(user_stat->st_dev != sudoers_stat.st_dev ||
+	user_stat->st_ino != sudoers_stat.st_ino))
+	goto bad;
+    if (digest != NULL && !digest_matches(fd, path, digest))
+	goto bad;
+    free(safe_cmnd);
+    if ((safe_cmnd = strdup(path)) == NULL) {
+	sudo_warnx(U_("%s: %s"), __func__, U_("unable to allocate memory"));
+	goto bad;
+    }
+    set_cmnd_fd(fd);
+    debug_return_bool(true);
+bad:
+    if (fd != -1)
+	close(fd);
+    debug_return_bool(false);
+}
+
 /*
  * Return true if user_cmnd names one of the inodes in dir, else false.
+ * Rather than reading the entire directory we look up user_base in
+ * it directly; no other entry can match.
  */
 static bool
 command_matches_dir(const char *sudoers_dir, size_t dlen,
     const struct command_digest *digest)
 {
-    struct stat sudoers_stat;
-    struct dirent *dent;
     char buf[PATH_MAX];
-    int fd = -1;
-    DIR *dirp;
     debug_decl(command_matches_dir, SUDOERS_DEBUG_MATCH);
 
-    /*
-     * Grot through directory entries, looking for user_base.
-     */
-    dirp = opendir(sudoers_dir);
-    if (dirp == NULL)
+    /* A directory entry cannot have an empty name. */
+    if (user_base[0] == '\0')
 	debug_return_bool(false);
 
-    if (strlcpy(buf, sudoers_dir, sizeof(buf)) >= sizeof(buf)) {
-	closedir(dirp);
+    /* ignore paths > PATH_MAX (XXX - log) */
+    if (dlen + strlen(user_base) >= sizeof(buf))
 	debug_return_bool(false);
-    }
-    while ((dent = readdir(dirp)) != NULL) {
-	if (fd != -1) {
-	    close(fd);
-	    fd = -1;
-	}
+    memcpy(buf, sudoers_dir, dlen);
+    memcpy(buf + dlen, user_base, strlen(user_base) + 1);
 
-	/* ignore paths > PATH_MAX (XXX - log) */
-	buf[dlen] = '\0';
-	if (strlcat(buf, dent->d_name, sizeof(buf)) >= sizeof(buf))
-	    continue;
-
-	/* only stat if basenames are the same */
-	if (strcmp(user_base, dent->d_name) != 0)
-	    continue;
-
-	/* Open the file for fdexec or for digest matching. */
-	if (!open_cmnd(buf, digest, &fd))
-	    continue;
-	if (!do_stat(fd, buf, &sudoers_stat))
-	    continue;
-
-	if (user_stat == NULL ||
-	    (user_stat->st_dev == sudoers_stat.st_dev &&
-	    user_stat->st_ino == sudoers_stat.st_ino)) {
-	    if (digest != NULL && !digest_matches(fd, buf, digest))
-		continue;
-	    free(safe_cmnd);
-	    if ((safe_cmnd = strdup(buf)) == NULL) {
-		sudo_warnx(U_("%s: %s"), __func__,
-		    U_("unable to allocate memory"));
-		dent = NULL;
-	    }
-	    break;
-	}
-    }
-    closedir(dirp);
-
-    if (dent != NULL) {
-	set_cmnd_fd(fd);
-	debug_return_bool(true);
-    }
-    if (fd != -1)
-	close(fd);
-    debug_return_bool(false);
+    debug_return_bool(command_matches_path(buf, digest));
 }
 
 static bool
@@ -303,6 +292,41 @@ bad:
     debug_return_bool(false);
 }
 
+/*
+ * Match a pattern whose meta characters are all in the last path
+ * component without calling glob(3).  The only expansion of the
+ * pattern that can match is the directory joined with user_base,
+ * so we check user_base against the last component with fnmatch(3)
+ * and look it up directly instead of reading the whole directory.
+ * As with glob(3), a leading period must be matched explicitly.
+ */
+static bool
+command_matches_glob_base(const char *sudoers_cmnd, const char *sudoers_args,
+    const char *base, const struct command_digest *digest)
+{
+    const size_t dlen = (size_t)(base - sudoers_cmnd);
+    char path[PATH_MAX];
+    debug_decl(command_matches_glob_base, SUDOERS_DEBUG_MATCH);
+
+    if (user_base[0] == '\0' || fnmatch(base, user_base, FNM_PERIOD) != 0)
+	debug_return_bool(false);
+    if (dlen + strlen(user_base) >= sizeof(path))
+	debug_return_bool(false);
+    memcpy(path, sudoers_cmnd, dlen);
+    memcpy(path + dlen, user_base, strlen(user_base) + 1);
+
+    /*
+     * Return true if the path names the same inode as user_cmnd AND
+     *  a) there are no args in sudoers OR
+     *  b) there are no args on command line and none required by sudoers OR
+     *  c) there are args in sudoers and on command line and they match
+     * else return false.
+     */
+    if (!command_args_match(sudoers_cmnd, sudoers_args))
+	debug_return_bool(false);
+    debug_return_bool(command_matches_path(path, digest));
+}
+
 static bool
 command_matches_glob(const char *sudoers_cmnd, const char *sudoers_args,
     const struct command_digest *digest)
@@ -319,13 +343,20 @@ command_matches_glob(const char *sudoers_cmnd, const char *sudoers_args,
      * First check to see if we can avoid the call to glob(3).
      * Short circuit if there are no meta chars in the command itself
      * and user_base and basename(sudoers_cmnd) don't match.
+     * If the meta chars are only in the basename, match it directly.
      */
     dlen = strlen(sudoers_cmnd);
     if (sudoers_cmnd[dlen - 1] != '/') {
 	if ((base = strrchr(sudoers_cmnd, '/')) != NULL) {
 	    base++;
-	    if (!has_meta(base) && strcmp(user_base, base) != 0)
-		debug_return_bool(false);
+	    if (!has_meta(base)) {
+		if (strcmp(user_base, base) != 0)
+		    debug_return_bool(false);
+	    } else if (strcspn(sudoers_cmnd, "\\?*[]") >=
+		(size_t)(base - sudoers_cmnd)) {
+		debug_return_bool(command_matches_glob_base(sudoers_cmnd,
+		    sudoers_args, base, digest));
+	    }
 	}
     }
     /*
@@ -48,21 +48,39 @@ digest_matches(int fd, const char *file, const struct command_digest *digest)
 {
     unsigned char *file_digest = NULL;
     unsigned char *sudoers_digest = NULL;
+    struct stat sb, sb2;
     bool matched = false;
+    bool cacheable;
     size_t digest_len;
     debug_decl(digest_matches, SUDOERS_DEBUG_MATCH);
 
     if (fd == -1)
 	goto done;
 
-    file_digest = sudo_filedigest(fd, file, digest->digest_type, &digest_len);
-    if (lseek(fd, (off_t)0, SEEK_SET) == -1) {
-	sudo_debug_printf(SUDO_DEBUG_ERROR|SUDO_DEBUG_ERRNO|SUDO_DEBUG_LINENO,
-	    "unable to rewind digest fd");
+    /* Use the cached digest if the file has not changed since it was hashed. */
+    cacheable = fstat(fd, &sb) == 0 && S_ISREG(sb.st_mode);
+    if (cacheable) {
+	file_digest = sudo_digestcache_get(&sb, digest->digest_type,
+	    &digest_len);
     }
     if (file_digest == NULL) {
-	/* Warning (if any) printed by sudo_filedigest() */
-	goto done;
+	file_digest = sudo_filedigest(fd, file, digest->digest_type,
+	    &digest_len);
+	if (lseek(fd, (off_t)0, SEEK_SET) == -1) {
+	    sudo_debug_printf(SUDO_DEBUG_ERROR|SUDO_DEBUG_ERRNO|SUDO_DEBUG_LINENO,
+		"unable to rewind digest fd");
+	}
+	if (file_digest == NULL) {
+	    /* Warning (if any) printed by sudo_filedigest() */
+	    goto done;
+	}
+
+	/* Only cache the digest if the file did not change while hashing. */
+	if (cacheable && fstat(fd, &sb2) == 0 && sb.st_size == sb2.st_size &&
+		sb.st_mtime == sb2.st_mtime && sb.st_ctime == sb2.st_ctime) {
+	    sudo_digestcache_put(&sb, digest->digest_type, file_digest,
+		digest_len);
+	}
     }
 
     /* Convert the command digest from ascii to binary. */
@@ -118,61 +118,62 @@ sudoers_lookup_pseudo(struct sudo_nss_list *snl, struct passwd *pw,
     debug_return_int(validated);
 }
 
+/*
+ * Check a single userspec for a matching command.
+ * Returns ALLOW or DENY on a match, else UNSPEC.
+ */
 static int
-sudoers_lookup_check(struct sudo_nss *nss, struct passwd *pw,
-    int *validated, struct cmndspec **matching_cs,
+sudoers_lookup_userspec(struct sudo_nss *nss, struct passwd *pw,
+    struct userspec *us, int *validated, struct cmndspec **matching_cs,
     struct defaults_list **defs, time_t now)
 {
     int host_match, runas_match, cmnd_match;
     struct cmndspec *cs;
     struct privilege *priv;
-    struct userspec *us;
     struct member *matching_user;
-    debug_decl(sudoers_lookup_check, SUDOERS_DEBUG_PARSER);
-
-    TAILQ_FOREACH_REVERSE(us, &nss->parse_tree->userspecs, userspec_list, entries) {
-	if (userlist_matches(nss->parse_tree, pw, &us->users) != ALLOW)
+    debug_decl(sudoers_lookup_userspec, SUDOERS_DEBUG_PARSER);
+
+    if (userlist_matches(nss->parse_tree, pw, &us->users) != ALLOW)
+	debug_return_int(UNSPEC);
+    CLR(*validated, FLAG_NO_USER);
+    TAILQ_FOREACH_REVERSE(priv, &us->privileges, privilege_list, entries) {
+	host_match = hostlist_matches(nss->parse_tree, pw, &priv->hostlist);
+	if (host_match == ALLOW)
+	    CLR(*validated, FLAG_NO_HOST);
+	else
 	    continue;
-	CLR(*validated, FLAG_NO_USER);
-	TAILQ_FOREACH_REVERSE(priv, &us->privileges, privilege_list, entries) {
-	    host_match = hostlist_matches(nss->parse_tree, pw, &priv->hostlist);
-	    if (host_match == ALLOW)
-		CLR(*validated, FLAG_NO_HOST);
-	    else
-		continue;
-	    TAILQ_FOREACH_REVERSE(cs, &priv->cmndlist, cmndspec_list, entries) {
-		if (cs->notbefore != UNSPEC) {
-		    if (now < cs->notbefore)
-			continue;
-		}
-		if (cs->notafter != UNSPEC) {
-		    if (now > cs->notafter)
-			continue;
-		}
-		matching_user = NULL;
-		runas_match = runaslist_matches(nss->parse_tree,
-		    cs->runasuserlist, cs->runasgrouplist, &matching_user,
-		    NULL);
-		if (runas_match == ALLOW) {
-		    cmnd_match = cmnd_matches(nss->parse_tree, cs->cmnd);
-		    if (cmnd_match != UNSPEC) {
-			/*
-			 * If user is running command as himself,
-			 * set runas_pw = sudo_user.pw.
-			 * XXX - hack, want more general solution
-			 */
-			if (matching_user && matching_user->type == MYSELF) {
-			    sudo_pw_delref(runas_pw);
-			    sudo_pw_addref(sudo_user.pw);
-			    runas_pw = sudo_user.pw;
-			}
-			*matching_cs = cs;
-			*defs = &priv->defaults;
-			sudo_debug_printf(SUDO_DEBUG_DEBUG|SUDO_DEBUG_LINENO,
-			    "userspec matched @ %s:%d %s", us->file, us->lineno,
-			    cmnd_match ? "allowed" : "denied");
-			debug_return_int(cmnd_match);
+	TAILQ_FOREACH_REVERSE(cs, &priv->cmndlist, cmndspec_list, entries) {
+	    if (cs->notbefore != UNSPEC) {
+		if (now < cs->notbefore)
+		    continue;
+	    }
+	    if (cs->notafter != UNSPEC) {
+		if (now > cs->notafter)
+		    continue;
+	    }
+	    matching_user = NULL;
+	    runas_match = runaslist_matches(nss->parse_tree,
+		cs->runasuserlist, cs->runasgrouplist, &matching_user,
+		NULL);
+	    if (runas_match == ALLOW) {
+		cmnd_match = cmnd_matches(nss->parse_tree, cs->cmnd);
+		if (cmnd_match != UNSPEC) {
+		    /*
+		     * If user is running command as himself,
+		     * set runas_pw = sudo_user.pw.
+		     * XXX - hack, want more general solution
+		     */
+		    if (matching_user && matching_user->type == MYSELF) {
+			sudo_pw_delref(runas_pw);
+			sudo_pw_addref(sudo_user.pw);
+			runas_pw = sudo_user.pw;
 		    }
+		    *matching_cs = cs;
+		    *defs = &priv->defaults;
+		    sudo_debug_printf(SUDO_DEBUG_DEBUG|SUDO_DEBUG_LINENO,
+			"userspec matched @ %s:%d %s", us->file, us->lineno,
+			cmnd_match ? "allowed" : "denied");
+		    debug_return_int(cmnd_match);
 		}
 	    }
 	}
@@ -180,6 +181,37 @@ sudoers_lookup_check(struct sudo_nss *nss, struct passwd *pw,
     debug_return_int(UNSPEC);
 }
 
+static int
+sudoers_lookup_check(struct sudo_nss *nss, struct passwd *pw,
+    int *validated, struct cmndspec **matching_cs,
+    struct defaults_list **defs, time_t now)
+{
+    struct userspec **candidates, *us;
+    int i, ncandidates, match = UNSPEC;
+    debug_decl(sudoers_lookup_check, SUDOERS_DEBUG_PARSER);
+
+    /* Only check the userspecs that may match pw if possible. */
+    ncandidates = userspec_index_lookup(nss->parse_tree, pw, &candidates);
+    if (ncandidates != -1) {
+	for (i = 0; i < ncandidates; i++) {
+	    match = sudoers_lookup_userspec(nss, pw, candidates[i], validated,
+		matching_cs, defs, now);
+	    if (match != UNSPEC)
+		break;
+	}
+	free(candidates);
+	debug_return_int(match);
+    }
+
+    TAILQ_FOREACH_REVERSE(us, &nss->parse_tree->userspecs, userspec_list, entries) {
+	match = sudoers_lookup_userspec(nss, pw, us, validated, matching_cs,
+	    defs, now);
+	if (match != UNSPEC)
+	    break;
+    }
+    debug_return_int(match);
+}
+
 /*
  * Apply cmndspec-specific settngs including SELinux role/type,
  * Solaris privs, and command tags.
@@ -273,6 +273,7 @@ struct sudoers_parse_tree {
     struct defaults_list defaults;
     struct rbtree *aliases;
     const char *shost, *lhost;
+    struct userspec_index *usidx;	/* optional userspec index */
 };
 
 /* alias.c */
@@ -375,4 +376,17 @@ bool sudoers_format_userspecs(struct sudo_lbuf *lbuf, struct sudoers_parse_tree
 bool sudoers_defaults_to_tags(const char *var, const char *val, int op, struct cmndtag *tags);
 bool sudoers_defaults_list_to_tags(struct defaults_list *defs, struct cmndtag *tags);
 
+/* userspec_index.c */
+struct userspec_index *userspec_index_build(struct sudoers_parse_tree *parse_tree);
+int userspec_index_lookup(struct sudoers_parse_tree *parse_tree, const struct passwd *pw, struct userspec ***candidatesp);
+void userspec_index_free(struct userspec_index *usidx);
+
+/* sudoers_cache.c */
+#define SUDOERS_CACHE_SUFFIX	".cache"
+bool sudoers_cache_add_source(const char *path, bool isdir);
+bool sudoers_cache_read(const char *path, struct sudoers_parse_tree *parse_tree, bool verify);
+bool sudoers_cache_write(const char *path, const char *sudoers_path, struct sudoers_parse_tree *parse_tree);
+void sudoers_cache_clear_sources(void);
+void sudoers_cache_record(bool onoff);
+
 #endif /* SUDOERS_PARSE_H */
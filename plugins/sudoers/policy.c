@@ -42,6 +42,7 @@
 #include "sudoers.h"
 #include "sudoers_version.h"
 #include "interfaces.h"
+#include "sudo_iolog.h"
 
 /*
  * Info passed in from the sudo front-end.
@@ -564,7 +565,7 @@ sudoers_policy_exec_setup(char *argv[], char *envp[], mode_t cmnd_umask,
 	debug_return_bool(true);	/* nothing to do */
 
     /* Increase the length of command_info as needed, it is *not* checked. */
-    command_info = calloc(52, sizeof(char *));
+    command_info = calloc(55, sizeof(char *));
     if (command_info == NULL)
 	goto oom;
 
@@ -574,8 +575,23 @@ sudoers_policy_exec_setup(char *argv[], char *envp[], mode_t cmnd_umask,
 	    goto oom;
     }
     if (def_log_input || def_log_output) {
-	if (iolog_path)
+	if (iolog_path) {
 	    command_info[info_len++] = iolog_path;	/* now owned */
+	    /*
+	     * The top of the I/O log dir is the part of iolog_dir before
+	     * the first escape sequence, which is the same when expanded.
+	     */
+	    if (sudo_user.iolog_file != NULL && def_iolog_dir != NULL) {
+		const char *dir = iolog_path + sizeof("iolog_path=") - 1;
+		size_t len = iolog_index_dirlen(def_iolog_dir);
+		if (len != 0 && len < (size_t)(sudo_user.iolog_file - dir) &&
+			strncmp(dir, def_iolog_dir, len) == 0) {
+		    if (asprintf(&command_info[info_len++], "iolog_dir=%.*s",
+			    (int)len, dir) == -1)
+			goto oom;
+		}
+	    }
+	}
 	if (def_log_input) {
 	    if ((command_info[info_len++] = strdup("iolog_stdin=true")) == NULL)
 		goto oom;
@@ -744,6 +760,14 @@ sudoers_policy_exec_setup(char *argv[], char *envp[], mode_t cmnd_umask,
 
 	if (asprintf(&command_info[info_len++], "log_server_timeout=%u", def_log_server_timeout) == -1)
 	    goto oom;
+	if (def_log_server_coalesce > 0) {
+	    if (asprintf(&command_info[info_len++], "log_server_coalesce=%u", def_log_server_coalesce) == -1)
+		goto oom;
+	}
+	if (def_log_server_compress) {
+	    if ((command_info[info_len++] = strdup("log_server_compress=true")) == NULL)
+		goto oom;
+	}
     }
 
     if ((command_info[info_len++] = sudo_new_key_val("log_server_keepalive",
@@ -1012,6 +1036,17 @@ sudoers_policy_invalidate(int remove)
     user_cmnd = "kill";
     /* XXX - plugin API should support a return value for fatal errors. */
     timestamp_remove(remove);
+
+    /*
+     * For "sudo -K" also purge the user's shared passwd and group cache
+     * entries, or the entire shared cache when run by root.
+     */
+    if (remove) {
+	if (set_perms(PERM_ROOT)) {
+	    (void)sudo_pwcache_purge(user_uid == ROOT_UID ? NULL : sudo_user.pw);
+	    (void)restore_perms();
+	}
+    }
     sudoers_cleanup();
 
     debug_return;
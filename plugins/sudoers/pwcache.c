@@ -0,0 +1,815 @@
+/*
+ * SPDX-License-Identifier: ISC
+ *
+ * Copyright (c) 2020 Todd C. Miller <Todd.Miller@sudo.ws>
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/*
+ * This is an open source non-commercial project. Dear PVS-Studio, please check it.
+ * PVS-Studio Static Code Analyzer for C, C++ and C#: http://www.viva64.com
+ */
+
+#include <config.h>
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <stdio.h>
+#include <stdlib.h>
+#if defined(HAVE_STDINT_H)
+# include <stdint.h>
+#elif defined(HAVE_INTTYPES_H)
+# include <inttypes.h>
+#endif
+#ifdef HAVE_STRING_H
+# include <string.h>
+#endif /* HAVE_STRING_H */
+#ifdef HAVE_STRINGS_H
+# include <strings.h>
+#endif /* HAVE_STRINGS_H */
+#include <unistd.h>
+#include <ctype.h>
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <pwd.h>
+#include <grp.h>
+
+#include "sudoers.h"
+#include "pwutil.h"
+
+/*
+ * Shared passwd and group cache.
+ *
+ * The per-process caches in pwutil.c are backed by a directory of
+ * small files, one per entry, that persists between sudo invocations.
+ * Each file holds a header followed by the entry's key and contents
+ * encoded as 32-bit integers in host byte order and NUL-terminated
+ * strings.  Negative lookups are not stored, since any user could
+ * create an unbounded number of them by asking for users or groups
+ * that do not exist.
+ *
+ * An entry is only used if it is owned by root, is not writable by
+ * anyone else, was written in the current generation and is younger
+ * than the time to live.  Entries that are expired, from an older
+ * generation or invalid are removed when they are looked up.
+ * Purging the whole cache bumps the generation
+ * number stored in the "generation" file, which invalidates every
+ * entry at once.  Only passwd entries whose password field is a
+ * placeholder are stored; real password hashes never leave NSS.
+ */
+
+#define PWCACHE_MAGIC		0x53505743	/* "SPWC" in host order */
+#define PWCACHE_VERSION		1
+#define PWCACHE_MAX_SIZE	(1024 * 1024)
+#define PWCACHE_GENERATION	"generation"
+
+/* Presence bits for optional strings. */
+#define PWCACHE_HAS_NAME	0x01
+#define PWCACHE_HAS_PASSWD	0x02
+#define PWCACHE_HAS_CLASS	0x04
+#define PWCACHE_HAS_GECOS	0x08
+#define PWCACHE_HAS_DIR		0x10
+#define PWCACHE_HAS_SHELL	0x20
+#define PWCACHE_HAS_MEM		0x40
+
+struct pwcache_header {
+    uint32_t magic;
+    uint16_t version;
+    uint16_t kind;
+    uint32_t flags;		/* currently unused, always zero */
+    uint32_t size;		/* size of data following the header */
+    uint64_t generation;
+    int64_t created;		/* seconds since the epoch */
+};
+
+/* Growable output buffer or bounded input cursor. */
+struct pwcache_buf {
+    char *data;
+    size_t len;
+    size_t size;
+    bool error;
+};
+
+static struct pwcache_state {
+    char *dir;
+    struct timespec ttl;
+    uint64_t generation;
+} pwcache;
+
+/* File name prefix for each entry type, indexed by kind. */
+static const char *pwcache_prefix[] = {
+    NULL,
+    "uid.",		/* PWCACHE_PWUID */
+    "user.",		/* PWCACHE_PWNAM */
+    "gid.",		/* PWCACHE_GRGID */
+    "group.",		/* PWCACHE_GRNAM */
+    "gids."		/* PWCACHE_GIDLIST */
+};
+
+static bool
+pwcache_keyed_by_name(unsigned int kind)
+{
+    return kind == PWCACHE_PWNAM || kind == PWCACHE_GRNAM ||
+	kind == PWCACHE_GIDLIST;
+}
+
+/*
+ * Append str to dst, escaping characters that are not safe to use
+ * in a file name as %XX.
+ * Returns false if dst is too small.
+ */
+static bool
+pwcache_escape(char *dst, size_t dsize, const char *str)
+{
+    static const char hex[] = "0123456789abcdef";
+    size_t len = strlen(dst);
+    const unsigned char *cp;
+
+    for (cp = (const unsigned char *)str; *cp != '\0'; cp++) {
+	if (isalnum(*cp) || *cp == '_' || *cp == '-' || *cp == '.') {
+	    if (len + 1 >= dsize)
+		return false;
+	    dst[len++] = *cp;
+	} else {
+	    if (len + 3 >= dsize)
+		return false;
+	    dst[len++] = '%';
+	    dst[len++] = hex[*cp >> 4];
+	    dst[len++] = hex[*cp & 0x0f];
+	}
+    }
+    dst[len] = '\0';
+    return true;
+}
+
+/*
+ * Store the cache file name for the given entry in path.
+ * The key name (if any) and AIX registry are escaped.
+ * Returns false if the name is too long.
+ */
+static bool
+pwcache_path(char *path, size_t psize, unsigned int kind,
+    const struct cache_item *key)
+{
+    char idbuf[sizeof("4294967295")];
+    int len;
+    debug_decl(pwcache_path, SUDOERS_DEBUG_NSS);
+
+    len = snprintf(path, psize, "%s/%s", pwcache.dir, pwcache_prefix[kind]);
+    if (len < 0 || (size_t)len >= psize)
+	debug_return_bool(false);
+    if (pwcache_keyed_by_name(kind)) {
+	if (!pwcache_escape(path, psize, key->k.name))
+	    debug_return_bool(false);
+    } else {
+	(void)snprintf(idbuf, sizeof(idbuf), "%u", kind == PWCACHE_PWUID ?
+	    (unsigned int)key->k.uid : (unsigned int)key->k.gid);
+	if (strlcat(path, idbuf, psize) >= psize)
+	    debug_return_bool(false);
+    }
+    if (key->registry[0] != '\0') {
+	if (strlcat(path, "@", psize) >= psize)
+	    debug_return_bool(false);
+	if (!pwcache_escape(path, psize, key->registry))
+	    debug_return_bool(false);
+    }
+    debug_return_bool(true);
+}
+
+/*
+ * Open a cache file for reading, see sudo_cachedir_open_file().
+ * Returns the file descriptor or -1 on error.
+ */
+static int
+pwcache_open_file(const char *path, struct stat *sb)
+{
+    int fd;
+    debug_decl(pwcache_open_file, SUDOERS_DEBUG_NSS);
+
+    fd = sudo_cachedir_open_file(path, ROOT_UID, sb);
+    if (fd != -1 && sb->st_size > PWCACHE_MAX_SIZE) {
+	sudo_debug_printf(SUDO_DEBUG_WARN|SUDO_DEBUG_LINENO,
+	    "ignoring oversized cache file %s", path);
+	close(fd);
+	fd = -1;
+    }
+    debug_return_int(fd);
+}
+
+/*
+ * Read the generation number from the cache dir.
+ * A missing file is treated as generation 0.
+ */
+static void
+pwcache_read_generation(void)
+{
+    char path[PATH_MAX], buf[64];
+    unsigned long long generation = 0;
+    struct stat sb;
+    ssize_t nread;
+    char *ep;
+    int fd, len;
+    debug_decl(pwcache_read_generation, SUDOERS_DEBUG_NSS);
+
+    len = snprintf(path, sizeof(path), "%s/%s", pwcache.dir,
+	PWCACHE_GENERATION);
+    if (len < 0 || (size_t)len >= sizeof(path))
+	debug_return;
+    if ((fd = pwcache_open_file(path, &sb)) == -1)
+	debug_return;
+    nread = read(fd, buf, sizeof(buf) - 1);
+    close(fd);
+    if (nread > 0) {
+	buf[nread] = '\0';
+	errno = 0;
+	generation = strtoull(buf, &ep, 10);
+	if (ep == buf || (*ep != '\0' && *ep != '\n') || errno == ERANGE)
+	    generation = 0;
+    }
+    pwcache.generation = generation;
+
+    debug_return;
+}
+
+/*
+ * Output helpers.  On allocation failure the buffer's error flag
+ * is set and further output is ignored.
+ */
+static void
+pwcache_put_bytes(struct pwcache_buf *buf, const void *data, size_t len)
+{
+    if (buf->error)
+	return;
+    if (len > buf->size - buf->len) {
+	size_t newsize = buf->size ? buf->size : 512;
+	char *newdata;
+
+	while (len > newsize - buf->len) {
+	    if (newsize > PWCACHE_MAX_SIZE) {
+		buf->error = true;
+		return;
+	    }
+	    newsize *= 2;
+	}
+	if ((newdata = realloc(buf->data, newsize)) == NULL) {
+	    buf->error = true;
+	    return;
+	}
+	buf->data = newdata;
+	buf->size = newsize;
+    }
+    memcpy(buf->data + buf->len, data, len);
+    buf->len += len;
+}
+
+static void
+pwcache_put_u32(struct pwcache_buf *buf, uint32_t val)
+{
+    pwcache_put_bytes(buf, &val, sizeof(val));
+}
+
+static void
+pwcache_put_str(struct pwcache_buf *buf, const char *str)
+{
+    if (str != NULL)
+	pwcache_put_bytes(buf, str, strlen(str) + 1);
+}
+
+/*
+ * Input helpers.  Reading past the end of the data sets the error flag.
+ */
+static uint32_t
+pwcache_get_u32(struct pwcache_buf *buf)
+{
+    uint32_t val = 0;
+
+    if (buf->size - buf->len < sizeof(val)) {
+	buf->error = true;
+    } else {
+	memcpy(&val, buf->data + buf->len, sizeof(val));
+	buf->len += sizeof(val);
+    }
+    return val;
+}
+
+static char *
+pwcache_get_str(struct pwcache_buf *buf)
+{
+    char *str = buf->data + buf->len;
+    char *nul;
+
+    if (buf->error || buf->len == buf->size)
+	goto bad;
+    nul = memchr(str, '\0', buf->size - buf->len);
+    if (nul == NULL)
+	goto bad;
+    buf->len += (size_t)(nul - str) + 1;
+    return str;
+bad:
+    buf->error = true;
+    return NULL;
+}
+
+static char *
+pwcache_get_optstr(struct pwcache_buf *buf, uint32_t present, uint32_t bit)
+{
+    return (present & bit) ? pwcache_get_str(buf) : NULL;
+}
+
+/*
+ * Remove a cache file that can no longer be used.  Nothing else would
+ * remove it until the cache is purged.  If another sudo process has
+ * just replaced it with a fresh entry, that entry is simply lost.
+ */
+static void
+pwcache_remove_file(const char *path)
+{
+    debug_decl(pwcache_remove_file, SUDOERS_DEBUG_NSS);
+
+    if (unlink(path) != 0 && errno != ENOENT) {
+	sudo_debug_printf(SUDO_DEBUG_WARN|SUDO_DEBUG_ERRNO|SUDO_DEBUG_LINENO,
+	    "unable to remove %s", path);
+    }
+    debug_return;
+}
+
+/*
+ * Decode a passwd entry and copy it to a new cache item.
+ */
+static struct cache_item *
+pwcache_decode_pw(struct pwcache_buf *buf, unsigned int kind,
+    const struct cache_item *key)
+{
+    struct passwd pw;
+    uint32_t present;
+    debug_decl(pwcache_decode_pw, SUDOERS_DEBUG_NSS);
+
+    memset(&pw, 0, sizeof(pw));
+    present = pwcache_get_u32(buf);
+    pw.pw_uid = (uid_t)pwcache_get_u32(buf);
+    pw.pw_gid = (gid_t)pwcache_get_u32(buf);
+    pw.pw_name = pwcache_get_optstr(buf, present, PWCACHE_HAS_NAME);
+    pw.pw_passwd = pwcache_get_optstr(buf, present, PWCACHE_HAS_PASSWD);
+#ifdef HAVE_LOGIN_CAP_H
+    pw.pw_class = pwcache_get_optstr(buf, present, PWCACHE_HAS_CLASS);
+#else
+    (void)pwcache_get_optstr(buf, present, PWCACHE_HAS_CLASS);
+#endif
+    pw.pw_gecos = pwcache_get_optstr(buf, present, PWCACHE_HAS_GECOS);
+    pw.pw_dir = pwcache_get_optstr(buf, present, PWCACHE_HAS_DIR);
+    pw.pw_shell = pwcache_get_optstr(buf, present, PWCACHE_HAS_SHELL);
+    if (buf->error || (kind == PWCACHE_PWUID && pw.pw_uid != key->k.uid))
+	debug_return_ptr(NULL);
+
+    debug_return_ptr(sudo_copy_pwitem(&pw,
+	kind == PWCACHE_PWNAM ? key->k.name : NULL));
+}
+
+/*
+ * Decode a group entry and copy it to a new cache item.
+ */
+static struct cache_item *
+pwcache_decode_gr(struct pwcache_buf *buf, unsigned int kind,
+    const struct cache_item *key)
+{
+    struct cache_item *item = NULL;
+    struct group gr;
+    uint32_t i, nmem, present;
+    debug_decl(pwcache_decode_gr, SUDOERS_DEBUG_NSS);
+
+    memset(&gr, 0, sizeof(gr));
+    present = pwcache_get_u32(buf);
+    gr.gr_gid = (gid_t)pwcache_get_u32(buf);
+    nmem = pwcache_get_u32(buf);
+    gr.gr_name = pwcache_get_optstr(buf, present, PWCACHE_HAS_NAME);
+    gr.gr_passwd = pwcache_get_optstr(buf, present, PWCACHE_HAS_PASSWD);
+    if (buf->error || (kind == PWCACHE_GRGID && gr.gr_gid != key->k.gid))
+	debug_return_ptr(NULL);
+    if (ISSET(present, PWCACHE_HAS_MEM)) {
+	/* Each member takes at least one byte. */
+	if (nmem > buf->size - buf->len)
+	    debug_return_ptr(NULL);
+	gr.gr_mem = reallocarray(NULL, nmem + 1, sizeof(char *));
+	if (gr.gr_mem == NULL)
+	    debug_return_ptr(NULL);
+	for (i = 0; i < nmem; i++)
+	    gr.gr_mem[i] = pwcache_get_str(buf);
+	gr.gr_mem[nmem] = NULL;
+	if (buf->error)
+	    goto done;
+    }
+
+    item = sudo_copy_gritem(&gr, kind == PWCACHE_GRNAM ? key->k.name : NULL);
+done:
+    free(gr.gr_mem);
+    debug_return_ptr(item);
+}
+
+/*
+ * Decode a group-ID list and copy it to a new cache item.
+ */
+static struct cache_item *
+pwcache_decode_gidlist(struct pwcache_buf *buf, const struct cache_item *key)
+{
+    struct cache_item *item;
+    GETGROUPS_T *gids;
+    uint32_t i, ngids;
+    debug_decl(pwcache_decode_gidlist, SUDOERS_DEBUG_NSS);
+
+    ngids = pwcache_get_u32(buf);
+    if (buf->error || ngids == 0 || ngids > INT_MAX ||
+	    ngids > (buf->size - buf->len) / sizeof(uint32_t))
+	debug_return_ptr(NULL);
+    gids = reallocarray(NULL, ngids, sizeof(GETGROUPS_T));
+    if (gids == NULL)
+	debug_return_ptr(NULL);
+    for (i = 0; i < ngids; i++)
+	gids[i] = (GETGROUPS_T)pwcache_get_u32(buf);
+
+    item = sudo_copy_gidlist_item(key->k.name, gids, (int)ngids,
+	ENTRY_TYPE_QUERIED);
+    free(gids);
+    debug_return_ptr(item);
+}
+
+/*
+ * Look up key in the shared cache.
+ * Returns true on a hit, storing a newly-allocated item (which may be
+ * a negative entry) in itemp.  Returns false on a miss or error.
+ */
+bool
+sudo_pwcache_get(unsigned int kind, const struct cache_item *key,
+    struct cache_item **itemp)
+{
+    char path[PATH_MAX];
+    struct pwcache_header hdr;
+    struct pwcache_buf buf = { NULL };
+    struct cache_item *item = NULL;
+    struct timespec now, age;
+    struct stat sb;
+    const char *keyname;
+    bool unusable = false;
+    ssize_t nread;
+    int fd;
+    debug_decl(sudo_pwcache_get, SUDOERS_DEBUG_NSS);
+
+    *itemp = NULL;
+    if (pwcache.dir == NULL || !pwcache_path(path, sizeof(path), kind, key))
+	debug_return_bool(false);
+    if ((fd = pwcache_open_file(path, &sb)) == -1)
+	debug_return_bool(false);
+
+    /* Read the whole entry at once. */
+    unusable = true;
+    if ((size_t)sb.st_size < sizeof(hdr))
+	goto done;
+    if ((buf.data = malloc(sb.st_size)) == NULL) {
+	unusable = false;
+	goto done;
+    }
+    nread = read(fd, buf.data, sb.st_size);
+    if (nread != sb.st_size)
+	goto done;
+    memcpy(&hdr, buf.data, sizeof(hdr));
+    if (hdr.magic != PWCACHE_MAGIC || hdr.version != PWCACHE_VERSION ||
+	    hdr.kind != kind || hdr.size != (size_t)sb.st_size - sizeof(hdr)) {
+	sudo_debug_printf(SUDO_DEBUG_WARN|SUDO_DEBUG_LINENO,
+	    "%s: invalid cache entry", path);
+	goto done;
+    }
+    if (hdr.generation != pwcache.generation) {
+	sudo_debug_printf(SUDO_DEBUG_DEBUG|SUDO_DEBUG_LINENO,
+	    "%s: stale generation %llu", path,
+	    (unsigned long long)hdr.generation);
+	goto done;
+    }
+    if (sudo_gettime_real(&now) == -1) {
+	unusable = false;
+	goto done;
+    }
+    age.tv_sec = now.tv_sec - hdr.created;
+    age.tv_nsec = 0;
+    if (hdr.created > now.tv_sec || sudo_timespeccmp(&age, &pwcache.ttl, >=)) {
+	sudo_debug_printf(SUDO_DEBUG_DEBUG|SUDO_DEBUG_LINENO,
+	    "%s: expired", path);
+	goto done;
+    }
+    unusable = false;
+    buf.len = sizeof(hdr);
+    buf.size = sb.st_size;
+
+    /* Check the key, the file name is not trusted to be unique. */
+    keyname = pwcache_get_str(&buf);
+    if (keyname == NULL || strcmp(keyname, pwcache_keyed_by_name(kind) ?
+	    key->k.name : "") != 0)
+	goto done;
+    keyname = pwcache_get_str(&buf);
+    if (keyname == NULL || strcmp(keyname, key->registry) != 0)
+	goto done;
+
+    switch (kind) {
+    case PWCACHE_PWUID:
+    case PWCACHE_PWNAM:
+	item = pwcache_decode_pw(&buf, kind, key);
+	break;
+    case PWCACHE_GRGID:
+    case PWCACHE_GRNAM:
+	item = pwcache_decode_gr(&buf, kind, key);
+	break;
+    case PWCACHE_GIDLIST:
+	item = pwcache_decode_gidlist(&buf, key);
+	break;
+    }
+    if (item != NULL) {
+	strlcpy(item->registry, key->registry, sizeof(item->registry));
+	sudo_debug_printf(SUDO_DEBUG_DEBUG|SUDO_DEBUG_LINENO,
+	    "%s: shared cache hit", path);
+    } else {
+	unusable = true;
+    }
+
+done:
+    close(fd);
+    free(buf.data);
+    if (unusable)
+	pwcache_remove_file(path);
+    *itemp = item;
+    debug_return_bool(item != NULL);
+}
+
+/*
+ * Store item in the shared cache under key.
+ * A NULL item or one without a datum (a negative entry) is not stored.
+ * Errors are not fatal, the entry is simply not cached.
+ */
+void
+sudo_pwcache_put(unsigned int kind, const struct cache_item *key,
+    const struct cache_item *item)
+{
+    char path[PATH_MAX];
+    struct pwcache_header hdr;
+    struct pwcache_buf buf = { NULL };
+    struct timespec now;
+    uint32_t present;
+    int i;
+    debug_decl(sudo_pwcache_put, SUDOERS_DEBUG_NSS);
+
+    if (pwcache.dir == NULL || !pwcache_path(path, sizeof(path), kind, key))
+	debug_return;
+    if (item == NULL || item->d.pw == NULL) {
+	sudo_debug_printf(SUDO_DEBUG_DEBUG|SUDO_DEBUG_LINENO,
+	    "%s: not caching negative entry", path);
+	debug_return;
+    }
+    if (sudo_gettime_real(&now) == -1)
+	debug_return;
+
+    memset(&hdr, 0, sizeof(hdr));
+    hdr.magic = PWCACHE_MAGIC;
+    hdr.version = PWCACHE_VERSION;
+    hdr.kind = kind;
+    hdr.generation = pwcache.generation;
+    hdr.created = now.tv_sec;
+    pwcache_put_bytes(&buf, &hdr, sizeof(hdr));
+    pwcache_put_str(&buf, pwcache_keyed_by_name(kind) ? key->k.name : "");
+    pwcache_put_str(&buf, key->registry);
+
+    switch (kind) {
+    case PWCACHE_PWUID:
+    case PWCACHE_PWNAM: {
+	const struct passwd *pw = item->d.pw;
+
+	/* Never store a real password hash. */
+	if (pw->pw_passwd != NULL && strlen(pw->pw_passwd) > 1) {
+	    sudo_debug_printf(SUDO_DEBUG_DEBUG|SUDO_DEBUG_LINENO,
+		"%s: not caching passwd entry with password", path);
+	    goto done;
+	}
+	present = 0;
+	if (pw->pw_name != NULL)
+	    SET(present, PWCACHE_HAS_NAME);
+	if (pw->pw_passwd != NULL)
+	    SET(present, PWCACHE_HAS_PASSWD);
+#ifdef HAVE_LOGIN_CAP_H
+	if (pw->pw_class != NULL)
+	    SET(present, PWCACHE_HAS_CLASS);
+#endif
+	if (pw->pw_gecos != NULL)
+	    SET(present, PWCACHE_HAS_GECOS);
+	if (pw->pw_dir != NULL)
+	    SET(present, PWCACHE_HAS_DIR);
+	if (pw->pw_shell != NULL)
+	    SET(present, PWCACHE_HAS_SHELL);
+	pwcache_put_u32(&buf, present);
+	pwcache_put_u32(&buf, (uint32_t)pw->pw_uid);
+	pwcache_put_u32(&buf, (uint32_t)pw->pw_gid);
+	pwcache_put_str(&buf, pw->pw_name);
+	pwcache_put_str(&buf, pw->pw_passwd);
+#ifdef HAVE_LOGIN_CAP_H
+	pwcache_put_str(&buf, pw->pw_class);
+#endif
+	pwcache_put_str(&buf, pw->pw_gecos);
+	pwcache_put_str(&buf, pw->pw_dir);
+	pwcache_put_str(&buf, pw->pw_shell);
+	break;
+    }
+    case PWCACHE_GRGID:
+    case PWCACHE_GRNAM: {
+	const struct group *gr = item->d.gr;
+	uint32_t nmem = 0;
+
+	present = 0;
+	if (gr->gr_name != NULL)
+	    SET(present, PWCACHE_HAS_NAME);
+	if (gr->gr_passwd != NULL)
+	    SET(present, PWCACHE_HAS_PASSWD);
+	if (gr->gr_mem != NULL) {
+	    SET(present, PWCACHE_HAS_MEM);
+	    while (gr->gr_mem[nmem] != NULL)
+		nmem++;
+	}
+	pwcache_put_u32(&buf, present);
+	pwcache_put_u32(&buf, (uint32_t)gr->gr_gid);
+	pwcache_put_u32(&buf, nmem);
+	pwcache_put_str(&buf, gr->gr_name);
+	pwcache_put_str(&buf, gr->gr_passwd);
+	for (i = 0; i < (int)nmem; i++)
+	    pwcache_put_str(&buf, gr->gr_mem[i]);
+	break;
+    }
+    case PWCACHE_GIDLIST: {
+	const struct gid_list *gidlist = item->d.gidlist;
+
+	pwcache_put_u32(&buf, (uint32_t)gidlist->ngids);
+	for (i = 0; i < gidlist->ngids; i++)
+	    pwcache_put_u32(&buf, (uint32_t)gidlist->gids[i]);
+	break;
+    }
+    default:
+	goto done;
+    }
+    if (buf.error) {
+	sudo_debug_printf(SUDO_DEBUG_WARN|SUDO_DEBUG_LINENO,
+	    "%s: unable to encode cache entry", path);
+	goto done;
+    }
+
+    /* Now that the size is known, update the header. */
+    hdr.size = buf.len - sizeof(hdr);
+    memcpy(buf.data, &hdr, sizeof(hdr));
+    if (sudo_cachedir_write_file(pwcache.dir, path, buf.data, buf.len)) {
+	sudo_debug_printf(SUDO_DEBUG_DEBUG|SUDO_DEBUG_LINENO,
+	    "%s: stored in shared cache", path);
+    }
+
+done:
+    free(buf.data);
+    debug_return;
+}
+
+/*
+ * Enable the shared passwd and group cache stored in dir.
+ * Entries older than ttl are ignored.  The directory is created
+ * if it does not already exist.  Must be called as root.
+ * Returns true on success, false if the cache cannot be used.
+ */
+bool
+sudo_pwcache_open(const char *dir, const struct timespec *ttl)
+{
+    debug_decl(sudo_pwcache_open, SUDOERS_DEBUG_NSS);
+
+    sudo_pwcache_close();
+    if (!sudo_cachedir_open(dir, ROOT_UID, ROOT_GID)) {
+	sudo_debug_printf(SUDO_DEBUG_INFO|SUDO_DEBUG_LINENO,
+	    "shared passwd and group cache disabled");
+	debug_return_bool(false);
+    }
+
+    if ((pwcache.dir = strdup(dir)) == NULL) {
+	sudo_warnx(U_("%s: %s"), __func__, U_("unable to allocate memory"));
+	debug_return_bool(false);
+    }
+    pwcache.ttl = *ttl;
+    pwcache_read_generation();
+    sudo_debug_printf(SUDO_DEBUG_INFO|SUDO_DEBUG_LINENO,
+	"using shared passwd and group cache %s, generation %llu",
+	pwcache.dir, (unsigned long long)pwcache.generation);
+
+    debug_return_bool(true);
+}
+
+/*
+ * Disable the shared passwd and group cache.
+ */
+void
+sudo_pwcache_close(void)
+{
+    debug_decl(sudo_pwcache_close, SUDOERS_DEBUG_NSS);
+
+    free(pwcache.dir);
+    memset(&pwcache, 0, sizeof(pwcache));
+
+    debug_return;
+}
+
+/*
+ * Remove the shared cache entries for pw, or all entries if pw is NULL.
+ * When removing all entries, the generation number is incremented
+ * first so that any entry we are unable to remove (or that is written
+ * concurrently by another sudo process) is no longer used.
+ * Returns true on success, else false.
+ */
+bool
+sudo_pwcache_purge(const struct passwd *pw)
+{
+    char path[PATH_MAX], buf[64];
+    char names[3][PATH_MAX];
+    struct cache_item key;
+    struct dirent *dent;
+    size_t len;
+    bool ret = true;
+    DIR *dir;
+    int i, n;
+    debug_decl(sudo_pwcache_purge, SUDOERS_DEBUG_NSS);
+
+    if (pwcache.dir == NULL)
+	debug_return_bool(true);
+
+    if (pw == NULL) {
+	n = snprintf(path, sizeof(path), "%s/%s", pwcache.dir,
+	    PWCACHE_GENERATION);
+	len = (size_t)snprintf(buf, sizeof(buf), "%llu\n",
+	    (unsigned long long)pwcache.generation + 1);
+	if (n < 0 || (size_t)n >= sizeof(path) ||
+		!sudo_cachedir_write_file(pwcache.dir, path, buf, len)) {
+	    sudo_warnx(U_("unable to update %s"), path);
+	    debug_return_bool(false);
+	}
+	pwcache.generation++;
+    } else {
+	/* Entries keyed by the user's uid and name (in any registry). */
+	memset(&key, 0, sizeof(key));
+	len = strlen(pwcache.dir) + 1;
+	key.k.uid = pw->pw_uid;
+	if (!pwcache_path(path, sizeof(path), PWCACHE_PWUID, &key))
+	    debug_return_bool(false);
+	strlcpy(names[0], path + len, sizeof(names[0]));
+	key.k.name = pw->pw_name;
+	if (!pwcache_path(path, sizeof(path), PWCACHE_PWNAM, &key))
+	    debug_return_bool(false);
+	strlcpy(names[1], path + len, sizeof(names[1]));
+	if (!pwcache_path(path, sizeof(path), PWCACHE_GIDLIST, &key))
+	    debug_return_bool(false);
+	strlcpy(names[2], path + len, sizeof(names[2]));
+    }
+
+    if ((dir = opendir(pwcache.dir)) == NULL) {
+	sudo_warn(U_("unable to open %s"), pwcache.dir);
+	debug_return_bool(false);
+    }
+    while ((dent = readdir(dir)) != NULL) {
+	if (pw == NULL) {
+	    /* Skip ".", ".." and the generation file. */
+	    for (i = 1; i < (int)nitems(pwcache_prefix); i++) {
+		if (strncmp(dent->d_name, pwcache_prefix[i],
+			strlen(pwcache_prefix[i])) == 0)
+		    break;
+	    }
+	    if (i == (int)nitems(pwcache_prefix))
+		continue;
+	} else {
+	    for (i = 0; i < 3; i++) {
+		len = strlen(names[i]);
+		if (strncmp(dent->d_name, names[i], len) == 0 &&
+			(dent->d_name[len] == '\0' || dent->d_name[len] == '@'))
+		    break;
+	    }
+	    if (i == 3)
+		continue;
+	}
+	n = snprintf(path, sizeof(path), "%s/%s", pwcache.dir, dent->d_name);
+	if (n < 0 || (size_t)n >= sizeof(path))
+	    continue;
+	if (unlink(path) != 0 && errno != ENOENT) {
+	    sudo_debug_printf(SUDO_DEBUG_WARN|SUDO_DEBUG_ERRNO|SUDO_DEBUG_LINENO,
+		"unable to remove %s", path);
+	    ret = false;
+	}
+    }
+    closedir(dir);
+
+    debug_return_bool(ret);
+}
@@ -209,23 +209,27 @@ sudo_getpwuid(uid_t uid)
     }
     /*
      * Cache passwd db entry if it exists or a negative response if not.
+     * The shared cache, if enabled, is checked before the passwd db.
      */
+    if (!sudo_pwcache_get(PWCACHE_PWUID, &key, &item)) {
 #ifdef HAVE_SETAUTHDB
-    aix_setauthdb(IDtouser(uid), key.registry);
+	aix_setauthdb(IDtouser(uid), key.registry);
 #endif
-    item = make_pwitem(uid, NULL);
+	item = make_pwitem(uid, NULL);
 #ifdef HAVE_SETAUTHDB
-    aix_restoreauthdb();
+	aix_restoreauthdb();
 #endif
-    if (item == NULL) {
-	if (errno != ENOENT || (item = calloc(1, sizeof(*item))) == NULL) {
-	    sudo_warn(U_("unable to cache uid %u"), (unsigned int) uid);
-	    /* cppcheck-suppress memleak */
-	    debug_return_ptr(NULL);
+	if (item == NULL) {
+	    if (errno != ENOENT || (item = calloc(1, sizeof(*item))) == NULL) {
+		sudo_warn(U_("unable to cache uid %u"), (unsigned int) uid);
+		/* cppcheck-suppress memleak */
+		debug_return_ptr(NULL);
+	    }
+	    item->refcnt = 1;
+	    item->k.uid = uid;
+	    /* item->d.pw = NULL; */
 	}
-	item->refcnt = 1;
-	item->k.uid = uid;
-	/* item->d.pw = NULL; */
+	sudo_pwcache_put(PWCACHE_PWUID, &key, item);
     }
     strlcpy(item->registry, key.registry, sizeof(item->registry));
     switch (rbinsert(pwcache_byuid, item, NULL)) {
@@ -280,25 +284,29 @@ sudo_getpwnam(const char *name)
     }
     /*
      * Cache passwd db entry if it exists or a negative response if not.
+     * The shared cache, if enabled, is checked before the passwd db.
      */
+    if (!sudo_pwcache_get(PWCACHE_PWNAM, &key, &item)) {
 #ifdef HAVE_SETAUTHDB
-    aix_setauthdb((char *) name, key.registry);
+	aix_setauthdb((char *) name, key.registry);
 #endif
-    item = make_pwitem((uid_t)-1, name);
+	item = make_pwitem((uid_t)-1, name);
 #ifdef HAVE_SETAUTHDB
-    aix_restoreauthdb();
+	aix_restoreauthdb();
 #endif
-    if (item == NULL) {
-	const size_t len = strlen(name) + 1;
-	if (errno != ENOENT || (item = calloc(1, sizeof(*item) + len)) == NULL) {
-	    sudo_warn(U_("unable to cache user %s"), name);
-	    /* cppcheck-suppress memleak */
-	    debug_return_ptr(NULL);
+	if (item == NULL) {
+	    const size_t len = strlen(name) + 1;
+	    if (errno != ENOENT || (item = calloc(1, sizeof(*item) + len)) == NULL) {
+		sudo_warn(U_("unable to cache user %s"), name);
+		/* cppcheck-suppress memleak */
+		debug_return_ptr(NULL);
+	    }
+	    item->refcnt = 1;
+	    item->k.name = (char *) item + sizeof(*item);
+	    memcpy(item->k.name, name, len);
+	    /* item->d.pw = NULL; */
 	}
-	item->refcnt = 1;
-	item->k.name = (char *) item + sizeof(*item);
-	memcpy(item->k.name, name, len);
-	/* item->d.pw = NULL; */
+	sudo_pwcache_put(PWCACHE_PWNAM, &key, item);
     }
     strlcpy(item->registry, key.registry, sizeof(item->registry));
     switch (rbinsert(pwcache_byname, item, NULL)) {
@@ -532,17 +540,21 @@ sudo_getgrgid(gid_t gid)
     }
     /*
      * Cache group db entry if it exists or a negative response if not.
+     * The shared cache, if enabled, is checked before the group db.
      */
-    item = make_gritem(gid, NULL);
-    if (item == NULL) {
-	if (errno != ENOENT || (item = calloc(1, sizeof(*item))) == NULL) {
-	    sudo_warn(U_("unable to cache gid %u"), (unsigned int) gid);
-	    /* cppcheck-suppress memleak */
-	    debug_return_ptr(NULL);
+    if (!sudo_pwcache_get(PWCACHE_GRGID, &key, &item)) {
+	item = make_gritem(gid, NULL);
+	if (item == NULL) {
+	    if (errno != ENOENT || (item = calloc(1, sizeof(*item))) == NULL) {
+		sudo_warn(U_("unable to cache gid %u"), (unsigned int) gid);
+		/* cppcheck-suppress memleak */
+		debug_return_ptr(NULL);
+	    }
+	    item->refcnt = 1;
+	    item->k.gid = gid;
+	    /* item->d.gr = NULL; */
 	}
-	item->refcnt = 1;
-	item->k.gid = gid;
-	/* item->d.gr = NULL; */
+	sudo_pwcache_put(PWCACHE_GRGID, &key, item);
     }
     strlcpy(item->registry, key.registry, sizeof(item->registry));
     switch (rbinsert(grcache_bygid, item, NULL)) {
@@ -596,19 +608,23 @@ sudo_getgrnam(const char *name)
     }
     /*
      * Cache group db entry if it exists or a negative response if not.
+     * The shared cache, if enabled, is checked before the group db.
      */
-    item = make_gritem((gid_t)-1, name);
-    if (item == NULL) {
-	const size_t len = strlen(name) + 1;
-	if (errno != ENOENT || (item = calloc(1, sizeof(*item) + len)) == NULL) {
-	    sudo_warn(U_("unable to cache group %s"), name);
-	    /* cppcheck-suppress memleak */
-	    debug_return_ptr(NULL);
+    if (!sudo_pwcache_get(PWCACHE_GRNAM, &key, &item)) {
+	item = make_gritem((gid_t)-1, name);
+	if (item == NULL) {
+	    const size_t len = strlen(name) + 1;
+	    if (errno != ENOENT || (item = calloc(1, sizeof(*item) + len)) == NULL) {
+		sudo_warn(U_("unable to cache group %s"), name);
+		/* cppcheck-suppress memleak */
+		debug_return_ptr(NULL);
+	    }
+	    item->refcnt = 1;
+	    item->k.name = (char *) item + sizeof(*item);
+	    memcpy(item->k.name, name, len);
+	    /* item->d.gr = NULL; */
 	}
-	item->refcnt = 1;
-	item->k.name = (char *) item + sizeof(*item);
-	memcpy(item->k.name, name, len);
-	/* item->d.gr = NULL; */
+	sudo_pwcache_put(PWCACHE_GRNAM, &key, item);
     }
     strlcpy(item->registry, key.registry, sizeof(item->registry));
     switch (rbinsert(grcache_byname, item, NULL)) {
@@ -901,11 +917,31 @@ sudo_set_grlist(struct passwd *pw, char * const *groups)
     debug_return_int(0);
 }
 
+/*
+ * Returns true if the group-IDs for pw of the specified type will be
+ * queried from the group database rather than taken from the front-end.
+ * Only queried lists are stored in the shared cache since the front-end's
+ * list is specific to the current process.
+ */
+static bool
+gidlist_is_queried(const struct passwd *pw, unsigned int type)
+{
+    switch (type) {
+    case ENTRY_TYPE_QUERIED:
+	return true;
+    case ENTRY_TYPE_ANY:
+	return pw != sudo_user.pw || sudo_user.gids == NULL;
+    default:
+	return false;
+    }
+}
+
 struct gid_list *
 sudo_get_gidlist(const struct passwd *pw, unsigned int type)
 {
     struct cache_item key, *item;
     struct rbnode *node;
+    bool shared;
     debug_decl(sudo_get_gidlist, SUDOERS_DEBUG_NSS);
 
     sudo_debug_printf(SUDO_DEBUG_DEBUG, "%s: looking up group-IDs for %s",
@@ -928,11 +964,18 @@ sudo_get_gidlist(const struct passwd *pw, unsigned int type)
     }
     /*
      * Cache group db entry if it exists or a negative response if not.
+     * Group-IDs queried from the group db may be in the shared cache,
+     * unless pw was faked up from a "#uid" that anyone may choose.
      */
-    item = make_gidlist_item(pw, NULL, type);
-    if (item == NULL) {
-	/* Out of memory? */
-	debug_return_ptr(NULL);
+    shared = gidlist_is_queried(pw, type) && pw->pw_name[0] != '#';
+    if (!shared || !sudo_pwcache_get(PWCACHE_GIDLIST, &key, &item)) {
+	item = make_gidlist_item(pw, NULL, type);
+	if (item == NULL) {
+	    /* Out of memory? */
+	    debug_return_ptr(NULL);
+	}
+	if (shared && item->type == ENTRY_TYPE_QUERIED)
+	    sudo_pwcache_put(PWCACHE_GIDLIST, &key, item);
     }
     strlcpy(item->registry, key.registry, sizeof(item->registry));
     switch (rbinsert(gidlist_cache, item, NULL)) {
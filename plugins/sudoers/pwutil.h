@@ -69,9 +69,25 @@ struct cache_item_gidlist {
     /* actually bigger */
 };
 
+/*
+ * Entry types stored in the shared cache.
+ */
+#define PWCACHE_PWUID		1
+#define PWCACHE_PWNAM		2
+#define PWCACHE_GRGID		3
+#define PWCACHE_GRNAM		4
+#define PWCACHE_GIDLIST		5
+
 struct cache_item *sudo_make_gritem(gid_t gid, const char *group);
 struct cache_item *sudo_make_grlist_item(const struct passwd *pw, char * const *groups);
 struct cache_item *sudo_make_gidlist_item(const struct passwd *pw, char * const *gids, unsigned int type);
 struct cache_item *sudo_make_pwitem(uid_t uid, const char *user);
+struct cache_item *sudo_copy_gritem(const struct group *gr, const char *group);
+struct cache_item *sudo_copy_gidlist_item(const char *user, const GETGROUPS_T *gids, int ngids, unsigned int type);
+struct cache_item *sudo_copy_pwitem(const struct passwd *pw, const char *user);
+
+/* pwcache.c */
+bool sudo_pwcache_get(unsigned int kind, const struct cache_item *key, struct cache_item **itemp);
+void sudo_pwcache_put(unsigned int kind, const struct cache_item *key, const struct cache_item *item);
 
 #endif /* SUDOERS_PWUTIL_H */
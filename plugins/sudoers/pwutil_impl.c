@@ -82,11 +82,7 @@ do {							\
 struct cache_item *
 sudo_make_pwitem(uid_t uid, const char *name)
 {
-    char *cp;
-    const char *pw_shell;
-    size_t nsize, psize, csize, gsize, dsize, ssize, total;
-    struct cache_item_pw *pwitem;
-    struct passwd *pw, *newpw;
+    struct passwd *pw;
     debug_decl(sudo_make_pwitem, SUDOERS_DEBUG_NSS);
 
     /* Look up by name or uid. */
@@ -96,6 +92,24 @@ sudo_make_pwitem(uid_t uid, const char *name)
 	debug_return_ptr(NULL);
     }
 
+    debug_return_ptr(sudo_copy_pwitem(pw, name));
+}
+
+/*
+ * Copy an existing struct passwd into a newly-allocated cache item.
+ * If name is non-NULL it is used as the key, else the uid is the key.
+ * Returns NULL on calloc error.
+ */
+struct cache_item *
+sudo_copy_pwitem(const struct passwd *pw, const char *name)
+{
+    char *cp;
+    const char *pw_shell;
+    size_t nsize, psize, csize, gsize, dsize, ssize, total;
+    struct cache_item_pw *pwitem;
+    struct passwd *newpw;
+    debug_decl(sudo_copy_pwitem, SUDOERS_DEBUG_NSS);
+
     /* If shell field is empty, expand to _PATH_BSHELL. */
     pw_shell = (pw->pw_shell == NULL || pw->pw_shell[0] == '\0')
 	? _PATH_BSHELL : pw->pw_shell;
@@ -165,10 +179,7 @@ sudo_make_pwitem(uid_t uid, const char *name)
 struct cache_item *
 sudo_make_gritem(gid_t gid, const char *name)
 {
-    char *cp;
-    size_t nsize, psize, nmem, total, len;
-    struct cache_item_gr *gritem;
-    struct group *gr, *newgr;
+    struct group *gr;
     debug_decl(sudo_make_gritem, SUDOERS_DEBUG_NSS);
 
     /* Look up by name or gid. */
@@ -178,6 +189,23 @@ sudo_make_gritem(gid_t gid, const char *name)
 	debug_return_ptr(NULL);
     }
 
+    debug_return_ptr(sudo_copy_gritem(gr, name));
+}
+
+/*
+ * Copy an existing struct group into a newly-allocated cache item.
+ * If name is non-NULL it is used as the key, else the gid is the key.
+ * Returns NULL on calloc error.
+ */
+struct cache_item *
+sudo_copy_gritem(const struct group *gr, const char *name)
+{
+    char *cp;
+    size_t nsize, psize, nmem, total, len;
+    struct cache_item_gr *gritem;
+    struct group *newgr;
+    debug_decl(sudo_copy_gritem, SUDOERS_DEBUG_NSS);
+
     /* Allocate in one big chunk for easy freeing. */
     nsize = psize = nmem = 0;
     total = sizeof(*gritem);
@@ -241,12 +269,9 @@ struct cache_item *
 sudo_make_gidlist_item(const struct passwd *pw, char * const *unused1,
     unsigned int type)
 {
-    char *cp;
-    size_t nsize, total;
-    struct cache_item_gidlist *glitem;
-    struct gid_list *gidlist;
+    struct cache_item *item;
     GETGROUPS_T *gids;
-    int i, ngids;
+    int ngids;
     debug_decl(sudo_make_gidlist_item, SUDOERS_DEBUG_NSS);
 
     /* Don't use user_gids if the entry type says we must query the db. */
@@ -282,15 +307,36 @@ sudo_make_gidlist_item(const struct passwd *pw, char * const *unused1,
 	debug_return_ptr(NULL);
     }
 
+    item = sudo_copy_gidlist_item(pw->pw_name, gids, ngids, type);
+    free(gids);
+
+    debug_return_ptr(item);
+}
+
+/*
+ * Copy a list of group-IDs into a newly-allocated cache item
+ * keyed by the user name.
+ * Returns NULL on calloc error.
+ */
+struct cache_item *
+sudo_copy_gidlist_item(const char *name, const GETGROUPS_T *gids, int ngids,
+    unsigned int type)
+{
+    char *cp;
+    size_t nsize, total;
+    struct cache_item_gidlist *glitem;
+    struct gid_list *gidlist;
+    int i;
+    debug_decl(sudo_copy_gidlist_item, SUDOERS_DEBUG_NSS);
+
     /* Allocate in one big chunk for easy freeing. */
-    nsize = strlen(pw->pw_name) + 1;
+    nsize = strlen(name) + 1;
     total = sizeof(*glitem) + nsize;
     total += sizeof(gid_t *) * ngids;
 
     if ((glitem = calloc(1, total)) == NULL) {
 	sudo_debug_printf(SUDO_DEBUG_ERROR|SUDO_DEBUG_LINENO,
 	    "unable to allocate memory");
-	free(gids);
 	debug_return_ptr(NULL);
     }
 
@@ -305,7 +351,7 @@ sudo_make_gidlist_item(const struct passwd *pw, char * const *unused1,
     cp += sizeof(gid_t) * ngids;
 
     /* Set key and datum. */
-    memcpy(cp, pw->pw_name, nsize);
+    memcpy(cp, name, nsize);
     glitem->cache.k.name = cp;
     glitem->cache.d.gidlist = gidlist;
     glitem->cache.refcnt = 1;
@@ -317,7 +363,6 @@ sudo_make_gidlist_item(const struct passwd *pw, char * const *unused1,
     for (i = 0; i < ngids; i++)
 	gidlist->gids[i] = gids[i];
     gidlist->ngids = ngids;
-    free(gids);
 
     debug_return_ptr(&glitem->cache);
 }
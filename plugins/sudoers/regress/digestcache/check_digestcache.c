@@ -0,0 +1,352 @@
+/*
+ * SPDX-License-Identifier: ISC
+ *
+ * Copyright (c) 2020 Todd C. Miller <Todd.Miller@sudo.ws>
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include <config.h>
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <stdio.h>
+#include <stdlib.h>
+#ifdef HAVE_STRING_H
+# include <string.h>
+#endif /* HAVE_STRING_H */
+#ifdef HAVE_STRINGS_H
+# include <strings.h>
+#endif /* HAVE_STRINGS_H */
+#include <unistd.h>
+#include <dirent.h>
+#include <fcntl.h>
+
+#define SUDO_ERROR_WRAP 0
+
+#include "sudoers.h"
+
+/*
+ * The cache only trusts files owned by root.  Use the invoking user
+ * instead so the test does not need to be run as root.
+ */
+static uid_t test_uid;
+#undef ROOT_UID
+#define ROOT_UID test_uid
+
+#include "digestcache.c"
+
+__dso_public int main(int argc, char *argv[]);
+
+/*
+ * Build the status of a command that was last changed well outside
+ * the window in which the cache refuses to store a digest.
+ */
+static void
+fake_stat(struct stat *sb)
+{
+    time_t now = time(NULL);
+
+    memset(sb, 0, sizeof(*sb));
+    sb->st_dev = 0x801;
+    sb->st_ino = 123456;
+    sb->st_mode = S_IFREG|0755;
+    sb->st_size = 4096;
+    sb->st_mtime = now - 3600;
+    sb->st_ctime = now - 3600;
+}
+
+static void
+fake_digest(unsigned char *digest, size_t len, int seed)
+{
+    size_t i;
+
+    for (i = 0; i < len; i++)
+	digest[i] = (unsigned char)(seed + i);
+}
+
+/*
+ * Returns true if the cache has a digest for sb that matches digest.
+ */
+static bool
+cache_hit(const struct stat *sb, int digest_type,
+    const unsigned char *digest, size_t len)
+{
+    unsigned char *cached;
+    size_t cached_len = 0;
+    bool ret;
+
+    cached = sudo_digestcache_get(sb, digest_type, &cached_len);
+    if (cached == NULL)
+	return false;
+    ret = cached_len == len && memcmp(cached, digest, len) == 0;
+    free(cached);
+    return ret;
+}
+
+static void
+check_hit(const char *func, const char *what, const struct stat *sb,
+    const unsigned char *digest, size_t len, bool want,
+    int *ntests, int *nerrors)
+{
+    (*ntests)++;
+    if (cache_hit(sb, SUDO_DIGEST_SHA256, digest, len) != want) {
+	sudo_warnx_nodebug("%s: %s: expected a cache %s", func, what,
+	    want ? "hit" : "miss");
+	(*nerrors)++;
+    }
+}
+
+/*
+ * Read the raw cache entry for sb, or write it back in place.
+ */
+static bool
+rw_entry(const struct stat *sb, struct digestcache_entry *entry, bool store)
+{
+    char path[PATH_MAX];
+    ssize_t nread;
+    int fd;
+
+    if (!digestcache_path(path, sizeof(path), sb, SUDO_DIGEST_SHA256))
+	return false;
+    fd = open(path, store ? O_WRONLY|O_TRUNC : O_RDONLY);
+    if (fd == -1)
+	return false;
+    if (store)
+	nread = write(fd, entry, sizeof(*entry));
+    else
+	nread = read(fd, entry, sizeof(*entry));
+    close(fd);
+    return nread == (ssize_t)sizeof(*entry);
+}
+
+/*
+ * A stored digest is returned only while the command's size,
+ * modification time and change time are unchanged.
+ */
+static void
+test_invalidate(int *ntests, int *nerrors)
+{
+    unsigned char digest[32];
+    struct stat sb, sb2;
+
+    fake_stat(&sb);
+    fake_digest(digest, sizeof(digest), 1);
+    sudo_digestcache_put(&sb, SUDO_DIGEST_SHA256, digest, sizeof(digest));
+    check_hit(__func__, "stored entry", &sb, digest, sizeof(digest),
+	true, ntests, nerrors);
+
+    /* The digest type is part of the key. */
+    (*ntests)++;
+    if (cache_hit(&sb, SUDO_DIGEST_SHA512, digest, sizeof(digest))) {
+	sudo_warnx_nodebug("%s: hit for the wrong digest type", __func__);
+	(*nerrors)++;
+    }
+
+    sb2 = sb;
+    sb2.st_size++;
+    check_hit(__func__, "size changed", &sb2, digest, sizeof(digest),
+	false, ntests, nerrors);
+
+    sb2 = sb;
+    sb2.st_mtime++;
+    check_hit(__func__, "mtime changed", &sb2, digest, sizeof(digest),
+	false, ntests, nerrors);
+
+    sb2 = sb;
+    sb2.st_ctime++;
+    check_hit(__func__, "ctime changed", &sb2, digest, sizeof(digest),
+	false, ntests, nerrors);
+
+    /* The original entry is still usable. */
+    check_hit(__func__, "unchanged", &sb, digest, sizeof(digest),
+	true, ntests, nerrors);
+
+    /* A newer digest replaces the old one. */
+    sb2 = sb;
+    sb2.st_mtime++;
+    sb2.st_ctime++;
+    fake_digest(digest, sizeof(digest), 2);
+    sudo_digestcache_put(&sb2, SUDO_DIGEST_SHA256, digest, sizeof(digest));
+    check_hit(__func__, "replaced entry", &sb2, digest, sizeof(digest),
+	true, ntests, nerrors);
+    check_hit(__func__, "old key after replace", &sb, digest, sizeof(digest),
+	false, ntests, nerrors);
+
+    /* A file changed in the last few seconds is not cached. */
+    sb2 = sb;
+    sb2.st_ino++;
+    sb2.st_ctime = time(NULL);
+    sudo_digestcache_put(&sb2, SUDO_DIGEST_SHA256, digest, sizeof(digest));
+    check_hit(__func__, "recently changed", &sb2, digest, sizeof(digest),
+	false, ntests, nerrors);
+}
+
+/*
+ * Cache files with the wrong owner, mode or length and entries
+ * with the wrong digest length are ignored.
+ */
+static void
+test_reject(int *ntests, int *nerrors)
+{
+    struct digestcache_entry entry, orig;
+    unsigned char digest[32];
+    char path[PATH_MAX];
+    struct stat sb;
+    int fd;
+
+    fake_stat(&sb);
+    sb.st_ino += 100;
+    fake_digest(digest, sizeof(digest), 3);
+    sudo_digestcache_put(&sb, SUDO_DIGEST_SHA256, digest, sizeof(digest));
+    if (!digestcache_path(path, sizeof(path), &sb, SUDO_DIGEST_SHA256) ||
+	    !rw_entry(&sb, &orig, false)) {
+	sudo_warnx_nodebug("%s: unable to read cache entry", __func__);
+	(*ntests)++;
+	(*nerrors)++;
+	return;
+    }
+    check_hit(__func__, "stored entry", &sb, digest, sizeof(digest),
+	true, ntests, nerrors);
+
+    /* Owned by someone other than the trusted user. */
+    test_uid++;
+    check_hit(__func__, "wrong owner", &sb, digest, sizeof(digest),
+	false, ntests, nerrors);
+    test_uid--;
+
+    /* Writable by group or other. */
+    if (chmod(path, S_IRUSR|S_IWUSR|S_IWGRP) == 0) {
+	check_hit(__func__, "group writable", &sb, digest, sizeof(digest),
+	    false, ntests, nerrors);
+	(void)chmod(path, S_IRUSR|S_IWUSR);
+    }
+
+    /* Truncated and overlong files. */
+    if (truncate(path, sizeof(orig) - 1) == 0) {
+	check_hit(__func__, "short file", &sb, digest, sizeof(digest),
+	    false, ntests, nerrors);
+    }
+    fd = open(path, O_WRONLY|O_APPEND);
+    if (fd != -1) {
+	if (write(fd, "xx", 2) == 2) {
+	    check_hit(__func__, "long file", &sb, digest, sizeof(digest),
+		false, ntests, nerrors);
+	}
+	close(fd);
+    }
+
+    /* A digest length that doesn't match the digest type. */
+    entry = orig;
+    entry.digest_len = sizeof(digest) - 1;
+    if (rw_entry(&sb, &entry, true)) {
+	check_hit(__func__, "short digest", &sb, digest, sizeof(digest) - 1,
+	    false, ntests, nerrors);
+    }
+    entry.digest_len = DIGESTCACHE_MAX_LEN + 1;
+    if (rw_entry(&sb, &entry, true)) {
+	check_hit(__func__, "oversized digest", &sb, digest, sizeof(digest),
+	    false, ntests, nerrors);
+    }
+
+    /* Bad magic number and version. */
+    entry = orig;
+    entry.magic = ~entry.magic;
+    if (rw_entry(&sb, &entry, true)) {
+	check_hit(__func__, "bad magic", &sb, digest, sizeof(digest),
+	    false, ntests, nerrors);
+    }
+    entry = orig;
+    entry.version++;
+    if (rw_entry(&sb, &entry, true)) {
+	check_hit(__func__, "bad version", &sb, digest, sizeof(digest),
+	    false, ntests, nerrors);
+    }
+
+    /* Restoring the original entry makes it usable again. */
+    if (rw_entry(&sb, &orig, true)) {
+	check_hit(__func__, "restored entry", &sb, digest, sizeof(digest),
+	    true, ntests, nerrors);
+    }
+
+    /* A symbolic link to a valid entry is not followed. */
+    sb.st_ino++;
+    sudo_digestcache_put(&sb, SUDO_DIGEST_SHA256, digest, sizeof(digest));
+    if (digestcache_path(path, sizeof(path), &sb, SUDO_DIGEST_SHA256)) {
+	char target[PATH_MAX];
+	int len;
+
+	len = snprintf(target, sizeof(target), "%s.target", path);
+	if (len > 0 && (size_t)len < sizeof(target) &&
+		rename(path, target) == 0 && symlink(target, path) == 0) {
+	    check_hit(__func__, "symbolic link", &sb, digest, sizeof(digest),
+		false, ntests, nerrors);
+	}
+    }
+}
+
+/*
+ * Remove everything in the cache directory, then the directory itself.
+ */
+static bool
+remove_cache(const char *dir)
+{
+    char path[PATH_MAX];
+    struct dirent *dp;
+    DIR *d;
+
+    if ((d = opendir(dir)) == NULL)
+	return false;
+    while ((dp = readdir(d)) != NULL) {
+	if (strcmp(dp->d_name, ".") == 0 || strcmp(dp->d_name, "..") == 0)
+	    continue;
+	(void)snprintf(path, sizeof(path), "%s/%s", dir, dp->d_name);
+	(void)unlink(path);
+    }
+    closedir(d);
+    return rmdir(dir) == 0;
+}
+
+int
+main(int argc, char *argv[])
+{
+    char dir[] = "/tmp/check_digestcache.XXXXXX";
+    int tests = 0, errors = 0;
+
+    initprogname(argc > 0 ? argv[0] : "check_digestcache");
+
+    test_uid = geteuid();
+
+    if (mkdtemp(dir) == NULL)
+	sudo_fatal_nodebug("mkdtemp");
+    if (!sudo_digestcache_open(dir)) {
+	sudo_warnx_nodebug("unable to open cache dir %s", dir);
+	errors++;
+    } else {
+	test_invalidate(&tests, &errors);
+	test_reject(&tests, &errors);
+	sudo_digestcache_close();
+    }
+    if (!remove_cache(dir)) {
+	sudo_warn_nodebug("unable to remove %s", dir);
+	errors++;
+    }
+
+    if (tests != 0) {
+	printf("check_digestcache: %d test%s run, %d errors, %d%% success rate\n",
+	    tests, tests == 1 ? "" : "s", errors,
+	    (tests - errors) * 100 / tests);
+    }
+
+    exit(errors);
+}
@@ -34,12 +34,52 @@
 
 __dso_public int main(int argc, char *argv[]);
 
+/*
+ * Check var against a list of patterns one at a time, like sudoers
+ * did before the lists were compiled.
+ */
+static int
+linear_match(struct list_members *list, const char *var)
+{
+    struct list_member *cur;
+    bool full_match = false;
+
+    SLIST_FOREACH(cur, list, entries) {
+	if (matches_env_pattern(cur->value, var, &full_match))
+	    return full_match ? 2 : 1;
+    }
+    return 0;
+}
+
+/*
+ * Check var against a compiled list of patterns.
+ */
+static int
+filter_match(struct list_members *list, const char *var)
+{
+    struct env_filter *filter;
+    bool full_match = false;
+    int ret = 0;
+
+    if ((filter = env_filter_compile(list)) == NULL) {
+	fprintf(stderr, "%s: unable to compile patterns\n", getprogname());
+	exit(EXIT_FAILURE);
+    }
+    if (env_filter_match(filter, var, &full_match))
+	ret = full_match ? 2 : 1;
+    env_filter_free(filter);
+    return ret;
+}
+
 int
 main(int argc, char *argv[])
 {
     FILE *fp = stdin;
     char pattern[1024], string[1024];
-    int errors = 0, tests = 0, got, want;
+    struct list_members patterns = SLIST_HEAD_INITIALIZER(patterns);
+    struct list_member *lm, *last = NULL;
+    char **strings = NULL;
+    int errors = 0, tests = 0, nstrings = 0, got, want, i;
 
     initprogname(argc > 0 ? argv[0] : "check_env_pattern");
 
@@ -57,6 +97,8 @@ main(int argc, char *argv[])
      *
      */
     for (;;) {
+	struct list_members single = SLIST_HEAD_INITIALIZER(single);
+	struct list_member member;
 	bool full_match = false;
 
 	got = fscanf(fp, "%s %s %d\n", pattern, string, &want);
@@ -73,8 +115,54 @@ main(int argc, char *argv[])
 		errors++;
 	    }
 	    tests++;
+
+	    /* A compiled list of one pattern must give the same result. */
+	    member.value = pattern;
+	    SLIST_INSERT_HEAD(&single, &member, entries);
+	    got = filter_match(&single, string);
+	    if (got != want) {
+		fprintf(stderr,
+		    "%s: %s %s (compiled): want %d, got %d\n",
+		    getprogname(), pattern, string, want, got);
+		errors++;
+	    }
+	    tests++;
+
+	    /* Save the pattern and string for the combined test below. */
+	    lm = calloc(1, sizeof(*lm));
+	    strings = reallocarray(strings, nstrings + 1, sizeof(char *));
+	    if (lm == NULL || strings == NULL ||
+		    (lm->value = strdup(pattern)) == NULL ||
+		    (strings[nstrings] = strdup(string)) == NULL) {
+		fprintf(stderr, "%s: unable to allocate memory\n",
+		    getprogname());
+		exit(EXIT_FAILURE);
+	    }
+	    nstrings++;
+	    if (last == NULL)
+		SLIST_INSERT_HEAD(&patterns, lm, entries);
+	    else
+		SLIST_INSERT_AFTER(last, lm, entries);
+	    last = lm;
 	}
     }
+
+    /*
+     * With all the patterns in a single list, the first one to
+     * match determines the result, as with a linear search.
+     */
+    for (i = 0; i < nstrings; i++) {
+	want = linear_match(&patterns, strings[i]);
+	got = filter_match(&patterns, strings[i]);
+	if (got != want) {
+	    fprintf(stderr,
+		"%s: %s (all patterns): want %d, got %d\n",
+		getprogname(), strings[i], want, got);
+	    errors++;
+	}
+	tests++;
+    }
+
     if (tests != 0) {
 	printf("%s: %d test%s run, %d errors, %d%% success rate\n",
 	    getprogname(), tests, tests == 1 ? "" : "s", errors,
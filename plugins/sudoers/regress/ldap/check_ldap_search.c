@@ -0,0 +1,436 @@
+/*
+ * SPDX-License-Identifier: ISC
+ *
+ * Copyright (c) 2020 Todd C. Miller <Todd.Miller@sudo.ws>
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include <config.h>
+
+#include <sys/types.h>
+#include <sys/time.h>
+#include <stdio.h>
+#include <stdlib.h>
+#ifdef HAVE_STRING_H
+# include <string.h>
+#endif /* HAVE_STRING_H */
+#ifdef HAVE_STRINGS_H
+# include <strings.h>
+#endif /* HAVE_STRINGS_H */
+#include <unistd.h>
+
+#define SUDO_ERROR_WRAP 0
+
+/*
+ * Test the asynchronous search path against the stand-in <ldap.h>
+ * in this directory, regardless of the LDAP library that was found.
+ */
+#undef HAVE_LBER_H
+#ifndef HAVE_LDAP_SEARCH_EXT_S
+# define HAVE_LDAP_SEARCH_EXT_S 1
+#endif
+
+#include "ldap_search.c"
+
+struct ldap_config ldap_conf;
+
+__dso_public int main(int argc, char *argv[]);
+
+/*
+ * A fake LDAP server.  The search base selects the outcome:
+ * "ou=fail" cannot be sent, "ou=noent" fails on the server,
+ * "ou=lost" loses the connection, "ou=slow" never completes
+ * and anything else succeeds.
+ */
+struct ldapmsg {
+    int msgid;
+    int rc;
+};
+
+#define MAX_SEARCHES	16
+
+static struct mock_ldap {
+    const char *bases[MAX_SEARCHES];	/* indexed by msgid */
+    bool outstanding[MAX_SEARCHES];
+    bool abandoned[MAX_SEARCHES];
+    int nsearches;
+    int nabandoned;
+    int nallocated;
+    int nfreed;
+    int errors;			/* API misuse detected by the mock */
+    int last_rc;
+    struct timeval search_timeout;
+    struct timeval result_timeout;
+    bool result_timeout_set;
+} mock;
+
+static void
+mock_reset(void)
+{
+    memset(&mock, 0, sizeof(mock));
+}
+
+int
+ldap_search_ext(LDAP *ld, const char *base, int scope, const char *filter,
+    char **attrs, int attrsonly, LDAPControl **sctrls, LDAPControl **cctrls,
+    struct timeval *timeout, int sizelimit, int *msgidp)
+{
+    if (strcmp(base, "ou=fail") == 0)
+	return LDAP_SERVER_DOWN;
+    if (mock.nsearches == MAX_SEARCHES) {
+	mock.errors++;
+	return LDAP_OTHER;
+    }
+    if (timeout != NULL)
+	mock.search_timeout = *timeout;
+    else
+	timerclear(&mock.search_timeout);
+    *msgidp = mock.nsearches++;
+    mock.bases[*msgidp] = base;
+    mock.outstanding[*msgidp] = true;
+    return LDAP_SUCCESS;
+}
+
+int
+ldap_search_ext_s(LDAP *ld, const char *base, int scope, const char *filter,
+    char **attrs, int attrsonly, LDAPControl **sctrls, LDAPControl **cctrls,
+    struct timeval *timeout, int sizelimit, LDAPMessage **res)
+{
+    /* Only used without ldap_search_ext(). */
+    mock.errors++;
+    return LDAP_OTHER;
+}
+
+int
+ldap_result(LDAP *ld, int msgid, int all, struct timeval *timeout,
+    LDAPMessage **result)
+{
+    LDAPMessage *msg;
+    const char *base;
+
+    if (msgid < 0 || msgid >= mock.nsearches || !mock.outstanding[msgid]) {
+	mock.errors++;
+	return -1;
+    }
+    mock.result_timeout_set = timeout != NULL;
+    if (timeout != NULL)
+	mock.result_timeout = *timeout;
+    base = mock.bases[msgid];
+    if (strcmp(base, "ou=slow") == 0)
+	return 0;
+    mock.outstanding[msgid] = false;
+    if (strcmp(base, "ou=lost") == 0) {
+	mock.last_rc = LDAP_SERVER_DOWN;
+	return -1;
+    }
+    if ((msg = malloc(sizeof(*msg))) == NULL)
+	sudo_fatal_nodebug(NULL);
+    msg->msgid = msgid;
+    msg->rc = strcmp(base, "ou=noent") ? LDAP_SUCCESS : LDAP_NO_SUCH_OBJECT;
+    mock.nallocated++;
+    *result = msg;
+    return LDAP_RES_SEARCH_RESULT;
+}
+
+int
+ldap_parse_result(LDAP *ld, LDAPMessage *res, int *errcodep,
+    char **matcheddnp, char **errmsgp, char ***referralsp,
+    LDAPControl ***sctrls, int freeit)
+{
+    *errcodep = res->rc;
+    return LDAP_SUCCESS;
+}
+
+int
+ldap_abandon_ext(LDAP *ld, int msgid, LDAPControl **sctrls,
+    LDAPControl **cctrls)
+{
+    if (msgid < 0 || msgid >= mock.nsearches || !mock.outstanding[msgid]) {
+	mock.errors++;
+	return LDAP_OTHER;
+    }
+    mock.outstanding[msgid] = false;
+    mock.abandoned[msgid] = true;
+    mock.nabandoned++;
+    return LDAP_SUCCESS;
+}
+
+int
+ldap_get_option(LDAP *ld, int option, void *outvalue)
+{
+    if (option != LDAP_OPT_RESULT_CODE) {
+	mock.errors++;
+	return LDAP_OTHER;
+    }
+    *(int *)outvalue = mock.last_rc;
+    return LDAP_SUCCESS;
+}
+
+int
+ldap_msgfree(LDAPMessage *msg)
+{
+    if (msg != NULL) {
+	mock.nfreed++;
+	free(msg);
+    }
+    return LDAP_RES_SEARCH_RESULT;
+}
+
+/*
+ * Check for searches left outstanding, leaked results and API misuse.
+ */
+static void
+check_mock(const char *name, int *nerrors)
+{
+    int i;
+
+    for (i = 0; i < mock.nsearches; i++) {
+	if (mock.outstanding[i]) {
+	    sudo_warnx_nodebug("%s: search %d still outstanding", name, i);
+	    (*nerrors)++;
+	}
+    }
+    if (mock.nallocated != mock.nfreed) {
+	sudo_warnx_nodebug("%s: %d results allocated, %d freed", name,
+	    mock.nallocated, mock.nfreed);
+	(*nerrors)++;
+    }
+    if (mock.errors != 0) {
+	sudo_warnx_nodebug("%s: %d invalid LDAP calls", name, mock.errors);
+	(*nerrors)++;
+    }
+}
+
+/*
+ * Several searches are outstanding at once and their results are
+ * read back in the order they were sent.
+ */
+static void
+test_concurrent(int *ntests, int *nerrors)
+{
+    const char *bases[] = { "ou=a", "ou=b", "ou=c" };
+    struct ldap_pending_search pending[3];
+    struct timespec deadline;
+    LDAPMessage *result;
+    int i, rc;
+
+    mock_reset();
+    ldap_conf.timeout = 0;
+    sudo_ldap_search_deadline(&deadline);
+    for (i = 0; i < 3; i++)
+	sudo_ldap_search_start(NULL, bases[i], "(cn=*)", &pending[i]);
+
+    (*ntests)++;
+    if (mock.nsearches != 3 || !mock.outstanding[2]) {
+	sudo_warnx_nodebug("%s: searches not sent concurrently", __func__);
+	(*nerrors)++;
+    }
+    for (i = 0; i < 3; i++) {
+	(*ntests)++;
+	result = NULL;
+	rc = sudo_ldap_search_finish(NULL, &pending[i], &deadline, &result);
+	if (rc != LDAP_SUCCESS || result == NULL || result->msgid != i) {
+	    sudo_warnx_nodebug("%s: %s: unexpected result (rc %d)", __func__,
+		bases[i], rc);
+	    (*nerrors)++;
+	}
+	if (mock.result_timeout_set) {
+	    sudo_warnx_nodebug("%s: %s: unexpected timeout", __func__,
+		bases[i]);
+	    (*nerrors)++;
+	}
+	ldap_msgfree(result);
+    }
+    for (i = 0; i < 3; i++)
+	sudo_ldap_search_abandon(NULL, &pending[i]);
+
+    (*ntests)++;
+    if (mock.nabandoned != 0) {
+	sudo_warnx_nodebug("%s: completed searches abandoned", __func__);
+	(*nerrors)++;
+    }
+    check_mock(__func__, nerrors);
+}
+
+/*
+ * Searches that cannot be sent, fail on the server or lose the
+ * connection return the error and no result.
+ */
+static void
+test_errors(int *ntests, int *nerrors)
+{
+    struct search_error {
+	const char *base;
+	int rc;
+    } errs[] = {
+	{ "ou=fail", LDAP_SERVER_DOWN },
+	{ "ou=noent", LDAP_NO_SUCH_OBJECT },
+	{ "ou=lost", LDAP_SERVER_DOWN }
+    };
+    struct ldap_pending_search pending[3];
+    struct timespec deadline;
+    LDAPMessage *result;
+    int i, rc;
+
+    mock_reset();
+    ldap_conf.timeout = 0;
+    sudo_ldap_search_deadline(&deadline);
+    for (i = 0; i < 3; i++)
+	sudo_ldap_search_start(NULL, errs[i].base, "(cn=*)", &pending[i]);
+    for (i = 0; i < 3; i++) {
+	(*ntests)++;
+	result = (LDAPMessage *)&deadline;
+	rc = sudo_ldap_search_finish(NULL, &pending[i], &deadline, &result);
+	if (rc != errs[i].rc || result != NULL) {
+	    sudo_warnx_nodebug("%s: %s: expected rc %d, got %d%s", __func__,
+		errs[i].base, errs[i].rc, rc,
+		result != NULL ? " and a result" : "");
+	    (*nerrors)++;
+	}
+    }
+    for (i = 0; i < 3; i++)
+	sudo_ldap_search_abandon(NULL, &pending[i]);
+
+    (*ntests)++;
+    if (mock.nabandoned != 0) {
+	sudo_warnx_nodebug("%s: failed searches abandoned", __func__);
+	(*nerrors)++;
+    }
+    check_mock(__func__, nerrors);
+}
+
+/*
+ * A search that does not complete by the deadline is abandoned,
+ * including one whose deadline has already passed.
+ */
+static void
+test_timeout(int *ntests, int *nerrors)
+{
+    struct ldap_pending_search pending;
+    struct timespec deadline;
+    LDAPMessage *result;
+    int rc;
+
+    mock_reset();
+    ldap_conf.timeout = 5;
+    sudo_ldap_search_deadline(&deadline);
+    sudo_ldap_search_start(NULL, "ou=slow", "(cn=*)", &pending);
+
+    (*ntests)++;
+    if (mock.search_timeout.tv_sec != 5) {
+	sudo_warnx_nodebug("%s: search time limit %lld, expected 5",
+	    __func__, (long long)mock.search_timeout.tv_sec);
+	(*nerrors)++;
+    }
+    (*ntests)++;
+    rc = sudo_ldap_search_finish(NULL, &pending, &deadline, &result);
+    if (rc != LDAP_TIMEOUT || result != NULL || !mock.abandoned[0]) {
+	sudo_warnx_nodebug("%s: slow search not abandoned (rc %d)",
+	    __func__, rc);
+	(*nerrors)++;
+    }
+    (*ntests)++;
+    if (!mock.result_timeout_set || mock.result_timeout.tv_sec > 5 ||
+	    (mock.result_timeout.tv_sec == 0 &&
+	    mock.result_timeout.tv_usec == 0)) {
+	sudo_warnx_nodebug("%s: wait not bounded by the deadline", __func__);
+	(*nerrors)++;
+    }
+    sudo_ldap_search_abandon(NULL, &pending);
+
+    /* A deadline in the past only polls for a result. */
+    sudo_ldap_search_deadline(&deadline);
+    deadline.tv_sec -= 10;
+    sudo_ldap_search_start(NULL, "ou=slow", "(cn=*)", &pending);
+    (*ntests)++;
+    rc = sudo_ldap_search_finish(NULL, &pending, &deadline, &result);
+    if (rc != LDAP_TIMEOUT || !mock.abandoned[1] ||
+	    !mock.result_timeout_set || timerisset(&mock.result_timeout)) {
+	sudo_warnx_nodebug("%s: expired deadline not handled (rc %d)",
+	    __func__, rc);
+	(*nerrors)++;
+    }
+    sudo_ldap_search_abandon(NULL, &pending);
+
+    (*ntests)++;
+    if (mock.nabandoned != 2) {
+	sudo_warnx_nodebug("%s: %d searches abandoned, expected 2",
+	    __func__, mock.nabandoned);
+	(*nerrors)++;
+    }
+    check_mock(__func__, nerrors);
+}
+
+/*
+ * Searches still outstanding when a lookup stops early, for example
+ * on error, are abandoned; ones that were already read are not.
+ */
+static void
+test_abandon(int *ntests, int *nerrors)
+{
+    const char *bases[] = { "ou=a", "ou=slow", "ou=b" };
+    struct ldap_pending_search pending[3];
+    struct timespec deadline;
+    LDAPMessage *result;
+    int i, rc;
+
+    mock_reset();
+    ldap_conf.timeout = 0;
+    sudo_ldap_search_deadline(&deadline);
+    for (i = 0; i < 3; i++)
+	sudo_ldap_search_start(NULL, bases[i], "(cn=*)", &pending[i]);
+
+    (*ntests)++;
+    rc = sudo_ldap_search_finish(NULL, &pending[0], &deadline, &result);
+    if (rc != LDAP_SUCCESS || result == NULL) {
+	sudo_warnx_nodebug("%s: first search failed (rc %d)", __func__, rc);
+	(*nerrors)++;
+    }
+    ldap_msgfree(result);
+
+    for (i = 0; i < 3; i++)
+	sudo_ldap_search_abandon(NULL, &pending[i]);
+    /* Abandoning twice is harmless. */
+    for (i = 0; i < 3; i++)
+	sudo_ldap_search_abandon(NULL, &pending[i]);
+
+    (*ntests)++;
+    if (mock.nabandoned != 2 || mock.abandoned[0] || !mock.abandoned[1] ||
+	    !mock.abandoned[2]) {
+	sudo_warnx_nodebug("%s: wrong searches abandoned", __func__);
+	(*nerrors)++;
+    }
+    check_mock(__func__, nerrors);
+}
+
+int
+main(int argc, char *argv[])
+{
+    int tests = 0, errors = 0;
+
+    initprogname(argc > 0 ? argv[0] : "check_ldap_search");
+
+    test_concurrent(&tests, &errors);
+    test_errors(&tests, &errors);
+    test_timeout(&tests, &errors);
+    test_abandon(&tests, &errors);
+
+    if (tests != 0) {
+	printf("check_ldap_search: %d test%s run, %d errors, %d%% success rate\n",
+	    tests, tests == 1 ? "" : "s", errors,
+	    (tests - errors) * 100 / tests);
+    }
+
+    exit(errors);
+}
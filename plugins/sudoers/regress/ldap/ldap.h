@@ -0,0 +1,53 @@
+/*
+ * SPDX-License-Identifier: ISC
+ *
+ * Copyright (c) 2020 Todd C. Miller <Todd.Miller@sudo.ws>
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/*
+ * Minimal stand-in for <ldap.h> used by check_ldap_search.
+ * It declares just enough of the LDAP API for ldap_search.c so the
+ * test can be built and run without an LDAP library or server; the
+ * functions themselves are implemented by the test.
+ */
+
+#ifndef SUDOERS_REGRESS_LDAP_H
+#define SUDOERS_REGRESS_LDAP_H
+
+typedef struct ldap LDAP;
+typedef struct ldapmsg LDAPMessage;
+typedef struct ldapcontrol LDAPControl;
+
+#define LDAP_SUCCESS		0x00
+#define LDAP_NO_SUCH_OBJECT	0x20
+#define LDAP_OTHER		0x50
+#define LDAP_SERVER_DOWN	0x51
+#define LDAP_TIMEOUT		0x55
+#define LDAP_NO_MEMORY		0x5a
+
+#define LDAP_SCOPE_SUBTREE	0x0002
+#define LDAP_MSG_ALL		0x01
+#define LDAP_RES_SEARCH_RESULT	0x65
+#define LDAP_OPT_RESULT_CODE	0x0031
+
+int ldap_search_ext(LDAP *ld, const char *base, int scope, const char *filter, char **attrs, int attrsonly, LDAPControl **sctrls, LDAPControl **cctrls, struct timeval *timeout, int sizelimit, int *msgidp);
+int ldap_search_ext_s(LDAP *ld, const char *base, int scope, const char *filter, char **attrs, int attrsonly, LDAPControl **sctrls, LDAPControl **cctrls, struct timeval *timeout, int sizelimit, LDAPMessage **res);
+int ldap_result(LDAP *ld, int msgid, int all, struct timeval *timeout, LDAPMessage **result);
+int ldap_parse_result(LDAP *ld, LDAPMessage *res, int *errcodep, char **matcheddnp, char **errmsgp, char ***referralsp, LDAPControl ***sctrls, int freeit);
+int ldap_abandon_ext(LDAP *ld, int msgid, LDAPControl **sctrls, LDAPControl **cctrls);
+int ldap_get_option(LDAP *ld, int option, void *outvalue);
+int ldap_msgfree(LDAPMessage *msg);
+
+#endif /* SUDOERS_REGRESS_LDAP_H */
@@ -0,0 +1,365 @@
+/*
+ * SPDX-License-Identifier: ISC
+ *
+ * Copyright (c) 2020 Todd C. Miller <Todd.Miller@sudo.ws>
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include <config.h>
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <stdio.h>
+#include <stdlib.h>
+#ifdef HAVE_STRING_H
+# include <string.h>
+#endif /* HAVE_STRING_H */
+#ifdef HAVE_STRINGS_H
+# include <strings.h>
+#endif /* HAVE_STRINGS_H */
+#include <unistd.h>
+#include <pwd.h>
+#include <grp.h>
+
+#define SUDO_ERROR_WRAP 0
+
+#include "sudoers.h"
+#include "pwutil.h"
+#include "def_data.c"		/* for pwutil.c */
+
+/*
+ * The cache only trusts files owned by root.  Use the invoking user
+ * instead so the test does not need to be run as root.
+ */
+static uid_t test_uid;
+#undef ROOT_UID
+#define ROOT_UID test_uid
+
+#include "pwcache.c"
+
+struct sudo_user sudo_user;
+
+__dso_public int main(int argc, char *argv[]);
+
+static struct path_test {
+    unsigned int kind;
+    const char *name;
+    unsigned int id;
+    const char *registry;
+    const char *path;
+} path_tests[] = {
+    { PWCACHE_PWUID, NULL, 0, "", "/cache/uid.0" },
+    { PWCACHE_GRGID, NULL, 4294967295U, "", "/cache/gid.4294967295" },
+    { PWCACHE_PWNAM, "alice", 0, "", "/cache/user.alice" },
+    { PWCACHE_PWNAM, "a.b_c-d", 0, "", "/cache/user.a.b_c-d" },
+    { PWCACHE_PWNAM, "../../etc/passwd", 0, "",
+	"/cache/user...%2f..%2fetc%2fpasswd" },
+    { PWCACHE_GRNAM, "domain users", 0, "", "/cache/group.domain%20users" },
+    { PWCACHE_GRNAM, "100%", 0, "", "/cache/group.100%25" },
+    { PWCACHE_GIDLIST, "bob@example", 0, "", "/cache/gids.bob%40example" },
+    { PWCACHE_PWNAM, "carol", 0, "LDAP/x", "/cache/user.carol@LDAP%2fx" }
+};
+
+/*
+ * Test that cache file names are escaped and stay in the cache dir.
+ */
+static void
+test_path(int *ntests, int *nerrors)
+{
+    struct cache_item key;
+    char path[PATH_MAX];
+    unsigned int i;
+
+    pwcache.dir = (char *)"/cache";
+    for (i = 0; i < nitems(path_tests); i++) {
+	struct path_test *test = &path_tests[i];
+
+	memset(&key, 0, sizeof(key));
+	if (test->name != NULL)
+	    key.k.name = (char *)test->name;
+	else if (test->kind == PWCACHE_PWUID)
+	    key.k.uid = (uid_t)test->id;
+	else
+	    key.k.gid = (gid_t)test->id;
+	strlcpy(key.registry, test->registry, sizeof(key.registry));
+
+	(*ntests)++;
+	if (!pwcache_path(path, sizeof(path), test->kind, &key)) {
+	    sudo_warnx_nodebug("%s:%u: unable to build path", __func__, i);
+	    (*nerrors)++;
+	} else if (strcmp(path, test->path) != 0) {
+	    sudo_warnx_nodebug("%s:%u: want %s, got %s", __func__, i,
+		test->path, path);
+	    (*nerrors)++;
+	}
+    }
+    pwcache.dir = NULL;
+}
+
+static bool
+cache_file_exists(unsigned int kind, const struct cache_item *key)
+{
+    char path[PATH_MAX];
+    struct stat sb;
+
+    if (!pwcache_path(path, sizeof(path), kind, key))
+	return false;
+    return stat(path, &sb) == 0;
+}
+
+/*
+ * Store entries in the cache and read them back.
+ */
+static void
+test_roundtrip(int *ntests, int *nerrors)
+{
+    struct cache_item key, *item, *out;
+    struct passwd pw;
+    struct group gr;
+    char *members[] = { "alice", "bob", NULL };
+    GETGROUPS_T gids[] = { 10, 20, 30 };
+    int i;
+
+    /* passwd entry keyed by uid */
+    memset(&pw, 0, sizeof(pw));
+    pw.pw_name = "alice";
+    pw.pw_passwd = "x";
+    pw.pw_uid = 1001;
+    pw.pw_gid = 100;
+    pw.pw_gecos = "Alice \344 Example";	/* not valid UTF-8 */
+    pw.pw_dir = "/home/alice";
+    pw.pw_shell = "/bin/sh";
+    memset(&key, 0, sizeof(key));
+    key.k.uid = pw.pw_uid;
+    item = sudo_copy_pwitem(&pw, NULL);
+    if (item == NULL)
+	sudo_fatalx_nodebug("unable to allocate memory");
+    sudo_pwcache_put(PWCACHE_PWUID, &key, item);
+    free(item);
+    (*ntests)++;
+    if (!sudo_pwcache_get(PWCACHE_PWUID, &key, &out)) {
+	sudo_warnx_nodebug("%s: passwd entry not found", __func__);
+	(*nerrors)++;
+    } else {
+	const struct passwd *npw = out->d.pw;
+	if (npw->pw_uid != pw.pw_uid || npw->pw_gid != pw.pw_gid ||
+		strcmp(npw->pw_name, pw.pw_name) != 0 ||
+		strcmp(npw->pw_passwd, pw.pw_passwd) != 0 ||
+		strcmp(npw->pw_gecos, pw.pw_gecos) != 0 ||
+		strcmp(npw->pw_dir, pw.pw_dir) != 0 ||
+		strcmp(npw->pw_shell, pw.pw_shell) != 0) {
+	    sudo_warnx_nodebug("%s: passwd entry mismatch", __func__);
+	    (*nerrors)++;
+	}
+	free(out);
+    }
+
+    /* A real password hash is never stored. */
+    pw.pw_name = "hashed";
+    pw.pw_passwd = "$6$salt$hash";
+    memset(&key, 0, sizeof(key));
+    key.k.name = pw.pw_name;
+    item = sudo_copy_pwitem(&pw, pw.pw_name);
+    if (item == NULL)
+	sudo_fatalx_nodebug("unable to allocate memory");
+    sudo_pwcache_put(PWCACHE_PWNAM, &key, item);
+    free(item);
+    (*ntests)++;
+    if (cache_file_exists(PWCACHE_PWNAM, &key)) {
+	sudo_warnx_nodebug("%s: stored passwd entry with a password hash",
+	    __func__);
+	(*nerrors)++;
+    }
+
+    /* group entry keyed by name, with members */
+    memset(&gr, 0, sizeof(gr));
+    gr.gr_name = "staff";
+    gr.gr_passwd = "*";
+    gr.gr_gid = 50;
+    gr.gr_mem = members;
+    memset(&key, 0, sizeof(key));
+    key.k.name = gr.gr_name;
+    item = sudo_copy_gritem(&gr, gr.gr_name);
+    if (item == NULL)
+	sudo_fatalx_nodebug("unable to allocate memory");
+    sudo_pwcache_put(PWCACHE_GRNAM, &key, item);
+    free(item);
+    (*ntests)++;
+    if (!sudo_pwcache_get(PWCACHE_GRNAM, &key, &out)) {
+	sudo_warnx_nodebug("%s: group entry not found", __func__);
+	(*nerrors)++;
+    } else {
+	const struct group *ngr = out->d.gr;
+	if (ngr->gr_gid != gr.gr_gid || strcmp(ngr->gr_name, "staff") != 0 ||
+		ngr->gr_mem == NULL || ngr->gr_mem[0] == NULL ||
+		ngr->gr_mem[1] == NULL || ngr->gr_mem[2] != NULL ||
+		strcmp(ngr->gr_mem[0], "alice") != 0 ||
+		strcmp(ngr->gr_mem[1], "bob") != 0) {
+	    sudo_warnx_nodebug("%s: group entry mismatch", __func__);
+	    (*nerrors)++;
+	}
+	free(out);
+    }
+
+    /* group-ID list */
+    memset(&key, 0, sizeof(key));
+    key.k.name = "alice";
+    item = sudo_copy_gidlist_item(key.k.name, gids, (int)nitems(gids),
+	ENTRY_TYPE_QUERIED);
+    if (item == NULL)
+	sudo_fatalx_nodebug("unable to allocate memory");
+    sudo_pwcache_put(PWCACHE_GIDLIST, &key, item);
+    free(item);
+    (*ntests)++;
+    if (!sudo_pwcache_get(PWCACHE_GIDLIST, &key, &out)) {
+	sudo_warnx_nodebug("%s: group-ID list not found", __func__);
+	(*nerrors)++;
+    } else {
+	const struct gid_list *gl = out->d.gidlist;
+	bool ok = gl->ngids == (int)nitems(gids);
+	for (i = 0; ok && i < gl->ngids; i++)
+	    ok = gl->gids[i] == gids[i];
+	if (!ok) {
+	    sudo_warnx_nodebug("%s: group-ID list mismatch", __func__);
+	    (*nerrors)++;
+	}
+	free(out);
+    }
+
+    /* Negative entries are not stored. */
+    memset(&key, 0, sizeof(key));
+    key.k.name = "nosuchuser";
+    sudo_pwcache_put(PWCACHE_PWNAM, &key, NULL);
+    (*ntests)++;
+    if (cache_file_exists(PWCACHE_PWNAM, &key)) {
+	sudo_warnx_nodebug("%s: stored a negative entry", __func__);
+	(*nerrors)++;
+    }
+}
+
+/*
+ * Entries that are expired or from an older generation are not
+ * used and their files are removed.
+ */
+static void
+test_expire(int *ntests, int *nerrors)
+{
+    struct cache_item key, *item, *out;
+    struct timespec ttl;
+    struct group gr;
+
+    memset(&gr, 0, sizeof(gr));
+    gr.gr_name = "wheel";
+    gr.gr_gid = 0;
+    memset(&key, 0, sizeof(key));
+    key.k.gid = gr.gr_gid;
+    item = sudo_copy_gritem(&gr, NULL);
+    if (item == NULL)
+	sudo_fatalx_nodebug("unable to allocate memory");
+
+    /* Time to live. */
+    sudo_pwcache_put(PWCACHE_GRGID, &key, item);
+    ttl = pwcache.ttl;
+    sudo_timespecclear(&pwcache.ttl);
+    (*ntests)++;
+    if (sudo_pwcache_get(PWCACHE_GRGID, &key, &out)) {
+	sudo_warnx_nodebug("%s: used an expired entry", __func__);
+	(*nerrors)++;
+	free(out);
+    } else if (cache_file_exists(PWCACHE_GRGID, &key)) {
+	sudo_warnx_nodebug("%s: expired entry not removed", __func__);
+	(*nerrors)++;
+    }
+    pwcache.ttl = ttl;
+
+    /* Generation, as bumped by purging the whole cache. */
+    sudo_pwcache_put(PWCACHE_GRGID, &key, item);
+    (*ntests)++;
+    if (!sudo_pwcache_get(PWCACHE_GRGID, &key, &out)) {
+	sudo_warnx_nodebug("%s: entry not found", __func__);
+	(*nerrors)++;
+    } else {
+	free(out);
+    }
+    pwcache.generation++;
+    (*ntests)++;
+    if (sudo_pwcache_get(PWCACHE_GRGID, &key, &out)) {
+	sudo_warnx_nodebug("%s: used an entry from an old generation",
+	    __func__);
+	(*nerrors)++;
+	free(out);
+    } else if (cache_file_exists(PWCACHE_GRGID, &key)) {
+	sudo_warnx_nodebug("%s: stale entry not removed", __func__);
+	(*nerrors)++;
+    }
+
+    /* The purge itself stores the new generation. */
+    sudo_pwcache_put(PWCACHE_GRGID, &key, item);
+    (*ntests)++;
+    if (!sudo_pwcache_purge(NULL) || cache_file_exists(PWCACHE_GRGID, &key)) {
+	sudo_warnx_nodebug("%s: purge failed", __func__);
+	(*nerrors)++;
+    } else {
+	unsigned long long generation = pwcache.generation;
+	pwcache_read_generation();
+	if (pwcache.generation != generation) {
+	    sudo_warnx_nodebug("%s: generation %llu not stored", __func__,
+		generation);
+	    (*nerrors)++;
+	}
+    }
+
+    free(item);
+}
+
+int
+main(int argc, char *argv[])
+{
+    char dir[] = "/tmp/check_pwcache.XXXXXX";
+    char path[PATH_MAX];
+    struct timespec ttl = { 300, 0 };
+    int tests = 0, errors = 0;
+
+    initprogname(argc > 0 ? argv[0] : "check_pwcache");
+
+    test_uid = geteuid();
+
+    test_path(&tests, &errors);
+
+    if (mkdtemp(dir) == NULL)
+	sudo_fatal_nodebug("mkdtemp");
+    if (!sudo_pwcache_open(dir, &ttl)) {
+	sudo_warnx_nodebug("unable to open cache dir %s", dir);
+	errors++;
+    } else {
+	test_roundtrip(&tests, &errors);
+	test_expire(&tests, &errors);
+	sudo_pwcache_purge(NULL);
+	sudo_pwcache_close();
+    }
+    (void)snprintf(path, sizeof(path), "%s/%s", dir, PWCACHE_GENERATION);
+    (void)unlink(path);
+    if (rmdir(dir) != 0) {
+	sudo_warn_nodebug("unable to remove %s", dir);
+	errors++;
+    }
+
+    if (tests != 0) {
+	printf("check_pwcache: %d test%s run, %d errors, %d%% success rate\n",
+	    tests, tests == 1 ? "" : "s", errors,
+	    (tests - errors) * 100 / tests);
+    }
+
+    exit(errors);
+}
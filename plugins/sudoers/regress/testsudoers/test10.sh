@@ -0,0 +1,42 @@
+#!/bin/sh
+#
+# Test matching of directory specs and patterns with wildcards in the
+# last path component, which do not use readdir(3) or glob(3).
+#
+
+parentdir="`echo $0 | sed 's:/[^/]*$::'`"
+if [ -d "$parentdir" ]; then
+	rm -rf "${parentdir}/test10.d"
+	mkdir -p "${parentdir}/test10.d/bin" "${parentdir}/test10.d/sbin"
+	touch "${parentdir}/test10.d/bin/foo" "${parentdir}/test10.d/bin/bar" \
+	    "${parentdir}/test10.d/bin/.hidden" "${parentdir}/test10.d/sbin/baz"
+
+	# Commands in sudoers must be fully-qualified.
+	D="`cd ${parentdir}/test10.d && pwd`"
+	exec 2>&1
+	for cmnd in bin/foo bin/bar bin/missing bin/.hidden sbin/baz; do
+		echo "$cmnd:"
+		./testsudoers root "$D/$cmnd" <<-EOF | grep '^Command'
+			root ALL = $D/bin/f*, $D/bin/*, $D/sbin/
+		EOF
+	done
+
+	# Wildcards in a directory component still use glob(3).
+	./testsudoers root "$D/sbin/baz" <<-EOF | grep '^Command'
+		root ALL = $D/s*/baz
+	EOF
+
+	# Arguments must still match.
+	./testsudoers root "$D/bin/foo" one <<-EOF | grep '^Command'
+		root ALL = $D/bin/f* two
+	EOF
+	./testsudoers root "$D/bin/foo" two <<-EOF | grep '^Command'
+		root ALL = $D/bin/f* two
+	EOF
+
+	rm -rf "${parentdir}/test10.d"
+	exit 0
+fi
+
+echo "$0: unable to determine parent dir" 1>&2
+exit 1
@@ -0,0 +1,17 @@
+#!/bin/sh
+#
+# Verify that only the userspecs that may match the user are checked
+# while preserving last-match-wins semantics.
+#
+
+exec 2>&1
+./testsudoers -P ${TESTDIR}/group root /bin/ls <<EOF
+User_Alias ADMINS = %wheel
+root ALL = /bin/ls
+%staff ALL = !/bin/ls
+ADMINS ALL = /bin/ls
+millert, %games ALL = !/bin/ls
+ALL, !root ALL = !/bin/ls
+EOF
+
+exit 0
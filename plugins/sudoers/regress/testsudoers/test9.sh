@@ -0,0 +1,54 @@
+#!/bin/sh
+#
+# Test the sudoers policy cache; it must produce the same policy as
+# the parser and must not be used once an included file changes.
+#
+
+parentdir="`echo $0 | sed 's:/[^/]*$::'`"
+if [ -d "$parentdir" ]; then
+	# make sure include file is owned by current user
+	rm -rf "${parentdir}/test9.d"
+	mkdir "${parentdir}/test9.d"
+	cat >"${parentdir}/test9.d/root" <<-EOF
+		root ALL = /bin/ls
+	EOF
+
+	MYUID=`\ls -lnd $TESTDIR/test9.d | awk '{print $3}'`
+	MYGID=`\ls -lnd $TESTDIR/test9.d | awk '{print $4}'`
+	CACHE="${TMPDIR-/tmp}/test9.cache.$$"
+	rm -f "$CACHE"
+
+	cat >"${CACHE}.in" <<-EOF
+		Defaults env_reset
+		Defaults:ADMINS !lecture
+		Defaults@SERVERS timestamp_timeout=10
+		Defaults>OP !set_logname
+		Defaults!SHELLS log_output, log_input
+		User_Alias ADMINS = millert, %wheel, !bob
+		Runas_Alias OP = root, operator
+		Host_Alias SERVERS = 127.0.0.1, 10.0.0.0/8, www
+		Cmnd_Alias SHELLS = /bin/sh, /bin/csh
+		Cmnd_Alias DIGEST = sha224:d06a7c8e4dcc7c8b1fc0b7c4fe4bb16b5fd00e5b4bf9a8a2e22e1f07 /bin/cat
+		ADMINS SERVERS = (OP) NOPASSWD: /bin/ls -l, /bin/cat "", !SHELLS, \\
+		    (:wheel) SETENV: DIGEST
+		root ALL = (ALL : ALL) TIMEOUT=1h NOTBEFORE=20200101000000Z ALL, \\
+		    (operator) NOEXEC: /usr/bin/id
+		#includedir $TESTDIR/test9.d
+	EOF
+
+	exec 2>&1
+	# Parse and create the cache, then load the cached copy.
+	./testsudoers -U $MYUID -G $MYGID -c "$CACHE" -d root /bin/ls < "${CACHE}.in"
+	./testsudoers -U $MYUID -G $MYGID -c "$CACHE" -d root /bin/ls < "${CACHE}.in"
+
+	# Changing an included file invalidates the cache.
+	echo "root ALL = !/bin/ls" >> "${parentdir}/test9.d/root"
+	./testsudoers -U $MYUID -G $MYGID -c "$CACHE" root /bin/ls < "${CACHE}.in"
+	./testsudoers -U $MYUID -G $MYGID -c "$CACHE" root /bin/ls < "${CACHE}.in"
+
+	rm -f "$CACHE" "${CACHE}.in"
+	exit 0
+fi
+
+echo "$0: unable to determine parent dir" 1>&2
+exit 1
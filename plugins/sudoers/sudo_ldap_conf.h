@@ -121,6 +121,27 @@ struct ldap_config {
     char *krb5_ccname;
 };
 
+/*
+ * A search that has been sent to the LDAP server but whose result
+ * has not been read yet.  Multiple searches may be outstanding on
+ * the same connection; results are read back with ldap_result().
+ */
+struct ldap_pending_search {
+    int msgid;			/* message ID or -1 if not outstanding */
+    int rc;			/* result code if not outstanding */
+    LDAPMessage *result;	/* search result if not outstanding */
+};
+
+#ifndef HAVE_LDAP_SEARCH_EXT_S
+# ifdef HAVE_LDAP_SEARCH_ST
+#  define ldap_search_ext_s(a, b, c, d, e, f, g, h, i, j, k)		\
+	ldap_search_st(a, b, c, d, e, f, i, k)
+# else
+#  define ldap_search_ext_s(a, b, c, d, e, f, g, h, i, j, k)		\
+	ldap_search_s(a, b, c, d, e, f, k)
+# endif
+#endif
+
 extern struct ldap_config ldap_conf;
 
 const char *sudo_krb5_ccname_path(const char *old_ccname);
@@ -128,4 +149,10 @@ bool sudo_ldap_read_config(void);
 int sudo_ldap_set_options_global(void);
 int sudo_ldap_set_options_conn(LDAP *ld);
 
+/* ldap_search.c */
+void sudo_ldap_search_deadline(struct timespec *deadline);
+void sudo_ldap_search_start(LDAP *ld, const char *base, const char *filt, struct ldap_pending_search *ps);
+int sudo_ldap_search_finish(LDAP *ld, struct ldap_pending_search *ps, const struct timespec *deadline, LDAPMessage **resultp);
+void sudo_ldap_search_abandon(LDAP *ld, struct ldap_pending_search *ps);
+
 #endif /* SUDOERS_LDAP_CONF_H */
@@ -220,6 +220,15 @@ sudoers_policy_init(void *info, char * const envp[])
 	goto cleanup;
     }
 
+    /* Use the shared passwd and group cache if enabled in sudoers. */
+    if (sudo_timespecisset(&def_pwcache_timeout) &&
+	    def_pwcache_timeout.tv_sec >= 0)
+	(void)sudo_pwcache_open(def_pwcache_dir, &def_pwcache_timeout);
+
+    /* Use the command digest cache if enabled in sudoers. */
+    if (def_digest_cache)
+	(void)sudo_digestcache_open(def_digest_cache_dir);
+
     /* Set login class if applicable (after sudoers is parsed). */
     if (set_loginclass(runas_pw ? runas_pw : sudo_user.pw))
 	ret = true;
@@ -808,6 +817,11 @@ init_vars(char * const envp[])
     /* Set umask callback. */
     sudo_defs_table[I_UMASK].callback = cb_umask;
 
+    /* Set env_check, env_delete and env_keep callbacks. */
+    sudo_defs_table[I_ENV_CHECK].callback = cb_env_list;
+    sudo_defs_table[I_ENV_DELETE].callback = cb_env_list;
+    sudo_defs_table[I_ENV_KEEP].callback = cb_env_list;
+
     /* It is now safe to use log_warningx() and set_perms() */
     if (unknown_user) {
 	log_warningx(SLOG_SEND_MAIL, N_("unknown uid: %u"),
@@ -1345,6 +1359,8 @@ sudoers_cleanup(void)
 	group_plugin_unload();
     sudo_freepwcache();
     sudo_freegrcache();
+    sudo_pwcache_close();
+    sudo_digestcache_close();
 
     debug_return;
 }
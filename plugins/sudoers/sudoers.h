@@ -338,6 +338,22 @@ int  sudo_set_grlist(struct passwd *pw, char * const *groups);
 void sudo_pwutil_set_backend(sudo_make_pwitem_t, sudo_make_gritem_t, sudo_make_gidlist_item_t, sudo_make_grlist_item_t);
 void sudo_setspent(void);
 
+/* cachedir.c */
+bool sudo_cachedir_open(const char *dir, uid_t uid, gid_t gid);
+int sudo_cachedir_open_file(const char *path, uid_t uid, struct stat *sb);
+bool sudo_cachedir_write_file(const char *dir, const char *path, const void *buf, size_t len);
+
+/* digestcache.c */
+bool sudo_digestcache_open(const char *dir);
+void sudo_digestcache_close(void);
+unsigned char *sudo_digestcache_get(const struct stat *sb, int digest_type, size_t *digest_len);
+void sudo_digestcache_put(const struct stat *sb, int digest_type, const unsigned char *digest, size_t digest_len);
+
+/* pwcache.c */
+bool sudo_pwcache_open(const char *dir, const struct timespec *ttl);
+bool sudo_pwcache_purge(const struct passwd *pw);
+void sudo_pwcache_close(void);
+
 /* timestr.c */
 char *get_timestr(time_t, int);
 
@@ -355,6 +371,7 @@ struct iolog_path_escape;
 extern const struct iolog_path_escape *sudoers_iolog_path_escapes;
 
 /* env.c */
+bool cb_env_list(const union sudo_defs_val *sd_un);
 char **env_get(void);
 bool env_merge(char * const envp[]);
 bool env_swap_old(void);
@@ -374,7 +391,11 @@ int sudoers_hook_unsetenv(const char *name, void *closure);
 void register_env_file(void * (*ef_open)(const char *), void (*ef_close)(void *), char * (*ef_next)(void *, int *), bool system);
 
 /* env_pattern.c */
+struct env_filter;
 bool matches_env_pattern(const char *pattern, const char *var, bool *full_match);
+struct env_filter *env_filter_compile(struct list_members *list);
+bool env_filter_match(const struct env_filter *filter, const char *var, bool *full_match);
+void env_filter_free(struct env_filter *filter);
 
 /* sudoers.c */
 FILE *open_sudoers(const char *, bool, bool *);
@@ -0,0 +1,1236 @@
+/*
+ * SPDX-License-Identifier: ISC
+ *
+ * Copyright (c) 2020 Todd C. Miller <Todd.Miller@sudo.ws>
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/*
+ * This is an open source non-commercial project. Dear PVS-Studio, please check it.
+ * PVS-Studio Static Code Analyzer for C, C++ and C#: http://www.viva64.com
+ */
+
+#include <config.h>
+
+#include <sys/types.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <stdio.h>
+#include <stdlib.h>
+#if defined(HAVE_STDINT_H)
+# include <stdint.h>
+#elif defined(HAVE_INTTYPES_H)
+# include <inttypes.h>
+#endif
+#ifdef HAVE_STRING_H
+# include <string.h>
+#endif /* HAVE_STRING_H */
+#ifdef HAVE_STRINGS_H
+# include <strings.h>
+#endif /* HAVE_STRINGS_H */
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <time.h>
+
+#include "sudoers.h"
+#include "sudoers_version.h"
+#include "redblack.h"
+#include <gram.h>
+
+/*
+ * Precompiled sudoers policy.
+ *
+ * After sudoers has been parsed successfully, visudo stores the parse
+ * tree in a binary image next to the sudoers file.  The image starts
+ * with a fixed header followed by a body of 32-bit words in host byte
+ * order: the string table and then the encoded tree.  The tree refers
+ * to strings by their position in the table (0 for NULL), so each
+ * distinct string is only stored once.
+ *
+ * The image also records every file and directory that was read to
+ * produce the tree along with its inode, size and modification times.
+ * The image is only used if all of those still match and the files
+ * pass the same security checks sudo applies when opening them,
+ * otherwise sudoers falls back to the text parser.
+ */
+
+#define SUDOERS_CACHE_MAGIC	0x53554443	/* "SUDC" in host order */
+#define SUDOERS_CACHE_VERSION	1
+
+/* Build options that affect the layout of struct cmndspec. */
+#ifdef HAVE_SELINUX
+# define CACHE_FLAG_SELINUX	0x01
+#else
+# define CACHE_FLAG_SELINUX	0x00
+#endif
+#ifdef HAVE_PRIV_SET
+# define CACHE_FLAG_PRIV_SET	0x02
+#else
+# define CACHE_FLAG_PRIV_SET	0x00
+#endif
+#define SUDOERS_CACHE_FLAGS	(CACHE_FLAG_SELINUX|CACHE_FLAG_PRIV_SET)
+
+struct sudoers_cache_header {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t grammar_version;
+    uint32_t flags;
+    uint32_t nstrings;			/* number of strings in the table */
+    uint32_t strwords;			/* length of string table in words */
+    uint32_t treewords;			/* length of encoded tree in words */
+    uint32_t reserved;
+    uint64_t checksum;			/* checksum of the body */
+    char package_version[32];
+};
+
+/* Source types. */
+#define CACHE_SOURCE_FILE	0
+#define CACHE_SOURCE_DIR	1
+
+/* Encoding of a pointer that may be shared with the previous entry. */
+#define CACHE_PTR_NULL		0
+#define CACHE_PTR_PREV		1
+#define CACHE_PTR_NEW		2
+
+/* Files and directories read by the parser, if recording is enabled. */
+struct cache_source {
+    STAILQ_ENTRY(cache_source) entries;
+    char *path;
+    bool isdir;
+};
+STAILQ_HEAD(cache_source_list, cache_source);
+
+static struct cache_source_list sources = STAILQ_HEAD_INITIALIZER(sources);
+static bool record_sources;
+
+static bool add_source(const char *path, bool isdir);
+
+/*
+ * Growable array of 32-bit words.
+ */
+struct cache_buf {
+    uint32_t *words;
+    size_t len;
+    size_t size;
+};
+
+struct cache_string {
+    const char *str;
+    uint32_t idx;
+};
+
+struct cache_writer {
+    struct cache_buf strings;
+    struct cache_buf tree;
+    struct rbtree *strtab;
+    uint32_t nstrings;
+    bool error;
+};
+
+struct cache_reader {
+    const uint32_t *cur;
+    const uint32_t *end;
+    const char **strings;		/* string table, in the mapped image */
+    char **rcstrs;			/* rcstr copies of file names */
+    uint32_t nstrings;
+    bool error;
+};
+
+/*
+ * Checksum the body of the cache, one word at a time (64-bit FNV-1a).
+ */
+static uint64_t
+cache_checksum(const uint32_t *words, size_t nwords)
+{
+    uint64_t h = 0xcbf29ce484222325ULL;
+    size_t i;
+
+    for (i = 0; i < nwords; i++) {
+	h ^= words[i];
+	h *= 0x100000001b3ULL;
+    }
+    return h;
+}
+
+/*
+ * Enable or disable recording of the files read by the parser.
+ */
+void
+sudoers_cache_record(bool onoff)
+{
+    debug_decl(sudoers_cache_record, SUDOERS_DEBUG_PARSER);
+
+    record_sources = onoff;
+
+    debug_return;
+}
+
+/*
+ * Forget the files read during a previous parse.
+ */
+void
+sudoers_cache_clear_sources(void)
+{
+    struct cache_source *src;
+    debug_decl(sudoers_cache_clear_sources, SUDOERS_DEBUG_PARSER);
+
+    while ((src = STAILQ_FIRST(&sources)) != NULL) {
+	STAILQ_REMOVE_HEAD(&sources, entries);
+	free(src->path);
+	free(src);
+    }
+
+    debug_return;
+}
+
+/*
+ * Called by the lexer for each included file and directory.
+ * Returns false on memory allocation failure, else true.
+ */
+bool
+sudoers_cache_add_source(const char *path, bool isdir)
+{
+    debug_decl(sudoers_cache_add_source, SUDOERS_DEBUG_PARSER);
+
+    if (!record_sources)
+	debug_return_bool(true);
+    debug_return_bool(add_source(path, isdir));
+}
+
+static bool
+add_source(const char *path, bool isdir)
+{
+    struct cache_source *src;
+    debug_decl(add_source, SUDOERS_DEBUG_PARSER);
+
+    STAILQ_FOREACH(src, &sources, entries) {
+	if (src->isdir == isdir && strcmp(src->path, path) == 0)
+	    debug_return_bool(true);
+    }
+    if ((src = malloc(sizeof(*src))) == NULL ||
+	    (src->path = strdup(path)) == NULL) {
+	free(src);
+	debug_return_bool(false);
+    }
+    src->isdir = isdir;
+    STAILQ_INSERT_TAIL(&sources, src, entries);
+
+    debug_return_bool(true);
+}
+
+/*
+ * Stat a source file or directory using the same security checks
+ * that are used when sudoers reads it.
+ * Returns a SUDO_PATH_* value.
+ */
+static int
+cache_stat_source(const char *path, bool isdir, struct stat *sb)
+{
+    if (isdir)
+	return sudo_secure_dir(path, sudoers_uid, sudoers_gid, sb);
+    return sudo_secure_file(path, sudoers_uid, sudoers_gid, sb);
+}
+
+/*
+ * Append count words to a cache buffer, growing it as needed.
+ */
+static void
+buf_append(struct cache_writer *cw, struct cache_buf *buf,
+    const uint32_t *words, size_t count)
+{
+    if (cw->error)
+	return;
+
+    if (buf->len + count > buf->size) {
+	size_t newsize = buf->size ? buf->size : 1024;
+	uint32_t *newwords;
+
+	while (buf->len + count > newsize)
+	    newsize *= 2;
+	newwords = reallocarray(buf->words, newsize, sizeof(uint32_t));
+	if (newwords == NULL) {
+	    cw->error = true;
+	    return;
+	}
+	buf->words = newwords;
+	buf->size = newsize;
+    }
+    memcpy(buf->words + buf->len, words, count * sizeof(uint32_t));
+    buf->len += count;
+}
+
+static void
+put_u32(struct cache_writer *cw, uint32_t val)
+{
+    buf_append(cw, &cw->tree, &val, 1);
+}
+
+static void
+put_u64(struct cache_writer *cw, uint64_t val)
+{
+    put_u32(cw, (uint32_t)(val >> 32));
+    put_u32(cw, (uint32_t)(val & 0xffffffff));
+}
+
+static int
+cache_string_compare(const void *v1, const void *v2)
+{
+    const struct cache_string *cs1 = v1;
+    const struct cache_string *cs2 = v2;
+
+    return strcmp(cs1->str, cs2->str);
+}
+
+/*
+ * Store a reference to str in the tree, adding it to the string
+ * table if it is not already present.
+ */
+static void
+put_str(struct cache_writer *cw, const char *str)
+{
+    struct cache_string key, *cs;
+    struct rbnode *node;
+    uint32_t i, len, zero = 0;
+    size_t start;
+
+    if (str == NULL) {
+	put_u32(cw, 0);
+	return;
+    }
+    if (cw->error)
+	return;
+
+    key.str = str;
+    if ((node = rbfind(cw->strtab, &key)) != NULL) {
+	cs = node->data;
+	put_u32(cw, cs->idx);
+	return;
+    }
+
+    if ((cs = malloc(sizeof(*cs))) == NULL) {
+	cw->error = true;
+	return;
+    }
+    cs->str = str;
+    cs->idx = ++cw->nstrings;
+    if (rbinsert(cw->strtab, cs, NULL) != 0) {
+	free(cs);
+	cw->error = true;
+	return;
+    }
+
+    /* Strings are stored as a length followed by NUL-terminated text. */
+    len = strlen(str);
+    buf_append(cw, &cw->strings, &len, 1);
+    start = cw->strings.len;
+    for (i = 0; i <= len / 4; i++)
+	buf_append(cw, &cw->strings, &zero, 1);
+    if (!cw->error)
+	memcpy(cw->strings.words + start, str, len);
+
+    put_u32(cw, cs->idx);
+}
+
+#if defined(HAVE_SELINUX) || defined(HAVE_PRIV_SET)
+/*
+ * Store a string that may be shared with the previous entry.
+ */
+static void
+put_shared_str(struct cache_writer *cw, const char *str, const char *prev)
+{
+    if (str == NULL) {
+	put_u32(cw, CACHE_PTR_NULL);
+    } else if (str == prev) {
+	put_u32(cw, CACHE_PTR_PREV);
+    } else {
+	put_u32(cw, CACHE_PTR_NEW);
+	put_str(cw, str);
+    }
+}
+#endif /* HAVE_SELINUX || HAVE_PRIV_SET */
+
+static void
+put_member(struct cache_writer *cw, const struct member *m)
+{
+    put_u32(cw, (uint32_t)m->type);
+    put_u32(cw, (uint32_t)m->negated);
+    if (m->type == COMMAND) {
+	const struct sudo_command *c = (const struct sudo_command *)m->name;
+
+	put_str(cw, c->cmnd);
+	put_str(cw, c->args);
+	if (c->digest != NULL) {
+	    put_u32(cw, 1);
+	    put_u32(cw, c->digest->digest_type);
+	    put_str(cw, c->digest->digest_str);
+	} else {
+	    put_u32(cw, 0);
+	}
+    } else {
+	put_str(cw, m->name);
+    }
+}
+
+static void
+put_members(struct cache_writer *cw, const struct member_list *members)
+{
+    const struct member *m;
+    uint32_t count = 0;
+
+    TAILQ_FOREACH(m, members, entries)
+	count++;
+    put_u32(cw, count);
+    TAILQ_FOREACH(m, members, entries)
+	put_member(cw, m);
+}
+
+/*
+ * Store a member list that may be shared with the previous entry.
+ */
+static void
+put_shared_members(struct cache_writer *cw, const struct member_list *members,
+    const struct member_list *prev)
+{
+    if (members == NULL) {
+	put_u32(cw, CACHE_PTR_NULL);
+    } else if (members == prev) {
+	put_u32(cw, CACHE_PTR_PREV);
+    } else {
+	put_u32(cw, CACHE_PTR_NEW);
+	put_members(cw, members);
+    }
+}
+
+static void
+put_defaults(struct cache_writer *cw, const struct defaults_list *defs)
+{
+    const struct member_list *prev_binding = NULL;
+    const struct defaults *def;
+    uint32_t count = 0;
+
+    TAILQ_FOREACH(def, defs, entries)
+	count++;
+    put_u32(cw, count);
+    TAILQ_FOREACH(def, defs, entries) {
+	put_str(cw, def->var);
+	put_str(cw, def->val);
+	put_shared_members(cw, def->binding, prev_binding);
+	prev_binding = def->binding;
+	put_str(cw, def->file);
+	put_u32(cw, (uint32_t)def->type);
+	put_u32(cw, (uint32_t)def->op);
+	put_u32(cw, (uint32_t)def->lineno);
+    }
+}
+
+static void
+put_cmndspec(struct cache_writer *cw, const struct cmndspec *cs,
+    const struct cmndspec *prev)
+{
+    put_shared_members(cw, cs->runasuserlist,
+	prev ? prev->runasuserlist : NULL);
+    put_shared_members(cw, cs->runasgrouplist,
+	prev ? prev->runasgrouplist : NULL);
+    put_member(cw, cs->cmnd);
+    put_u32(cw, (uint32_t)cs->tags.nopasswd);
+    put_u32(cw, (uint32_t)cs->tags.noexec);
+    put_u32(cw, (uint32_t)cs->tags.setenv);
+    put_u32(cw, (uint32_t)cs->tags.log_input);
+    put_u32(cw, (uint32_t)cs->tags.log_output);
+    put_u32(cw, (uint32_t)cs->tags.send_mail);
+    put_u32(cw, (uint32_t)cs->tags.follow);
+    put_u32(cw, (uint32_t)cs->timeout);
+    put_u64(cw, (uint64_t)cs->notbefore);
+    put_u64(cw, (uint64_t)cs->notafter);
+#ifdef HAVE_SELINUX
+    put_shared_str(cw, cs->role, prev ? prev->role : NULL);
+    put_shared_str(cw, cs->type, prev ? prev->type : NULL);
+#endif
+#ifdef HAVE_PRIV_SET
+    put_shared_str(cw, cs->privs, prev ? prev->privs : NULL);
+    put_shared_str(cw, cs->limitprivs, prev ? prev->limitprivs : NULL);
+#endif
+}
+
+static void
+put_privilege(struct cache_writer *cw, const struct privilege *priv)
+{
+    const struct cmndspec *cs, *prev = NULL;
+    uint32_t count = 0;
+
+    put_str(cw, priv->ldap_role);
+    put_members(cw, &priv->hostlist);
+    TAILQ_FOREACH(cs, &priv->cmndlist, entries)
+	count++;
+    put_u32(cw, count);
+    TAILQ_FOREACH(cs, &priv->cmndlist, entries) {
+	put_cmndspec(cw, cs, prev);
+	prev = cs;
+    }
+    put_defaults(cw, &priv->defaults);
+}
+
+static void
+put_userspec(struct cache_writer *cw, const struct userspec *us)
+{
+    const struct sudoers_comment *comment;
+    const struct privilege *priv;
+    uint32_t count = 0;
+
+    put_members(cw, &us->users);
+    TAILQ_FOREACH(priv, &us->privileges, entries)
+	count++;
+    put_u32(cw, count);
+    TAILQ_FOREACH(priv, &us->privileges, entries)
+	put_privilege(cw, priv);
+    count = 0;
+    STAILQ_FOREACH(comment, &us->comments, entries)
+	count++;
+    put_u32(cw, count);
+    STAILQ_FOREACH(comment, &us->comments, entries)
+	put_str(cw, comment->str);
+    put_u32(cw, (uint32_t)us->lineno);
+    put_str(cw, us->file);
+}
+
+static int
+count_alias(struct sudoers_parse_tree *parse_tree, struct alias *a, void *v)
+{
+    uint32_t *count = v;
+
+    (*count)++;
+    return 0;
+}
+
+static int
+put_alias(struct sudoers_parse_tree *parse_tree, struct alias *a, void *v)
+{
+    struct cache_writer *cw = v;
+
+    put_str(cw, a->name);
+    put_u32(cw, (uint32_t)a->type);
+    put_u32(cw, (uint32_t)a->lineno);
+    put_str(cw, a->file);
+    put_members(cw, &a->members);
+    return cw->error;
+}
+
+/*
+ * Store the stamp of each source in the cache.
+ * Returns false if a source does not pass the security checks
+ * sudoers uses when reading it.
+ */
+static bool
+put_sources(struct cache_writer *cw, const char *sudoers_path)
+{
+    struct cache_source *src;
+    struct timespec mtim;
+    struct stat sb;
+    uint32_t count = 0;
+    int status;
+    debug_decl(put_sources, SUDOERS_DEBUG_PARSER);
+
+    if (sudoers_path != NULL) {
+	if (!add_source(sudoers_path, false)) {
+	    cw->error = true;
+	    debug_return_bool(false);
+	}
+    }
+    STAILQ_FOREACH(src, &sources, entries)
+	count++;
+    put_u32(cw, count);
+    STAILQ_FOREACH(src, &sources, entries) {
+	status = cache_stat_source(src->path, src->isdir, &sb);
+	if (status != SUDO_PATH_SECURE) {
+	    /* A missing or insecure include dir is ignored by the parser. */
+	    if (!src->isdir || status == SUDO_PATH_BAD_TYPE) {
+		sudo_debug_printf(SUDO_DEBUG_WARN,
+		    "%s: %s is not secure (%d), not caching",
+		    __func__, src->path, status);
+		debug_return_bool(false);
+	    }
+	    memset(&sb, 0, sizeof(sb));
+	}
+	mtim_get(&sb, mtim);
+	put_str(cw, src->path);
+	put_u32(cw, src->isdir ? CACHE_SOURCE_DIR : CACHE_SOURCE_FILE);
+	put_u32(cw, (uint32_t)status);
+	put_u64(cw, (uint64_t)sb.st_dev);
+	put_u64(cw, (uint64_t)sb.st_ino);
+	put_u64(cw, (uint64_t)sb.st_size);
+	put_u64(cw, (uint64_t)mtim.tv_sec);
+	put_u32(cw, (uint32_t)mtim.tv_nsec);
+	put_u64(cw, (uint64_t)sb.st_ctime);
+    }
+    debug_return_bool(true);
+}
+
+/*
+ * Write the parse tree to a cache file at path.
+ * The sources read by the parser (and sudoers_path itself, if not NULL)
+ * are checked and stamped at the time the cache is written.
+ * The file is written to a temporary file and renamed into place.
+ * Returns true on success, false if the cache could not be written.
+ */
+bool
+sudoers_cache_write(const char *path, const char *sudoers_path,
+    struct sudoers_parse_tree *parse_tree)
+{
+    struct sudoers_cache_header hdr;
+    struct cache_writer cw;
+    const struct userspec *us;
+    char *tpath = NULL;
+    uint32_t count;
+    bool ret = false;
+    int fd = -1;
+    debug_decl(sudoers_cache_write, SUDOERS_DEBUG_PARSER);
+
+    memset(&cw, 0, sizeof(cw));
+    if ((cw.strtab = rbcreate(cache_string_compare)) == NULL)
+	goto done;
+
+    /* The host name may be used to expand #include paths. */
+    put_str(&cw, user_shost);
+    if (!put_sources(&cw, sudoers_path))
+	goto done;
+
+    put_defaults(&cw, &parse_tree->defaults);
+
+    count = 0;
+    if (parse_tree->aliases != NULL) {
+	alias_apply(parse_tree, count_alias, &count);
+	put_u32(&cw, count);
+	alias_apply(parse_tree, put_alias, &cw);
+    } else {
+	put_u32(&cw, 0);
+    }
+
+    count = 0;
+    TAILQ_FOREACH(us, &parse_tree->userspecs, entries)
+	count++;
+    put_u32(&cw, count);
+    TAILQ_FOREACH(us, &parse_tree->userspecs, entries)
+	put_userspec(&cw, us);
+    if (cw.error) {
+	sudo_warnx(U_("%s: %s"), __func__, U_("unable to allocate memory"));
+	goto done;
+    }
+
+    memset(&hdr, 0, sizeof(hdr));
+    hdr.magic = SUDOERS_CACHE_MAGIC;
+    hdr.version = SUDOERS_CACHE_VERSION;
+    hdr.grammar_version = SUDOERS_GRAMMAR_VERSION;
+    hdr.flags = SUDOERS_CACHE_FLAGS;
+    hdr.nstrings = cw.nstrings;
+    hdr.strwords = cw.strings.len;
+    hdr.treewords = cw.tree.len;
+    hdr.checksum = cache_checksum(cw.strings.words, cw.strings.len);
+    hdr.checksum ^= cache_checksum(cw.tree.words, cw.tree.len);
+    strlcpy(hdr.package_version, PACKAGE_VERSION, sizeof(hdr.package_version));
+
+    /* Write to a temporary file and rename it into place. */
+    if (asprintf(&tpath, "%s.XXXXXX", path) == -1) {
+	tpath = NULL;
+	sudo_warnx(U_("%s: %s"), __func__, U_("unable to allocate memory"));
+	goto done;
+    }
+    if ((fd = mkstemp(tpath)) == -1) {
+	sudo_warn(U_("unable to create %s"), tpath);
+	free(tpath);
+	tpath = NULL;
+	goto done;
+    }
+    if (fchown(fd, sudoers_uid, sudoers_gid) != 0) {
+	sudo_warn(U_("unable to set (uid, gid) of %s to (%u, %u)"),
+	    tpath, (unsigned int)sudoers_uid, (unsigned int)sudoers_gid);
+	goto done;
+    }
+    if (fchmod(fd, sudoers_mode) != 0) {
+	sudo_warn(U_("unable to change mode of %s to 0%o"), tpath,
+	    (unsigned int)sudoers_mode);
+	goto done;
+    }
+    if (write(fd, &hdr, sizeof(hdr)) != sizeof(hdr) ||
+	write(fd, cw.strings.words, cw.strings.len * sizeof(uint32_t)) !=
+	    (ssize_t)(cw.strings.len * sizeof(uint32_t)) ||
+	write(fd, cw.tree.words, cw.tree.len * sizeof(uint32_t)) !=
+	    (ssize_t)(cw.tree.len * sizeof(uint32_t))) {
+	sudo_warn(U_("unable to write to %s"), tpath);
+	goto done;
+    }
+    if (close(fd) != 0) {
+	fd = -1;
+	sudo_warn(U_("unable to write to %s"), tpath);
+	goto done;
+    }
+    fd = -1;
+    if (rename(tpath, path) != 0) {
+	sudo_warn(U_("unable to rename %s to %s"), tpath, path);
+	goto done;
+    }
+    free(tpath);
+    tpath = NULL;
+    ret = true;
+
+done:
+    if (fd != -1)
+	close(fd);
+    if (tpath != NULL) {
+	unlink(tpath);
+	free(tpath);
+    }
+    if (cw.strtab != NULL)
+	rbdestroy(cw.strtab, free);
+    free(cw.strings.words);
+    free(cw.tree.words);
+    debug_return_bool(ret);
+}
+
+static uint32_t
+get_u32(struct cache_reader *cr)
+{
+    if (cr->cur >= cr->end) {
+	cr->error = true;
+	return 0;
+    }
+    return *cr->cur++;
+}
+
+static uint64_t
+get_u64(struct cache_reader *cr)
+{
+    uint64_t val = (uint64_t)get_u32(cr) << 32;
+    return val | get_u32(cr);
+}
+
+/*
+ * Return a pointer to a string in the mapped string table.
+ */
+static const char *
+get_str_ref(struct cache_reader *cr, uint32_t *idxp)
+{
+    uint32_t idx = get_u32(cr);
+
+    if (idx > cr->nstrings) {
+	cr->error = true;
+	idx = 0;
+    }
+    if (idxp != NULL)
+	*idxp = idx;
+    return idx ? cr->strings[idx - 1] : NULL;
+}
+
+/*
+ * Return a heap copy of a string in the cache.
+ */
+static char *
+get_str(struct cache_reader *cr)
+{
+    const char *str = get_str_ref(cr, NULL);
+    char *copy = NULL;
+
+    if (str != NULL) {
+	if ((copy = strdup(str)) == NULL)
+	    cr->error = true;
+    }
+    return copy;
+}
+
+/*
+ * Return a reference-counted file name, shared by all users.
+ */
+static char *
+get_rcstr(struct cache_reader *cr)
+{
+    uint32_t idx;
+    const char *str = get_str_ref(cr, &idx);
+
+    if (str == NULL)
+	return NULL;
+    if (cr->rcstrs[idx - 1] == NULL) {
+	if ((cr->rcstrs[idx - 1] = rcstr_dup(str)) == NULL) {
+	    cr->error = true;
+	    return NULL;
+	}
+    }
+    return rcstr_addref(cr->rcstrs[idx - 1]);
+}
+
+#if defined(HAVE_SELINUX) || defined(HAVE_PRIV_SET)
+/*
+ * Read a string that may be shared with the previous entry.
+ */
+static char *
+get_shared_str(struct cache_reader *cr, char *prev)
+{
+    switch (get_u32(cr)) {
+    case CACHE_PTR_NULL:
+	return NULL;
+    case CACHE_PTR_PREV:
+	if (prev == NULL)
+	    cr->error = true;
+	return prev;
+    case CACHE_PTR_NEW:
+	return get_str(cr);
+    default:
+	cr->error = true;
+	return NULL;
+    }
+}
+#endif /* HAVE_SELINUX || HAVE_PRIV_SET */
+
+static struct member *
+get_member(struct cache_reader *cr)
+{
+    struct member *m;
+    debug_decl(get_member, SUDOERS_DEBUG_PARSER);
+
+    if ((m = calloc(1, sizeof(*m))) == NULL) {
+	cr->error = true;
+	debug_return_ptr(NULL);
+    }
+    m->type = (short)get_u32(cr);
+    m->negated = (short)get_u32(cr);
+    if (m->type == COMMAND) {
+	struct sudo_command *c;
+
+	if ((c = calloc(1, sizeof(*c))) == NULL) {
+	    cr->error = true;
+	    free(m);
+	    debug_return_ptr(NULL);
+	}
+	m->name = (char *)c;
+	c->cmnd = get_str(cr);
+	c->args = get_str(cr);
+	if (get_u32(cr) != 0) {
+	    if ((c->digest = malloc(sizeof(*c->digest))) == NULL) {
+		cr->error = true;
+	    } else {
+		c->digest->digest_type = get_u32(cr);
+		c->digest->digest_str = get_str(cr);
+	    }
+	}
+    } else {
+	m->name = get_str(cr);
+    }
+    debug_return_ptr(m);
+}
+
+/*
+ * Read a list of members, appending them to members.
+ * On error, the members read so far are left on the list.
+ */
+static void
+get_members(struct cache_reader *cr, struct member_list *members)
+{
+    struct member *m;
+    uint32_t count;
+
+    for (count = get_u32(cr); count > 0 && !cr->error; count--) {
+	if ((m = get_member(cr)) == NULL)
+	    break;
+	TAILQ_INSERT_TAIL(members, m, entries);
+    }
+}
+
+/*
+ * Read a member list that may be shared with the previous entry.
+ */
+static struct member_list *
+get_shared_members(struct cache_reader *cr, struct member_list *prev)
+{
+    struct member_list *members;
+
+    switch (get_u32(cr)) {
+    case CACHE_PTR_NULL:
+	return NULL;
+    case CACHE_PTR_PREV:
+	if (prev == NULL)
+	    cr->error = true;
+	return prev;
+    case CACHE_PTR_NEW:
+	if ((members = malloc(sizeof(*members))) == NULL) {
+	    cr->error = true;
+	    return NULL;
+	}
+	TAILQ_INIT(members);
+	get_members(cr, members);
+	return members;
+    default:
+	cr->error = true;
+	return NULL;
+    }
+}
+
+static void
+get_defaults(struct cache_reader *cr, struct defaults_list *defs)
+{
+    struct member_list *prev_binding = NULL;
+    struct defaults *def;
+    uint32_t count;
+    debug_decl(get_defaults, SUDOERS_DEBUG_PARSER);
+
+    for (count = get_u32(cr); count > 0 && !cr->error; count--) {
+	if ((def = calloc(1, sizeof(*def))) == NULL) {
+	    cr->error = true;
+	    break;
+	}
+	TAILQ_INSERT_TAIL(defs, def, entries);
+	def->var = get_str(cr);
+	def->val = get_str(cr);
+	def->binding = get_shared_members(cr, prev_binding);
+	prev_binding = def->binding;
+	def->file = get_rcstr(cr);
+	def->type = (short)get_u32(cr);
+	def->op = (char)get_u32(cr);
+	def->lineno = (int)get_u32(cr);
+    }
+
+    debug_return;
+}
+
+static void
+get_privilege(struct cache_reader *cr, struct privilege *priv)
+{
+    struct cmndspec *cs, *prev = NULL;
+    uint32_t count;
+    debug_decl(get_privilege, SUDOERS_DEBUG_PARSER);
+
+    priv->ldap_role = get_str(cr);
+    get_members(cr, &priv->hostlist);
+    for (count = get_u32(cr); count > 0 && !cr->error; count--) {
+	if ((cs = calloc(1, sizeof(*cs))) == NULL) {
+	    cr->error = true;
+	    break;
+	}
+	cs->runasuserlist = get_shared_members(cr,
+	    prev ? prev->runasuserlist : NULL);
+	cs->runasgrouplist = get_shared_members(cr,
+	    prev ? prev->runasgrouplist : NULL);
+	if ((cs->cmnd = get_member(cr)) == NULL) {
+	    /* Keep the shared lists owned by the previous entry. */
+	    if (cs->runasuserlist != NULL && (prev == NULL ||
+		    cs->runasuserlist != prev->runasuserlist)) {
+		free_members(cs->runasuserlist);
+		free(cs->runasuserlist);
+	    }
+	    if (cs->runasgrouplist != NULL && (prev == NULL ||
+		    cs->runasgrouplist != prev->runasgrouplist)) {
+		free_members(cs->runasgrouplist);
+		free(cs->runasgrouplist);
+	    }
+	    free(cs);
+	    break;
+	}
+	TAILQ_INSERT_TAIL(&priv->cmndlist, cs, entries);
+	cs->tags.nopasswd = (int)get_u32(cr);
+	cs->tags.noexec = (int)get_u32(cr);
+	cs->tags.setenv = (int)get_u32(cr);
+	cs->tags.log_input = (int)get_u32(cr);
+	cs->tags.log_output = (int)get_u32(cr);
+	cs->tags.send_mail = (int)get_u32(cr);
+	cs->tags.follow = (int)get_u32(cr);
+	cs->timeout = (int)get_u32(cr);
+	cs->notbefore = (time_t)get_u64(cr);
+	cs->notafter = (time_t)get_u64(cr);
+#ifdef HAVE_SELINUX
+	cs->role = get_shared_str(cr, prev ? prev->role : NULL);
+	cs->type = get_shared_str(cr, prev ? prev->type : NULL);
+#endif
+#ifdef HAVE_PRIV_SET
+	cs->privs = get_shared_str(cr, prev ? prev->privs : NULL);
+	cs->limitprivs = get_shared_str(cr, prev ? prev->limitprivs : NULL);
+#endif
+	prev = cs;
+    }
+    get_defaults(cr, &priv->defaults);
+
+    debug_return;
+}
+
+static void
+get_userspec(struct cache_reader *cr, struct userspec *us)
+{
+    struct sudoers_comment *comment;
+    struct privilege *priv;
+    uint32_t count;
+    debug_decl(get_userspec, SUDOERS_DEBUG_PARSER);
+
+    get_members(cr, &us->users);
+    for (count = get_u32(cr); count > 0 && !cr->error; count--) {
+	if ((priv = calloc(1, sizeof(*priv))) == NULL) {
+	    cr->error = true;
+	    break;
+	}
+	TAILQ_INIT(&priv->hostlist);
+	TAILQ_INIT(&priv->cmndlist);
+	TAILQ_INIT(&priv->defaults);
+	TAILQ_INSERT_TAIL(&us->privileges, priv, entries);
+	get_privilege(cr, priv);
+    }
+    for (count = get_u32(cr); count > 0 && !cr->error; count--) {
+	if ((comment = malloc(sizeof(*comment))) == NULL) {
+	    cr->error = true;
+	    break;
+	}
+	STAILQ_INSERT_TAIL(&us->comments, comment, entries);
+	comment->str = get_str(cr);
+    }
+    us->lineno = (int)get_u32(cr);
+    us->file = get_rcstr(cr);
+
+    debug_return;
+}
+
+static void
+get_alias(struct cache_reader *cr, struct sudoers_parse_tree *parse_tree)
+{
+    struct alias *a;
+    debug_decl(get_alias, SUDOERS_DEBUG_PARSER);
+
+    if ((a = calloc(1, sizeof(*a))) == NULL) {
+	cr->error = true;
+	debug_return;
+    }
+    TAILQ_INIT(&a->members);
+    a->name = get_str(cr);
+    a->type = (unsigned short)get_u32(cr);
+    a->lineno = (int)get_u32(cr);
+    a->file = get_rcstr(cr);
+    get_members(cr, &a->members);
+    if (cr->error || a->name == NULL ||
+	    rbinsert(parse_tree->aliases, a, NULL) != 0) {
+	cr->error = true;
+	alias_free(a);
+    }
+
+    debug_return;
+}
+
+/*
+ * Check that the sources recorded in the cache have not changed.
+ * Returns true if they are unchanged, else false.
+ */
+static bool
+check_sources(struct cache_reader *cr)
+{
+    struct timespec mtim;
+    const char *path;
+    struct stat sb;
+    uint32_t count, type, status;
+    debug_decl(check_sources, SUDOERS_DEBUG_PARSER);
+
+    for (count = get_u32(cr); count > 0 && !cr->error; count--) {
+	path = get_str_ref(cr, NULL);
+	type = get_u32(cr);
+	status = get_u32(cr);
+	if (path == NULL || cr->error)
+	    break;
+	if ((uint32_t)cache_stat_source(path, type == CACHE_SOURCE_DIR, &sb)
+		!= status) {
+	    sudo_debug_printf(SUDO_DEBUG_INFO, "%s: %s status changed",
+		__func__, path);
+	    debug_return_bool(false);
+	}
+	if (status != SUDO_PATH_SECURE)
+	    memset(&sb, 0, sizeof(sb));
+	mtim_get(&sb, mtim);
+	if (get_u64(cr) != (uint64_t)sb.st_dev ||
+		get_u64(cr) != (uint64_t)sb.st_ino ||
+		get_u64(cr) != (uint64_t)sb.st_size ||
+		get_u64(cr) != (uint64_t)mtim.tv_sec ||
+		get_u32(cr) != (uint32_t)mtim.tv_nsec ||
+		get_u64(cr) != (uint64_t)sb.st_ctime) {
+	    sudo_debug_printf(SUDO_DEBUG_INFO, "%s: %s modified",
+		__func__, path);
+	    debug_return_bool(false);
+	}
+    }
+    debug_return_bool(!cr->error);
+}
+
+/*
+ * Build the string table from the mapped image.
+ */
+static bool
+read_strings(struct cache_reader *cr, const uint32_t *words, size_t nwords)
+{
+    const uint32_t *end = words + nwords;
+    uint32_t i, len;
+    debug_decl(read_strings, SUDOERS_DEBUG_PARSER);
+
+    cr->strings = reallocarray(NULL, cr->nstrings, sizeof(char *));
+    cr->rcstrs = calloc(cr->nstrings, sizeof(char *));
+    if ((cr->strings == NULL || cr->rcstrs == NULL) && cr->nstrings != 0) {
+	sudo_warnx(U_("%s: %s"), __func__, U_("unable to allocate memory"));
+	debug_return_bool(false);
+    }
+    for (i = 0; i < cr->nstrings; i++) {
+	if (words >= end)
+	    debug_return_bool(false);
+	len = *words++;
+	if ((size_t)(end - words) <= len / 4)
+	    debug_return_bool(false);
+	cr->strings[i] = (const char *)words;
+	if (cr->strings[i][len] != '\0')
+	    debug_return_bool(false);
+	words += len / 4 + 1;
+    }
+    debug_return_bool(words == end);
+}
+
+/*
+ * Load a parse tree from the cache file at path.
+ * If verify is set, the cache is only used if it is owned
+ * by the sudoers owner and the files it was built from are unchanged.
+ * Returns true if parse_tree was filled in from the cache, else false.
+ */
+bool
+sudoers_cache_read(const char *path, struct sudoers_parse_tree *parse_tree,
+    bool verify)
+{
+    const struct sudoers_cache_header *hdr;
+    struct cache_reader cr;
+    struct userspec *us;
+    struct stat sb, fsb;
+    const uint32_t *body;
+    void *map = MAP_FAILED;
+    const char *host;
+    uint32_t count, i;
+    bool ret = false;
+    int fd = -1;
+    debug_decl(sudoers_cache_read, SUDOERS_DEBUG_PARSER);
+
+    memset(&cr, 0, sizeof(cr));
+
+    if (verify) {
+	if (sudo_secure_file(path, sudoers_uid, sudoers_gid, &sb) !=
+		SUDO_PATH_SECURE) {
+	    sudo_debug_printf(SUDO_DEBUG_INFO,
+		"%s: %s missing or insecure", __func__, path);
+	    goto done;
+	}
+    }
+    if ((fd = open(path, O_RDONLY)) == -1 || fstat(fd, &fsb) == -1) {
+	sudo_debug_printf(SUDO_DEBUG_INFO|SUDO_DEBUG_ERRNO,
+	    "%s: unable to open %s", __func__, path);
+	goto done;
+    }
+    if (verify && (fsb.st_dev != sb.st_dev || fsb.st_ino != sb.st_ino))
+	goto done;
+    if (fsb.st_size < ssizeof(*hdr))
+	goto done;
+    map = mmap(NULL, fsb.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (map == MAP_FAILED) {
+	sudo_debug_printf(SUDO_DEBUG_ERROR|SUDO_DEBUG_ERRNO,
+	    "%s: unable to map %s", __func__, path);
+	goto done;
+    }
+
+    /* Check the header and body before using the contents. */
+    hdr = map;
+    if (hdr->magic != SUDOERS_CACHE_MAGIC ||
+	    hdr->version != SUDOERS_CACHE_VERSION ||
+	    hdr->grammar_version != SUDOERS_GRAMMAR_VERSION ||
+	    hdr->flags != SUDOERS_CACHE_FLAGS ||
+	    strncmp(hdr->package_version, PACKAGE_VERSION,
+	    sizeof(hdr->package_version)) != 0) {
+	sudo_debug_printf(SUDO_DEBUG_INFO, "%s: %s version mismatch",
+	    __func__, path);
+	goto done;
+    }
+    if ((uint64_t)fsb.st_size != sizeof(*hdr) +
+	    ((uint64_t)hdr->strwords + hdr->treewords) * sizeof(uint32_t)) {
+	sudo_debug_printf(SUDO_DEBUG_WARN, "%s: %s truncated",
+	    __func__, path);
+	goto done;
+    }
+    body = (const uint32_t *)(hdr + 1);
+    if ((cache_checksum(body, hdr->strwords) ^
+	    cache_checksum(body + hdr->strwords, hdr->treewords)) !=
+	    hdr->checksum) {
+	sudo_debug_printf(SUDO_DEBUG_WARN, "%s: %s checksum mismatch",
+	    __func__, path);
+	goto done;
+    }
+    cr.nstrings = hdr->nstrings;
+    if (!read_strings(&cr, body, hdr->strwords)) {
+	sudo_debug_printf(SUDO_DEBUG_WARN, "%s: %s bad string table",
+	    __func__, path);
+	goto done;
+    }
+    cr.cur = body + hdr->strwords;
+    cr.end = cr.cur + hdr->treewords;
+
+    /* Include paths may have been expanded using the host name. */
+    host = get_str_ref(&cr, NULL);
+    if (host != NULL && (user_shost == NULL || strcmp(host, user_shost) != 0))
+	goto done;
+    if (verify) {
+	if (!check_sources(&cr))
+	    goto done;
+    } else {
+	/* Skip the source stamps. */
+	for (count = get_u32(&cr); count > 0 && !cr.error; count--) {
+	    for (i = 0; i < 14; i++)
+		(void)get_u32(&cr);
+	}
+    }
+
+    get_defaults(&cr, &parse_tree->defaults);
+
+    count = get_u32(&cr);
+    if (count != 0 && !cr.error) {
+	if ((parse_tree->aliases = alloc_aliases()) == NULL)
+	    cr.error = true;
+    }
+    for (; count > 0 && !cr.error; count--)
+	get_alias(&cr, parse_tree);
+
+    for (count = get_u32(&cr); count > 0 && !cr.error; count--) {
+	if ((us = calloc(1, sizeof(*us))) == NULL) {
+	    cr.error = true;
+	    break;
+	}
+	TAILQ_INIT(&us->users);
+	TAILQ_INIT(&us->privileges);
+	STAILQ_INIT(&us->comments);
+	TAILQ_INSERT_TAIL(&parse_tree->userspecs, us, entries);
+	get_userspec(&cr, us);
+    }
+    if (cr.error || cr.cur != cr.end) {
+	sudo_debug_printf(SUDO_DEBUG_WARN, "%s: %s is corrupt",
+	    __func__, path);
+	free_parse_tree(parse_tree);
+	init_parse_tree(parse_tree, NULL, NULL);
+	goto done;
+    }
+    sudo_debug_printf(SUDO_DEBUG_INFO, "%s: loaded policy from %s",
+	__func__, path);
+    ret = true;
+
+done:
+    if (cr.rcstrs != NULL) {
+	for (i = 0; i < cr.nstrings; i++)
+	    rcstr_delref(cr.rcstrs[i]);
+	free(cr.rcstrs);
+    }
+    free(cr.strings);
+    if (map != MAP_FAILED)
+	munmap(map, fsb.st_size);
+    if (fd != -1)
+	close(fd);
+    debug_return_bool(ret);
+}
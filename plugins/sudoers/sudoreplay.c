@@ -141,6 +141,20 @@ static double speed_factor = 1.0;
 
 static const char *session_dir = _PATH_SUDO_IO_LOGDIR;
 
+static FILE *index_rebuild_fp;
+
+/*
+ * Sessions found by rebuild_index() whose log file was written shortly
+ * before or during the rebuild.  They may also have been appended to
+ * the existing index while it was being rebuilt.
+ */
+static time_t index_rebuild_start;
+static char **index_recent;
+static size_t index_recent_len, index_recent_size;
+
+/* Sessions older than this when the rebuild starts are not tracked. */
+#define INDEX_REBUILD_SLACK	60
+
 static bool terminal_can_resize, terminal_was_resized;
 
 static int terminal_lines, terminal_cols;
@@ -156,14 +170,17 @@ static struct iolog_file iolog_files[] = {
     { true, },	/* IOFD_TIMING */
 };
 
-static const char short_opts[] =  "d:f:hlm:nRSs:V";
+static const char short_opts[] =  "d:f:hIj:lm:no:RSs:V";
 static struct option long_opts[] = {
     { "directory",	required_argument,	NULL,	'd' },
     { "filter",		required_argument,	NULL,	'f' },
     { "help",		no_argument,		NULL,	'h' },
+    { "rebuild-index",	no_argument,		NULL,	'I' },
+    { "jobs",		required_argument,	NULL,	'j' },
     { "list",		no_argument,		NULL,	'l' },
     { "max-wait",	required_argument,	NULL,	'm' },
     { "non-interactive", no_argument,		NULL,	'n' },
+    { "offset",		required_argument,	NULL,	'o' },
     { "no-resize",	no_argument,		NULL,	'R' },
     { "suspend-wait",	no_argument,		NULL,	'S' },
     { "speed",		required_argument,	NULL,	's' },
@@ -175,13 +192,16 @@ static struct option long_opts[] = {
 extern char *get_timestr(time_t, int);
 extern time_t get_date(char *);
 
-static int list_sessions(int, char **, const char *, const char *, const char *);
+static int find_sessions(const char *, regex_t *, const char *, const char *);
+static int list_sessions(int, char **, const char *, const char *, const char *, unsigned int);
+static int rebuild_index(void);
 static int parse_expr(struct search_node_list *, char **, bool);
 static void read_keyboard(int fd, int what, void *v);
+static void schedule_timing_record(struct replay_closure *closure);
 static void help(void) __attribute__((__noreturn__));
 static int replay_session(int iolog_dir_fd, const char *iolog_dir,
-    struct timespec *max_wait, const char *decimal, bool interactive,
-    bool suspend_wait);
+    struct timespec *max_wait, struct timespec *offset, const char *decimal,
+    bool interactive, bool suspend_wait);
 static void sudoreplay_cleanup(void);
 static void usage(int);
 static void write_output(int fd, int what, void *v);
@@ -193,14 +213,16 @@ static void setup_terminal(struct iolog_info *li, bool interactive, bool resize)
     isalnum((unsigned char)(s)[3]) && isalnum((unsigned char)(s)[4]) && \
     isalnum((unsigned char)(s)[5]) && (s)[6] == '\0')
 
-#define IS_IDLOG(s) ( \
+/* Upper bound on the number of processes used to list sessions. */
+#define MAX_LIST_JOBS	1024
+
+#define IS_SESSID(s) ( \
     isalnum((unsigned char)(s)[0]) && isalnum((unsigned char)(s)[1]) && \
     (s)[2] == '/' && \
     isalnum((unsigned char)(s)[3]) && isalnum((unsigned char)(s)[4]) && \
     (s)[5] == '/' && \
     isalnum((unsigned char)(s)[6]) && isalnum((unsigned char)(s)[7]) && \
-    (s)[8] == '/' && (s)[9] == 'l' && (s)[10] == 'o' && (s)[11] == 'g' && \
-    (s)[12] == '\0')
+    (s)[8] == '\0')
 
 __dso_public int main(int argc, char *argv[]);
 
@@ -208,12 +230,15 @@ int
 main(int argc, char *argv[])
 {
     int ch, fd, i, iolog_dir_fd, len, exitcode = EXIT_FAILURE;
-    bool def_filter = true, listonly = false;
+    unsigned int njobs = 1;
+    bool def_filter = true, listonly = false, rebuild = false;
     bool interactive = true, suspend_wait = false, resize = true;
     const char *decimal, *id, *user = NULL, *pattern = NULL, *tty = NULL;
+    const char *errstr;
     char *cp, *ep, iolog_dir[PATH_MAX];
     struct iolog_info *li;
     struct timespec max_delay_storage, *max_delay = NULL;
+    struct timespec offset_storage, *offset = NULL;
     double dval;
     FILE *fp;
     debug_decl(main, SUDO_DEBUG_MAIN);
@@ -266,6 +291,14 @@ main(int argc, char *argv[])
 	case 'h':
 	    help();
 	    /* NOTREACHED */
+	case 'I':
+	    rebuild = true;
+	    break;
+	case 'j':
+	    njobs = sudo_strtonum(optarg, 1, MAX_LIST_JOBS, &errstr);
+	    if (errstr != NULL)
+		sudo_fatalx(U_("invalid number of jobs: %s"), optarg);
+	    break;
 	case 'l':
 	    listonly = true;
 	    break;
@@ -286,6 +319,16 @@ main(int argc, char *argv[])
 	case 'n':
 	    interactive = false;
 	    break;
+	case 'o':
+	    errno = 0;
+	    dval = strtod(optarg, &ep);
+	    if (*ep != '\0' || errno != 0 || dval < 0.0)
+		sudo_fatalx(U_("invalid offset: %s"), optarg);
+	    offset_storage.tv_sec = dval;
+	    offset_storage.tv_nsec =
+		(dval - offset_storage.tv_sec) * 1000000000.0;
+	    offset = &offset_storage;
+	    break;
 	case 'R':
 	    resize = false;
 	    break;
@@ -311,8 +354,15 @@ main(int argc, char *argv[])
     argc -= optind;
     argv += optind;
 
+    if (rebuild) {
+	if (listonly || argc != 0)
+	    usage(1);
+	exitcode = rebuild_index();
+	goto done;
+    }
+
     if (listonly) {
-	exitcode = list_sessions(argc, argv, pattern, user, tty);
+	exitcode = list_sessions(argc, argv, pattern, user, tty, njobs);
 	goto done;
     }
 
@@ -383,8 +433,8 @@ main(int argc, char *argv[])
     li = NULL;
 
     /* Replay session corresponding to iolog_files[]. */
-    exitcode = replay_session(iolog_dir_fd, iolog_dir, max_delay, decimal,
-	interactive, suspend_wait);
+    exitcode = replay_session(iolog_dir_fd, iolog_dir, max_delay, offset,
+	decimal, interactive, suspend_wait);
 
     restore_terminal_size();
     sudo_term_restore(ttyfd, true);
@@ -737,6 +787,19 @@ get_timing_record(struct replay_closure *closure)
 
     if ((ret = iolog_read_timing_record(&iolog_files[IOFD_TIMING], timing)) != 0)
 	debug_return_int(ret);
+    schedule_timing_record(closure);
+
+    debug_return_int(0);
+}
+
+/*
+ * Schedule the event for the timing record that was just read.
+ */
+static void
+schedule_timing_record(struct replay_closure *closure)
+{
+    struct timing_closure *timing = &closure->timing;
+    debug_decl(schedule_timing_record, SUDO_DEBUG_UTIL);
 
     /* Record number bytes to read. */
     if (timing->event != IO_EVENT_WINSIZE &&
@@ -754,6 +817,82 @@ get_timing_record(struct replay_closure *closure)
     if (sudo_ev_add(closure->evbase, closure->delay_ev, &timing->delay, false) == -1)
 	sudo_fatal(U_("unable to add event to queue"));
 
+    debug_return;
+}
+
+/*
+ * Skip to the specified offset from the start of the session and
+ * schedule the first timing record after it.
+ * If the session has a seek index, reading starts at the closest chunk
+ * before the offset instead of at the beginning of the I/O log files.
+ * Returns 0 on success, 1 on EOF and -1 on error.
+ */
+static int
+seek_session(struct replay_closure *closure, const struct timespec *offset)
+{
+    struct timing_closure *timing = &closure->timing;
+    struct timespec elapsed = { 0, 0 };
+    struct iolog_chunk chunk;
+    int i, lines = 0, cols = 0, ret;
+    debug_decl(seek_session, SUDO_DEBUG_UTIL);
+
+    if (iolog_chunk_find(closure->iolog_dir_fd, offset, &chunk)) {
+	for (i = 0; i < IOFD_MAX; i++) {
+	    if (!iolog_files[i].enabled)
+		continue;
+	    (void)iolog_close(&iolog_files[i], NULL);
+	    if (!iolog_open_offset(&iolog_files[i], closure->iolog_dir_fd, i,
+		    "r", chunk.offsets[i])) {
+		sudo_warn(U_("unable to open %s/%s"), closure->iolog_dir,
+		    iolog_fd_to_name(i));
+		debug_return_int(-1);
+	    }
+	}
+	elapsed = chunk.elapsed;
+	lines = chunk.lines;
+	cols = chunk.cols;
+    }
+
+    for (;;) {
+	ret = iolog_read_timing_record(&iolog_files[IOFD_TIMING], timing);
+	if (ret != 0)
+	    debug_return_int(ret);
+	sudo_timespecadd(&elapsed, &timing->delay, &elapsed);
+	if (sudo_timespeccmp(&elapsed, offset, >))
+	    break;
+
+	/* Skip over this record. */
+	switch (timing->event) {
+	case IO_EVENT_WINSIZE:
+	    lines = timing->u.winsize.lines;
+	    cols = timing->u.winsize.cols;
+	    break;
+	case IO_EVENT_STDIN:
+	case IO_EVENT_STDOUT:
+	case IO_EVENT_STDERR:
+	case IO_EVENT_TTYIN:
+	case IO_EVENT_TTYOUT:
+	    if (!iolog_files[timing->event].enabled)
+		break;
+	    if (iolog_seek(&iolog_files[timing->event],
+		    timing->u.nbytes, SEEK_CUR) == -1) {
+		sudo_warn(U_("%s/%s: unable to seek forward %zu"),
+		    closure->iolog_dir, iolog_fd_to_name(timing->event),
+		    timing->u.nbytes);
+		debug_return_int(-1);
+	    }
+	    break;
+	}
+    }
+
+    /* Apply the window size in effect at the offset. */
+    if (lines != 0 && cols != 0)
+	resize_terminal(lines, cols);
+
+    /* Only wait for what remains of the first record's delay. */
+    sudo_timespecsub(&elapsed, offset, &timing->delay);
+    schedule_timing_record(closure);
+
     debug_return_int(0);
 }
 
@@ -1007,8 +1146,8 @@ bad:
 
 static int
 replay_session(int iolog_dir_fd, const char *iolog_dir,
-    struct timespec *max_delay, const char *decimal, bool interactive,
-    bool suspend_wait)
+    struct timespec *max_delay, struct timespec *offset, const char *decimal,
+    bool interactive, bool suspend_wait)
 {
     struct replay_closure *closure;
     int ret = 0;
@@ -1017,7 +1156,12 @@ replay_session(int iolog_dir_fd, const char *iolog_dir,
     /* Allocate the delay closure and read the first timing record. */
     closure = replay_closure_alloc(iolog_dir_fd, iolog_dir, max_delay, decimal,
 	interactive, suspend_wait);
-    if (get_timing_record(closure) != 0) {
+    if (offset != NULL) {
+	if (seek_session(closure, offset) != 0) {
+	    ret = 1;
+	    goto done;
+	}
+    } else if (get_timing_record(closure) != 0) {
 	ret = 1;
 	goto done;
     }
@@ -1305,51 +1449,98 @@ match_expr(struct search_node_list *head, struct iolog_info *log, bool last_matc
     debug_return_bool(matched);
 }
 
+/*
+ * Convert a session path relative to session_dir to a session ID
+ * if possible, e.g. 00/00/01 to 000001.
+ */
+static const char *
+session_id(const char *session, char idbuf[7])
+{
+    if (!IS_SESSID(session))
+	return session;
+    idbuf[0] = session[0];
+    idbuf[1] = session[1];
+    idbuf[2] = session[3];
+    idbuf[3] = session[4];
+    idbuf[4] = session[6];
+    idbuf[5] = session[7];
+    idbuf[6] = '\0';
+    return idbuf;
+}
+
+static void
+print_session(struct iolog_info *li, const char *idstr)
+{
+    const char *timestr;
+    debug_decl(print_session, SUDO_DEBUG_UTIL);
+
+    /* XXX - print lines + cols? */
+    timestr = get_timestr(li->tstamp, 1);
+    printf("%s : %s : TTY=%s ; CWD=%s ; USER=%s ; ",
+	timestr ? timestr : "invalid date",
+	li->user, li->tty, li->cwd, li->runas_user);
+    if (li->runas_group)
+	printf("GROUP=%s ; ", li->runas_group);
+    printf("TSID=%s ; COMMAND=%s\n", idstr, li->cmd);
+
+    debug_return;
+}
+
+/*
+ * List the session whose log file is logfile, which is opened
+ * relative to the directory dfd as relname.
+ */
 static int
-list_session(char *logfile, regex_t *re, const char *user, const char *tty)
+list_session(int dfd, char *logfile, const char *relname, regex_t *re,
+    const char *user, const char *tty)
 {
-    char idbuf[7], *idstr, *cp;
+    char idbuf[7], *cp;
     struct iolog_info *li = NULL;
-    const char *timestr;
-    int ret = -1;
-    FILE *fp;
+    int fd, ret = -1;
+    FILE *fp = NULL;
     debug_decl(list_session, SUDO_DEBUG_UTIL);
 
-    if ((fp = fopen(logfile, "r")) == NULL) {
+    fd = openat(dfd, relname, O_RDONLY);
+    if (fd == -1 || (fp = fdopen(fd, "r")) == NULL) {
 	sudo_warn("%s", logfile);
+	if (fd != -1)
+	    close(fd);
 	goto done;
     }
     if ((li = iolog_parse_loginfo(fp, logfile)) == NULL)
 	goto done;
 
+    /* Convert from /var/log/sudo-sessions/00/00/01/log to 00/00/01 */
+    cp = logfile + strlen(session_dir) + 1;
+    cp[strlen(cp) - 4] = '\0';
+
+    /* When rebuilding the index, record every session. */
+    if (index_rebuild_fp != NULL) {
+	struct stat sb;
+
+	if (!iolog_index_write(index_rebuild_fp, cp, NULL, li, NULL))
+	    sudo_fatal(U_("unable to write to %s"), IOLOG_INDEX);
+	if (fstat(fd, &sb) == 0 &&
+		sb.st_mtime >= index_rebuild_start - INDEX_REBUILD_SLACK) {
+	    if (index_recent_len + 1 > index_recent_size) {
+		index_recent_size = index_recent_size ? index_recent_size * 2 : 64;
+		index_recent = reallocarray(index_recent, index_recent_size,
+		    sizeof(char *));
+		if (index_recent == NULL)
+		    sudo_fatalx(U_("%s: %s"), __func__, U_("unable to allocate memory"));
+	    }
+	    if ((index_recent[index_recent_len++] = strdup(cp)) == NULL)
+		sudo_fatalx(U_("%s: %s"), __func__, U_("unable to allocate memory"));
+	}
+	ret = 0;
+	goto done;
+    }
+
     /* Match on search expression if there is one. */
     if (!STAILQ_EMPTY(&search_expr) && !match_expr(&search_expr, li, true))
 	goto done;
 
-    /* Convert from /var/log/sudo-sessions/00/00/01/log to 000001 */
-    cp = logfile + strlen(session_dir) + 1;
-    if (IS_IDLOG(cp)) {
-	idbuf[0] = cp[0];
-	idbuf[1] = cp[1];
-	idbuf[2] = cp[3];
-	idbuf[3] = cp[4];
-	idbuf[4] = cp[6];
-	idbuf[5] = cp[7];
-	idbuf[6] = '\0';
-	idstr = idbuf;
-    } else {
-	/* Not an id, just use the iolog_file portion. */
-	cp[strlen(cp) - 4] = '\0';
-	idstr = cp;
-    }
-    /* XXX - print lines + cols? */
-    timestr = get_timestr(li->tstamp, 1);
-    printf("%s : %s : TTY=%s ; CWD=%s ; USER=%s ; ",
-	timestr ? timestr : "invalid date",
-	li->user, li->tty, li->cwd, li->runas_user);
-    if (li->runas_group)
-	printf("GROUP=%s ; ", li->runas_group);
-    printf("TSID=%s ; COMMAND=%s\n", idstr, li->cmd);
+    print_session(li, session_id(cp, idbuf));
 
     ret = 0;
 
@@ -1360,6 +1551,39 @@ done:
     debug_return_int(ret);
 }
 
+/*
+ * List sessions from the index instead of walking session_dir.
+ * Sessions are listed in the order they were created.
+ * The IOLOG_INDEX_HEADER has already been read from fp.
+ */
+static int
+list_index(FILE *fp)
+{
+    struct iolog_info li;
+    char *line = NULL, *host, *session, idbuf[7];
+    size_t linesize = 0;
+    unsigned int lineno = 0;
+    debug_decl(list_index, SUDO_DEBUG_UTIL);
+
+    while (getdelim(&line, &linesize, '\n', fp) != -1) {
+	lineno++;
+	if (!iolog_index_parse(line, &li, &host, &session)) {
+	    sudo_warnx(U_("%s/%s: invalid record on line %u"), session_dir,
+		IOLOG_INDEX, lineno);
+	    continue;
+	}
+
+	/* Match on search expression if there is one. */
+	if (!STAILQ_EMPTY(&search_expr) && !match_expr(&search_expr, &li, true))
+	    continue;
+
+	print_session(&li, session_id(session, idbuf));
+    }
+    free(line);
+
+    debug_return_int(0);
+}
+
 static int
 session_compare(const void *v1, const void *v2)
 {
@@ -1368,36 +1592,25 @@ session_compare(const void *v1, const void *v2)
     return strcmp(s1, s2);
 }
 
-/* XXX - always returns 0, calls sudo_fatal() on failure */
-static int
-find_sessions(const char *dir, regex_t *re, const char *user, const char *tty)
+/*
+ * Read the names of the entries in d that may be session directories,
+ * sorted by name.  Stores the number of entries in nsessionsp.
+ * If checked_typep is set to false, the entries must be stat()ed to
+ * determine whether or not they are directories.
+ */
+static char **
+read_session_dir(DIR *d, size_t *nsessionsp, bool *checked_typep)
 {
-    DIR *d;
     struct dirent *dp;
-    struct stat sb;
-    size_t sdlen, sessions_len = 0, sessions_size = 0;
-    unsigned int i;
-    int len;
-    char pathbuf[PATH_MAX], **sessions = NULL;
+    size_t sessions_len = 0, sessions_size = 0;
+    char **sessions = NULL;
+    debug_decl(read_session_dir, SUDO_DEBUG_UTIL);
+
 #ifdef HAVE_STRUCT_DIRENT_D_TYPE
-    bool checked_type = true;
+    *checked_typep = true;
 #else
-    const bool checked_type = false;
+    *checked_typep = false;
 #endif
-    debug_decl(find_sessions, SUDO_DEBUG_UTIL);
-
-    d = opendir(dir);
-    if (d == NULL)
-	sudo_fatal(U_("unable to open %s"), dir);
-
-    /* XXX - would be faster to use openat() and relative names */
-    sdlen = strlcpy(pathbuf, dir, sizeof(pathbuf));
-    if (sdlen + 1 >= sizeof(pathbuf)) {
-	errno = ENAMETOOLONG;
-	sudo_fatal("%s/", dir);
-    }
-    pathbuf[sdlen++] = '/';
-    pathbuf[sdlen] = '\0';
 
     /* Store potential session dirs for sorting. */
     while ((dp = readdir(d)) != NULL) {
@@ -1406,12 +1619,12 @@ find_sessions(const char *dir, regex_t *re, const char *user, const char *tty)
 	    (dp->d_name[1] == '.' && dp->d_name[2] == '\0')))
 	    continue;
 #ifdef HAVE_STRUCT_DIRENT_D_TYPE
-	if (checked_type) {
+	if (*checked_typep) {
 	    if (dp->d_type != DT_DIR) {
 		/* Not all file systems support d_type. */
 		if (dp->d_type != DT_UNKNOWN)
 		    continue;
-		checked_type = false;
+		*checked_typep = false;
 	    }
 	}
 #endif
@@ -1429,43 +1642,314 @@ find_sessions(const char *dir, regex_t *re, const char *user, const char *tty)
 	    sudo_fatalx(U_("%s: %s"), __func__, U_("unable to allocate memory"));
 	sessions_len++;
     }
-    closedir(d);
 
-    /* Sort and list the sessions. */
-    if (sessions != NULL) {
+    if (sessions != NULL)
 	qsort(sessions, sessions_len, sizeof(char *), session_compare);
-	for (i = 0; i < sessions_len; i++) {
-	    len = snprintf(&pathbuf[sdlen], sizeof(pathbuf) - sdlen,
-		"%s/log", sessions[i]);
-	    if (len < 0 || (size_t)len >= sizeof(pathbuf) - sdlen) {
-		errno = ENAMETOOLONG;
-		sudo_fatal("%s/%s/log", dir, sessions[i]);
+    *nsessionsp = sessions_len;
+
+    debug_return_ptr(sessions);
+}
+
+/*
+ * List the session stored in pathbuf or, if it is not a session,
+ * recurse into it.  The last path component starts at pathbuf + sdlen
+ * and is looked up relative to the directory dfd to avoid resolving
+ * the full path name for each session.
+ */
+static void
+find_session(int dfd, char *pathbuf, size_t pathsize, size_t sdlen,
+    bool checked_type, regex_t *re, const char *user, const char *tty)
+{
+    size_t len = strlen(pathbuf);
+    struct stat sb;
+    debug_decl(find_session, SUDO_DEBUG_UTIL);
+
+    if (strlcpy(pathbuf + len, "/log", pathsize - len) >= pathsize - len) {
+	errno = ENAMETOOLONG;
+	sudo_fatal("%s/log", pathbuf);
+    }
+
+    /* Check for dir with a log file. */
+    if (fstatat(dfd, pathbuf + sdlen, &sb, AT_SYMLINK_NOFOLLOW) == 0 &&
+	    S_ISREG(sb.st_mode)) {
+	list_session(dfd, pathbuf, pathbuf + sdlen, re, user, tty);
+    } else {
+	/* Strip off "/log" and recurse if a dir. */
+	pathbuf[len] = '\0';
+	if (checked_type || (fstatat(dfd, pathbuf + sdlen, &sb,
+		AT_SYMLINK_NOFOLLOW) == 0 && S_ISDIR(sb.st_mode)))
+	    find_sessions(pathbuf, re, user, tty);
+    }
+
+    debug_return;
+}
+
+/* XXX - always returns 0, calls sudo_fatal() on failure */
+static int
+find_sessions(const char *dir, regex_t *re, const char *user, const char *tty)
+{
+    DIR *d;
+    size_t sdlen, i, nsessions;
+    char pathbuf[PATH_MAX], **sessions;
+    bool checked_type;
+    debug_decl(find_sessions, SUDO_DEBUG_UTIL);
+
+    d = opendir(dir);
+    if (d == NULL)
+	sudo_fatal(U_("unable to open %s"), dir);
+
+    sdlen = strlcpy(pathbuf, dir, sizeof(pathbuf));
+    if (sdlen + 1 >= sizeof(pathbuf)) {
+	errno = ENAMETOOLONG;
+	sudo_fatal("%s/", dir);
+    }
+    pathbuf[sdlen++] = '/';
+    pathbuf[sdlen] = '\0';
+
+    /* List the sessions in sorted order. */
+    sessions = read_session_dir(d, &nsessions, &checked_type);
+    for (i = 0; i < nsessions; i++) {
+	if (strlcpy(pathbuf + sdlen, sessions[i], sizeof(pathbuf) - sdlen) >=
+		sizeof(pathbuf) - sdlen) {
+	    errno = ENAMETOOLONG;
+	    sudo_fatal("%s/%s", dir, sessions[i]);
+	}
+	free(sessions[i]);
+	find_session(dirfd(d), pathbuf, sizeof(pathbuf), sdlen, checked_type,
+	    re, user, tty);
+    }
+    free(sessions);
+    closedir(d);
+
+    debug_return_int(0);
+}
+
+/*
+ * Copy the output of a listing job to the standard output.
+ */
+static void
+copy_job_output(FILE *fp)
+{
+    char buf[8192];
+    size_t nread;
+    debug_decl(copy_job_output, SUDO_DEBUG_UTIL);
+
+    rewind(fp);
+    while ((nread = fread(buf, 1, sizeof(buf), fp)) > 0) {
+	if (fwrite(buf, 1, nread, stdout) != nread)
+	    break;
+    }
+    fclose(fp);
+
+    debug_return;
+}
+
+/*
+ * A unit of work for find_sessions_parallel(): a path relative to
+ * session_dir that is either a session or a directory to search.
+ */
+struct list_unit {
+    char *path;
+    bool checked_type;
+};
+
+/*
+ * Add a unit for path to the units array, growing it as needed.
+ */
+static void
+add_list_unit(struct list_unit **unitsp, size_t *nunitsp, size_t *sizep,
+    char *path, bool checked_type)
+{
+    debug_decl(add_list_unit, SUDO_DEBUG_UTIL);
+
+    if (*nunitsp + 1 > *sizep) {
+	*sizep = *sizep ? *sizep * 2 : 36 * 36;
+	*unitsp = reallocarray(*unitsp, *sizep, sizeof(**unitsp));
+	if (*unitsp == NULL)
+	    sudo_fatalx(U_("%s: %s"), __func__, U_("unable to allocate memory"));
+    }
+    (*unitsp)[*nunitsp].path = path;
+    (*unitsp)[*nunitsp].checked_type = checked_type;
+    (*nunitsp)++;
+
+    debug_return;
+}
+
+/*
+ * Split the search of session_dir into units of work, in sorted order.
+ * Session IDs are allocated sequentially so the first 36^4 sessions
+ * all live under "00"; splitting at the top level alone would leave
+ * a single job to do nearly all the work.  Instead, each directory
+ * at the top level is expanded into its entries, so that a unit holds
+ * at most 36^2 sessions when the session ID is used as the path.
+ */
+static struct list_unit *
+read_list_units(DIR *d, size_t *nunitsp)
+{
+    struct list_unit *units = NULL;
+    size_t i, j, nsessions, nsubs, nunits = 0, unitsize = 0;
+    char **sessions, **subs, *path;
+    bool checked_type, sub_checked_type;
+    struct stat sb;
+    DIR *subd;
+    debug_decl(read_list_units, SUDO_DEBUG_UTIL);
+
+    sessions = read_session_dir(d, &nsessions, &checked_type);
+
+    for (i = 0; i < nsessions; i++) {
+	/* A session at the top level is a unit of its own. */
+	if (asprintf(&path, "%s/log", sessions[i]) == -1)
+	    sudo_fatalx(U_("%s: %s"), __func__, U_("unable to allocate memory"));
+	if (fstatat(dirfd(d), path, &sb, AT_SYMLINK_NOFOLLOW) == 0 &&
+		S_ISREG(sb.st_mode)) {
+	    free(path);
+	    add_list_unit(&units, &nunits, &unitsize, sessions[i],
+		checked_type);
+	    continue;
+	}
+	free(path);
+
+	if (asprintf(&path, "%s/%s", session_dir, sessions[i]) == -1)
+	    sudo_fatalx(U_("%s: %s"), __func__, U_("unable to allocate memory"));
+	subd = opendir(path);
+	free(path);
+	if (subd == NULL) {
+	    /* Not a directory, or one find_session() will report. */
+	    add_list_unit(&units, &nunits, &unitsize, sessions[i],
+		checked_type);
+	    continue;
+	}
+	subs = read_session_dir(subd, &nsubs, &sub_checked_type);
+	closedir(subd);
+	for (j = 0; j < nsubs; j++) {
+	    if (asprintf(&path, "%s/%s", sessions[i], subs[j]) == -1)
+		sudo_fatalx(U_("%s: %s"), __func__, U_("unable to allocate memory"));
+	    free(subs[j]);
+	    add_list_unit(&units, &nunits, &unitsize, path, sub_checked_type);
+	}
+	free(subs);
+	free(sessions[i]);
+    }
+    free(sessions);
+
+    *nunitsp = nunits;
+    debug_return_ptr(units);
+}
+
+/*
+ * Like find_sessions() but the search is split into units of work by
+ * read_list_units() and each unit is listed by a separate process,
+ * with up to njobs running at once.  A new job is started as soon as
+ * one finishes; the output of each job is stored in a temporary file
+ * and displayed in sorted order.
+ */
+static int
+find_sessions_parallel(regex_t *re, const char *user, const char *tty,
+    unsigned int njobs)
+{
+    struct list_job {
+	pid_t pid;
+	FILE *output;
+    } *jobs;
+    size_t sdlen, nunits, next = 0, printed = 0, running = 0, i;
+    struct list_unit *units;
+    char pathbuf[PATH_MAX];
+    int status, ret = 0;
+    pid_t pid;
+    DIR *d;
+    debug_decl(find_sessions_parallel, SUDO_DEBUG_UTIL);
+
+    d = opendir(session_dir);
+    if (d == NULL)
+	sudo_fatal(U_("unable to open %s"), session_dir);
+
+    sdlen = strlcpy(pathbuf, session_dir, sizeof(pathbuf));
+    if (sdlen + 1 >= sizeof(pathbuf)) {
+	errno = ENAMETOOLONG;
+	sudo_fatal("%s/", session_dir);
+    }
+    pathbuf[sdlen++] = '/';
+    pathbuf[sdlen] = '\0';
+
+    units = read_list_units(d, &nunits);
+    if (nunits == 0)
+	goto done;
+    jobs = calloc(nunits, sizeof(*jobs));
+    if (jobs == NULL)
+	sudo_fatalx(U_("%s: %s"), __func__, U_("unable to allocate memory"));
+
+    for (;;) {
+	/* Start new jobs but don't get too far ahead of the output. */
+	while (next < nunits && running < njobs &&
+		next - printed < njobs * 4) {
+	    if ((jobs[next].output = tmpfile()) == NULL)
+		sudo_fatal("tmpfile");
+	    /* Don't let the child inherit buffered output. */
+	    fflush(stdout);
+	    switch (jobs[next].pid = fork()) {
+	    case -1:
+		sudo_fatal(U_("unable to fork"));
+		break;
+	    case 0:
+		/* child, list sessions to the temporary file */
+		if (dup2(fileno(jobs[next].output), STDOUT_FILENO) == -1)
+		    sudo_fatal("dup2");
+		if (strlcpy(pathbuf + sdlen, units[next].path,
+			sizeof(pathbuf) - sdlen) >= sizeof(pathbuf) - sdlen) {
+		    errno = ENAMETOOLONG;
+		    sudo_fatal("%s/%s", session_dir, units[next].path);
+		}
+		find_session(dirfd(d), pathbuf, sizeof(pathbuf), sdlen,
+		    units[next].checked_type, re, user, tty);
+		_exit(fflush(stdout) == 0 ? 0 : 1);
 	    }
-	    free(sessions[i]);
+	    free(units[next].path);
+	    next++;
+	    running++;
+	}
 
-	    /* Check for dir with a log file. */
-	    if (lstat(pathbuf, &sb) == 0 && S_ISREG(sb.st_mode)) {
-		list_session(pathbuf, re, user, tty);
-	    } else {
-		/* Strip off "/log" and recurse if a dir. */
-		pathbuf[sdlen + len - 4] = '\0';
-		if (checked_type ||
-		    (lstat(pathbuf, &sb) == 0 && S_ISDIR(sb.st_mode)))
-		    find_sessions(pathbuf, re, user, tty);
+	/* Display the output of finished jobs in order. */
+	while (printed < next && jobs[printed].pid == 0) {
+	    copy_job_output(jobs[printed].output);
+	    printed++;
+	}
+	if (running == 0)
+	    break;
+
+	/* Wait for a job to finish. */
+	pid = waitpid(-1, &status, 0);
+	if (pid == -1) {
+	    if (errno == EINTR)
+		continue;
+	    sudo_fatal("waitpid");
+	}
+	for (i = printed; i < next; i++) {
+	    if (jobs[i].pid == pid) {
+		if (!WIFEXITED(status) || WEXITSTATUS(status) != 0)
+		    ret = 1;
+		jobs[i].pid = 0;
+		running--;
+		break;
 	    }
 	}
-	free(sessions);
     }
+    free(jobs);
 
-    debug_return_int(0);
+done:
+    free(units);
+    closedir(d);
+    debug_return_int(ret);
 }
 
 /* XXX - always returns 0, calls sudo_fatal() on failure */
 static int
 list_sessions(int argc, char **argv, const char *pattern, const char *user,
-    const char *tty)
+    const char *tty, unsigned int njobs)
 {
     regex_t rebuf, *re = NULL;
+    char path[PATH_MAX];
+    int len, ret;
+    FILE *fp;
     debug_decl(list_sessions, SUDO_DEBUG_UTIL);
 
     /* Parse search expression if present */
@@ -1478,9 +1962,181 @@ list_sessions(int argc, char **argv, const char *pattern, const char *user,
 	    sudo_fatalx(U_("invalid regular expression: %s"), pattern);
     }
 
+    /*
+     * Use the session index if it is known to be complete, which is
+     * only the case for one created by rebuild_index().  An index that
+     * was started by the I/O log plugin may be missing older sessions.
+     */
+    len = snprintf(path, sizeof(path), "%s/%s", session_dir, IOLOG_INDEX);
+    if (len < 0 || len >= ssizeof(path)) {
+	errno = ENAMETOOLONG;
+	sudo_fatal("%s/%s", session_dir, IOLOG_INDEX);
+    }
+    if ((fp = fopen(path, "r")) != NULL) {
+	char header[sizeof(IOLOG_INDEX_HEADER)];
+
+	if (fgets(header, sizeof(header), fp) != NULL &&
+		strcmp(header, IOLOG_INDEX_HEADER) == 0) {
+	    ret = list_index(fp);
+	    fclose(fp);
+	    debug_return_int(ret);
+	}
+	sudo_debug_printf(SUDO_DEBUG_INFO,
+	    "%s: not a complete session index, searching %s", path,
+	    session_dir);
+	fclose(fp);
+    }
+
+    if (njobs > 1)
+	debug_return_int(find_sessions_parallel(re, user, tty, njobs));
     debug_return_int(find_sessions(session_dir, re, user, tty));
 }
 
+/*
+ * Copy records appended to the index in lockfd since offset to the
+ * rebuilt index, skipping sessions that the rebuild already found
+ * and sessions that have since been removed.
+ */
+static void
+copy_index_tail(int lockfd, off_t offset, const char *path)
+{
+    char *line = NULL, *copy, *host, *session, logpath[PATH_MAX];
+    size_t linesize = 0;
+    struct iolog_info li;
+    struct stat sb;
+    ssize_t len;
+    FILE *fp;
+    int fd;
+    debug_decl(copy_index_tail, SUDO_DEBUG_UTIL);
+
+    if ((fd = dup(lockfd)) == -1 || (fp = fdopen(fd, "r")) == NULL)
+	sudo_fatal(U_("unable to open %s"), path);
+    if (fseeko(fp, offset, SEEK_SET) == -1)
+	sudo_fatal(U_("unable to read %s"), path);
+
+    while ((len = getdelim(&line, &linesize, '\n', fp)) != -1) {
+	if (line[0] == '#' || line[len - 1] != '\n')
+	    continue;
+	if ((copy = strdup(line)) == NULL)
+	    sudo_fatalx(U_("%s: %s"), __func__, U_("unable to allocate memory"));
+	if (iolog_index_parse(copy, &li, &host, &session) &&
+		bsearch(&session, index_recent, index_recent_len,
+		sizeof(char *), session_compare) == NULL) {
+	    len = snprintf(logpath, sizeof(logpath), "%s/%s/log",
+		session_dir, session);
+	    if (len > 0 && len < ssizeof(logpath) && stat(logpath, &sb) == 0) {
+		if (fputs(line, index_rebuild_fp) == EOF)
+		    sudo_fatal(U_("unable to write to %s"), IOLOG_INDEX);
+	    }
+	}
+	free(copy);
+    }
+    free(line);
+    fclose(fp);
+
+    debug_return;
+}
+
+/*
+ * Regenerate the session index in session_dir from the I/O logs.
+ * The new index is written to a temporary file which then replaces
+ * the existing one, preserving its owner and mode.  The I/O log
+ * directory is searched without holding the lock that the I/O log
+ * plugin and sudo_logsrvd use to append to the index, which may take
+ * a long time.  The lock is only taken at the end to copy the records
+ * appended in the meantime and to rename the new index into place.
+ * Sessions that have been removed are not included.
+ */
+static int
+rebuild_index(void)
+{
+    char path[PATH_MAX], tmppath[PATH_MAX];
+    struct stat sb, sb2;
+    off_t offset;
+    int fd, lockfd, len;
+    size_t i;
+    debug_decl(rebuild_index, SUDO_DEBUG_UTIL);
+
+    len = snprintf(path, sizeof(path), "%s/%s", session_dir, IOLOG_INDEX);
+    if (len < 0 || len >= ssizeof(path)) {
+	errno = ENAMETOOLONG;
+	sudo_fatal("%s/%s", session_dir, IOLOG_INDEX);
+    }
+    len = snprintf(tmppath, sizeof(tmppath), "%s.XXXXXX", path);
+    if (len < 0 || len >= ssizeof(tmppath)) {
+	errno = ENAMETOOLONG;
+	sudo_fatal("%s.XXXXXX", path);
+    }
+
+    /* Note where the existing index ends, under the iolog_index_append() lock. */
+    lockfd = open(path, O_RDWR|O_CREAT|O_APPEND, S_IRUSR|S_IWUSR);
+    if (lockfd == -1)
+	sudo_fatal(U_("unable to open %s"), path);
+    if (!sudo_lock_file(lockfd, SUDO_LOCK))
+	sudo_fatal(U_("unable to lock %s"), path);
+    if (fstat(lockfd, &sb) == -1)
+	sudo_fatal(U_("unable to stat %s"), path);
+    offset = sb.st_size;
+    time(&index_rebuild_start);
+    (void)sudo_lock_file(lockfd, SUDO_UNLOCK);
+
+    if ((fd = mkstemp(tmppath)) == -1)
+	sudo_fatal(U_("unable to create %s"), tmppath);
+    if (fchown(fd, sb.st_uid, sb.st_gid) == -1 ||
+	    fchmod(fd, sb.st_mode & ACCESSPERMS) == -1) {
+	sudo_warn(U_("unable to set owner and mode of %s"), tmppath);
+    }
+    if ((index_rebuild_fp = fdopen(fd, "w")) == NULL) {
+	unlink(tmppath);
+	sudo_fatal(U_("unable to create %s"), tmppath);
+    }
+
+    if (fputs(IOLOG_INDEX_HEADER, index_rebuild_fp) == EOF) {
+	unlink(tmppath);
+	sudo_fatal(U_("unable to write to %s"), tmppath);
+    }
+    find_sessions(session_dir, NULL, NULL, NULL);
+    if (index_recent != NULL) {
+	qsort(index_recent, index_recent_len, sizeof(char *),
+	    session_compare);
+    }
+
+    /*
+     * Add sessions started since the search began.  New appenders wait
+     * for the lock and, once the index has been replaced, reopen it.
+     */
+    if (!sudo_lock_file(lockfd, SUDO_LOCK)) {
+	unlink(tmppath);
+	sudo_fatal(U_("unable to lock %s"), path);
+    }
+    if (stat(path, &sb2) == -1 || sb2.st_dev != sb.st_dev ||
+	    sb2.st_ino != sb.st_ino) {
+	unlink(tmppath);
+	sudo_fatalx(U_("%s was replaced while it was being rebuilt"), path);
+    }
+    copy_index_tail(lockfd, offset, path);
+
+    if (fflush(index_rebuild_fp) != 0 || ferror(index_rebuild_fp) ||
+	    fclose(index_rebuild_fp) != 0) {
+	unlink(tmppath);
+	sudo_fatal(U_("unable to write to %s"), tmppath);
+    }
+    index_rebuild_fp = NULL;
+    if (rename(tmppath, path) == -1) {
+	unlink(tmppath);
+	sudo_fatal(U_("unable to rename %s to %s"), tmppath, path);
+    }
+    close(lockfd);
+
+    for (i = 0; i < index_recent_len; i++)
+	free(index_recent[i]);
+    free(index_recent);
+    index_recent = NULL;
+    index_recent_len = index_recent_size = 0;
+
+    debug_return_int(0);
+}
+
 /*
  * Check keyboard for ' ', '<', '>', return
  * pause, slow, fast, next
@@ -1566,10 +2222,13 @@ static void
 usage(int fatal)
 {
     fprintf(fatal ? stderr : stdout,
-	_("usage: %s [-hnRS] [-d dir] [-m num] [-s num] ID\n"),
+	_("usage: %s [-hnRS] [-d dir] [-m num] [-o num] [-s num] ID\n"),
+	getprogname());
+    fprintf(fatal ? stderr : stdout,
+	_("usage: %s [-h] [-d dir] [-j num] -l [search expression]\n"),
 	getprogname());
     fprintf(fatal ? stderr : stdout,
-	_("usage: %s [-h] [-d dir] -l [search expression]\n"),
+	_("usage: %s [-h] [-d dir] -I\n"),
 	getprogname());
     if (fatal)
 	exit(EXIT_FAILURE);
@@ -1584,9 +2243,12 @@ help(void)
 	"  -d, --directory=dir    specify directory for session logs\n"
 	"  -f, --filter=filter    specify which I/O type(s) to display\n"
 	"  -h, --help             display help message and exit\n"
+	"  -I, --rebuild-index    rebuild the session index used by -l\n"
+	"  -j, --jobs=num         number of processes to use when listing sessions\n"
 	"  -l, --list             list available session IDs, with optional expression\n"
 	"  -m, --max-wait=num     max number of seconds to wait between events\n"
 	"  -n, --non-interactive  no prompts, session is sent to the standard output\n"
+	"  -o, --offset=num       start replaying num seconds into the session\n"
 	"  -R, --no-resize        do not attempt to re-size the terminal\n"
 	"  -S, --suspend-wait     wait while the command was suspended\n"
 	"  -s, --speed=num        speed up or slow down output\n"
@@ -69,6 +69,7 @@ enum sudoers_formats {
  * Function Prototypes
  */
 static void dump_sudoers(struct sudo_lbuf *lbuf);
+static void bench_lookup(int count);
 static void usage(void) __attribute__((__noreturn__));
 static void set_runaspw(const char *);
 static void set_runasgr(const char *);
@@ -115,11 +116,12 @@ main(int argc, char *argv[])
     enum sudoers_formats input_format = format_sudoers;
     struct cmndspec *cs;
     struct privilege *priv;
-    struct userspec *us;
-    char *p, *grfile, *pwfile;
+    struct userspec *us, **candidates;
+    char *p, *cache_file, *grfile, *pwfile;
     const char *errstr;
     int match, host_match, runas_match, cmnd_match;
-    int ch, dflag, exitcode = EXIT_FAILURE;
+    int ch, dflag, bcount = 0, exitcode = EXIT_FAILURE;
+    int i, ncandidates;
     struct sudo_lbuf lbuf;
     debug_decl(main, SUDOERS_DEBUG_MAIN);
 
@@ -148,9 +150,18 @@ main(int argc, char *argv[])
 	goto done;
 
     dflag = 0;
-    grfile = pwfile = NULL;
-    while ((ch = getopt(argc, argv, "dg:G:h:i:P:p:tu:U:")) != -1) {
+    cache_file = grfile = pwfile = NULL;
+    while ((ch = getopt(argc, argv, "b:c:dg:G:h:i:P:p:tu:U:")) != -1) {
 	switch (ch) {
+	    case 'b':
+		bcount = sudo_strtonum(optarg, 1, INT_MAX, &errstr);
+		if (errstr != NULL)
+		    sudo_fatalx("benchmark count %s: %s", optarg, errstr);
+		break;
+	    case 'c':
+		cache_file = optarg;
+		sudoers_cache_record(true);
+		break;
 	    case 'd':
 		dflag = 1;
 		break;
@@ -304,6 +315,12 @@ main(int argc, char *argv[])
 	    (void) fputs("Parses OK", stdout);
         break;
     case format_sudoers:
+	/* Use the cached policy if it is up to date, else create it. */
+	if (cache_file != NULL &&
+		sudoers_cache_read(cache_file, &parsed_policy, true)) {
+	    (void) fputs("Parses OK (cached)", stdout);
+	    break;
+	}
 	if (sudoersparse() != 0 || parse_error) {
 	    parse_error = true;
 	    if (errorlineno != -1)
@@ -313,6 +330,9 @@ main(int argc, char *argv[])
 		(void) printf("Parse error in %s", errorfile);
 	} else {
 	    (void) fputs("Parses OK", stdout);
+	    if (cache_file != NULL &&
+		    !sudoers_cache_write(cache_file, NULL, &parsed_policy))
+		(void) fputs(" (unable to write cache)", stdout);
 	}
         break;
     default:
@@ -323,6 +343,9 @@ main(int argc, char *argv[])
 	(void) fputs(" (problem with defaults entries)", stdout);
     puts(".");
 
+    /* Index the userspecs like the sudoers file backend does. */
+    parsed_policy.usidx = userspec_index_build(&parsed_policy);
+
     if (dflag) {
 	(void) putchar('\n');
 	dump_sudoers(&lbuf);
@@ -332,10 +355,26 @@ main(int argc, char *argv[])
 	}
     }
 
-    /* This loop must match the one in sudo_file_lookup() */
+    if (bcount != 0)
+	bench_lookup(bcount);
+
+    /* This loop must match the one in sudoers_lookup_check() */
     printf("\nEntries for user %s:\n", user_name);
     match = UNSPEC;
-    TAILQ_FOREACH_REVERSE(us, &parsed_policy.userspecs, userspec_list, entries) {
+    ncandidates = userspec_index_lookup(&parsed_policy, sudo_user.pw,
+	&candidates);
+    us = ncandidates != -1 ? NULL :
+	TAILQ_LAST(&parsed_policy.userspecs, userspec_list);
+    for (i = 0; ; i++) {
+	if (ncandidates != -1) {
+	    if (i == ncandidates)
+		break;
+	    us = candidates[i];
+	} else if (i != 0) {
+	    us = TAILQ_PREV(us, userspec_list, entries);
+	}
+	if (us == NULL)
+	    break;
 	if (userlist_matches(&parsed_policy, sudo_user.pw, &us->users) != ALLOW)
 	    continue;
 	TAILQ_FOREACH_REVERSE(priv, &us->privileges, privilege_list, entries) {
@@ -362,6 +401,8 @@ main(int argc, char *argv[])
 		puts(U_("\thost  unmatched"));
 	}
     }
+    if (ncandidates != -1)
+	free(candidates);
     puts(match == ALLOW ? U_("\nCommand allowed") :
 	match == DENY ?  U_("\nCommand denied") :  U_("\nCommand unmatched"));
 
@@ -381,6 +422,81 @@ done:
     exit(exitcode);
 }
 
+/*
+ * Perform the lookup done by sudoers_lookup_check() count times,
+ * with and without the userspec index, and display the average time.
+ */
+static int
+bench_lookup_once(bool use_index)
+{
+    struct userspec **candidates = NULL, *us;
+    struct privilege *priv;
+    struct cmndspec *cs;
+    int i, ncandidates = -1, match = UNSPEC;
+
+    if (use_index) {
+	ncandidates = userspec_index_lookup(&parsed_policy, sudo_user.pw,
+	    &candidates);
+    }
+    us = ncandidates != -1 ? NULL :
+	TAILQ_LAST(&parsed_policy.userspecs, userspec_list);
+    for (i = 0; match == UNSPEC; i++) {
+	if (ncandidates != -1) {
+	    if (i == ncandidates)
+		break;
+	    us = candidates[i];
+	} else if (i != 0) {
+	    us = TAILQ_PREV(us, userspec_list, entries);
+	}
+	if (us == NULL)
+	    break;
+	if (userlist_matches(&parsed_policy, sudo_user.pw, &us->users) != ALLOW)
+	    continue;
+	TAILQ_FOREACH_REVERSE(priv, &us->privileges, privilege_list, entries) {
+	    if (hostlist_matches(&parsed_policy, sudo_user.pw,
+		    &priv->hostlist) != ALLOW)
+		continue;
+	    TAILQ_FOREACH_REVERSE(cs, &priv->cmndlist, cmndspec_list, entries) {
+		if (runaslist_matches(&parsed_policy, cs->runasuserlist,
+			cs->runasgrouplist, NULL, NULL) != ALLOW)
+		    continue;
+		if ((match = cmnd_matches(&parsed_policy, cs->cmnd)) != UNSPEC)
+		    break;
+	    }
+	    if (match != UNSPEC)
+		break;
+	}
+    }
+    free(candidates);
+    return match;
+}
+
+static void
+bench_lookup(int count)
+{
+    struct timespec start, stop, elapsed[2];
+    int i, j, match[2];
+    debug_decl(bench_lookup, SUDOERS_DEBUG_UTIL);
+
+    for (j = 0; j < 2; j++) {
+	sudo_gettime_mono(&start);
+	for (i = 0; i < count; i++)
+	    match[j] = bench_lookup_once(j == 0);
+	sudo_gettime_mono(&stop);
+	sudo_timespecsub(&stop, &start, &elapsed[j]);
+    }
+    if (match[0] != match[1]) {
+	sudo_warnx("indexed lookup returned %d, linear lookup returned %d",
+	    match[0], match[1]);
+    }
+    printf("\nLookup time (%d iterations): indexed %.2f usec, "
+	"linear %.2f usec\n", count,
+	(elapsed[0].tv_sec * 1000000.0 + elapsed[0].tv_nsec / 1000.0) / count,
+	(elapsed[1].tv_sec * 1000000.0 + elapsed[1].tv_nsec / 1000.0) / count);
+
+    debug_return;
+}
+
 static void
 set_runaspw(const char *user)
 {
@@ -605,6 +721,6 @@ testsudoers_error(const char *buf)
 static void
 usage(void)
 {
-    (void) fprintf(stderr, "usage: %s [-dt] [-G sudoers_gid] [-g group] [-h host] [-i input_format] [-P grfile] [-p pwfile] [-U sudoers_uid] [-u user] <user> <command> [args]\n", getprogname());
+    (void) fprintf(stderr, "usage: %s [-dt] [-b count] [-c cache_file] [-G sudoers_gid] [-g group] [-h host] [-i input_format] [-P grfile] [-p pwfile] [-U sudoers_uid] [-u user] <user> <command> [args]\n", getprogname());
     exit(EXIT_FAILURE);
 }
@@ -54,6 +54,9 @@
 #define TIMESTAMP_OPEN_ERROR	-1
 #define TIMESTAMP_PERM_ERROR	-2
 
+/* Number of time stamp records to read at a time when searching. */
+#define TS_READ_RECORDS		64
+
 /*
  * Each user has a single time stamp file that contains multiple records.
  * Records are locked to ensure that changes are serialized.
@@ -148,36 +151,81 @@ ts_match_record(struct timestamp_entry *key, struct timestamp_entry *entry,
  * On failure, returns false.
  *
  * Note that records are searched starting at the current file offset,
- * which may not be the beginning of the file.
+ * which may not be the beginning of the file.  Records are read in
+ * batches of TS_READ_RECORDS to avoid a read(2) per record.  On return,
+ * the file offset is just past the matching record, or at the end of
+ * the records that were searched if no match was found.
  */
 static bool
 ts_find_record(int fd, struct timestamp_entry *key, struct timestamp_entry *entry)
 {
+    unsigned char buf[TS_READ_RECORDS * sizeof(struct timestamp_entry)];
     struct timestamp_entry cur;
     unsigned int recno = 0;
+    size_t len = 0, pos = 0;
+    ssize_t nread;
+    off_t base;
     debug_decl(ts_find_record, SUDOERS_DEBUG_AUTH);
 
+    /* File offset corresponding to the start of buf. */
+    if ((base = lseek(fd, 0, SEEK_CUR)) == -1) {
+	sudo_debug_printf(SUDO_DEBUG_ERROR|SUDO_DEBUG_ERRNO|SUDO_DEBUG_LINENO,
+	    "unable to get current file offset");
+	debug_return_bool(false);
+    }
+
     /*
      * Find a matching record (does not match sid or time stamp value).
      */
-    while (read(fd, &cur, sizeof(cur)) == sizeof(cur)) {
+    for (;;) {
+	if (len - pos < sizeof(cur)) {
+	    /* Move any partial record to the front and refill the buffer. */
+	    memmove(buf, buf + pos, len - pos);
+	    base += pos;
+	    len -= pos;
+	    pos = 0;
+	    nread = read(fd, buf + len, sizeof(buf) - len);
+	    if (nread <= 0)
+		break;
+	    len += nread;
+	    continue;
+	}
+	memcpy(&cur, buf + pos, sizeof(cur));
 	recno++;
 	if (cur.size != sizeof(cur)) {
-	    /* wrong size, seek to start of next record */
+	    /* wrong size, skip to start of next record */
 	    sudo_debug_printf(SUDO_DEBUG_INFO|SUDO_DEBUG_LINENO,
 		"wrong sized record, got %hu, expected %zu",
 		cur.size, sizeof(cur));
-	    if (lseek(fd, (off_t)cur.size - (off_t)sizeof(cur), SEEK_CUR) == -1) {
-		sudo_debug_printf(SUDO_DEBUG_ERROR|SUDO_DEBUG_ERRNO|SUDO_DEBUG_LINENO,
-		    "unable to seek forward %d",
-		    (int)cur.size - (int)sizeof(cur));
+	    if (cur.size == 0) {
+		/* size must be non-zero, leave offset at the bad record */
+		if (lseek(fd, base + (off_t)pos, SEEK_SET) == -1) {
+		    sudo_debug_printf(SUDO_DEBUG_ERROR|SUDO_DEBUG_ERRNO|SUDO_DEBUG_LINENO,
+			"unable to seek to %lld", (long long)(base + (off_t)pos));
+		}
 		break;
 	    }
-	    if (cur.size == 0)
-		break;			/* size must be non-zero */
+	    pos += cur.size;
+	    if (pos > len) {
+		/* Next record starts past the end of the buffer. */
+		base += pos;
+		len = pos = 0;
+		if (lseek(fd, base, SEEK_SET) == -1) {
+		    sudo_debug_printf(SUDO_DEBUG_ERROR|SUDO_DEBUG_ERRNO|SUDO_DEBUG_LINENO,
+			"unable to seek to %lld", (long long)base);
+		    break;
+		}
+	    }
 	    continue;
 	}
+	pos += sizeof(cur);
 	if (ts_match_record(key, &cur, recno)) {
+	    /* Position the file offset just past the matching record. */
+	    if (lseek(fd, base + (off_t)pos, SEEK_SET) == -1) {
+		sudo_debug_printf(SUDO_DEBUG_ERROR|SUDO_DEBUG_ERRNO|SUDO_DEBUG_LINENO,
+		    "unable to seek to %lld", (long long)(base + (off_t)pos));
+		break;
+	    }
 	    memcpy(entry, &cur, sizeof(struct timestamp_entry));
 	    debug_return_bool(true);
 	}
@@ -4459,6 +4459,10 @@ read_dir_files(const char *dirpath, struct path_list ***pathsp)
 	    rcstr_delref(path);
 	    continue;
 	}
+	if (!sudoers_cache_add_source(path, false)) {
+	    rcstr_delref(path);
+	    goto oom;
+	}
 	pl = malloc(sizeof(*pl));
 	if (pl == NULL) {
 	    rcstr_delref(path);
@@ -4560,6 +4564,7 @@ init_lexer(void)
     continued = false;
     digest_type = -1;
     prev_state = INITIAL;
+    sudoers_cache_clear_sources();
 
     debug_return;
 }
@@ -4600,6 +4605,11 @@ push_include_int(char *path, bool isdir)
 	int count, status;
 
 	status = sudo_secure_dir(path, sudoers_uid, sudoers_gid, &sb);
+	if (!sudoers_cache_add_source(path, true)) {
+	    sudo_warnx(U_("%s: %s"), __func__, U_("unable to allocate memory"));
+	    sudoerserror(NULL);
+	    debug_return_bool(false);
+	}
 	if (status != SUDO_PATH_SECURE) {
 	    if (sudoers_warnings) {
 		switch (status) {
@@ -4646,6 +4656,11 @@ push_include_int(char *path, bool isdir)
 	    free(pl);
 	} while ((fp = open_sudoers(path, false, &keepopen)) == NULL);
     } else {
+	if (!sudoers_cache_add_source(path, false)) {
+	    sudo_warnx(U_("%s: %s"), __func__, U_("unable to allocate memory"));
+	    sudoerserror(NULL);
+	    debug_return_bool(false);
+	}
 	if ((fp = open_sudoers(path, true, &keepopen)) == NULL) {
 	    /* The error was already printed by open_sudoers() */
 	    sudoerserror(NULL);
@@ -0,0 +1,392 @@
+/*
+ * SPDX-License-Identifier: ISC
+ *
+ * Copyright (c) 2020 Todd C. Miller <Todd.Miller@sudo.ws>
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/*
+ * This is an open source non-commercial project. Dear PVS-Studio, please check it.
+ * PVS-Studio Static Code Analyzer for C, C++ and C#: http://www.viva64.com
+ */
+
+#include <config.h>
+
+#include <sys/types.h>
+#include <stdio.h>
+#include <stdlib.h>
+#ifdef HAVE_STRING_H
+# include <string.h>
+#endif /* HAVE_STRING_H */
+#ifdef HAVE_STRINGS_H
+# include <strings.h>
+#endif /* HAVE_STRINGS_H */
+#include <unistd.h>
+#include <ctype.h>
+#include <pwd.h>
+#include <grp.h>
+
+#include "sudoers.h"
+#include <gram.h>
+
+/*
+ * Index of the userspecs in a parse tree by the user and group names
+ * in their user lists.  A userspec can only match a user if one of
+ * its non-negated members matches, so only the userspecs that list
+ * the user's name or one of the user's groups need to be checked,
+ * along with those that contain members that cannot be indexed by
+ * name (ALL, netgroups, aliases, uids and gids).
+ *
+ * The user and group tables are hashed by the case-folded name and
+ * stored as arrays of userspec numbers, one array per hash bucket.
+ * Different names that share a bucket only result in extra candidates;
+ * each candidate is still checked with userlist_matches().
+ */
+struct userspec_index {
+    struct userspec **userspecs;	/* userspecs in sudoers order */
+    unsigned int nuserspecs;
+    unsigned int nbuckets;		/* power of two */
+    unsigned int *generic;		/* userspecs that may match anyone */
+    unsigned int ngeneric;
+    unsigned int *user_offsets;		/* nbuckets + 1 offsets into users */
+    unsigned int *users;
+    unsigned int *group_offsets;	/* nbuckets + 1 offsets into groups */
+    unsigned int *groups;
+};
+
+/*
+ * Hash a user or group name, ignoring case.
+ */
+static unsigned int
+usidx_hash(const char *name, unsigned int nbuckets)
+{
+    unsigned int h = 5381;
+
+    while (*name != '\0')
+	h = (h * 33) ^ (unsigned char)tolower((unsigned char)*name++);
+    return h & (nbuckets - 1);
+}
+
+/*
+ * Classify a user list member for the index.
+ * Returns the name to hash and sets *tablep to 'u' (user) or 'g' (group)
+ * if the member is indexable, else returns NULL and sets *tablep to
+ * 'a' if it may match any user or '\0' if it can never result in a match.
+ */
+static const char *
+usidx_classify(const struct member *m, int *tablep)
+{
+    switch (m->type) {
+    case WORD:
+	if (m->negated)
+	    break;
+	if (m->name[0] == '#') {
+	    /* uid */
+	    *tablep = 'a';
+	    return NULL;
+	}
+	*tablep = 'u';
+	return m->name;
+    case USERGROUP:
+	if (m->negated)
+	    break;
+	if (m->name[1] == '#' || m->name[1] == ':') {
+	    /* gid or non-Unix group */
+	    *tablep = 'a';
+	    return NULL;
+	}
+	*tablep = 'g';
+	return m->name + 1;
+    case ALIAS:
+	/* A negated alias matches if the alias denies. */
+	*tablep = 'a';
+	return NULL;
+    default:
+	/* ALL, NETGROUP */
+	if (m->negated)
+	    break;
+	*tablep = 'a';
+	return NULL;
+    }
+    *tablep = '\0';
+    return NULL;
+}
+
+/*
+ * Fill in the user, group and generic tables.  If counting is true,
+ * only count the number of entries in each hash bucket.
+ */
+static void
+usidx_fill(struct userspec_index *usidx, bool counting)
+{
+    unsigned int *user_next = usidx->user_offsets + 1;
+    unsigned int *group_next = usidx->group_offsets + 1;
+    unsigned int i, h;
+    struct member *m;
+    const char *name;
+    int table;
+    debug_decl(usidx_fill, SUDOERS_DEBUG_PARSER);
+
+    usidx->ngeneric = 0;
+    for (i = 0; i < usidx->nuserspecs; i++) {
+	bool generic = false;
+
+	TAILQ_FOREACH(m, &usidx->userspecs[i]->users, entries) {
+	    name = usidx_classify(m, &table);
+	    switch (table) {
+	    case 'u':
+		h = usidx_hash(name, usidx->nbuckets);
+		if (counting)
+		    user_next[h]++;
+		else
+		    usidx->users[usidx->user_offsets[h]++] = i;
+		break;
+	    case 'g':
+		h = usidx_hash(name, usidx->nbuckets);
+		if (counting)
+		    group_next[h]++;
+		else
+		    usidx->groups[usidx->group_offsets[h]++] = i;
+		break;
+	    case 'a':
+		generic = true;
+		break;
+	    }
+	}
+	if (generic) {
+	    if (!counting)
+		usidx->generic[usidx->ngeneric] = i;
+	    usidx->ngeneric++;
+	}
+    }
+
+    debug_return;
+}
+
+/*
+ * Free a userspec index.
+ */
+void
+userspec_index_free(struct userspec_index *usidx)
+{
+    debug_decl(userspec_index_free, SUDOERS_DEBUG_PARSER);
+
+    if (usidx != NULL) {
+	free(usidx->userspecs);
+	free(usidx->generic);
+	free(usidx->user_offsets);
+	free(usidx->users);
+	free(usidx->group_offsets);
+	free(usidx->groups);
+	free(usidx);
+    }
+
+    debug_return;
+}
+
+/*
+ * Build an index of the userspecs in parse_tree, which must not
+ * be modified while the index is in use.
+ * Returns the index on success or NULL on failure.
+ */
+struct userspec_index *
+userspec_index_build(struct sudoers_parse_tree *parse_tree)
+{
+    struct userspec_index *usidx;
+    struct userspec *us;
+    unsigned int i, n;
+    debug_decl(userspec_index_build, SUDOERS_DEBUG_PARSER);
+
+    if ((usidx = calloc(1, sizeof(*usidx))) == NULL)
+	goto oom;
+
+    n = 0;
+    TAILQ_FOREACH(us, &parse_tree->userspecs, entries)
+	n++;
+    usidx->nuserspecs = n;
+    for (usidx->nbuckets = 64; usidx->nbuckets < n; usidx->nbuckets <<= 1)
+	continue;
+
+    usidx->userspecs = reallocarray(NULL, n ? n : 1, sizeof(struct userspec *));
+    usidx->user_offsets = calloc(usidx->nbuckets + 1, sizeof(unsigned int));
+    usidx->group_offsets = calloc(usidx->nbuckets + 1, sizeof(unsigned int));
+    if (usidx->userspecs == NULL || usidx->user_offsets == NULL ||
+	    usidx->group_offsets == NULL)
+	goto oom;
+    i = 0;
+    TAILQ_FOREACH(us, &parse_tree->userspecs, entries)
+	usidx->userspecs[i++] = us;
+
+    /* Count the entries in each bucket and convert counts to offsets. */
+    usidx_fill(usidx, true);
+    for (i = 0; i < usidx->nbuckets; i++) {
+	usidx->user_offsets[i + 1] += usidx->user_offsets[i];
+	usidx->group_offsets[i + 1] += usidx->group_offsets[i];
+    }
+    usidx->users = reallocarray(NULL,
+	usidx->user_offsets[usidx->nbuckets] + 1, sizeof(unsigned int));
+    usidx->groups = reallocarray(NULL,
+	usidx->group_offsets[usidx->nbuckets] + 1, sizeof(unsigned int));
+    usidx->generic = reallocarray(NULL, usidx->ngeneric + 1,
+	sizeof(unsigned int));
+    if (usidx->users == NULL || usidx->groups == NULL || usidx->generic == NULL)
+	goto oom;
+
+    /*
+     * Fill in the tables, using the offsets as insertion points.
+     * When done, offsets[h] is the end of bucket h, which is also
+     * the start of bucket h + 1, so shift them back by one.
+     */
+    usidx_fill(usidx, false);
+    for (i = usidx->nbuckets; i > 0; i--) {
+	usidx->user_offsets[i] = usidx->user_offsets[i - 1];
+	usidx->group_offsets[i] = usidx->group_offsets[i - 1];
+    }
+    usidx->user_offsets[0] = 0;
+    usidx->group_offsets[0] = 0;
+
+    sudo_debug_printf(SUDO_DEBUG_INFO,
+	"indexed %u userspecs: %u user and %u group entries, %u generic",
+	usidx->nuserspecs, usidx->user_offsets[usidx->nbuckets],
+	usidx->group_offsets[usidx->nbuckets], usidx->ngeneric);
+
+    debug_return_ptr(usidx);
+oom:
+    sudo_warnx(U_("%s: %s"), __func__, U_("unable to allocate memory"));
+    userspec_index_free(usidx);
+    debug_return_ptr(NULL);
+}
+
+static int
+usidx_compare(const void *v1, const void *v2)
+{
+    const unsigned int i1 = *(const unsigned int *)v1;
+    const unsigned int i2 = *(const unsigned int *)v2;
+
+    /* Sort in reverse order, the last match wins. */
+    return i1 < i2 ? 1 : i1 > i2 ? -1 : 0;
+}
+
+/*
+ * Append the entries in bucket h of a table to the candidate list.
+ */
+static void
+usidx_add_bucket(unsigned int *candidates, unsigned int *ncandidates,
+    const unsigned int *offsets, const unsigned int *table, unsigned int h)
+{
+    unsigned int i;
+
+    for (i = offsets[h]; i < offsets[h + 1]; i++)
+	candidates[(*ncandidates)++] = table[i];
+}
+
+/*
+ * Find the userspecs in parse_tree that may match the user described
+ * by pw.  On success, *candidatesp is set to an array of userspecs,
+ * in reverse sudoers order, that must be freed by the caller.
+ * Returns the number of candidates or -1 if parse_tree has no index,
+ * the index cannot be used with the current settings or on error.
+ * The caller should check every userspec in the parse tree in that case.
+ */
+int
+userspec_index_lookup(struct sudoers_parse_tree *parse_tree,
+    const struct passwd *pw, struct userspec ***candidatesp)
+{
+    struct userspec_index *usidx = parse_tree->usidx;
+    struct group_list *grlist = NULL;
+    struct userspec **candidates = NULL;
+    unsigned int *idx = NULL, nidx = 0, maxidx, i, j, h;
+    struct group *grp = NULL;
+    int ret = -1;
+    debug_decl(userspec_index_lookup, SUDOERS_DEBUG_PARSER);
+
+    if (usidx == NULL)
+	debug_return_int(-1);
+
+    /*
+     * Group membership may not be determined by the user's group names
+     * when using a group plugin or matching groups by group-ID.
+     */
+    if (def_group_plugin || def_match_group_by_gid)
+	debug_return_int(-1);
+
+    /* Primary group plus the group vector, if there are group entries. */
+    if (usidx->group_offsets[usidx->nbuckets] != 0) {
+	grp = sudo_getgrgid(pw->pw_gid);
+	grlist = sudo_get_grlist(pw);
+    }
+
+    /* Compute an upper bound on the number of candidates. */
+    h = usidx_hash(pw->pw_name, usidx->nbuckets);
+    maxidx = usidx->ngeneric + usidx->user_offsets[h + 1] -
+	usidx->user_offsets[h];
+    if (grp != NULL) {
+	h = usidx_hash(grp->gr_name, usidx->nbuckets);
+	maxidx += usidx->group_offsets[h + 1] - usidx->group_offsets[h];
+    }
+    if (grlist != NULL) {
+	for (i = 0; i < (unsigned int)grlist->ngroups; i++) {
+	    h = usidx_hash(grlist->groups[i], usidx->nbuckets);
+	    maxidx += usidx->group_offsets[h + 1] - usidx->group_offsets[h];
+	}
+    }
+
+    idx = reallocarray(NULL, maxidx + 1, sizeof(unsigned int));
+    if (idx == NULL)
+	goto done;
+
+    /* Gather the candidates. */
+    memcpy(idx, usidx->generic, usidx->ngeneric * sizeof(unsigned int));
+    nidx = usidx->ngeneric;
+    usidx_add_bucket(idx, &nidx, usidx->user_offsets, usidx->users,
+	usidx_hash(pw->pw_name, usidx->nbuckets));
+    if (grp != NULL) {
+	usidx_add_bucket(idx, &nidx, usidx->group_offsets, usidx->groups,
+	    usidx_hash(grp->gr_name, usidx->nbuckets));
+    }
+    if (grlist != NULL) {
+	for (i = 0; i < (unsigned int)grlist->ngroups; i++) {
+	    usidx_add_bucket(idx, &nidx, usidx->group_offsets, usidx->groups,
+		usidx_hash(grlist->groups[i], usidx->nbuckets));
+	}
+    }
+
+    /* Sort in reverse sudoers order and remove duplicates. */
+    qsort(idx, nidx, sizeof(unsigned int), usidx_compare);
+    candidates = reallocarray(NULL, nidx + 1, sizeof(struct userspec *));
+    if (candidates == NULL)
+	goto done;
+    for (i = j = 0; i < nidx; i++) {
+	if (i == 0 || idx[i] != idx[i - 1])
+	    candidates[j++] = usidx->userspecs[idx[i]];
+    }
+
+    sudo_debug_printf(SUDO_DEBUG_DEBUG,
+	"%u of %u userspecs may match user %s", j, usidx->nuserspecs,
+	pw->pw_name);
+    *candidatesp = candidates;
+    ret = (int)j;
+
+done:
+    if (ret == -1) {
+	sudo_warnx(U_("%s: %s"), __func__, U_("unable to allocate memory"));
+	free(candidates);
+    }
+    free(idx);
+    if (grlist != NULL)
+	sudo_grlist_delref(grlist);
+    if (grp != NULL)
+	sudo_gr_delref(grp);
+    debug_return_int(ret);
+}
@@ -102,6 +102,7 @@ static bool reparse_sudoers(char *, int, char **, bool, bool);
 static int run_command(char *, char **);
 static void parse_sudoers_options(void);
 static void setup_signals(void);
+static void update_cache(const char *path);
 static void help(void) __attribute__((__noreturn__));
 static void usage(int);
 static void visudo_cleanup(void);
@@ -116,6 +117,7 @@ struct sudo_user sudo_user;
 struct passwd *list_pw;
 static struct sudoersfile_list sudoerslist = TAILQ_HEAD_INITIALIZER(sudoerslist);
 static bool checkonly;
+static bool policy_ok;
 static const char short_opts[] =  "cf:hqsVx:";
 static struct option long_opts[] = {
     { "check",		no_argument,		NULL,	'c' },
@@ -253,8 +255,14 @@ main(int argc, char *argv[])
     if (!init_defaults())
 	sudo_fatalx(U_("unable to initialize sudoers default values"));
 
+    /* Record the files read by the parser for the policy cache. */
+    if (!fflag)
+	sudoers_cache_record(true);
+
     if (checkonly) {
 	exitcode = check_syntax(sudoers_file, quiet, strict, fflag) ? 0 : 1;
+	if (exitcode == 0 && !fflag)
+	    update_cache(sudoers_file);
 	goto done;
     }
 
@@ -293,9 +301,14 @@ main(int argc, char *argv[])
      * and install the edited files as needed.
      */
     if (reparse_sudoers(editor, editor_argc, editor_argv, strict, quiet)) {
+	bool installed = true;
+
 	TAILQ_FOREACH(sp, &sudoerslist, entries) {
-	    (void) install_sudoers(sp, fflag);
+	    if (sp->tpath != NULL && !install_sudoers(sp, fflag))
+		installed = false;
 	}
+	if (installed && policy_ok && !fflag)
+	    update_cache(sudoers_file);
     }
     free(editor);
 
@@ -628,6 +641,7 @@ reparse_sudoers(char *editor, int editor_argc, char **editor_argv,
 	    check_defaults_and_aliases(strict, quiet);
 	}
 	sudoers_setlocale(oldlocale, NULL);
+	policy_ok = !parse_error;
 
 	/*
 	 * Got an error, prompt the user for what to do now.
@@ -981,6 +995,27 @@ done:
     debug_return_bool(ok);
 }
 
+/*
+ * Store the parsed policy next to the sudoers file for use by the
+ * sudoers plugin.  If it cannot be updated, remove the old copy.
+ */
+static void
+update_cache(const char *path)
+{
+    char *cache_path;
+    debug_decl(update_cache, SUDOERS_DEBUG_UTIL);
+
+    if (asprintf(&cache_path, "%s%s", path, SUDOERS_CACHE_SUFFIX) == -1)
+	sudo_fatalx(U_("%s: %s"), __func__, U_("unable to allocate memory"));
+    if (!sudoers_cache_write(cache_path, path, &parsed_policy)) {
+	if (unlink(cache_path) == -1 && errno != ENOENT)
+	    sudo_warn(U_("unable to remove %s"), cache_path);
+    }
+    free(cache_path);
+
+    debug_return;
+}
+
 static bool
 lock_sudoers(struct sudoersfile *entry)
 {
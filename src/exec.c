@@ -313,7 +313,7 @@ sudo_terminated(struct command_status *cstat)
     debug_return_bool(false);
 }
 
-#if SUDO_API_VERSION != SUDO_API_MKVERSION(1, 15)
+#if SUDO_API_VERSION != SUDO_API_MKVERSION(1, 16)
 # error "Update sudo_needs_pty() after changing the plugin API"
 #endif
 static bool
@@ -333,6 +333,9 @@ sudo_needs_pty(struct command_details *details)
 	    plugin->u.io->change_winsize != NULL ||
 	    plugin->u.io->log_suspend != NULL)
 	    return true;
+	if (plugin->u.io->version >= SUDO_API_MKVERSION(1, 16) &&
+	    plugin->u.io->log_io != NULL)
+	    return true;
     }
     return false;
 }
@@ -25,6 +25,9 @@
 
 #include <sys/types.h>
 #include <sys/wait.h>
+#ifdef HAVE_SYS_SYSCALL_H
+# include <sys/syscall.h>
+#endif
 #include <stdio.h>
 #include <stdlib.h>
 #ifdef HAVE_STRING_H
@@ -46,10 +49,12 @@
 struct exec_closure_nopty {
     pid_t cmnd_pid;
     pid_t ppgrp;
+    int cmnd_pidfd;
     struct command_status *cstat;
     struct command_details *details;
     struct sudo_event_base *evbase;
     struct sudo_event *errpipe_event;
+    struct sudo_event *pidfd_event;
     struct sudo_event *sigint_event;
     struct sudo_event *sigquit_event;
     struct sudo_event *sigtstp_event;
@@ -111,6 +116,49 @@ errpipe_cb(int fd, int what, void *v)
     debug_return;
 }
 
+/*
+ * The command's pidfd is readable when the command has exited.
+ */
+static void
+pidfd_cb(int fd, int what, void *v)
+{
+    struct exec_closure_nopty *ec = v;
+    debug_decl(pidfd_cb, SUDO_DEBUG_EXEC);
+
+    if (ec->cmnd_pid == -1)
+	debug_return;
+
+    sudo_debug_printf(SUDO_DEBUG_INFO, "pidfd %d readable, command %d",
+	fd, (int)ec->cmnd_pid);
+    handle_sigchld_nopty(ec);
+    if (ec->cmnd_pid == -1) {
+	/* Command exited or was killed, exit event loop. */
+	sudo_ev_loopexit(ec->evbase);
+    }
+    debug_return;
+}
+
+/*
+ * Open a pidfd for the command (Linux 5.3 and higher).
+ * Returns -1 if not supported.
+ */
+static int
+open_cmnd_pidfd(pid_t pid)
+{
+    int fd = -1;
+    debug_decl(open_cmnd_pidfd, SUDO_DEBUG_EXEC);
+
+#if defined(SYS_pidfd_open)
+    /* The close-on-exec flag is always set on a pidfd. */
+    fd = (int)syscall(SYS_pidfd_open, pid, 0U);
+    if (fd == -1) {
+	sudo_debug_printf(SUDO_DEBUG_INFO|SUDO_DEBUG_ERRNO,
+	    "unable to open pidfd for %d", (int)pid);
+    }
+#endif
+    debug_return_int(fd);
+}
+
 /* Signal callback */
 static void
 signal_cb_nopty(int signo, int what, void *v)
@@ -220,6 +268,23 @@ fill_exec_closure_nopty(struct exec_closure_nopty *ec,
 	sudo_fatal(U_("unable to add event to queue"));
     sudo_debug_printf(SUDO_DEBUG_INFO, "error pipe fd %d\n", errfd);
 
+    /*
+     * Event for command exit via pidfd, if supported.  This does not
+     * depend on signal delivery, but SIGCHLD is still needed to tell
+     * us when the command is stopped.
+     */
+    ec->cmnd_pidfd = open_cmnd_pidfd(ec->cmnd_pid);
+    if (ec->cmnd_pidfd != -1) {
+	ec->pidfd_event = sudo_ev_alloc(ec->cmnd_pidfd,
+	    SUDO_EV_READ|SUDO_EV_PERSIST, pidfd_cb, ec);
+	if (ec->pidfd_event == NULL)
+	    sudo_fatalx(U_("%s: %s"), __func__, U_("unable to allocate memory"));
+	if (sudo_ev_add(ec->evbase, ec->pidfd_event, NULL, false) == -1)
+	    sudo_fatal(U_("unable to add event to queue"));
+	sudo_debug_printf(SUDO_DEBUG_INFO, "command pidfd %d\n",
+	    ec->cmnd_pidfd);
+    }
+
     /* Events for local signals. */
     ec->sigint_event = sudo_ev_alloc(SIGINT,
 	SUDO_EV_SIGINFO, signal_cb_nopty, ec);
@@ -323,6 +388,9 @@ free_exec_closure_nopty(struct exec_closure_nopty *ec)
 
     sudo_ev_base_free(ec->evbase);
     sudo_ev_free(ec->errpipe_event);
+    sudo_ev_free(ec->pidfd_event);
+    if (ec->cmnd_pidfd != -1)
+	close(ec->cmnd_pidfd);
     sudo_ev_free(ec->sigint_event);
     sudo_ev_free(ec->sigquit_event);
     sudo_ev_free(ec->sigtstp_event);
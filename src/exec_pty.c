@@ -85,30 +85,49 @@ struct exec_closure_pty {
 };
 
 /*
- * I/O buffer with associated read/write events and a logging action.
+ * I/O buffer with associated read/write events and an I/O log event.
  * Used to, e.g. pass data from the pty to the user's terminal
  * and any I/O logging plugins.
  */
-struct io_buffer;
-typedef bool (*sudo_io_action_t)(const char *, unsigned int, struct io_buffer *);
 struct io_buffer {
     SLIST_ENTRY(io_buffer) entries;
     struct exec_closure_pty *ec;
     struct sudo_event *revent;
     struct sudo_event *wevent;
-    sudo_io_action_t action;
+    int event; /* I/O log event (SUDO_IO_EVENT_*) */
+    bool rtty; /* reading from a terminal that can send SIGTTIN */
+    bool wtty; /* writing to a terminal that can send SIGTTOU */
     int len; /* buffer length (how much produced) */
     int off; /* write position (how much already consumed) */
     char buf[64 * 1024];
 };
 SLIST_HEAD(io_buffer_list, io_buffer);
 
+/*
+ * I/O that has been read but not yet passed to the I/O plugins.
+ * Reads made during a pass through the event loop are logged
+ * together, before any of the data is written out.
+ */
+#define IO_RECORDS_MAX	64
+#define IO_EVENT_MASK(_e)	(1U << (_e))
+struct io_record_batch {
+    unsigned int count;
+    unsigned int events; /* mask of events in records[] */
+    struct io_buffer *iobs[IO_RECORDS_MAX];
+    struct timespec times[IO_RECORDS_MAX];
+    struct sudo_io_record records[IO_RECORDS_MAX];
+};
+
+/* An I/O plugin's log function for a single event. */
+typedef int (*sudo_io_log_t)(const char *, unsigned int, const char **);
+
 static char ptyname[PATH_MAX];
 int io_fds[6] = { -1, -1, -1, -1, -1, -1};
 static bool foreground, pipeline;
 static int ttymode = TERM_COOKED;
 static sigset_t ttyblock;
 static struct io_buffer_list iobufs;
+static struct io_record_batch io_batch;
 static const char *utmp_user;
 
 static void del_io_events(bool nonblocking);
@@ -196,232 +215,198 @@ pty_make_controlling(void)
     return 0;
 }
 
-/* Call I/O plugin tty input log method. */
-static bool
-log_ttyin(const char *buf, unsigned int n, struct io_buffer *iob)
+/*
+ * Returns a pointer to the I/O plugin's log function for event.
+ */
+static sudo_io_log_t *
+io_log_func(struct io_plugin *io, int event)
 {
-    struct plugin_container *plugin;
-    const char *errstr = NULL;
-    sigset_t omask;
-    bool ret = true;
-    debug_decl(log_ttyin, SUDO_DEBUG_EXEC);
-
-    sigprocmask(SIG_BLOCK, &ttyblock, &omask);
-    TAILQ_FOREACH(plugin, &io_plugins, entries) {
-	if (plugin->u.io->log_ttyin) {
-	    int rc;
-
-	    sudo_debug_set_active_instance(plugin->debug_instance);
-	    rc = plugin->u.io->log_ttyin(buf, n, &errstr);
-	    if (rc <= 0) {
-		if (rc < 0) {
-		    /* Error: disable plugin's I/O function. */
-		    plugin->u.io->log_ttyin = NULL;
-		    audit_error(plugin->name, SUDO_IO_PLUGIN,
-			errstr ? errstr : _("I/O plugin error"), NULL);
-		} else {
-		    audit_reject(plugin->name, SUDO_IO_PLUGIN,
-			errstr ? errstr : _("command rejected by I/O plugin"),
-			NULL);
-		}
-		ret = false;
-		break;
-	    }
-	}
+    switch (event) {
+    case SUDO_IO_EVENT_STDIN:
+	return &io->log_stdin;
+    case SUDO_IO_EVENT_STDOUT:
+	return &io->log_stdout;
+    case SUDO_IO_EVENT_STDERR:
+	return &io->log_stderr;
+    case SUDO_IO_EVENT_TTYIN:
+	return &io->log_ttyin;
+    default:
+	return &io->log_ttyout;
     }
-    sudo_debug_set_active_instance(sudo_debug_instance);
-    sigprocmask(SIG_SETMASK, &omask, NULL);
-
-    debug_return_bool(ret);
 }
 
-/* Call I/O plugin stdin log method. */
-static bool
-log_stdin(const char *buf, unsigned int n, struct io_buffer *iob)
+/*
+ * Returns a mask of the events an I/O plugin logs.
+ * Plugins that support log_io() use the individual log functions
+ * to specify which events they wish to receive.
+ */
+static unsigned int
+io_plugin_events(struct io_plugin *io)
 {
-    struct plugin_container *plugin;
-    const char *errstr = NULL;
-    sigset_t omask;
-    bool ret = true;
-    debug_decl(log_stdin, SUDO_DEBUG_EXEC);
-
-    sigprocmask(SIG_BLOCK, &ttyblock, &omask);
-    TAILQ_FOREACH(plugin, &io_plugins, entries) {
-	if (plugin->u.io->log_stdin) {
-	    int rc;
+    unsigned int mask = 0;
+    int event;
 
-	    sudo_debug_set_active_instance(plugin->debug_instance);
-	    rc = plugin->u.io->log_stdin(buf, n, &errstr);
-	    if (rc <= 0) {
-		if (rc < 0) {
-		    /* Error: disable plugin's I/O function. */
-		    plugin->u.io->log_stdin = NULL;
-		    audit_error(plugin->name, SUDO_IO_PLUGIN,
-			errstr ? errstr : _("I/O plugin error"), NULL);
-		} else {
-		    audit_reject(plugin->name, SUDO_IO_PLUGIN,
-			errstr ? errstr : _("command rejected by I/O plugin"),
-			NULL);
-		}
-		ret = false;
-		break;
-	    }
-	}
+    for (event = SUDO_IO_EVENT_STDIN; event <= SUDO_IO_EVENT_TTYOUT; event++) {
+	if (*io_log_func(io, event) != NULL)
+	    SET(mask, IO_EVENT_MASK(event));
     }
-    sudo_debug_set_active_instance(sudo_debug_instance);
-    sigprocmask(SIG_SETMASK, &omask, NULL);
-
-    debug_return_bool(ret);
+    return mask;
 }
 
-/* Call I/O plugin tty output log method. */
+/*
+ * Pass the batched I/O log records to the I/O plugins.
+ * Plugins that support log_io() receive the entire batch in a
+ * single call, the individual log functions are called otherwise.
+ * If a plugin rejects the I/O or returns an error, any output
+ * in the batch is discarded and the command is terminated.
+ */
 static bool
-log_ttyout(const char *buf, unsigned int n, struct io_buffer *iob)
+flush_io_records(void)
 {
+    static struct sudo_io_record filtered[IO_RECORDS_MAX];
+    const struct sudo_io_record *records;
     struct plugin_container *plugin;
+    struct io_buffer *iob;
     const char *errstr = NULL;
+    unsigned int i, count, mask;
+    sudo_io_log_t *func;
     sigset_t omask;
     bool ret = true;
-    debug_decl(log_ttyout, SUDO_DEBUG_EXEC);
+    int rc;
+    debug_decl(flush_io_records, SUDO_DEBUG_EXEC);
+
+    if (io_batch.count == 0)
+	debug_return_bool(true);
 
     sigprocmask(SIG_BLOCK, &ttyblock, &omask);
     TAILQ_FOREACH(plugin, &io_plugins, entries) {
-	if (plugin->u.io->log_ttyout) {
-	    int rc;
+	struct io_plugin *io = plugin->u.io;
 
-	    sudo_debug_set_active_instance(plugin->debug_instance);
-	    rc = plugin->u.io->log_ttyout(buf, n, &errstr);
-	    if (rc <= 0) {
-		if (rc < 0) {
-		    /* Error: disable plugin's I/O function. */
-		    plugin->u.io->log_ttyout = NULL;
-		    audit_error(plugin->name, SUDO_IO_PLUGIN,
-			errstr ? errstr : _("I/O plugin error"), NULL);
-		} else {
-		    audit_reject(plugin->name, SUDO_IO_PLUGIN,
-			errstr ? errstr : _("command rejected by I/O plugin"),
-			NULL);
+	/* Only pass the plugin records for events it logs. */
+	mask = io_plugin_events(io);
+	if (!ISSET(io_batch.events, mask))
+	    continue;
+
+	sudo_debug_set_active_instance(plugin->debug_instance);
+	rc = 1;
+	if (io->version >= SUDO_API_MKVERSION(1, 16) && io->log_io != NULL) {
+	    records = io_batch.records;
+	    count = io_batch.count;
+	    if (ISSET(io_batch.events, ~mask)) {
+		records = filtered;
+		for (i = 0, count = 0; i < io_batch.count; i++) {
+		    if (ISSET(mask, IO_EVENT_MASK(io_batch.records[i].event)))
+			filtered[count++] = io_batch.records[i];
 		}
-		ret = false;
-		break;
 	    }
-	}
-    }
-    sudo_debug_set_active_instance(sudo_debug_instance);
-    if (!ret) {
-	/*
-	 * I/O plugin rejected the output, delete the write event
-	 * (user's tty) so we do not display the rejected output.
-	 */
-	sudo_debug_printf(SUDO_DEBUG_INFO,
-	    "%s: deleting and freeing devtty wevent %p", __func__, iob->wevent);
-	sudo_ev_free(iob->wevent);
-	iob->wevent = NULL;
-	iob->off = iob->len = 0;
-    }
-    sigprocmask(SIG_SETMASK, &omask, NULL);
-
-    debug_return_bool(ret);
-}
-
-/* Call I/O plugin stdout log method. */
-static bool
-log_stdout(const char *buf, unsigned int n, struct io_buffer *iob)
-{
-    struct plugin_container *plugin;
-    const char *errstr = NULL;
-    sigset_t omask;
-    bool ret = true;
-    debug_decl(log_stdout, SUDO_DEBUG_EXEC);
-
-    sigprocmask(SIG_BLOCK, &ttyblock, &omask);
-    TAILQ_FOREACH(plugin, &io_plugins, entries) {
-	if (plugin->u.io->log_stdout) {
-	    int rc;
-
-	    sudo_debug_set_active_instance(plugin->debug_instance);
-	    rc = plugin->u.io->log_stdout(buf, n, &errstr);
-	    if (rc <= 0) {
-		if (rc < 0) {
-		    /* Error: disable plugin's I/O function. */
-		    plugin->u.io->log_stdout = NULL;
-		    audit_error(plugin->name, SUDO_IO_PLUGIN,
-			errstr ? errstr : _("I/O plugin error"), NULL);
-		} else {
-		    audit_reject(plugin->name, SUDO_IO_PLUGIN,
-			errstr ? errstr : _("command rejected by I/O plugin"),
-			NULL);
+	    rc = io->log_io(records, count, &errstr);
+	    if (rc < 0) {
+		/* Error: disable plugin's I/O functions. */
+		io->log_io = NULL;
+		io->log_ttyin = NULL;
+		io->log_ttyout = NULL;
+		io->log_stdin = NULL;
+		io->log_stdout = NULL;
+		io->log_stderr = NULL;
+	    }
+	} else {
+	    for (i = 0; i < io_batch.count; i++) {
+		func = io_log_func(io, io_batch.records[i].event);
+		if (*func == NULL)
+		    continue;
+		rc = (*func)(io_batch.records[i].buf, io_batch.records[i].len,
+		    &errstr);
+		if (rc <= 0) {
+		    if (rc < 0) {
+			/* Error: disable plugin's I/O function. */
+			*func = NULL;
+		    }
+		    break;
 		}
-		ret = false;
-		break;
 	    }
 	}
+	if (rc <= 0) {
+	    if (rc < 0) {
+		audit_error(plugin->name, SUDO_IO_PLUGIN,
+		    errstr ? errstr : _("I/O plugin error"), NULL);
+	    } else {
+		audit_reject(plugin->name, SUDO_IO_PLUGIN,
+		    errstr ? errstr : _("command rejected by I/O plugin"),
+		    NULL);
+	    }
+	    ret = false;
+	    break;
+	}
     }
     sudo_debug_set_active_instance(sudo_debug_instance);
     if (!ret) {
 	/*
-	 * I/O plugin rejected the output, delete the write event
-	 * (user's stdout) so we do not display the rejected output.
+	 * I/O plugin rejected the I/O, delete the write events for
+	 * any output so we do not display the rejected output.
 	 */
-	sudo_debug_printf(SUDO_DEBUG_INFO,
-	    "%s: deleting and freeing stdout wevent %p", __func__, iob->wevent);
-	sudo_ev_free(iob->wevent);
-	iob->wevent = NULL;
-	iob->off = iob->len = 0;
+	for (i = 0; i < io_batch.count; i++) {
+	    switch (io_batch.records[i].event) {
+	    case SUDO_IO_EVENT_STDIN:
+	    case SUDO_IO_EVENT_TTYIN:
+		continue;
+	    }
+	    iob = io_batch.iobs[i];
+	    if (iob->wevent != NULL) {
+		sudo_debug_printf(SUDO_DEBUG_INFO,
+		    "%s: deleting and freeing wevent %p, fd %d", __func__,
+		    iob->wevent, sudo_ev_get_fd(iob->wevent));
+		sudo_ev_free(iob->wevent);
+		iob->wevent = NULL;
+	    }
+	    iob->off = iob->len = 0;
+	}
+	iob = io_batch.iobs[0];
+	terminate_command(iob->ec->cmnd_pid, true);
+	iob->ec->cmnd_pid = -1;
     }
+    io_batch.count = 0;
+    io_batch.events = 0;
     sigprocmask(SIG_SETMASK, &omask, NULL);
 
     debug_return_bool(ret);
 }
 
-/* Call I/O plugin stderr log method. */
-static bool
-log_stderr(const char *buf, unsigned int n, struct io_buffer *iob)
+/*
+ * Queue data that was just read into iob for the I/O plugins.
+ * The data is passed to the plugins by flush_io_records() before
+ * it is written out or when the batch is full.
+ */
+static void
+queue_io_record(struct io_buffer *iob, unsigned int n)
 {
+    static struct timespec last_read;
     struct plugin_container *plugin;
-    const char *errstr = NULL;
-    sigset_t omask;
-    bool ret = true;
-    debug_decl(log_stderr, SUDO_DEBUG_EXEC);
+    struct sudo_io_record *rec;
+    unsigned int mask = 0;
+    debug_decl(queue_io_record, SUDO_DEBUG_EXEC);
 
-    sigprocmask(SIG_BLOCK, &ttyblock, &omask);
+    /* Don't bother queuing events that no plugin logs. */
     TAILQ_FOREACH(plugin, &io_plugins, entries) {
-	if (plugin->u.io->log_stderr) {
-	    int rc;
-
-	    sudo_debug_set_active_instance(plugin->debug_instance);
-	    rc = plugin->u.io->log_stderr(buf, n, &errstr);
-	    if (rc <= 0) {
-		if (rc < 0) {
-		    /* Error: disable plugin's I/O function. */
-		    plugin->u.io->log_stderr = NULL;
-		    audit_error(plugin->name, SUDO_IO_PLUGIN,
-			errstr ? errstr : _("I/O plugin error"), NULL);
-		} else {
-		    audit_reject(plugin->name, SUDO_IO_PLUGIN,
-			errstr ? errstr : _("command rejected by I/O plugin"),
-			NULL);
-		}
-		ret = false;
-		break;
-	    }
-	}
+	SET(mask, io_plugin_events(plugin->u.io));
     }
-    sudo_debug_set_active_instance(sudo_debug_instance);
-    if (!ret) {
-	/*
-	 * I/O plugin rejected the output, delete the write event
-	 * (user's stderr) so we do not display the rejected output.
-	 */
-	sudo_debug_printf(SUDO_DEBUG_INFO,
-	    "%s: deleting and freeing stderr wevent %p", __func__, iob->wevent);
-	sudo_ev_free(iob->wevent);
-	iob->wevent = NULL;
-	iob->off = iob->len = 0;
+    if (!ISSET(mask, IO_EVENT_MASK(iob->event)))
+	debug_return;
+
+    if (sudo_gettime_awake(&last_read) == -1) {
+	/* Use the time of the previous read instead. */
+	sudo_debug_printf(SUDO_DEBUG_ERROR|SUDO_DEBUG_ERRNO,
+	    "%s: unable to get time of day", __func__);
     }
-    sigprocmask(SIG_SETMASK, &omask, NULL);
+    io_batch.times[io_batch.count] = last_read;
+    io_batch.iobs[io_batch.count] = iob;
+    rec = &io_batch.records[io_batch.count++];
+    rec->event = iob->event;
+    rec->len = n;
+    rec->buf = iob->buf + iob->len;
+    rec->when = &io_batch.times[io_batch.count - 1];
+    SET(io_batch.events, IO_EVENT_MASK(iob->event));
 
-    debug_return_bool(ret);
+    debug_return;
 }
 
 /* Call I/O plugin suspend log method. */
@@ -433,6 +418,9 @@ log_suspend(int signo)
     sigset_t omask;
     debug_decl(log_suspend, SUDO_DEBUG_EXEC);
 
+    /* Log pending I/O first so the events stay in order. */
+    flush_io_records();
+
     sigprocmask(SIG_BLOCK, &ttyblock, &omask);
     TAILQ_FOREACH(plugin, &io_plugins, entries) {
 	if (plugin->u.io->version < SUDO_API_MKVERSION(1, 13))
@@ -466,6 +454,9 @@ log_winchange(unsigned int rows, unsigned int cols)
     sigset_t omask;
     debug_decl(log_winchange, SUDO_DEBUG_EXEC);
 
+    /* Log pending I/O first so the events stay in order. */
+    flush_io_records();
+
     sigprocmask(SIG_BLOCK, &ttyblock, &omask);
     TAILQ_FOREACH(plugin, &io_plugins, entries) {
 	if (plugin->u.io->version < SUDO_API_MKVERSION(1, 12))
@@ -632,20 +623,30 @@ read_callback(int fd, int what, void *v)
     ssize_t n;
     debug_decl(read_callback, SUDO_DEBUG_EXEC);
 
+    /* Make room for another I/O log record if the batch is full. */
+    if (io_batch.count == IO_RECORDS_MAX)
+	flush_io_records();
+
     /*
      * We ignore SIGTTIN by default but we need to handle it when reading
      * from the terminal.  A signal event won't work here because the
      * read() would be restarted, preventing the callback from running.
+     * Only a terminal can generate SIGTTIN so there is no need to
+     * install the handler when reading from a pipe, file or the pty master.
      */
-    memset(&sa, 0, sizeof(sa));
-    sigemptyset(&sa.sa_mask);
-    sa.sa_handler = sigttin;
     got_sigttin = 0;
-    sigaction(SIGTTIN, &sa, &osa);
+    if (iob->rtty) {
+	memset(&sa, 0, sizeof(sa));
+	sigemptyset(&sa.sa_mask);
+	sa.sa_handler = sigttin;
+	sigaction(SIGTTIN, &sa, &osa);
+    }
     n = read(fd, iob->buf + iob->len, sizeof(iob->buf) - iob->len);
-    saved_errno = errno;
-    sigaction(SIGTTIN, &osa, NULL);
-    errno = saved_errno;
+    if (iob->rtty) {
+	saved_errno = errno;
+	sigaction(SIGTTIN, &osa, NULL);
+	errno = saved_errno;
+    }
 
     switch (n) {
 	case -1:
@@ -677,10 +678,7 @@ read_callback(int fd, int what, void *v)
 	default:
 	    sudo_debug_printf(SUDO_DEBUG_INFO,
 		"read %zd bytes from fd %d", n, fd);
-	    if (!iob->action(iob->buf + iob->len, n, iob)) {
-		terminate_command(iob->ec->cmnd_pid, true);
-		iob->ec->cmnd_pid = -1;
-	    }
+	    queue_io_record(iob, n);
 	    iob->len += n;
 	    /* Enable writer now that there is data in the buffer. */
 	    if (iob->wevent != NULL) {
@@ -714,26 +712,40 @@ static void
 write_callback(int fd, int what, void *v)
 {
     struct io_buffer *iob = v;
-    struct sudo_event_base *evbase = sudo_ev_get_base(iob->wevent);
+    struct sudo_event_base *evbase;
     struct sigaction sa, osa;
     int saved_errno;
     ssize_t n;
     debug_decl(write_callback, SUDO_DEBUG_EXEC);
 
+    /* I/O must be logged before it is written. */
+    if (io_batch.count != 0) {
+	if (!flush_io_records() && iob->wevent == NULL) {
+	    /* Output was rejected by an I/O plugin. */
+	    debug_return;
+	}
+    }
+    evbase = sudo_ev_get_base(iob->wevent);
+
     /*
      * We ignore SIGTTOU by default but we need to handle it when writing
      * to the terminal.  A signal event won't work here because the
      * write() would be restarted, preventing the callback from running.
+     * As with SIGTTIN, only writes to a terminal are affected.
      */
-    memset(&sa, 0, sizeof(sa));
-    sigemptyset(&sa.sa_mask);
-    sa.sa_handler = sigttou;
     got_sigttou = 0;
-    sigaction(SIGTTOU, &sa, &osa);
+    if (iob->wtty) {
+	memset(&sa, 0, sizeof(sa));
+	sigemptyset(&sa.sa_mask);
+	sa.sa_handler = sigttou;
+	sigaction(SIGTTOU, &sa, &osa);
+    }
     n = write(fd, iob->buf + iob->off, iob->len - iob->off);
-    saved_errno = errno;
-    sigaction(SIGTTOU, &osa, NULL);
-    errno = saved_errno;
+    if (iob->wtty) {
+	saved_errno = errno;
+	sigaction(SIGTTOU, &osa, NULL);
+	errno = saved_errno;
+    }
 
     if (n == -1) {
 	switch (errno) {
@@ -801,9 +813,8 @@ write_callback(int fd, int what, void *v)
 }
 
 static void
-io_buf_new(int rfd, int wfd,
-    bool (*action)(const char *, unsigned int, struct io_buffer *),
-    struct exec_closure_pty *ec, struct io_buffer_list *head)
+io_buf_new(int rfd, int wfd, int event, struct exec_closure_pty *ec,
+    struct io_buffer_list *head)
 {
     int n;
     struct io_buffer *iob;
@@ -825,7 +836,14 @@ io_buf_new(int rfd, int wfd,
     iob->wevent = sudo_ev_alloc(wfd, SUDO_EV_WRITE, write_callback, iob);
     iob->len = 0;
     iob->off = 0;
-    iob->action = action;
+    iob->event = event;
+    /*
+     * The user's terminal may be reached via /dev/tty or via stdin,
+     * stdout or stderr (e.g. when running in the background).
+     * The pty master never generates SIGTTIN or SIGTTOU.
+     */
+    iob->rtty = rfd != io_fds[SFD_MASTER] && isatty(rfd);
+    iob->wtty = wfd != io_fds[SFD_MASTER] && isatty(wfd);
     iob->buf[0] = '\0';
     if (iob->revent == NULL || iob->wevent == NULL)
 	sudo_fatalx(U_("%s: %s"), __func__, U_("unable to allocate memory"));
@@ -854,6 +872,9 @@ pty_finish(struct command_status *cstat)
     }
     del_io_events(false);
 
+    /* Log any I/O that was read but not written. */
+    flush_io_records();
+
     /* Free I/O buffers. */
     while ((iob = SLIST_FIRST(&iobufs)) != NULL) {
 	SLIST_REMOVE_HEAD(&iobufs, entries);
@@ -1419,12 +1440,12 @@ exec_pty(struct command_details *details, struct command_status *cstat)
 	/* Read from /dev/tty, write to pty master */
 	if (!ISSET(details->flags, CD_BACKGROUND)) {
 	    io_buf_new(io_fds[SFD_USERTTY], io_fds[SFD_MASTER],
-		log_ttyin, &ec, &iobufs);
+		SUDO_IO_EVENT_TTYIN, &ec, &iobufs);
 	}
 
 	/* Read from pty master, write to /dev/tty */
 	io_buf_new(io_fds[SFD_MASTER], io_fds[SFD_USERTTY],
-	    log_ttyout, &ec, &iobufs);
+	    SUDO_IO_EVENT_TTYOUT, &ec, &iobufs);
 
 	/* Are we the foreground process? */
 	foreground = tcgetpgrp(io_fds[SFD_USERTTY]) == ppgrp;
@@ -1451,7 +1472,7 @@ exec_pty(struct command_details *details, struct command_status *cstat)
 	    if (pipe2(io_pipe[STDIN_FILENO], O_CLOEXEC) != 0)
 		sudo_fatal(U_("unable to create pipe"));
 	    io_buf_new(STDIN_FILENO, io_pipe[STDIN_FILENO][1],
-		log_stdin, &ec, &iobufs);
+		SUDO_IO_EVENT_STDIN, &ec, &iobufs);
 	    io_fds[SFD_STDIN] = io_pipe[STDIN_FILENO][0];
 	}
     }
@@ -1472,7 +1493,7 @@ exec_pty(struct command_details *details, struct command_status *cstat)
 	    if (pipe2(io_pipe[STDOUT_FILENO], O_CLOEXEC) != 0)
 		sudo_fatal(U_("unable to create pipe"));
 	    io_buf_new(io_pipe[STDOUT_FILENO][0], STDOUT_FILENO,
-		log_stdout, &ec, &iobufs);
+		SUDO_IO_EVENT_STDOUT, &ec, &iobufs);
 	    io_fds[SFD_STDOUT] = io_pipe[STDOUT_FILENO][1];
 	}
     }
@@ -1492,7 +1513,7 @@ exec_pty(struct command_details *details, struct command_status *cstat)
 	    if (pipe2(io_pipe[STDERR_FILENO], O_CLOEXEC) != 0)
 		sudo_fatal(U_("unable to create pipe"));
 	    io_buf_new(io_pipe[STDERR_FILENO][0], STDERR_FILENO,
-		log_stderr, &ec, &iobufs);
+		SUDO_IO_EVENT_STDERR, &ec, &iobufs);
 	    io_fds[SFD_STDERR] = io_pipe[STDERR_FILENO][1];
 	}
     }